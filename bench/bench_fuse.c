@@ -0,0 +1,758 @@
+/******************************************************************************\
+*  bench_fuse.c                                                                *
+*                                                                              *
+*  Benchmarks a mounted view. The root of a fresh mount is first listed with   *
+*  every entry stated, as ls -l does, to count the requests that still reach   *
+*  the daemon once listings describe their entries.                            *
+*  Then under parallel load, every client thread stats, opens and reads files  *
+*  of BASE through the mount. The same load is run from 1 up to the given      *
+*  number of clients, once against a daemon serving on a single thread and     *
+*  once against its pool of workers, to show how it scales. Then the clients   *
+*  only look up names that don't exist, which the kernel never caches, so      *
+*  every stat is a lookup served by the daemon, to show how lookups scale.     *
+*  Every file is then stated over and over, with one of them changed through   *
+*  ufs between rounds, to see how many stats the kernel answers from its       *
+*  cache.                                                                      *
+*  A large file is then written and read sequentially through the mount and    *
+*  directly in BASE, to compare the data path with the native filesystem.      *
+*  Last, the blocks of a file are read in random order through a mount that    *
+*  serves content from the daemon, through one that passes it through to the   *
+*  backing file when it can, and natively, to compare the latency of a read.   *
+*  Then small files and a large one are written in small writes, with and      *
+*  without the writeback cache of the kernel.                                  *
+*  Then a block is written in the middle of files of BASE of growing sizes,    *
+*  which are copied up only by the extents written to, so the latency of the   *
+*  first write stays flat, with the time spent by each way of copying.         *
+*  Mounting needs to be permitted.                                             *
+*                                                                              *
+*  Usage: bench_fuse [clients] [files]                                         *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+#define FUSE_USE_VERSION 35
+
+#include "ufs_core.h"
+#include "ufs_fuse.h"
+#include "utils.h"
+#include <fuse_lowlevel.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#define BENCH_DEFAULT_CLIENTS (16)
+#define BENCH_DEFAULT_FILES (10000)
+#define BENCH_FILE_SIZE (4096)
+#define BENCH_OPERATIONS (20000)
+#define BENCH_TEMPLATE ("/tmp/ufsBenchFuseXXXXXX")
+#define BENCH_CHUNK_SIZE (1024 * 1024)
+#define BENCH_LARGE_CHUNKS (512)
+#define BENCH_ROUNDS (10)
+#define BENCH_LATENCY_BLOCKS (4096)
+#define BENCH_SMALL_FILES (1000)
+#define BENCH_SMALL_WRITE (1024)
+#define BENCH_SMALL_WRITES (16)
+#define BENCH_LARGE_WRITES (16384)
+#define BENCH_COPY_UP_SIZES (3)
+
+typedef struct benchClientStruct {
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    const char *mountpoint;
+    uint64_t files;
+    uint64_t operations;
+    uint64_t seed;
+    int failures;
+} benchClientType;
+
+typedef struct benchMountStruct {
+    char mountpoint[ 128 ];
+    ufsIdentifierType view[ 2 ];
+    ufsType ufs;
+    ufsFuseType fuse;
+    pthread_t thread;
+} benchMountType;
+
+static void *serve( void *data )
+{
+    ufsFuseLoop( data );
+    return NULL;
+}
+
+/* One operation is a stat, an open, a read of the whole file and a close.    */
+static void *runClient( void *data )
+{
+    char path[ 256 ], buffer[ BENCH_FILE_SIZE ];
+    benchClientType *client;
+    struct stat st;
+    uint64_t i, pick;
+    int fd;
+
+    client = data;
+    pthread_barrier_wait( client -> barrier );
+    for ( i = 0; i < client -> operations; i++ ) {
+        pick = ( ( i + client -> seed ) * 2654435761ULL ) % client -> files;
+        snprintf( path, sizeof( path ), "%s/f%llu", client -> mountpoint,
+                  ( unsigned long long )pick );
+        if ( stat( path, &st ) ) {
+            client -> failures++;
+            continue;
+        }
+
+        fd = open( path, O_RDONLY );
+        if ( fd < 0 ) {
+            client -> failures++;
+            continue;
+        }
+
+        if ( read( fd, buffer, sizeof( buffer ) ) != BENCH_FILE_SIZE )
+            client -> failures++;
+        close( fd );
+    }
+
+    return NULL;
+}
+
+/* One operation is a lookup of a name that doesn't exist.                    */
+static void *runLookups( void *data )
+{
+    benchClientType *client;
+    char path[ 256 ];
+    struct stat st;
+    uint64_t i;
+
+    client = data;
+    pthread_barrier_wait( client -> barrier );
+    for ( i = 0; i < client -> operations; i++ ) {
+        snprintf( path, sizeof( path ), "%s/m%llu", client -> mountpoint,
+                  ( unsigned long long )( client -> seed + i ) );
+        if ( !stat( path, &st ) || errno != ENOENT )
+            client -> failures++;
+    }
+
+    return NULL;
+}
+
+static int benchClients( const char *mountpoint, uint64_t files,
+                         uint32_t clients, void *( *routine )( void * ),
+                         uint64_t *elapsed )
+{
+    benchClientType *client;
+    pthread_barrier_t barrier;
+    uint64_t start;
+    uint32_t i;
+    int failures;
+
+    client = calloc( clients, sizeof( *client ) );
+    if ( !client )
+        return -1;
+
+    pthread_barrier_init( &barrier, NULL, clients + 1 );
+    for ( i = 0; i < clients; i++ ) {
+        client[ i ].barrier = &barrier;
+        client[ i ].mountpoint = mountpoint;
+        client[ i ].files = files;
+        client[ i ].operations = BENCH_OPERATIONS / clients;
+        client[ i ].seed = i * ( files / clients );
+        if ( pthread_create( &client[ i ].thread, NULL, routine,
+                             &client[ i ] ) )
+            return -1;
+    }
+
+    pthread_barrier_wait( &barrier );
+    start = benchNow();
+    failures = 0;
+    for ( i = 0; i < clients; i++ ) {
+        pthread_join( client[ i ].thread, NULL );
+        failures += client[ i ].failures;
+    }
+
+    *elapsed = benchNow() - start;
+    pthread_barrier_destroy( &barrier );
+    free( client );
+    return failures ? -1 : 0;
+}
+
+/* Lists the root and states every entry, while the kernel has nothing        */
+/* cached yet.                                                                */
+static int benchListing( ufsFuseType fuse, const char *mountpoint,
+                         uint64_t files )
+{
+    ufsFuseStatsType before, after;
+    struct dirent *entry;
+    uint64_t start, count;
+    struct stat st;
+    DIR *dir;
+
+    ufsFuseGetStats( fuse, &before );
+    start = benchNow();
+    dir = opendir( mountpoint );
+    if ( !dir )
+        return -1;
+
+    count = 0;
+    while ( ( entry = readdir( dir ) ) ) {
+        if ( entry -> d_name[ 0 ] == '.' )
+            continue;
+
+        if ( fstatat( dirfd( dir ), entry -> d_name, &st,
+                      AT_SYMLINK_NOFOLLOW ) ) {
+            closedir( dir );
+            return -1;
+        }
+        count++;
+    }
+
+    closedir( dir );
+    benchReport( "readdir+stat", count, benchNow() - start );
+    ufsFuseGetStats( fuse, &after );
+    printf( "%-40s %12llu of %llu entries\n", "  looked up after listing",
+            ( unsigned long long )( after.lookups - before.lookups +
+                                    after.getattrs - before.getattrs ),
+            ( unsigned long long )files );
+    return count == files ? 0 : -1;
+}
+
+/* Touches the attributes of file f<index> of BASE.                           */
+static ufsStatusType touchFile( ufsType ufs, void *userData )
+{
+    ufsAttributesType attributes;
+    ufsIdentifierType storage;
+    ufsStatusType status;
+    char name[ 32 ];
+
+    snprintf( name, sizeof( name ), "f%llu",
+              ( unsigned long long )*( uint64_t * )userData );
+    storage = ufsGetFile( ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+    if ( storage < 0 )
+        return ufsErrno;
+
+    status = ufsGetAttributes( ufs, storage, &attributes );
+    if ( status != UFS_NO_ERROR )
+        return status;
+
+    attributes.mtime++;
+    return ufsSetAttributes( ufs, storage, &attributes );
+}
+
+/* The first round finds nothing cached, the others only miss the file that   */
+/* was touched before them.                                                   */
+static int benchRepeat( ufsFuseType fuse, const char *mountpoint,
+                        uint64_t files )
+{
+    ufsFuseStatsType before, after;
+    uint64_t start, elapsed, i, round, misses;
+    char path[ 256 ];
+    struct stat st;
+
+    elapsed = 0;
+    ufsFuseGetStats( fuse, &before );
+    for ( round = 0; round < BENCH_ROUNDS; round++ ) {
+        if ( round && ufsFuseUpdate( fuse, touchFile, &round ) !=
+                      UFS_NO_ERROR )
+            return -1;
+
+        start = benchNow();
+        for ( i = 0; i < files; i++ ) {
+            snprintf( path, sizeof( path ), "%s/f%llu", mountpoint,
+                      ( unsigned long long )i );
+            if ( stat( path, &st ) )
+                return -1;
+        }
+
+        elapsed += benchNow() - start;
+    }
+
+    ufsFuseGetStats( fuse, &after );
+    misses = after.lookups - before.lookups + after.getattrs - before.getattrs;
+    benchReport( "repeated stat", files * BENCH_ROUNDS, elapsed );
+    printf( "%-40s %12.2f%% of %llu stats, %llu invalidations\n",
+            "  answered by the kernel",
+            100.0 - 100.0 * misses / ( files * BENCH_ROUNDS ),
+            ( unsigned long long )( files * BENCH_ROUNDS ),
+            ( unsigned long long )( after.invalidations -
+                                    before.invalidations ) );
+    return 0;
+}
+
+/* Writes and reads back a file of BENCH_LARGE_CHUNKS chunks, the rates are   */
+/* in MiB/s. Content is synced before it's read, and the read is cold for the */
+/* mount since FUSE drops cached content when a file is opened.               */
+static int benchSequential( const char *directory, const char *label )
+{
+    char path[ 256 ], name[ 64 ], *buffer;
+    uint64_t start, i;
+    int fd, res;
+
+    buffer = malloc( BENCH_CHUNK_SIZE );
+    if ( !buffer )
+        return -1;
+
+    memset( buffer, 'u', BENCH_CHUNK_SIZE );
+    snprintf( path, sizeof( path ), "%s/large", directory );
+    res = -1;
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+        goto out;
+
+    start = benchNow();
+    for ( i = 0; i < BENCH_LARGE_CHUNKS; i++ ) {
+        if ( write( fd, buffer, BENCH_CHUNK_SIZE ) != BENCH_CHUNK_SIZE ) {
+            close( fd );
+            goto out;
+        }
+    }
+
+    fsync( fd );
+    close( fd );
+    snprintf( name, sizeof( name ), "sequential write, %s", label );
+    benchReport( name, BENCH_LARGE_CHUNKS, benchNow() - start );
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        goto out;
+
+    start = benchNow();
+    for ( i = 0; i < BENCH_LARGE_CHUNKS; i++ ) {
+        if ( read( fd, buffer, BENCH_CHUNK_SIZE ) != BENCH_CHUNK_SIZE ) {
+            close( fd );
+            goto out;
+        }
+    }
+
+    close( fd );
+    snprintf( name, sizeof( name ), "sequential read, %s", label );
+    benchReport( name, BENCH_LARGE_CHUNKS, benchNow() - start );
+    res = unlink( path );
+
+out:
+    free( buffer );
+    return res;
+}
+
+/* Reads every block of a file once, in an order that defeats readahead, so   */
+/* each read of the mount is a request of its own unless it's passed through. */
+static int benchLatency( const char *directory, const char *label )
+{
+    char path[ 256 ], name[ 64 ], *buffer;
+    uint64_t start, elapsed, i, block;
+    int fd, res;
+
+    buffer = malloc( BENCH_LATENCY_BLOCKS * BENCH_FILE_SIZE );
+    if ( !buffer )
+        return -1;
+
+    memset( buffer, 'u', BENCH_LATENCY_BLOCKS * BENCH_FILE_SIZE );
+    snprintf( path, sizeof( path ), "%s/latency", directory );
+    res = -1;
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+        goto out;
+
+    if ( write( fd, buffer, BENCH_LATENCY_BLOCKS * BENCH_FILE_SIZE ) !=
+         BENCH_LATENCY_BLOCKS * BENCH_FILE_SIZE ) {
+        close( fd );
+        goto out;
+    }
+
+    fsync( fd );
+    close( fd );
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        goto out;
+
+    posix_fadvise( fd, 0, 0, POSIX_FADV_RANDOM );
+    start = benchNow();
+    for ( i = 0; i < BENCH_LATENCY_BLOCKS; i++ ) {
+        /* An odd factor permutes the blocks, their count being a power of 2. */
+        block = ( i * 2654435761ULL ) % BENCH_LATENCY_BLOCKS;
+        if ( pread( fd, buffer, BENCH_FILE_SIZE, block * BENCH_FILE_SIZE ) !=
+             BENCH_FILE_SIZE ) {
+            close( fd );
+            goto out;
+        }
+    }
+
+    elapsed = benchNow() - start;
+    close( fd );
+    snprintf( name, sizeof( name ), "random read, %s", label );
+    benchReport( name, BENCH_LATENCY_BLOCKS, elapsed );
+    printf( "%-40s %12.2f us\n", "  latency per read",
+            elapsed / 1000.0 / BENCH_LATENCY_BLOCKS );
+    res = unlink( path );
+
+out:
+    free( buffer );
+    return res;
+}
+
+/* Writes files the way a build writes objects, many small writes to small    */
+/* files, and then a large file in small writes. The rates are of files and   */
+/* of writes, along with the requests that reached the daemon.                */
+static int benchWriteFiles( ufsFuseType fuse, const char *directory,
+                            const char *label )
+{
+    char path[ 256 ], name[ 64 ], buffer[ BENCH_SMALL_WRITE ];
+    ufsFuseStatsType before, after;
+    uint64_t start, i, j;
+    int fd;
+
+    memset( buffer, 'u', sizeof( buffer ) );
+    ufsFuseGetStats( fuse, &before );
+    start = benchNow();
+    for ( i = 0; i < BENCH_SMALL_FILES; i++ ) {
+        snprintf( path, sizeof( path ), "%s/o%llu", directory,
+                  ( unsigned long long )i );
+        fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+        if ( fd < 0 )
+            return -1;
+
+        for ( j = 0; j < BENCH_SMALL_WRITES; j++ ) {
+            if ( write( fd, buffer, sizeof( buffer ) ) != sizeof( buffer ) ) {
+                close( fd );
+                return -1;
+            }
+        }
+
+        close( fd );
+    }
+
+    snprintf( name, sizeof( name ), "small files, %s", label );
+    benchReport( name, BENCH_SMALL_FILES, benchNow() - start );
+    ufsFuseGetStats( fuse, &after );
+    printf( "%-40s %12llu of %d writes\n", "  reached the daemon",
+            ( unsigned long long )( after.writes - before.writes ),
+            BENCH_SMALL_FILES * BENCH_SMALL_WRITES );
+
+    before = after;
+    snprintf( path, sizeof( path ), "%s/log", directory );
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 )
+        return -1;
+
+    start = benchNow();
+    for ( i = 0; i < BENCH_LARGE_WRITES; i++ ) {
+        if ( write( fd, buffer, sizeof( buffer ) ) != sizeof( buffer ) ) {
+            close( fd );
+            return -1;
+        }
+    }
+
+    close( fd );
+    snprintf( name, sizeof( name ), "small writes to a file, %s", label );
+    benchReport( name, BENCH_LARGE_WRITES, benchNow() - start );
+    ufsFuseGetStats( fuse, &after );
+    printf( "%-40s %12llu of %d writes\n", "  reached the daemon",
+            ( unsigned long long )( after.writes - before.writes ),
+            BENCH_LARGE_WRITES );
+    return 0;
+}
+
+static int startMount( const char *root, int baseFd, int upperFd,
+                       uint32_t threads, uint32_t flags,
+                       benchMountType *mount )
+{
+    ufsImportOptionsType importOptions = { 0 };
+    ufsFuseOptionsType options = { 0 };
+    char *argv[] = { "bench_fuse" };
+
+    mount -> ufs = ufsInit();
+    importOptions.flags = UFS_IMPORT_FLAG_ATTRIBUTES;
+    if ( !mount -> ufs || ufsImportBase( mount -> ufs, baseFd,
+                                         &importOptions ) != UFS_NO_ERROR )
+        return -1;
+
+    mount -> view[ 0 ] = ufsAddArea( mount -> ufs, "area" );
+    mount -> view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    if ( mount -> view[ 0 ] < 0 )
+        return -1;
+
+    snprintf( mount -> mountpoint, sizeof( mount -> mountpoint ), "%s/mnt",
+              root );
+    options.baseFd = baseFd;
+    options.upperFd = upperFd;
+    options.view.areas = mount -> view;
+    options.view.count = 2;
+    options.threads = threads;
+    options.flags = flags;
+    mount -> fuse = ufsFuseInit( mount -> ufs, &options, 1, argv );
+    if ( !mount -> fuse ||
+         ufsFuseMount( mount -> fuse, mount -> mountpoint ) != UFS_NO_ERROR ) {
+        fprintf( stderr, "bench_fuse: can't mount %s\n", mount -> mountpoint );
+        return -1;
+    }
+
+    return pthread_create( &mount -> thread, NULL, serve, mount -> fuse ) ?
+           -1 : 0;
+}
+
+static void stopMount( benchMountType *mount )
+{
+    umount2( mount -> mountpoint, 0 );
+    pthread_join( mount -> thread, NULL );
+    ufsFuseDestroy( mount -> fuse );
+    ufsDestroy( mount -> ufs );
+}
+
+static int benchMount( const char *root, int baseFd, int upperFd,
+                       uint64_t files, uint32_t clients, uint32_t threads )
+{
+    uint64_t elapsed, single;
+    benchMountType mount;
+    char name[ 64 ];
+    uint32_t count;
+    int res;
+
+    if ( startMount( root, baseFd, upperFd, threads, 0, &mount ) )
+        return -1;
+
+    printf( "%s\n", threads == 1 ? "single-threaded loop" :
+                                   "multi-threaded loop" );
+    res = benchListing( mount.fuse, mount.mountpoint, files );
+    single = 0;
+    for ( count = 1; !res && count <= clients; count *= 2 ) {
+        res = benchClients( mount.mountpoint, files, count, runClient,
+                            &elapsed );
+        if ( res )
+            break;
+
+        if ( count == 1 )
+            single = elapsed;
+
+        snprintf( name, sizeof( name ), "stat+open+read, %u clients", count );
+        benchReport( name, BENCH_OPERATIONS / count * count, elapsed );
+        printf( "%-40s %12.2fx\n", "  speedup over 1 client",
+                elapsed ? ( double )single / elapsed : 0.0 );
+    }
+
+    for ( count = 1; !res && count <= clients; count *= 2 ) {
+        res = benchClients( mount.mountpoint, files, count, runLookups,
+                            &elapsed );
+        if ( res )
+            break;
+
+        if ( count == 1 )
+            single = elapsed;
+
+        snprintf( name, sizeof( name ), "lookup, %u clients", count );
+        benchReport( name, BENCH_OPERATIONS / count * count, elapsed );
+        printf( "%-40s %12.2fx\n", "  speedup over 1 client",
+                elapsed ? ( double )single / elapsed : 0.0 );
+    }
+
+    if ( !res )
+        res = benchRepeat( mount.fuse, mount.mountpoint, files );
+    if ( !res )
+        res = benchSequential( mount.mountpoint, "mount" );
+
+    stopMount( &mount );
+    return res;
+}
+
+/* The same reads with content served by the daemon, and passed through to    */
+/* the backing file when the kernel and libfuse allow it.                     */
+/* The same writes, sent as they're made and gathered by the writeback cache. */
+static int benchWriteback( const char *root, int baseFd, int upperFd )
+{
+    benchMountType mount;
+    int res, writeback;
+
+    res = 0;
+    for ( writeback = 0; !res && writeback < 2; writeback++ ) {
+        if ( startMount( root, baseFd, upperFd, 1, writeback ? 0 :
+                         UFS_FUSE_FLAG_NO_WRITEBACK_CACHE, &mount ) )
+            return -1;
+
+        res = benchWriteFiles( mount.fuse, mount.mountpoint,
+                               writeback ? "writeback" : "write-through" );
+        stopMount( &mount );
+    }
+
+    return res;
+}
+
+#ifdef FUSE_CAP_PASSTHROUGH
+static int benchPassthrough( const char *root, int baseFd, int upperFd )
+{
+    ufsFuseStatsType stats;
+    benchMountType mount;
+    int res, passthrough;
+
+    res = 0;
+    for ( passthrough = 0; !res && passthrough < 2; passthrough++ ) {
+        if ( startMount( root, baseFd, upperFd, 1, passthrough ? 0 :
+                         UFS_FUSE_FLAG_NO_PASSTHROUGH, &mount ) )
+            return -1;
+
+        res = benchLatency( mount.mountpoint, passthrough ? "passthrough" :
+                                                            "daemon" );
+        ufsFuseGetStats( mount.fuse, &stats );
+        if ( passthrough )
+            printf( "%-40s %12llu\n", "  opens passed through",
+                    ( unsigned long long )stats.passthroughs );
+        stopMount( &mount );
+    }
+
+    return res;
+}
+#else
+/* Without libfuse 3.16 or later both runs would serve from the daemon.       */
+static int benchPassthrough( const char *root, int baseFd, int upperFd )
+{
+    ( void )root;
+    ( void )baseFd;
+    ( void )upperFd;
+    printf( "%-40s %12s\n", "random read, passthrough",
+            "not built, needs libfuse 3.16" );
+    return 0;
+}
+#endif
+
+/* Every extent of the files holds a block, so none of them is a hole that's  */
+/* left out of the copy. The file stays open until the rest of it is copied   */
+/* in background, through whichever way the filesystems allow.                */
+static int benchCopyUp( const char *root, int baseFd, int upperFd )
+{
+    static const char *strategies[ UFS_FUSE_COPIES ] = {
+        "clone", "copy_file_range", "splice", "read+write"
+    };
+    char path[ 256 ], name[ 64 ], buffer[ BENCH_FILE_SIZE ];
+    ufsFuseStatsType before, stats;
+    uint64_t start, size, j;
+    benchMountType mount;
+    int i, fd, res;
+
+    memset( buffer, 'u', sizeof( buffer ) );
+    for ( i = 0, size = 4; i < BENCH_COPY_UP_SIZES; i++, size *= 8 ) {
+        snprintf( path, sizeof( path ), "c%d", i );
+        fd = openat( baseFd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644 );
+        if ( fd < 0 )
+            return -1;
+
+        for ( j = 0; j < size; j++ ) {
+            if ( pwrite( fd, buffer, sizeof( buffer ),
+                         j * BENCH_CHUNK_SIZE ) != sizeof( buffer ) ) {
+                close( fd );
+                return -1;
+            }
+        }
+
+        res = ftruncate( fd, size * BENCH_CHUNK_SIZE );
+        close( fd );
+        if ( res )
+            return -1;
+    }
+
+    if ( startMount( root, baseFd, upperFd, 1, 0, &mount ) )
+        return -1;
+
+    res = 0;
+    for ( i = 0, size = 4; !res && i < BENCH_COPY_UP_SIZES; i++, size *= 8 ) {
+        snprintf( path, sizeof( path ), "%s/c%d", mount.mountpoint, i );
+        ufsFuseGetStats( mount.fuse, &before );
+        start = benchNow();
+        fd = open( path, O_WRONLY | O_CLOEXEC );
+        if ( fd < 0 )
+            return -1;
+
+        if ( pwrite( fd, buffer, sizeof( buffer ),
+                     size * BENCH_CHUNK_SIZE / 2 ) != sizeof( buffer ) ||
+             fsync( fd ) )
+            res = -1;
+
+        snprintf( name, sizeof( name ), "first write, %llu MiB file",
+                  ( unsigned long long )size );
+        benchReport( name, 1, benchNow() - start );
+        do {
+            usleep( 1000 );
+            ufsFuseGetStats( mount.fuse, &stats );
+        } while ( !res && stats.extents - before.extents < size );
+
+        close( fd );
+        benchReport( "  copied whole in background", size,
+                     benchNow() - start );
+    }
+
+    for ( i = 0; i < UFS_FUSE_COPIES; i++ ) {
+        snprintf( name, sizeof( name ), "  copied by %s", strategies[ i ] );
+        printf( "%-40s %12llu ops %10.3f ms %11.0f MiB/s\n", name,
+                ( unsigned long long )stats.copies[ i ].copies,
+                stats.copies[ i ].nanoseconds / 1e6,
+                stats.copies[ i ].nanoseconds ?
+                stats.copies[ i ].bytes * 1e9 / BENCH_CHUNK_SIZE /
+                stats.copies[ i ].nanoseconds : 0.0 );
+    }
+
+    stopMount( &mount );
+    return res;
+}
+
+int main( int argc, char **argv )
+{
+    char root[ 64 ], path[ 128 ], buffer[ BENCH_FILE_SIZE ];
+    uint64_t files, i;
+    int baseFd, upperFd, fd, res;
+    uint32_t clients;
+
+    clients = argc > 1 ? strtoul( argv[ 1 ], NULL, 0 ) : BENCH_DEFAULT_CLIENTS;
+    files = argc > 2 ? strtoull( argv[ 2 ], NULL, 0 ) : BENCH_DEFAULT_FILES;
+    if ( !clients || !files ) {
+        fprintf( stderr, "bench_fuse: bad arguments\n" );
+        return 1;
+    }
+
+    strcpy( root, BENCH_TEMPLATE );
+    if ( !mkdtemp( root ) )
+        return 1;
+
+    snprintf( path, sizeof( path ), "%s/base", root );
+    mkdir( path, 0755 );
+    baseFd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    snprintf( path, sizeof( path ), "%s/upper", root );
+    mkdir( path, 0755 );
+    upperFd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    snprintf( path, sizeof( path ), "%s/mnt", root );
+    mkdir( path, 0755 );
+    if ( baseFd < 0 || upperFd < 0 )
+        return 1;
+
+    memset( buffer, 'u', sizeof( buffer ) );
+    for ( i = 0; i < files; i++ ) {
+        snprintf( path, sizeof( path ), "f%llu", ( unsigned long long )i );
+        fd = openat( baseFd, path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644 );
+        if ( fd < 0 || write( fd, buffer, sizeof( buffer ) ) !=
+                       sizeof( buffer ) )
+            return 1;
+        close( fd );
+    }
+
+    printf( "%llu files of %d bytes, up to %u clients\n",
+            ( unsigned long long )files, BENCH_FILE_SIZE, clients );
+    /* The pool gets a worker per client, whatever the number of CPUs.        */
+    res = benchMount( root, baseFd, upperFd, files, clients, 1 ) ||
+          benchMount( root, baseFd, upperFd, files, clients,
+                      clients > 1 ? clients : 2 ) ||
+          benchPassthrough( root, baseFd, upperFd ) ||
+          benchWriteback( root, baseFd, upperFd ) ||
+          benchCopyUp( root, baseFd, upperFd );
+
+    snprintf( path, sizeof( path ), "%s/base", root );
+    if ( !res )
+        res = benchSequential( path, "native" ) ||
+              benchLatency( path, "native" );
+
+    close( upperFd );
+    benchRemoveTree( root, baseFd );
+    return res ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+/******************************************************************************\
+*  bench_import.c                                                              *
+*                                                                              *
+*  Benchmarks ufsImportBase over a generated tree.                             *
+*                                                                              *
+*  Usage: bench_import [files] [fanout]                                        *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#include "ufs_core.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_FILES (1000000ULL)
+#define BENCH_DEFAULT_FANOUT (64)
+
+static void printProgress( uint64_t directories,
+                           uint64_t files,
+                           void *userData )
+{
+    uint64_t *next;
+
+    next = userData;
+    if ( files < *next )
+        return;
+
+    fprintf( stderr, "\r  %llu directories, %llu files",
+             ( unsigned long long )directories,
+             ( unsigned long long )files );
+    *next = files + 100000;
+}
+
+static int benchImport( int fd, uint64_t files, uint32_t threads,
+                        uint64_t flags )
+{
+    ufsImportOptionsType options = { 0 };
+    uint64_t start, elapsed, next;
+    ufsStatusType status;
+    char name[ 64 ];
+    ufsType ufs;
+
+    ufs = ufsInit();
+    if ( !ufs )
+        return -1;
+
+    next = 0;
+    options.threads = threads;
+    options.flags = flags;
+    options.progress = printProgress;
+    options.userData = &next;
+
+    start = benchNow();
+    status = ufsImportBase( ufs, fd, &options );
+    elapsed = benchNow() - start;
+    fprintf( stderr, "\r" );
+    ufsDestroy( ufs );
+    if ( status != UFS_NO_ERROR ) {
+        fprintf( stderr, "ufsImportBase: %s\n", ufsStatusStrings[ status ] );
+        return -1;
+    }
+
+    snprintf( name, sizeof( name ), "import %u threads%s", threads,
+              flags & UFS_IMPORT_FLAG_ATTRIBUTES ? " +attributes" : "" );
+    benchReport( name, files, elapsed );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    uint32_t fanout, threads, maxThreads;
+    uint64_t files, start;
+    char root[ 64 ];
+    int fd;
+
+    files = argc > 1 ? strtoull( argv[ 1 ], NULL, 0 ) : BENCH_DEFAULT_FILES;
+    fanout = argc > 2 ? strtoul( argv[ 2 ], NULL, 0 ) : BENCH_DEFAULT_FANOUT;
+    maxThreads = sysconf( _SC_NPROCESSORS_ONLN );
+
+    start = benchNow();
+    fd = benchCreateTree( root, files, fanout );
+    if ( fd < 0 ) {
+        perror( "benchCreateTree" );
+        return 1;
+    }
+    benchReport( "create tree", files, benchNow() - start );
+
+    for ( threads = 1; threads <= maxThreads; threads *= 2 ) {
+        if ( benchImport( fd, files, threads, 0 ) ||
+             benchImport( fd, files, threads, UFS_IMPORT_FLAG_ATTRIBUTES ) ) {
+            benchRemoveTree( root, fd );
+            return 1;
+        }
+    }
+
+    benchRemoveTree( root, fd );
+    return 0;
+}
@@ -0,0 +1,141 @@
+/******************************************************************************\
+*  bench_mappings.c                                                            *
+*                                                                              *
+*  Benchmarks the mappings of large areas: the memory they take, probing them  *
+*  and collapsing them into another area.                                      *
+*  Without arguments areas of 10k, 100k and 1M mappings are run.               *
+*                                                                              *
+*  Usage: bench_mappings [mappings]                                            *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#include "ufs_core.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_PROBES (100000)
+
+static const uint64_t BENCH_DEFAULT_MAPPINGS[] = { 10000, 100000, 1000000 };
+
+/* Probes storage picked from storage[ parity ], storage[ parity + 2 ], ...   */
+/* and checks each one has the expected status.                               */
+static int benchProbe( ufsType ufs, const char *name, ufsIdentifierType area,
+                       const ufsIdentifierType *storage, uint64_t files,
+                       uint64_t parity, ufsStatusType expected )
+{
+    uint64_t i, start, pick;
+    ufsStatusType status;
+
+    start = benchNow();
+    for ( i = 0; i < BENCH_PROBES; i++ ) {
+        pick = ( i * 2654435761ULL ) % ( files / 2 ) * 2 + parity;
+        status = ufsProbeMapping( ufs, area, storage[ pick ] );
+        if ( status != expected ) {
+            fprintf( stderr, "%s: probed %lld: %s\n", name,
+                     ( long long )storage[ pick ], ufsStatusStrings[ status ] );
+            return -1;
+        }
+    }
+
+    benchReport( name, BENCH_PROBES, benchNow() - start );
+    return 0;
+}
+
+static int benchMappings( uint64_t files )
+{
+    uint64_t i, start, rss;
+    ufsIdentifierType *storage, area, target;
+    ufsStatusType status;
+    ufsViewType view;
+    char name[ 64 ];
+    ufsType ufs;
+
+    storage = malloc( files * sizeof( *storage ) );
+    ufs = ufsInit();
+    if ( !storage || !ufs )
+        return -1;
+
+    printf( "%llu storage, every other one mapped\n",
+            ( unsigned long long )files );
+    start = benchNow();
+    for ( i = 0; i < files; i++ ) {
+        snprintf( name, sizeof( name ), "%llu", ( unsigned long long )i );
+        storage[ i ] = ufsAddFile( ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+        if ( storage[ i ] < 0 )
+            return -1;
+    }
+    benchReport( "add storage", files, benchNow() - start );
+
+    area = ufsAddArea( ufs, "area" );
+    target = ufsAddArea( ufs, "target" );
+    if ( area < 0 || target < 0 )
+        return -1;
+
+    /* Only the memory taken by the mappings themselves is of interest.       */
+    rss = benchRss();
+    start = benchNow();
+    for ( i = 0; i < files; i += 2 ) {
+        status = ufsAddMapping( ufs, area, storage[ i ] );
+        if ( status != UFS_NO_ERROR )
+            return -1;
+    }
+    benchReport( "add mapping", files / 2, benchNow() - start );
+    printf( "%-40s %12.1f bytes per mapping\n", "memory",
+            ( double )( benchRss() - rss ) / ( files / 2 ) );
+
+    if ( benchProbe( ufs, "probe mapped", area, storage, files, 0,
+                     UFS_NO_ERROR ) ||
+         benchProbe( ufs, "probe unmapped", area, storage, files, 1,
+                     UFS_MAPPING_DOES_NOT_EXIST ) )
+        return -1;
+
+    view[ 0 ] = area;
+    view[ 1 ] = target;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    start = benchNow();
+    if ( ufsCollapse( ufs, view ) != UFS_NO_ERROR )
+        return -1;
+    benchReport( "collapse into empty area", files / 2, benchNow() - start );
+
+    /* Nothing is left to add the second time, only the sets are compared.    */
+    start = benchNow();
+    if ( ufsCollapse( ufs, view ) != UFS_NO_ERROR )
+        return -1;
+    benchReport( "collapse into same mappings", files / 2, benchNow() - start );
+
+    if ( benchProbe( ufs, "probe collapsed", target, storage, files, 0,
+                     UFS_NO_ERROR ) )
+        return -1;
+
+    ufsDestroy( ufs );
+    free( storage );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    uint64_t files;
+    size_t i;
+
+    if ( argc < 2 ) {
+        for ( i = 0; i < sizeof( BENCH_DEFAULT_MAPPINGS ) /
+                         sizeof( *BENCH_DEFAULT_MAPPINGS ); i++ ) {
+            if ( benchMappings( BENCH_DEFAULT_MAPPINGS[ i ] * 2 ) )
+                return 1;
+        }
+
+        return 0;
+    }
+
+    files = strtoull( argv[ 1 ], NULL, 0 ) * 2;
+    if ( !files ) {
+        fprintf( stderr, "bench_mappings: bad arguments\n" );
+        return 1;
+    }
+
+    return benchMappings( files ) ? 1 : 0;
+}
@@ -0,0 +1,190 @@
+/******************************************************************************\
+*  bench_resolve.c                                                             *
+*                                                                              *
+*  Benchmarks ufsResolveStorageInView over deep views.                         *
+*  Without arguments a view of 256 areas and one of UFS_VIEW_MAX_SIZE are run. *
+*                                                                              *
+*  Usage: bench_resolve [areas] [mappings per area]                            *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#include "ufs_core.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_DEFAULT_AREAS (256)
+#define BENCH_DEFAULT_MAPPINGS (256)
+#define BENCH_MAX_VIEW_MAPPINGS (16)
+#define BENCH_RESOLVES (100000)
+#define BENCH_BATCH (10000)
+
+static ufsViewType view;
+static ufsViewSpanType span;
+
+/* Resolves storage picked from [first, first + count) and checks that every  */
+/* one of them resolves to expected, -1 to expect the area that maps it. The  */
+/* view is passed as a span when bySpan is set.                               */
+static int benchResolve( ufsType ufs, const char *name,
+                         const ufsIdentifierType *storage,
+                         uint64_t first, uint64_t count,
+                         uint64_t mappings, ufsIdentifierType expected,
+                         int bySpan )
+{
+    uint64_t i, start, elapsed, pick;
+    ufsIdentifierType area;
+
+    start = benchNow();
+    for ( i = 0; i < BENCH_RESOLVES; i++ ) {
+        pick = first + ( i * 2654435761ULL ) % count;
+        area = bySpan ?
+               ufsResolveStorageInViewSpan( ufs, span, storage[ pick ] ) :
+               ufsResolveStorageInView( ufs, view, storage[ pick ] );
+        if ( area != ( expected < 0 ? view[ pick / mappings ] : expected ) ) {
+            fprintf( stderr, "%s: resolved %lld to %lld: %s\n", name,
+                     ( long long )storage[ pick ], ( long long )area,
+                     ufsStatusStrings[ ufsErrno ] );
+            return -1;
+        }
+    }
+
+    elapsed = benchNow() - start;
+    benchReport( name, BENCH_RESOLVES, elapsed );
+    return 0;
+}
+
+/* Same as benchResolve, resolving BENCH_BATCH storage per call.              */
+static int benchResolveMany( ufsType ufs, const char *name,
+                             const ufsIdentifierType *storage,
+                             uint64_t first, uint64_t count,
+                             uint64_t mappings )
+{
+    static ufsIdentifierType batch[ BENCH_BATCH ], areasOut[ BENCH_BATCH ];
+    static ufsStatusType statusOut[ BENCH_BATCH ];
+    uint64_t i, j, start, elapsed, pick;
+
+    elapsed = 0;
+    for ( i = 0; i < BENCH_RESOLVES; i += BENCH_BATCH ) {
+        for ( j = 0; j < BENCH_BATCH; j++ )
+            batch[ j ] = storage[ first +
+                                  ( ( i + j ) * 2654435761ULL ) % count ];
+
+        start = benchNow();
+        if ( ufsResolveManyInViewSpan( ufs, span, batch, BENCH_BATCH,
+                                       areasOut, statusOut ) != UFS_NO_ERROR )
+            return -1;
+        elapsed += benchNow() - start;
+
+        for ( j = 0; j < BENCH_BATCH; j++ ) {
+            pick = first + ( ( i + j ) * 2654435761ULL ) % count;
+            if ( statusOut[ j ] != UFS_NO_ERROR ||
+                 areasOut[ j ] != view[ pick / mappings ] ) {
+                fprintf( stderr, "%s: resolved %lld to %lld: %s\n", name,
+                         ( long long )batch[ j ], ( long long )areasOut[ j ],
+                         ufsStatusStrings[ statusOut[ j ] ] );
+                return -1;
+            }
+        }
+    }
+
+    benchReport( name, BENCH_RESOLVES, elapsed );
+    return 0;
+}
+
+static int benchView( uint64_t areas, uint64_t mappings )
+{
+    uint64_t files, i, start;
+    ufsIdentifierType *storage;
+    ufsStatusType status;
+    char name[ 64 ];
+    ufsType ufs;
+
+    /* Area k maps its own slice of the storage, the last slice of the same   */
+    /* size is only in BASE.                                                  */
+    files = ( areas + 1 ) * mappings;
+    storage = malloc( files * sizeof( *storage ) );
+    ufs = ufsInit();
+    if ( !storage || !ufs )
+        return -1;
+
+    start = benchNow();
+    for ( i = 0; i < files; i++ ) {
+        snprintf( name, sizeof( name ), "%llu", ( unsigned long long )i );
+        storage[ i ] = ufsAddFile( ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+        if ( storage[ i ] < 0 )
+            return -1;
+    }
+
+    for ( i = 0; i < areas; i++ ) {
+        snprintf( name, sizeof( name ), "area%llu", ( unsigned long long )i );
+        view[ i ] = ufsAddArea( ufs, name );
+        if ( view[ i ] < 0 )
+            return -1;
+    }
+    view[ areas ] = UFS_AREA_BASE_IDENTIFIER;
+    if ( areas + 1 < UFS_VIEW_MAX_SIZE )
+        view[ areas + 1 ] = UFS_VIEW_TERMINATOR;
+
+    span.areas = view;
+    span.count = areas + 1;
+
+    for ( i = 0; i < areas * mappings; i++ ) {
+        status = ufsAddMapping( ufs, view[ i / mappings ], storage[ i ] );
+        if ( status != UFS_NO_ERROR )
+            return -1;
+    }
+    benchReport( "populate", files + areas * mappings, benchNow() - start );
+
+    /* The first resolve validates and indexes the view.                      */
+    start = benchNow();
+    if ( ufsResolveStorageInView( ufs, view, storage[ files - 1 ] ) !=
+         UFS_AREA_BASE_IDENTIFIER )
+        return -1;
+    benchReport( "first resolve", 1, benchNow() - start );
+
+    snprintf( name, sizeof( name ), "resolve in BASE, %llu areas",
+              ( unsigned long long )areas );
+    if ( benchResolve( ufs, name, storage, areas * mappings, mappings,
+                       mappings, UFS_AREA_BASE_IDENTIFIER, 0 ) )
+        return -1;
+
+    if ( benchResolve( ufs, "resolve in last area", storage,
+                       ( areas - 1 ) * mappings, mappings, mappings, -1, 0 ) ||
+         benchResolve( ufs, "resolve in first area", storage,
+                       0, mappings, mappings, -1, 0 ) ||
+         benchResolve( ufs, "resolve in any area", storage,
+                       0, areas * mappings, mappings, -1, 0 ) ||
+         benchResolve( ufs, "resolve in any area, span", storage,
+                       0, areas * mappings, mappings, -1, 1 ) ||
+         benchResolveMany( ufs, "resolve in first area, batches", storage,
+                           0, mappings, mappings ) ||
+         benchResolveMany( ufs, "resolve in any area, batches", storage,
+                           0, areas * mappings, mappings ) )
+        return -1;
+
+    ufsDestroy( ufs );
+    free( storage );
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    uint64_t areas, mappings;
+
+    if ( argc < 2 )
+        return benchView( BENCH_DEFAULT_AREAS, BENCH_DEFAULT_MAPPINGS ) ||
+               benchView( UFS_VIEW_MAX_SIZE - 1, BENCH_MAX_VIEW_MAPPINGS );
+
+    areas = strtoull( argv[ 1 ], NULL, 0 );
+    mappings = argc > 2 ? strtoull( argv[ 2 ], NULL, 0 ) :
+                          BENCH_DEFAULT_MAPPINGS;
+    if ( !areas || !mappings || areas >= UFS_VIEW_MAX_SIZE ) {
+        fprintf( stderr, "bench_resolve: bad arguments\n" );
+        return 1;
+    }
+
+    return benchView( areas, mappings ) ? 1 : 0;
+}
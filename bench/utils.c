@@ -0,0 +1,112 @@
+/******************************************************************************\
+*  utils.c                                                                     *
+*                                                                              *
+*  Contains common benchmark utilities.                                        *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BENCH_TREE_TEMPLATE ("/tmp/ufsBenchXXXXXX")
+
+uint64_t benchNow( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void benchReport( const char *name, uint64_t operations, uint64_t elapsed )
+{
+    printf( "%-40s %12llu ops %10.3f ms %14.0f ops/s\n",
+            name,
+            ( unsigned long long )operations,
+            elapsed / 1e6,
+            elapsed ? operations * 1e9 / elapsed : 0.0 );
+}
+
+uint64_t benchRss( void )
+{
+    unsigned long long size, resident;
+    FILE *statm;
+    int res;
+
+    statm = fopen( "/proc/self/statm", "r" );
+    if ( !statm )
+        return 0;
+
+    res = fscanf( statm, "%llu %llu", &size, &resident );
+    fclose( statm );
+    return res == 2 ? resident * sysconf( _SC_PAGESIZE ) : 0;
+}
+
+int benchCreateTree( char *root, uint64_t files, uint32_t fanout )
+{
+    char path[ 256 ];
+    uint64_t i, rest;
+    size_t length;
+    int fd, fileFd;
+
+    strcpy( root, BENCH_TREE_TEMPLATE );
+    if ( !mkdtemp( root ) )
+        return -1;
+
+    fd = open( root, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( fd < 0 )
+        return -1;
+
+    /* File i lives at d<digit>/d<digit>/.../f<lowest digit>, with the digits */
+    /* of i in base fanout, so the tree stays balanced for any size.          */
+    for ( i = 0; i < files; i++ ) {
+        length = 0;
+        for ( rest = i / fanout; rest > 0; rest /= fanout ) {
+            length += snprintf( path + length, sizeof( path ) - length, "d%llu",
+                                ( unsigned long long )( rest % fanout ) );
+            if ( mkdirat( fd, path, 0755 ) && errno != EEXIST )
+                return -1;
+
+            path[ length++ ] = '/';
+        }
+
+        snprintf( path + length, sizeof( path ) - length,
+                  "f%llu", ( unsigned long long )( i % fanout ) );
+        fileFd = openat( fd, path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644 );
+        if ( fileFd < 0 )
+            return -1;
+        close( fileFd );
+    }
+
+    return fd;
+}
+
+static int removeEntry( const char *path,
+                        const struct stat *st,
+                        int flag,
+                        struct FTW *ftw )
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove( path );
+}
+
+void benchRemoveTree( const char *root, int fd )
+{
+    close( fd );
+    nftw( root, removeEntry, 64, FTW_DEPTH | FTW_PHYS );
+}
@@ -0,0 +1,32 @@
+/******************************************************************************\
+*  utils.h                                                                     *
+*                                                                              *
+*  Contains common benchmark utilities.                                        *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#ifndef UFS_BENCH_UTILS_H
+#define UFS_BENCH_UTILS_H
+
+#include <stdint.h>
+
+/* Monotonic time in nanoseconds.                                             */
+uint64_t benchNow( void );
+
+/* Prints one result line: name, operations, elapsed time and rate.           */
+void benchReport( const char *name, uint64_t operations, uint64_t elapsed );
+
+/* Resident memory of the process in bytes, 0 if it can't be read.            */
+uint64_t benchRss( void );
+
+/* Creates a temporary directory tree holding at least files files, spread    */
+/* over directories of fanout entries each. Returns an fd of the root, the    */
+/* path is written into root which must hold 64 bytes.                        */
+int benchCreateTree( char *root, uint64_t files, uint32_t fanout );
+
+/* Removes a tree created by benchCreateTree and closes its fd.               */
+void benchRemoveTree( const char *root, int fd );
+
+#endif /* UFS_BENCH_UTILS_H */
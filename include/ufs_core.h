@@ -33,6 +33,18 @@
 /* Area: A set of storage represented by a unique name.                       */
 /*       areas DO NOT own said storage, they only project it using a name.    */
 /*                                                                            */
+/* Whiteout: A marker of storage in an area, meaning the storage was deleted  */
+/*           in it. A view that reaches the whiteout before any area that     */
+/*           contains the storage doesn't see it at all, not even in BASE.    */
+/*           Clones inherit whiteouts like mappings. An area holds either a   */
+/*           mapping or a whiteout of storage, never both.                    */
+/*                                                                            */
+/* Clone: An area created from another area (its source). A clone starts out  */
+/*        with exactly the explicit mappings of its source without copying    */
+/*        them, from then on the two diverge: mappings added to or removed    */
+/*        from either one are not observed by the other.                      */
+/*        An area can't be removed while it has clones.                       */
+/*                                                                            */
 /* a ufs type: Is either a storage or an area.                                */
 /*                                                                            */
 /* Mapping: A (area, storage) relation, defined as area projects storage.     */
@@ -40,6 +52,18 @@
 /*            * They have set semantics.                                      */
 /*            * The same storage can appear with different areas.             */
 /*                                                                            */
+/* Extents: An area may contain storage by extents, holding only some fixed-  */
+/*          size pieces of its content, each known by its index. A view reads */
+/*          the other extents from the next area after it that contains the   */
+/*          storage, BASE always holds all of it. A mapping added by ufsAdd-  */
+/*          Mapping holds the whole content, one added by ufsAddExtents holds */
+/*          the extents given to it so far. ufs doesn't know how large an ex- */
+/*          tent is, the users of an area agree on it.                        */
+/*          Extents go away along with their mapping, and clones inherit them */
+/*          like they inherit mappings. A collapse merges them: the last area */
+/*          holds storage whole if any area it was read from held it whole,   */
+/*          otherwise it holds the union of their extents.                    */
+/*                                                                            */
 /* external filesystem: Referred to as external fs in other places in this d- */
 /*                      ocument. It Is the file-system that ufs is mounted on */
 /*                      top of.                                               */
@@ -85,6 +109,11 @@
 /*       extend to UFS_VIEW_MAX_SIZE. Meaning when looking at a view an       */
 /*       observer must stop at the FIRST UFS_VIEW_TERMINATOR or until they    */
 /*       exhaust all of UFS_VIEW_MAX_SIZE.                                    */
+/*       A view can also be given as a span, an array of areas along with     */
+/*       their count, which needs no terminator and takes only as much memory */
+/*       as it has areas. Every function that takes a view has a *Span vari-  */
+/*       ant, the functions that take a fixed array find its length and call  */
+/*       them.                                                                */
 /*                                                                            */
 /* Note: ufs views are treated as immutable state given by the user. Ufs onl- */
 /*       y reads and validates them, it does not store or mutate them in any  */
@@ -106,11 +135,20 @@
 /*    * User provided data.                                                   */
 /* An iterator can return an error status, it'd halt iteration and set ufsEr- */
 /* rno.                                                                       */
+/* Entries are given in the order of their names.                             */
+/*                                                                            */
+/* Directory filters: An iteration can be limited to entries of some types,   */
+/* whose names start with a prefix, or match a glob. Globs support *, ? and   */
+/* [...] classes, negated with [^...], and are case sensitive. Entries        */
+/* that don't pass the filter are skipped before they are resolved in the     */
+/* view, and don't count towards the total number of entries.                 */
 /*                                                                            */
 /* IdentifierType: A numeric unique identifier to ufs type instance.          */
 /*                 ufs areas have their own identifier space while ufs stora- */
 /*                 ge shares their space.                                     */
 /*                 The identifier must be strictly greater than 0.            */
+/*                 Identifiers of removed storage are never given again, so   */
+/*                 an identifier always names the same storage.               */
 /*                 Note: it is up to the implementer to deduce the ufs type   */
 /*                       of a ufs type, IdentifierType doesn't define a tagg- */
 /*                       ing mechanism.                                       */
@@ -146,6 +184,13 @@
 /*                                                                            */
 /* Explicit mappings can be removed freely as no other ufs entity depends on  */
 /* them.                                                                      */
+/*                                                                            */
+/* Subtree removal: ufsRemoveTree removes a directory together with all the   */
+/* storage under it as a single operation. It follows the same rules, except  */
+/* that the subtree itself is not considered a dependency. Explicit mappings  */
+/* of the subtree are a dependency unless UFS_REMOVE_TREE_FLAG_MAPPINGS is    */
+/* given, in which case they're removed along with it.                        */
+/* The removal is atomic, either the whole subtree is removed or nothing is.  */
 /* ufs does not view "views" as state, meaning that if an area referenced in  */
 /* a view is removed, it should treated as a "does not exist" case.           */
 /*                                                                            */
@@ -173,8 +218,67 @@
 /* Note: both ROOT and BASE cannot be removed, if they're given as arguments  */
 /*       a UFS_BAD_CALL is emitted.                                           */
 /*                                                                            */
+/* Attributes: Storage may optionally carry an attribute record (mode, size,  */
+/*             times, link count and ownership) describing its backing file.  */
+/*             ufs does not interpret attributes, it only stores them so they */
+/*             can be answered without touching the external fs.              */
+/*             Every time a record is set it's stamped with a generation that */
+/*             is strictly greater than any generation handed out before it,  */
+/*             a cached copy of a record is fresh as long as its generation   */
+/*             matches the stored one.                                        */
+/*             Attribute records do not place removal constraints, they're    */
+/*             removed along with their storage.                              */
+/*                                                                            */
+/* Import: ufsImportBase mirrors a tree of the external fs into a directory   */
+/*         of ufs. Every directory and file found in the tree is added as     */
+/*         storage that is known to exist in BASE, storage that already ex-   */
+/*         ists under the same name and type is reused. Once imported, look-  */
+/*         ups of BASE storage are answered by ufs rather than by the exter-  */
+/*         nal fs. Importing does not add or remove any explicit mappings.    */
+/*         Storage leaves BASE when the external fs no longer has it, if it's */
+/*         still mapped or holds storage that isn't in BASE it stays in ufs,  */
+/*         otherwise it's removed along with its attributes.                  */
+/*                                                                            */
+/* Image: The whole state of a ufs can be saved into a single image file with */
+/*        ufsSaveImage. ufsInitFromImage maps an image into memory and uses   */
+/*        it in place, nothing is parsed or replayed when loading it, so it   */
+/*        takes the same time regardless of the size of the image.            */
+/*        The mapping is private, changes made after loading an image never   */
+/*        reach the image file, they must be saved explicitly.                */
+/*        All the metadata of a ufs, loaded or not, lives in memory reserved  */
+/*        up front, UFS_IMAGE_MAX_SIZE bytes of address space or as much of   */
+/*        it as the system grants. Only the part in use is backed by memory.  */
+/*        Once the metadata nears the end of the reservation, calls that      */
+/*        change ufs fail with UFS_OUT_OF_MEMORY and change nothing.          */
+/*                                                                            */
+/* Change feed: Every successful mutation is recorded as a change with a se-  */
+/*              quence number, in a ring of the last UFS_CHANGE_FEED_SIZE     */
+/*              changes. Consumers that cache what ufs answers poll the feed  */
+/*              from a cursor of their own to learn exactly what went stale.  */
+/*              A consumer that falls behind by more than the ring holds is   */
+/*              told so, and must drop everything it cached.                  */
+/*              Nothing is recorded until someone subscribes.                 */
+/*                                                                            */
+/* Directory generation: Every directory carries a generation that grows      */
+/*                       whenever what it lists in some view may have chan-   */
+/*                       ged: storage was added to it, removed from it or     */
+/*                       moved in or out of it, a mapping of storage it con-  */
+/*                       tains changed, or such storage entered or left BASE. */
+/*                       A listing cached along with the generation is fresh  */
+/*                       as long as the generation still matches.             */
+/*                                                                            */
+/* Threads: ufsErrno is kept per thread, so the status of a call is always    */
+/*          the one of the calling thread. Any number of ufs instances may be */
+/*          used by different threads at once, but a single instance must     */
+/*          only be used by one thread at a time, callers that share one      */
+/*          serialize their calls to it. Callbacks run on the calling thread. */
+/*          Readers made with ufsInitReader let any number of threads look    */
+/*          at one instance at once, one reader per thread, while nobody      */
+/*          changes it.                                                       */
+/*                                                                            */
 
 #define UFS_VIEW_MAX_SIZE (4096)
+#define UFS_IMAGE_MAX_SIZE (1ULL << 40)
 #define UFS_VIEW_TERMINATOR (-1)
 #define UFS_AREA_BASE_NAME ("BASE") 
 #define UFS_AREA_BASE_IDENTIFIER (0)
@@ -182,6 +286,26 @@
 #define UFS_STORAGE_ROOT_IDENTIFIER (0)
 #define UFS_STORAGE_TYPE_FILE (0)
 #define UFS_STORAGE_TYPE_DIRECTORY (1)
+#define UFS_STORAGE_NAME_MAX (255)
+#define UFS_REMOVE_TREE_FLAG_MAPPINGS (1ULL << 0)
+#define UFS_IMPORT_FLAG_ATTRIBUTES (1ULL << 0)
+#define UFS_IMPORT_FLAG_SYNC (1ULL << 1)
+#define UFS_DIR_FILTER_TYPE_FILE (1ULL << UFS_STORAGE_TYPE_FILE)
+#define UFS_DIR_FILTER_TYPE_DIRECTORY (1ULL << UFS_STORAGE_TYPE_DIRECTORY)
+#define UFS_CHANGE_FEED_SIZE (4096)
+#define UFS_CHANGE_ADD_STORAGE (0)
+#define UFS_CHANGE_REMOVE_STORAGE (1)
+#define UFS_CHANGE_MOVE_STORAGE (2)
+#define UFS_CHANGE_ADD_AREA (3)
+#define UFS_CHANGE_ADD_MAPPING (4)
+#define UFS_CHANGE_REMOVE_MAPPING (5)
+#define UFS_CHANGE_ATTRIBUTES (6)
+#define UFS_CHANGE_BASE (7)
+#define UFS_CHANGE_COLLAPSE (8)
+#define UFS_CHANGE_ADD_WHITEOUT (9)
+#define UFS_CHANGE_REMOVE_WHITEOUT (10)
+#define UFS_CHANGE_EXTENTS (11)
+#define UFS_CHANGE_REMOVE_AREA (12)
 #define UFS_NAME
 
 #include <stdint.h>
@@ -202,7 +326,10 @@
     UFS_X( UFS_OUT_OF_MEMORY,              1ULL << 10 )                        \
     UFS_X( UFS_UNKNOWN_ERROR,              1ULL << 11 )                        \
     UFS_X( UFS_VIEW_CONTAINS_DUPLICATES,   1ULL << 12 )                        \
-    UFS_X( UFS_BASE_IS_NOT_LAST_AREA,      1ULL << 13 ) 
+    UFS_X( UFS_BASE_IS_NOT_LAST_AREA,      1ULL << 13 )                        \
+    UFS_X( UFS_ATTRIBUTES_DO_NOT_EXIST,    1ULL << 14 )                        \
+    UFS_X( UFS_CHANGES_OVERFLOWED,         1ULL << 15 )                        \
+    UFS_X( UFS_AREA_HAS_CLONES,            1ULL << 16 )
 
 enum {
 #define UFS_X( name, val ) name = val,
@@ -221,9 +348,87 @@ typedef ufsStatusType (*ufsDirIter)( ufsIdentifierType storage,
                                      uint64_t currEntry,
                                      uint64_t numEntries,
                                      void *userData);
+typedef ufsStatusType (*ufsResolvedDirIter)( ufsIdentifierType storage,
+                                             ufsIdentifierType area,
+                                             uint64_t currEntry,
+                                             uint64_t numEntries,
+                                             void *userData );
 typedef ufsIdentifierType ufsViewType[ UFS_VIEW_MAX_SIZE ];
 
-extern ufsStatusType ufsErrno;
+typedef struct ufsViewSpanStruct {
+    const ufsIdentifierType *areas; /* Can be NULL if count is 0.             */
+    uint32_t count;                 /* At most UFS_VIEW_MAX_SIZE.             */
+} ufsViewSpanType;
+
+typedef struct ufsStorageInfoStruct {
+    ufsIdentifierType parent;       /* ROOT is 0.                             */
+    uint32_t type;                  /* One of UFS_STORAGE_TYPE_*.             */
+    char name[ UFS_STORAGE_NAME_MAX + 1 ];
+} ufsStorageInfoType;
+
+typedef struct ufsAttributesStruct {
+    mode_t mode;
+    uint64_t size;
+    int64_t mtime;          /* Nanoseconds since the epoch.                   */
+    int64_t ctime;          /* Nanoseconds since the epoch.                   */
+    uint64_t nlink;
+    uid_t uid;
+    gid_t gid;
+    uint64_t generation;    /* Set by ufs, ignored by ufsSetAttributes.       */
+} ufsAttributesType;
+
+typedef void (*ufsImportProgress)( uint64_t directories,
+                                   uint64_t files,
+                                   void *userData );
+
+typedef ufsStatusType (*ufsImportVisit)( ufsIdentifierType directory,
+                                        ufsIdentifierType parent,
+                                        const char *path,
+                                        void *userData );
+
+typedef struct ufsImportOptionsStruct {
+    ufsIdentifierType directory;    /* Where the tree is imported, ROOT is 0. */
+    uint32_t threads;               /* 0 uses one thread per online CPU.      */
+    uint64_t flags;
+    ufsImportProgress progress;     /* Can be NULL.                           */
+    ufsImportVisit visit;           /* Can be NULL.                           */
+    void *userData;
+} ufsImportOptionsType;
+
+typedef struct ufsDirFilterStruct {
+    uint64_t types;                 /* UFS_DIR_FILTER_TYPE_* mask, 0 for all. */
+    const char *prefix;             /* Can be NULL.                           */
+    const char *glob;               /* Can be NULL.                           */
+} ufsDirFilterType;
+
+/* What each UFS_CHANGE_* type means, fields that don't apply are -1:         */
+/*  -ADD_STORAGE: storage was added to parent.                                */
+/*  -REMOVE_STORAGE: storage and everything it contains was removed from      */
+/*                   parent, along with their mappings and attributes.        */
+/*  -MOVE_STORAGE: storage moved from the directory from to parent, and/or    */
+/*                 was renamed.                                               */
+/*  -ADD_AREA: area was added, from is its source if it's a clone.            */
+/*  -REMOVE_AREA: area was removed, along with its whiteouts.                 */
+/*  -ADD_MAPPING, REMOVE_MAPPING: the mapping (area, storage) changed.        */
+/*  -ADD_WHITEOUT, REMOVE_WHITEOUT: the whiteout (area, storage) changed,     */
+/*                                  replacing a mapping when one is added.    */
+/*  -ATTRIBUTES: the attribute record of storage was set or invalidated.      */
+/*  -BASE: storage, or storage in its subtree (ROOT is 0), entered or left    */
+/*         BASE, storage that left it may have been removed. parent is the    */
+/*         parent of storage when it's known.                                 */
+/*  -COLLAPSE: any mapping or whiteout of area may have changed, and if area  */
+/*             is BASE any storage may have entered or left it.               */
+/*  -EXTENTS: the extents area holds of storage changed.                      */
+typedef struct ufsChangeStruct {
+    uint64_t sequence;
+    uint32_t type;                  /* One of UFS_CHANGE_*.                   */
+    ufsIdentifierType storage;
+    ufsIdentifierType parent;
+    ufsIdentifierType area;
+    ufsIdentifierType from;
+} ufsChangeType;
+
+extern _Thread_local ufsStatusType ufsErrno;
 
 /******************************************************************************\
 * ufsInit                                                                      *
@@ -234,7 +439,9 @@ extern ufsStatusType ufsErrno;
 *  Meaning, after ufsInit, both ROOT and BASE can be referenced as intended.   *
 *                                                                              *
 *  Possible errors:                                                            *
-*   -UFS_OUT_OF_MEMORY: The system is out of memory and can't create ufs.      *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory and can't create ufs, or   *
+*                       can't reserve the address space for its metadata, see  *
+*                       Image above.                                           *
 *   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
 *                                                                              *
 * Return                                                                       *
@@ -264,6 +471,83 @@ ufsType ufsInit();
 \******************************************************************************/
 void ufsDestroy( ufsType ufs );
 
+/******************************************************************************\
+* ufsInitFromImage                                                             *
+*                                                                              *
+*  Initialise a ufs from an image saved with ufsSaveImage and return it.       *
+*  The image is mapped copy-on-write and used as is, the image file itself is  *
+*  never modified.                                                             *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The image file does not exist.                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory and can't create ufs.      *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including a file that   *
+*                       is not a ufs image.                                    *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -path: The path of the image file, must not be NULL.                        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsType: a new ufs instance, NULL on failure, check ufsErrno.              *
+*                                                                              *
+\******************************************************************************/
+ufsType ufsInitFromImage( const char *path );
+
+/******************************************************************************\
+* ufsInitReader                                                                *
+*                                                                              *
+*  Initialise a reader of a ufs and return it.                                 *
+*  A reader has a database connection and caches of its own over the memory    *
+*  of the instance, so readers of one instance can be used by different        *
+*  threads at once. Only functions that don't change ufs may be called on a    *
+*  reader, and only while nothing is changing the instance itself, they see    *
+*  everything the instance did before. Readers must be destroyed with          *
+*  ufsDestroy before their instance is.                                        *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments, including a reader.    *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory and can't create it.       *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance to read, must not be NULL.                           *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsType: a new reader, NULL on failure, check ufsErrno.                    *
+*                                                                              *
+\******************************************************************************/
+ufsType ufsInitReader( ufsType ufs );
+
+/******************************************************************************\
+* ufsSaveImage                                                                 *
+*                                                                              *
+*  Saves the state of a ufs into an image file that can be loaded with ufsIn-  *
+*  itFromImage. The image is written next to path and renamed over it, so an   *
+*  existing image is either fully replaced or left untouched.                  *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including I/O errors.   *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -path: The path of the image file, must not be NULL.                        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsSaveImage( ufsType ufs,
+                            const char *path );
+
 /******************************************************************************\
 * ufsAddDirectory                                                              *
 *                                                                              *
@@ -347,6 +631,37 @@ ufsIdentifierType ufsAddFile( ufsType ufs,
 ufsIdentifierType ufsAddArea( ufsType ufs,
                               const char *name );
 
+/******************************************************************************\
+* ufsCloneArea                                                                 *
+*                                                                              *
+*  Adds an area to ufs as a clone of an existing area.                         *
+*  The clone shares the explicit mappings of its source instead of copying     *
+*  them, so the cost of this call does not depend on the number of mappings.   *
+*  Extra state is only kept for mappings that diverge between the two.         *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The source area does not exist in ufs.                *
+*   -UFS_ALREADY_EXISTS: An area with the new name already exists.             *
+*   -UFS_ILLEGAL_NAME: An illegal area name (e.e "BASE") was provided.         *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -source: the source area's unique identifier, must be greater than 0.       *
+*  -name: The name of the new area, must not be NULL.                          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsIdentifierType: The unique identifier of the new area.                  *
+*                      If a negative value is returned, check ufsErrno.        *
+*                                                                              *
+\******************************************************************************/
+ufsIdentifierType ufsCloneArea( ufsType ufs,
+                                ufsIdentifierType source,
+                                const char *name );
+
 /******************************************************************************\
 * ufsAddMapping                                                                *
 *                                                                              *
@@ -450,6 +765,65 @@ ufsIdentifierType ufsGetFile( ufsType ufs,
 ufsIdentifierType ufsGetArea( ufsType ufs,
                               const char *name );
 
+/******************************************************************************\
+* ufsGetStorage                                                                *
+*                                                                              *
+*  Retrieves what ufs knows of storage given only its unique identifier: its   *
+*  parent, its type and its name. Names longer than UFS_STORAGE_NAME_MAX are   *
+*  truncated.                                                                  *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*  -info: Where to store what's known of the storage, must not be NULL.        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsGetStorage( ufsType ufs,
+                             ufsIdentifierType storage,
+                             ufsStorageInfoType *info );
+
+/******************************************************************************\
+* ufsGetManyStorage                                                            *
+*                                                                              *
+*  Retrieves what ufs knows of a batch of storage, the same as ufsGetStorage   *
+*  for each of them, in a single read transaction.                             *
+*  infoOut entries whose status is not UFS_NO_ERROR are left untouched.        *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storages: The storage unique identifiers, must not be NULL.                *
+*  -count: The number of storage in the batch.                                 *
+*  -infoOut: Where to store what's known of each storage, must not be NULL.    *
+*  -statusOut: Where to store the per storage status, must not be NULL.        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                  UFS_NO_ERROR means the batch was processed, check statusOut *
+*                  for the result of each storage.                             *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsGetManyStorage( ufsType ufs,
+                                 const ufsIdentifierType *storages,
+                                 size_t count,
+                                 ufsStorageInfoType *infoOut,
+                                 ufsStatusType *statusOut );
+
 /******************************************************************************\
 * ufsProbeMapping                                                              *
 *                                                                              *
@@ -486,6 +860,7 @@ ufsStatusType ufsProbeMapping( ufsType ufs,
 *  Removes a directory from ufs.                                               *
 *  A directory must be empty before being removed, an empty directory is a     *
 *  directory that does not contain any files globally across ufs.              *
+*  Whiteouts of the directory are removed along with it.                       *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
@@ -514,6 +889,7 @@ ufsStatusType ufsRemoveDirectory( ufsType ufs,
 * ufsRemoveFile                                                                *
 *                                                                              *
 *  Removes a file from ufs.                                                    *
+*  Whiteouts of the file are removed along with it.                            *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
@@ -540,12 +916,16 @@ ufsStatusType ufsRemoveFile( ufsType ufs,
 * ufsRemoveArea                                                                *
 *                                                                              *
 *  Removes a area from ufs.                                                    *
+*  Whiteouts in the area are removed along with it, and its id may be given to *
+*  an area added later.                                                        *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
 *   -UFS_DOES_NOT_EXIST: The area does not exist in ufs.                       *
 *   -UFS_EXISTS_IN_EXPLICIT_MAPPING: The area is referenced in an explicit ma- *
 *                                    pping and cannot be removed.              *
+*   -UFS_AREA_HAS_CLONES: The area is the source of a clone and cannot be re-  *
+*                         moved.                                               *
 *   -UFS_ILLEGAL_NAME: An illegal area name (e.e "BASE") was provided.         *
 *   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
 *                                                                              *
@@ -588,96 +968,876 @@ ufsStatusType ufsRemoveMapping( ufsType ufs,
                                 ufsIdentifierType storage );
 
 /******************************************************************************\
-* ufsResolveStorageInView                                                      *
+* ufsAddWhiteout                                                               *
 *                                                                              *
-*  Given storage and a view, resolve the storage over the view.                *
+*  Deletes storage in an area by adding a whiteout of it, any mapping of the   *
+*  storage in the area is replaced. Nothing is copied or rewritten in the      *
+*  areas after it, or in BASE.                                                 *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
-*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
-*   -UFS_CANNOT_RESOLVE_STORAGE: Could not resolve storage in the view.        *
-*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
-*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
-*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
-*                               e view.                                        *
+*   -UFS_DOES_NOT_EXIST: The area or the storage do not exist in ufs.          *
+*   -UFS_ALREADY_EXISTS: The area already has a whiteout of the storage.       *
 *   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
 *                                                                              *
 * Parameters                                                                   *
 *                                                                              *
 *  -ufs: The ufs instance, must not be NULL.                                   *
-*  -view: The view to use.                                                     *
+*  -area: the area's unique identifier, must be greater than 0.                *
 *  -storage: the storage's unique identifier, must be greater than 0.          *
 *                                                                              *
 * Return                                                                       *
 *                                                                              *
-*  -ufsIdentifierType: The unique identifier of the first area that contains   *
-*                      the storage.                                            *
-*                      If a negative value is returned, check ufsErrno.        *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
 *                                                                              *
 \******************************************************************************/
-ufsIdentifierType ufsResolveStorageInView( ufsType ufs,
-                                           ufsViewType view,
-                                           ufsIdentifierType storage );
+ufsStatusType ufsAddWhiteout( ufsType ufs,
+                              ufsIdentifierType area,
+                              ufsIdentifierType storage );
 
 /******************************************************************************\
-* ufsIterateDirInView                                                          *
+* ufsRemoveWhiteout                                                            *
 *                                                                              *
-*  Given a directory and a view, iterate over the directory in the context     *
-*  of that view.                                                               *
+*  Removes the whiteout of storage from an area, views see the storage in the  *
+*  areas after it again.                                                       *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
-*   -UFS_DOES_NOT_EXIST: The directory does not exist in ufs.                  *
-*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
-*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
-*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
-*                               e view.                                        *
+*   -UFS_DOES_NOT_EXIST: The area has no whiteout of the storage.              *
 *   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
 *                                                                              *
 * Parameters                                                                   *
 *                                                                              *
 *  -ufs: The ufs instance, must not be NULL.                                   *
-*  -view: The view to use.                                                     *
-*  -directory: The directory's unique identifier, must be greater than 0.      *
-*  -iterator: The iterator function to apply, must not be NULL.                *
-*  -userData: The user's data, can be NULL.                                    *
+*  -area: the area's unique identifier, must be greater than 0.                *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
 *                                                                              *
 * Return                                                                       *
 *                                                                              *
 *  -ufsStatusType: The status of this call, ufsErrno is also set.              *
 *                                                                              *
 \******************************************************************************/
-ufsStatusType ufsIterateDirInView( ufsType ufs,
-                                   ufsViewType view,
-                                   ufsIdentifierType directory,
-                                   ufsDirIter iterator,
-                                   void *userData );
+ufsStatusType ufsRemoveWhiteout( ufsType ufs,
+                                 ufsIdentifierType area,
+                                 ufsIdentifierType storage );
 
 /******************************************************************************\
-* ufsCollapse                                                                  *
+* ufsProbeWhiteout                                                             *
 *                                                                              *
-*  Collapses all mappings in a ufs view into the last area in the view.        *
+*  Probes an area for a whiteout of storage, including whiteouts it inherits   *
+*  as a clone.                                                                 *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The area has no whiteout of the storage.              *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -area: the area's unique identifier, must be greater than 0.                *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*  Note, like ufsProbeMapping, UFS_DOES_NOT_EXIST is the result of the query   *
+*  and not a traditional error.                                                *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsProbeWhiteout( ufsType ufs,
+                                ufsIdentifierType area,
+                                ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsAddExtents                                                                *
+*                                                                              *
+*  Adds extents of storage to an area. If the area doesn't contain the         *
+*  storage, it's mapped to it by extents first, in which case count can be 0   *
+*  to map it without any.                                                      *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The area or the storage do not exist in ufs.          *
+*   -UFS_ALREADY_EXISTS: The area holds the whole storage already.             *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -area: the area's unique identifier, must be greater than 0.                *
+*  -storage: the storage's unique identifier, must be non-negative.            *
+*  -first: The index of the first extent.                                      *
+*  -count: The number of extents from first, first + count must not exceed     *
+*          INT64_MAX.                                                          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+\******************************************************************************/
+ufsStatusType ufsAddExtents( ufsType ufs,
+                             ufsIdentifierType area,
+                             ufsIdentifierType storage,
+                             uint64_t first,
+                             uint64_t count );
+
+/******************************************************************************\
+* ufsGetExtents                                                                *
+*                                                                              *
+*  Retrieves which of a range of extents of storage an area holds, including   *
+*  what it inherits as a clone. An area that holds the whole storage holds     *
+*  every extent.                                                               *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_MAPPING_DOES_NOT_EXIST: The area doesn't contain the storage.         *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -area: the area's unique identifier, must be greater than 0.                *
+*  -storage: the storage's unique identifier, must be non-negative.            *
+*  -first: The index of the first extent.                                      *
+*  -count: The number of extents from first, first + count must not exceed     *
+*          INT64_MAX.                                                          *
+*  -present: Filled with count entries, 1 for each extent the area holds and   *
+*            0 for the others. Can be NULL if count is 0.                      *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+\******************************************************************************/
+ufsStatusType ufsGetExtents( ufsType ufs,
+                             ufsIdentifierType area,
+                             ufsIdentifierType storage,
+                             uint64_t first,
+                             uint64_t count,
+                             uint8_t *present );
+
+/******************************************************************************\
+* ufsProbeExtents                                                              *
+*                                                                              *
+*  Probes an area for storage it contains by extents rather than whole,        *
+*  including what it inherits as a clone.                                      *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The area doesn't contain the storage by extents.      *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -area: the area's unique identifier, must be greater than 0.                *
+*  -storage: the storage's unique identifier, must be non-negative.            *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*  Note, like ufsProbeMapping, UFS_DOES_NOT_EXIST is the result of the query   *
+*  and not a traditional error.                                                *
+\******************************************************************************/
+ufsStatusType ufsProbeExtents( ufsType ufs,
+                               ufsIdentifierType area,
+                               ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsRemoveTree                                                                *
+*                                                                              *
+*  Removes a directory and all the storage it contains from ufs.               *
+*  The cost of this call is a bounded number of queries regardless of the      *
+*  size of the subtree.                                                        *
 *                                                                              *
 *  Possible errors:                                                            *
 *   -UFS_BAD_CALL: The function received bad arguments.                        *
 *   -UFS_DOES_NOT_EXIST: The directory does not exist in ufs.                  *
-*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
-*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
-*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
-*                               e view.                                        *
+*   -UFS_EXISTS_IN_EXPLICIT_MAPPING: Storage in the subtree is referenced in   *
+*                                    an explicit mapping, and UFS_REMOVE_TREE- *
+*                                    _FLAG_MAPPINGS was not given.             *
 *   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
 *                                                                              *
 * Parameters                                                                   *
 *                                                                              *
 *  -ufs: The ufs instance, must not be NULL.                                   *
-*  -view: The view to use.                                                     *
+*  -directory: the directory's unique identifier, must be greater than 0.      *
+*  -flags: A combination of UFS_REMOVE_TREE_FLAG_* values, or 0.               *
+*          UFS_REMOVE_TREE_FLAG_MAPPINGS: Also remove all the explicit mappi-  *
+*                                         ngs of the subtree.                  *
 *                                                                              *
 * Return                                                                       *
 *                                                                              *
 *  -ufsStatusType: The status of this call, ufsErrno is also set.              *
 *                                                                              *
 \******************************************************************************/
-ufsStatusType ufsCollapse( ufsType ufs,
-                           ufsViewType view );
+ufsStatusType ufsRemoveTree( ufsType ufs,
+                             ufsIdentifierType directory,
+                             uint64_t flags );
+
+/******************************************************************************\
+* ufsMoveStorage                                                               *
+*                                                                              *
+*  Moves storage to a new parent directory and/or gives it a new name.         *
+*  The storage keeps its unique identifier and all of its mappings, if it's a  *
+*  directory everything it contains moves along with it.                       *
+*  The cost of this call does not depend on the number of storage contained in *
+*  a directory.                                                                *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments, or a directory was to  *
+*                  be moved under itself.                                      *
+*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
+*   -UFS_PARENT_DOES_NOT_EXIST: The new parent directory does not exist.       *
+*   -UFS_ALREADY_EXISTS: Storage with the same name and type already exists in *
+*                        the new parent directory.                             *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*  -newParent: The directory that will contain the storage, must be non-nega-  *
+*              tive.                                                           *
+*  -newName: The new name of the storage, must not be NULL.                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsMoveStorage( ufsType ufs,
+                              ufsIdentifierType storage,
+                              ufsIdentifierType newParent,
+                              const char *newName );
+
+/******************************************************************************\
+* ufsSetAttributes                                                             *
+*                                                                              *
+*  Sets the attribute record of storage, replacing any existing record.        *
+*  The record is stamped with a new generation, which can be read back with    *
+*  ufsGetAttributes.                                                           *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*  -attributes: The attributes to store, must not be NULL.                     *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsSetAttributes( ufsType ufs,
+                                ufsIdentifierType storage,
+                                const ufsAttributesType *attributes );
+
+/******************************************************************************\
+* ufsGetAttributes                                                             *
+*                                                                              *
+*  Retrieves the attribute record of storage.                                  *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_ATTRIBUTES_DO_NOT_EXIST: The storage has no attribute record.         *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*  -attributes: Where to store the record, must not be NULL.                   *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*  Note, like ufsProbeMapping, UFS_ATTRIBUTES_DO_NOT_EXIST is the result of    *
+*  the query and not a traditional error.                                      *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsGetAttributes( ufsType ufs,
+                                ufsIdentifierType storage,
+                                ufsAttributesType *attributes );
+
+/******************************************************************************\
+* ufsGetManyAttributes                                                         *
+*                                                                              *
+*  Retrieves the attribute records of a batch of storage in one call.          *
+*  The i-th entry of attributesOut and statusOut corresponds to the i-th entry *
+*  of storages, statusOut entries are set as ufsGetAttributes would set them.  *
+*  attributesOut entries whose status is not UFS_NO_ERROR are left untouched.  *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storages: The storage unique identifiers, must not be NULL.                *
+*  -count: The number of storage in the batch.                                 *
+*  -attributesOut: Where to store the records, must not be NULL.               *
+*  -statusOut: Where to store the per storage status, must not be NULL.        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                  UFS_NO_ERROR means the batch was processed, check statusOut *
+*                  for the result of each storage.                             *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsGetManyAttributes( ufsType ufs,
+                                    const ufsIdentifierType *storages,
+                                    size_t count,
+                                    ufsAttributesType *attributesOut,
+                                    ufsStatusType *statusOut );
+
+/******************************************************************************\
+* ufsInvalidateAttributes                                                      *
+*                                                                              *
+*  Removes the attribute record of storage.                                    *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_ATTRIBUTES_DO_NOT_EXIST: The storage has no attribute record.         *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsInvalidateAttributes( ufsType ufs,
+                                       ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsImportBase                                                                *
+*                                                                              *
+*  Imports the external tree under rootFd into a directory of ufs.             *
+*  The tree is walked by a pool of threads, directories are listed as they're  *
+*  discovered and the entries are added in bulk. Entries that disappear while  *
+*  the tree is walked, or can't be inspected, are skipped, and directories     *
+*  that can't be opened are imported without their entries. Symbolic links     *
+*  are imported as files and are never followed.                               *
+*  With UFS_IMPORT_FLAG_ATTRIBUTES the attributes of every entry are stored as *
+*  well. With UFS_IMPORT_FLAG_SYNC storage under the directory that's in BASE  *
+*  but wasn't found in the tree leaves BASE.                                   *
+*  The import is all or nothing, if it fails ufs is left unchanged.            *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The directory does not exist in ufs.                  *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including I/O errors.   *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -rootFd: A directory fd of the tree to import, must be non-negative.        *
+*  -options: The import options, can be NULL to import into ROOT with default  *
+*            options. Callbacks are called from the calling thread. progress   *
+*            is called as entries are added. visit is called with every dir-   *
+*            ectory that's added, its parent and its path relative to rootFd,  *
+*            before its entries are listed. An error returned from visit stops *
+*            the import.                                                       *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsImportBase( ufsType ufs,
+                             int rootFd,
+                             const ufsImportOptionsType *options );
+
+/******************************************************************************\
+* ufsAddToBase                                                                 *
+*                                                                              *
+*  Adds storage that exists in BASE to ufs, or marks existing storage of the   *
+*  same name and type as existing in BASE.                                     *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_PARENT_DOES_NOT_EXIST: The parent directory does not exist.           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -parent: The directory that contains the storage, must be non-negative.     *
+*  -name: The name of the storage, must not be NULL.                           *
+*  -type: UFS_STORAGE_TYPE_FILE or UFS_STORAGE_TYPE_DIRECTORY.                 *
+*  -attributes: The attributes to store, can be NULL to leave them as is.      *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsIdentifierType: The unique identifier of the storage.                   *
+*                      If a negative value is returned, check ufsErrno.        *
+*                                                                              *
+\******************************************************************************/
+ufsIdentifierType ufsAddToBase( ufsType ufs,
+                                ufsIdentifierType parent,
+                                const char *name,
+                                int type,
+                                const ufsAttributesType *attributes );
+
+/******************************************************************************\
+* ufsRemoveFromBase                                                            *
+*                                                                              *
+*  Takes storage, and everything under it, out of BASE.                        *
+*  Storage that's still mapped, or holds storage that isn't in BASE, stays in  *
+*  ufs. The rest is removed along with its attributes.                         *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -storage: The storage's unique identifier, must be greater than 0.          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsRemoveFromBase( ufsType ufs,
+                                 ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsResolveStorageInView                                                      *
+*                                                                              *
+*  Given storage and a view, resolve the storage over the view.                *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The storage does not exist in ufs.                    *
+*   -UFS_CANNOT_RESOLVE_STORAGE: Could not resolve storage in the view, or a   *
+*                                whiteout hides it.                            *
+*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
+*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
+*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
+*                               e view.                                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsIdentifierType: The unique identifier of the first area that contains   *
+*                      the storage.                                            *
+*                      If a negative value is returned, check ufsErrno.        *
+*                                                                              *
+\******************************************************************************/
+ufsIdentifierType ufsResolveStorageInView( ufsType ufs,
+                                           ufsViewType view,
+                                           ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsResolveStorageInViewSpan                                                  *
+*                                                                              *
+*  Same as ufsResolveStorageInView, with the view given as a span.             *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsResolveStorageInView.                                     *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -storage: the storage's unique identifier, must be greater than 0.          *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsIdentifierType: The unique identifier of the first area that contains   *
+*                      the storage.                                            *
+*                      If a negative value is returned, check ufsErrno.        *
+*                                                                              *
+\******************************************************************************/
+ufsIdentifierType ufsResolveStorageInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType storage );
+
+/******************************************************************************\
+* ufsResolveManyInView                                                         *
+*                                                                              *
+*  Resolves a batch of storage over a view, as ufsResolveStorageInView would   *
+*  resolve each one. The view is validated once and the batch is resolved in   *
+*  a single pass over ufs, which is far cheaper than resolving each storage    *
+*  on its own.                                                                 *
+*  The status of each storage is given in statusOut, it's one of the errors    *
+*  of ufsResolveStorageInView that concern the storage: UFS_BAD_CALL for an    *
+*  identifier that isn't greater than 0, UFS_DOES_NOT_EXIST and UFS_CANNOT_RE- *
+*  SOLVE_STORAGE.                                                              *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
+*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
+*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
+*                               e view.                                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -storages: The storage to resolve, can be NULL if n is 0.                   *
+*  -n: The number of storage to resolve.                                       *
+*  -areasOut: Filled with the area of each storage, -1 if it has an error.     *
+*             Can be NULL if n is 0.                                           *
+*  -statusOut: Filled with the status of each storage, can be NULL if n is 0.  *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set. Nothing in   *
+*                  the out arrays is valid unless it's UFS_NO_ERROR.           *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsResolveManyInView( ufsType ufs,
+                                    ufsViewType view,
+                                    const ufsIdentifierType *storages,
+                                    size_t n,
+                                    ufsIdentifierType *areasOut,
+                                    ufsStatusType *statusOut );
+
+/******************************************************************************\
+* ufsResolveManyInViewSpan                                                     *
+*                                                                              *
+*  Same as ufsResolveManyInView, with the view given as a span.                *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsResolveManyInView.                                        *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -storages: The storage to resolve, can be NULL if n is 0.                   *
+*  -n: The number of storage to resolve.                                       *
+*  -areasOut: Filled with the area of each storage, -1 if it has an error.     *
+*             Can be NULL if n is 0.                                           *
+*  -statusOut: Filled with the status of each storage, can be NULL if n is 0.  *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsResolveManyInViewSpan( ufsType ufs,
+                                        ufsViewSpanType view,
+                                        const ufsIdentifierType *storages,
+                                        size_t n,
+                                        ufsIdentifierType *areasOut,
+                                        ufsStatusType *statusOut );
+
+/******************************************************************************\
+* ufsIterateDirInView                                                          *
+*                                                                              *
+*  Given a directory and a view, iterate over the directory in the context     *
+*  of that view.                                                               *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_DOES_NOT_EXIST: The directory does not exist in ufs.                  *
+*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
+*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
+*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
+*                               e view.                                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -directory: The directory's unique identifier, ROOT is 0.                   *
+*  -iterator: The iterator function to apply, must not be NULL.                *
+*  -userData: The user's data, can be NULL.                                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsIterateDirInView( ufsType ufs,
+                                   ufsViewType view,
+                                   ufsIdentifierType directory,
+                                   ufsDirIter iterator,
+                                   void *userData );
+
+/******************************************************************************\
+* ufsIterateDirInViewSpan                                                      *
+*                                                                              *
+*  Same as ufsIterateDirInView, with the view given as a span.                 *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsIterateDirInView.                                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -directory: The directory's unique identifier, ROOT is 0.                   *
+*  -iterator: The iterator function to apply, must not be NULL.                *
+*  -userData: The user's data, can be NULL.                                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsIterateDirInViewSpan( ufsType ufs,
+                                       ufsViewSpanType view,
+                                       ufsIdentifierType directory,
+                                       ufsDirIter iterator,
+                                       void *userData );
+
+/******************************************************************************\
+* ufsIterateFilteredDirInView                                                  *
+*                                                                              *
+*  Same as ufsIterateDirInView, only over the entries that pass a filter.      *
+*  The filter is applied by the query that lists the directory, names outside  *
+*  the prefix, and outside the literal start of the glob, are never read.      *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsIterateDirInView.                                         *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -directory: The directory's unique identifier, ROOT is 0.                   *
+*  -filter: The filter, can be NULL to iterate over all entries.               *
+*  -iterator: The iterator function to apply, must not be NULL.                *
+*  -userData: The user's data, can be NULL.                                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsIterateFilteredDirInView( ufsType ufs,
+                                           ufsViewType view,
+                                           ufsIdentifierType directory,
+                                           const ufsDirFilterType *filter,
+                                           ufsDirIter iterator,
+                                           void *userData );
+
+/******************************************************************************\
+* ufsIterateFilteredDirInViewSpan                                              *
+*                                                                              *
+*  Same as ufsIterateFilteredDirInView, with the view given as a span.         *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsIterateFilteredDirInView.                                 *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -directory: The directory's unique identifier, ROOT is 0.                   *
+*  -filter: The filter, can be NULL to iterate over all entries.               *
+*  -iterator: The iterator function to apply, must not be NULL.                *
+*  -userData: The user's data, can be NULL.                                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsIterateFilteredDirInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType directory,
+                                               const ufsDirFilterType *filter,
+                                               ufsDirIter iterator,
+                                               void *userData );
+
+/******************************************************************************\
+* ufsIterateResolvedDirInViewSpan                                              *
+*                                                                              *
+*  Same as ufsIterateFilteredDirInViewSpan, with the area each entry resolves  *
+*  to in the view passed to the iterator as well. Entries are resolved in      *
+*  batches, so callers that need the area don't resolve them again.            *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsIterateFilteredDirInView.                                 *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*  -directory: The directory's unique identifier, ROOT is 0.                   *
+*  -filter: The filter, can be NULL to iterate over all entries.               *
+*  -iterator: The iterator function to apply, must not be NULL.                *
+*  -userData: The user's data, can be NULL.                                    *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsIterateResolvedDirInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType directory,
+                                               const ufsDirFilterType *filter,
+                                               ufsResolvedDirIter iterator,
+                                               void *userData );
+
+/******************************************************************************\
+* ufsGetDirectoryGeneration                                                    *
+*                                                                              *
+*  Retrieves the generation of a directory, in constant time. The directory    *
+*  isn't looked up, the generation of an identifier that isn't a directory     *
+*  means nothing.                                                              *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -directory: the directory's unique identifier, ROOT is 0.                   *
+*  -generation: Where to store the generation, must not be NULL.               *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsGetDirectoryGeneration( ufsType ufs,
+                                         ufsIdentifierType directory,
+                                         uint64_t *generation );
+
+/******************************************************************************\
+* ufsCollapse                                                                  *
+*                                                                              *
+*  Collapses all mappings in a ufs view into the last area in the view.        *
+*  Storage is looked up in the other areas in the order of the view, like a    *
+*  view resolves it. Storage the first of them to hold it contains becomes     *
+*  contained in the last area, storage the first of them whited out gets a     *
+*  whiteout in the last area instead, replacing its mapping there. So the      *
+*  last area shows what the view showed, deletions included. The other areas   *
+*  are left as they are. If the last area is BASE the storage is marked as     *
+*  existing in BASE, or as not existing in it if it was whited out, applying   *
+*  it to the external fs is up to the caller. A view of a single area is a     *
+*  no-op.                                                                      *
+*  Extents of storage in the last area are merged, see Extents above.          *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_VIEW_CONTAINS_DUPLICATES: The view contains duplicate areas.          *
+*   -UFS_INVALID_AREA_IN_VIEW: The view contains a non-existent area.          *
+*   -UFS_BASE_IS_NOT_LAST_AREA: BASE was used but was not the last area in th- *
+*                               e view.                                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsCollapse( ufsType ufs,
+                           ufsViewType view );
+
+/******************************************************************************\
+* ufsCollapseSpan                                                              *
+*                                                                              *
+*  Same as ufsCollapse, with the view given as a span.                         *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -Any error of ufsCollapse.                                                 *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -view: The view to use.                                                     *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsCollapseSpan( ufsType ufs,
+                               ufsViewSpanType view );
+
+/******************************************************************************\
+* ufsSubscribeChanges                                                          *
+*                                                                              *
+*  Starts a consumer of the change feed and returns its cursor, the sequence   *
+*  number of the next change. The first subscription starts recording, every   *
+*  consumer shares the same ring and only keeps its own cursor.                *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -cursor: Set to the cursor of the consumer, must not be NULL.               *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsSubscribeChanges( ufsType ufs,
+                                   uint64_t *cursor );
+
+/******************************************************************************\
+* ufsPollChanges                                                               *
+*                                                                              *
+*  Copies the changes made since cursor, oldest first, and advances cursor     *
+*  past them. Doesn't block, count is 0 when there are no new changes.         *
+*  If changes after cursor were already dropped from the ring nothing is       *
+*  copied and the cursor moves to the next change, the consumer must consider  *
+*  everything it cached stale.                                                 *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments, including a cursor     *
+*                  that wasn't handed out by ufsSubscribeChanges.              *
+*   -UFS_CHANGES_OVERFLOWED: Changes after cursor were dropped.                *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL.                                   *
+*  -cursor: The cursor of the consumer, must not be NULL.                      *
+*  -changes: Filled with up to max changes, must not be NULL if max isn't 0.   *
+*  -max: The number of changes that fit in changes.                            *
+*  -count: Set to the number of changes copied, must not be NULL.              *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsPollChanges( ufsType ufs,
+                              uint64_t *cursor,
+                              ufsChangeType *changes,
+                              size_t max,
+                              size_t *count );
 
 #endif /* UFS_CORE_H */
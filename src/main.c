@@ -1,8 +1,379 @@
+/******************************************************************************\
+*  main.c                                                                      *
+*                                                                              *
+*  The ufs daemon, mounts a view of areas on top of an external fs.            *
+*  The state of ufs is kept in an image in the upper directory along with the  *
+*  content of the areas, BASE is imported again on every start so changes      *
+*  made to the external fs while unmounted are picked up, and it's watched     *
+*  while mounted so the kernel drops what it cached of what changed.           *
+*                                                                              *
+*  Usage: ufs [options] <base> <upper> <area[,area...]> <mountpoint>           *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+#define FUSE_USE_VERSION 35
+
 #include "ufs_core.h"
+#include "ufs_fuse.h"
+#include "ufs_watch.h"
+#include <fuse_lowlevel.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define UFS_MAIN_IMAGE_NAME ("ufs.image")
+#define UFS_MAIN_POSITIONALS (3)
+
+typedef struct ufsMainConfigStruct {
+    const char *positionals[ UFS_MAIN_POSITIONALS ];
+    int numPositionals;
+    unsigned int threads;
+    int noPassthrough;
+    int noWritebackCache;
+    int noBackgroundCopy;
+} ufsMainConfigType;
+
+static const struct fuse_opt ufsMainOptions[] = {
+    { "threads=%u", offsetof( ufsMainConfigType, threads ), 0 },
+    { "no_passthrough", offsetof( ufsMainConfigType, noPassthrough ), 1 },
+    { "no_writeback_cache", offsetof( ufsMainConfigType, noWritebackCache ),
+      1 },
+    { "no_background_copy", offsetof( ufsMainConfigType, noBackgroundCopy ),
+      1 },
+    FUSE_OPT_END
+};
+
+/* Changes of the external fs followed while the view is served.              */
+typedef struct ufsMainFollowStruct {
+    ufsWatchType watch;
+    ufsFuseType fuse;
+    int stopFd;                     /* Readable once the loop returned.       */
+    pthread_t thread;
+} ufsMainFollowType;
+
+/* Status values are bits, their strings are in the order of the bits.        */
+static const char *statusString( ufsStatusType status )
+{
+    return ufsStatusStrings[ status ? __builtin_ctzll( status ) + 1 : 0 ];
+}
+
+/* Takes base, upper and the areas, and leaves the mountpoint to FUSE.        */
+static int parseArgument( void *data,
+                          const char *arg,
+                          int key,
+                          struct fuse_args *args )
+{
+    ufsMainConfigType *config;
+
+    ( void )args;
+    config = data;
+    if ( key != FUSE_OPT_KEY_NONOPT ||
+         config -> numPositionals == UFS_MAIN_POSITIONALS )
+        return 1;
+
+    config -> positionals[ config -> numPositionals++ ] = arg;
+    return 0;
+}
+
+static void usage( const char *program )
+{
+    printf( "usage: %s [options] <base> <upper> <area[,area...]> "
+            "<mountpoint>\n\n", program );
+    printf( "Mounts the view made of the areas, in order, and BASE.\n"
+            "Writes go to the first area.\n\n" );
+    printf( "    -o threads=N           workers serving requests, 0 for one "
+            "per CPU (default)\n" );
+#ifdef FUSE_CAP_PASSTHROUGH
+    printf( "    -o no_passthrough      serve file content from the daemon even "
+            "if the\n"
+            "                           kernel can pass it through\n" );
+#endif
+    printf( "    -o no_writeback_cache  send writes to the daemon as they're "
+            "made\n" );
+    printf( "    -o no_background_copy  copy up only the extents of large "
+            "files that\n"
+            "                           are written to\n" );
+    fuse_cmdline_help();
+    fuse_lowlevel_help();
+}
+
+static ufsStatusType applyChanges( ufsType ufs, void *userData )
+{
+    ( void )ufs;
+    return ufsWatchProcess( userData );
+}
+
+/* Changes are applied to ufs while requests are held off, and the kernel     */
+/* drops what it cached of the storage they touched. Signals are left to the  */
+/* thread that serves requests, so they stop its loop.                        */
+static void *followBase( void *data )
+{
+    ufsMainFollowType *follow;
+    struct pollfd fds[ 2 ];
+    ufsStatusType status;
+
+    follow = data;
+    fds[ 0 ].fd = ufsWatchGetFd( follow -> watch );
+    fds[ 0 ].events = POLLIN;
+    fds[ 1 ].fd = follow -> stopFd;
+    fds[ 1 ].events = POLLIN;
+    for ( ;; ) {
+        if ( poll( fds, 2, -1 ) < 0 ) {
+            if ( errno == EINTR )
+                continue;
+
+            perror( "ufs: can't follow changes of the external fs" );
+            break;
+        }
+
+        if ( fds[ 1 ].revents )
+            break;
+
+        status = ufsFuseUpdate( follow -> fuse, applyChanges,
+                                follow -> watch );
+        if ( status != UFS_NO_ERROR ) {
+            fprintf( stderr, "ufs: can't follow changes of the external fs: "
+                     "%s\n", statusString( status ) );
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int startFollowing( ufsMainFollowType *follow )
+{
+    sigset_t all, old;
+    int res;
+
+    follow -> stopFd = eventfd( 0, EFD_CLOEXEC );
+    if ( follow -> stopFd < 0 )
+        return -1;
+
+    sigfillset( &all );
+    pthread_sigmask( SIG_SETMASK, &all, &old );
+    res = pthread_create( &follow -> thread, NULL, followBase, follow );
+    pthread_sigmask( SIG_SETMASK, &old, NULL );
+    if ( res ) {
+        close( follow -> stopFd );
+        follow -> stopFd = -1;
+        errno = res;
+        return -1;
+    }
 
-int main()
+    return 0;
+}
+
+static void stopFollowing( ufsMainFollowType *follow )
 {
+    if ( follow -> stopFd < 0 )
+        return;
+
+    if ( eventfd_write( follow -> stopFd, 1 ) == 0 )
+        pthread_join( follow -> thread, NULL );
+
+    close( follow -> stopFd );
+    follow -> stopFd = -1;
+}
+
+/* Builds the view out of the area names, areas that don't exist are added.   */
+static int buildView( ufsType ufs, char *names, ufsIdentifierType **areas,
+                      uint32_t *count )
+{
+    ufsIdentifierType *view, area;
+    char *name, *save;
+    uint32_t size;
+
+    size = 2;
+    for ( name = names; *name; name++ )
+        size += *name == ',';
+
+    view = malloc( size * sizeof( *view ) );
+    if ( !view )
+        return -1;
+
+    *count = 0;
+    for ( name = strtok_r( names, ",", &save ); name;
+          name = strtok_r( NULL, ",", &save ) ) {
+        area = ufsGetArea( ufs, name );
+        if ( area < 0 && ufsErrno == UFS_DOES_NOT_EXIST )
+            area = ufsAddArea( ufs, name );
+
+        if ( area <= 0 ) {
+            fprintf( stderr, "ufs: can't use area %s: %s\n", name,
+                     area ? statusString( ufsErrno ) : "it's BASE" );
+            free( view );
+            return -1;
+        }
+
+        view[ ( *count )++ ] = area;
+    }
+
+    if ( !*count ) {
+        fprintf( stderr, "ufs: no areas given\n" );
+        free( view );
+        return -1;
+    }
+
+    view[ ( *count )++ ] = UFS_AREA_BASE_IDENTIFIER;
+    *areas = view;
     return 0;
 }
 
+int main( int argc, char **argv )
+{
+    struct fuse_args args = FUSE_ARGS_INIT( argc, argv );
+    ufsImportOptionsType importOptions = { 0 };
+    ufsFuseOptionsType options = { 0 };
+    struct fuse_cmdline_opts opts;
+    ufsMainConfigType config = { 0 };
+    ufsMainFollowType follow = { 0 };
+    char image[ PATH_MAX + sizeof( UFS_MAIN_IMAGE_NAME ) ];
+    char upper[ PATH_MAX ], *names;
+    ufsIdentifierType *areas;
+    ufsFuseType fuse;
+    ufsType ufs;
+    int ret;
+
+    if ( fuse_opt_parse( &args, &config, ufsMainOptions, parseArgument ) ||
+         fuse_parse_cmdline( &args, &opts ) )
+        return 1;
+
+    if ( opts.show_help ) {
+        usage( argv[ 0 ] );
+        return 0;
+    }
+
+    if ( opts.show_version ) {
+        printf( "FUSE library version %s\n", fuse_pkgversion() );
+        fuse_lowlevel_version();
+        return 0;
+    }
+
+#ifndef FUSE_CAP_PASSTHROUGH
+    /* Built against a libfuse older than 3.16, content is never passed       */
+    /* through, so there is nothing to turn off.                              */
+    if ( config.noPassthrough ) {
+        fprintf( stderr, "ufs: no_passthrough: this build can't pass file "
+                 "content through, it needs libfuse 3.16 or later\n" );
+        return 1;
+    }
+#endif
+
+    if ( config.numPositionals != UFS_MAIN_POSITIONALS || !opts.mountpoint ) {
+        usage( argv[ 0 ] );
+        return 1;
+    }
+
+    ret = 1;
+    ufs = NULL;
+    fuse = NULL;
+    areas = NULL;
+    follow.stopFd = -1;
+    names = strdup( config.positionals[ 2 ] );
+    options.baseFd = open( config.positionals[ 0 ],
+                           O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    options.upperFd = open( config.positionals[ 1 ],
+                            O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( !names || options.baseFd < 0 || options.upperFd < 0 ) {
+        perror( "ufs" );
+        goto out;
+    }
+
+    /* The daemon leaves the working directory once it's mounted.             */
+    if ( !realpath( config.positionals[ 1 ], upper ) ) {
+        perror( "ufs" );
+        goto out;
+    }
+
+    snprintf( image, sizeof( image ), "%s/%s", upper, UFS_MAIN_IMAGE_NAME );
+    ufs = ufsInitFromImage( image );
+    if ( !ufs && ufsErrno == UFS_DOES_NOT_EXIST )
+        ufs = ufsInit();
+
+    if ( !ufs ) {
+        fprintf( stderr, "ufs: can't load %s: %s\n", image,
+                 statusString( ufsErrno ) );
+        goto out;
+    }
+
+    /* Without a watch, as when the kernel has no watches left for the tree,  */
+    /* BASE is served as it was imported.                                     */
+    importOptions.flags = UFS_IMPORT_FLAG_ATTRIBUTES | UFS_IMPORT_FLAG_SYNC;
+    follow.watch = ufsWatchInit( ufs, options.baseFd, &importOptions, 0 );
+    if ( !follow.watch )
+        fprintf( stderr, "ufs: can't watch %s, changes made to it while "
+                 "mounted won't be seen: %s\n", config.positionals[ 0 ],
+                 statusString( ufsErrno ) );
+    if ( !follow.watch &&
+         ufsImportBase( ufs, options.baseFd, &importOptions ) !=
+         UFS_NO_ERROR ) {
+        fprintf( stderr, "ufs: can't import %s: %s\n", config.positionals[ 0 ],
+                 statusString( ufsErrno ) );
+        goto out;
+    }
+
+    if ( buildView( ufs, names, &areas, &options.view.count ) )
+        goto out;
+
+    options.view.areas = areas;
+    options.threads = opts.singlethread ? 1 : config.threads;
+    options.maxIdleThreads = opts.max_idle_threads;
+    options.flags = ( config.noPassthrough ? UFS_FUSE_FLAG_NO_PASSTHROUGH :
+                                             0 ) |
+                    ( config.noWritebackCache ?
+                      UFS_FUSE_FLAG_NO_WRITEBACK_CACHE : 0 ) |
+                    ( config.noBackgroundCopy ?
+                      UFS_FUSE_FLAG_NO_BACKGROUND_COPY : 0 );
+    fuse = ufsFuseInit( ufs, &options, args.argc, args.argv );
+    if ( !fuse || ufsFuseMount( fuse, opts.mountpoint ) != UFS_NO_ERROR ) {
+        fprintf( stderr, "ufs: can't mount %s: %s\n", opts.mountpoint,
+                 statusString( ufsErrno ) );
+        goto out;
+    }
+
+    /* Threads don't outlive the fork into the background.                    */
+    fuse_daemonize( opts.foreground );
+    follow.fuse = fuse;
+    if ( follow.watch && startFollowing( &follow ) )
+        perror( "ufs: can't follow changes of the external fs" );
+
+    ret = ufsFuseLoop( fuse ) == UFS_NO_ERROR ? 0 : 1;
+    stopFollowing( &follow );
+    ufsFuseDestroy( fuse );
+    fuse = NULL;
+
+    if ( ufsSaveImage( ufs, image ) != UFS_NO_ERROR ) {
+        fprintf( stderr, "ufs: can't save %s: %s\n", image,
+                 statusString( ufsErrno ) );
+        ret = 1;
+    }
+
+out:
+    stopFollowing( &follow );
+    ufsFuseDestroy( fuse );
+    ufsWatchDestroy( follow.watch );
+    if ( ufs )
+        ufsDestroy( ufs );
+    if ( options.baseFd >= 0 )
+        close( options.baseFd );
+    if ( options.upperFd >= 0 )
+        close( options.upperFd );
+    free( areas );
+    free( names );
+    free( opts.mountpoint );
+    fuse_opt_free_args( &args );
+    return ret;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+*  ufs_bloom.c                                                                 *
+*                                                                              *
+*  Blocked Bloom filters over identifiers, see ufs_bloom.h.                    *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#include "ufs_bloom.h"
+#include <stdlib.h>
+
+#define UFS_BLOOM_BLOCK_WORDS (8)
+#define UFS_BLOOM_BLOCK_BITS (UFS_BLOOM_BLOCK_WORDS * 64)
+
+static inline uint64_t mixKey( uint64_t key );
+
+uint64_t mixKey( uint64_t key )
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+int ufsBloomInit( ufsBloomType *bloom, uint64_t capacity )
+{
+    uint64_t blocks, i;
+
+    /* Blocks are a power of two so picking one is a mask.                    */
+    blocks = 1;
+    while ( blocks * UFS_BLOOM_BLOCK_BITS < capacity * UFS_BLOOM_BITS_PER_KEY )
+        blocks *= 2;
+
+    bloom -> words = aligned_alloc( UFS_BLOOM_BLOCK_WORDS * sizeof( uint64_t ),
+                                    blocks * UFS_BLOOM_BLOCK_WORDS *
+                                    sizeof( uint64_t ) );
+    if ( !bloom -> words )
+        return -1;
+
+    for ( i = 0; i < blocks * UFS_BLOOM_BLOCK_WORDS; i++ )
+        bloom -> words[ i ] = 0;
+
+    bloom -> blockMask = blocks - 1;
+    bloom -> capacity = capacity;
+    bloom -> count = 0;
+    return 0;
+}
+
+void ufsBloomDestroy( ufsBloomType *bloom )
+{
+    free( bloom -> words );
+    bloom -> words = NULL;
+}
+
+void ufsBloomAdd( ufsBloomType *bloom, uint64_t key )
+{
+    uint64_t hash, *block;
+    uint32_t bit;
+    int i;
+
+    /* One hash picks the block, 9 bits of another pick each bit inside it.   */
+    hash = mixKey( key );
+    block = bloom -> words +
+            ( hash & bloom -> blockMask ) * UFS_BLOOM_BLOCK_WORDS;
+    hash = mixKey( hash );
+    for ( i = 0; i < UFS_BLOOM_HASHES; i++ ) {
+        bit = ( hash >> ( i * 9 ) ) & ( UFS_BLOOM_BLOCK_BITS - 1 );
+        block[ bit / 64 ] |= 1ULL << ( bit % 64 );
+    }
+
+    bloom -> count++;
+}
+
+int ufsBloomMayContain( const ufsBloomType *bloom, uint64_t key )
+{
+    const uint64_t *block;
+    uint64_t hash;
+    uint32_t bit;
+    int i;
+
+    hash = mixKey( key );
+    block = bloom -> words +
+            ( hash & bloom -> blockMask ) * UFS_BLOOM_BLOCK_WORDS;
+    hash = mixKey( hash );
+    for ( i = 0; i < UFS_BLOOM_HASHES; i++ ) {
+        bit = ( hash >> ( i * 9 ) ) & ( UFS_BLOOM_BLOCK_BITS - 1 );
+        if ( !( block[ bit / 64 ] & ( 1ULL << ( bit % 64 ) ) ) )
+            return 0;
+    }
+
+    return 1;
+}
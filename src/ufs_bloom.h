@@ -0,0 +1,94 @@
+/******************************************************************************\
+*  ufs_bloom.h                                                                 *
+*                                                                              *
+*  Blocked Bloom filters over identifiers.                                     *
+*  All the bits of a key live in one 64 byte block, so a lookup touches a      *
+*  single cache line. Keys can't be removed, filters are rebuilt instead.      *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#ifndef UFS_BLOOM_H
+#define UFS_BLOOM_H
+
+#include <stdint.h>
+
+#define UFS_BLOOM_BITS_PER_KEY (10)
+#define UFS_BLOOM_HASHES (7)
+
+typedef struct ufsBloomStruct {
+    uint64_t *words;
+    uint64_t blockMask;
+    uint64_t capacity;              /* Keys the filter was sized for.         */
+    uint64_t count;                 /* Keys added so far.                     */
+} ufsBloomType;
+
+/******************************************************************************\
+* ufsBloomInit                                                                 *
+*                                                                              *
+*  Initializes an empty filter sized for capacity keys.                        *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -bloom: The filter to initialize, must not be NULL.                         *
+*  -capacity: The number of keys expected, can be 0.                           *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -int: 0 on success, -1 if out of memory.                                    *
+*                                                                              *
+\******************************************************************************/
+int ufsBloomInit( ufsBloomType *bloom, uint64_t capacity );
+
+/******************************************************************************\
+* ufsBloomDestroy                                                              *
+*                                                                              *
+*  Frees the memory held by a filter.                                          *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -bloom: The filter, must not be NULL.                                       *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsBloomDestroy( ufsBloomType *bloom );
+
+/******************************************************************************\
+* ufsBloomAdd                                                                  *
+*                                                                              *
+*  Adds a key to a filter.                                                     *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -bloom: The filter, must not be NULL.                                       *
+*  -key: The key to add.                                                       *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsBloomAdd( ufsBloomType *bloom, uint64_t key );
+
+/******************************************************************************\
+* ufsBloomMayContain                                                           *
+*                                                                              *
+*  Checks whether a key may have been added to a filter.                       *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -bloom: The filter, must not be NULL.                                       *
+*  -key: The key to check.                                                     *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -int: 0 if the key was never added, 1 if it might have been.                *
+*                                                                              *
+\******************************************************************************/
+int ufsBloomMayContain( const ufsBloomType *bloom, uint64_t key );
+
+#endif /* UFS_BLOOM_H */
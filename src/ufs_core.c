@@ -15,4 +15,4 @@ const char *ufsStatusStrings[ UFS_NUM_ERRORS ] = {
 #undef UFS_X
 };
 
-ufsStatusType ufsErrno = UFS_NO_ERROR;
+_Thread_local ufsStatusType ufsErrno = UFS_NO_ERROR;
@@ -10,9 +10,38 @@
 
 #include "sqlite3.h"
 #include "ufs_core.h"
+#include "ufs_import.h"
+#include "ufs_bloom.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Room a call that changes ufs must find left in the reservation of the      */
+/* image, the reservation is never smaller than twice this past the end of    */
+/* a loaded image. A new ufs starts from an empty image.                      */
+#define UFS_SQLITE_IMAGE_HEADROOM (32ULL << 20)
+#define UFS_SQLITE_META_GENERATION ("attributesGeneration")
+
+/* Areas keep a Bloom filter over the storage they map, so most areas of a    */
+/* view can be ruled out without touching the mappings table.                 */
+#define UFS_SQLITE_FILTER_BUCKETS (1024)
+
+/* Runs of a batch shorter than this are resolved one storage at a time.      */
+#define UFS_SQLITE_BATCH_MIN_RANGE (8)
+
+/* Mapping rows are mappings when removed is 0, hide what a clone inherits    */
+/* when it's 1, and are whiteouts when it's this.                             */
+#define UFS_SQLITE_WHITEOUT (2)
+
+/* A mapping held by extents has a row of this extent along with its own, so  */
+/* it stays partial while it holds none.                                      */
+#define UFS_SQLITE_PARTIAL (-1)
 
 enum ufsSqliteStatementType {
     UFS_STATEMENT_INSERT_INTO_STORAGE,
@@ -24,43 +53,226 @@ enum ufsSqliteStatementType {
     UFS_STATEMENT_QUERY_AREAS_BY_ID,
     UFS_STATEMENT_INSERT_INTO_MAPPINGS,
     UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS,
+    UFS_STATEMENT_QUERY_MAPPING_BY_IDS,
+    UFS_STATEMENT_BEGIN_TRANSACTION,
+    UFS_STATEMENT_COMMIT_TRANSACTION,
+    UFS_STATEMENT_ROLLBACK_TRANSACTION,
+    UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE,
+    UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE,
+    UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE,
+    UFS_STATEMENT_QUERY_STORAGE_ANCESTOR,
+    UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME,
+    UFS_STATEMENT_REPLACE_ATTRIBUTES,
+    UFS_STATEMENT_QUERY_ATTRIBUTES_BY_ID,
+    UFS_STATEMENT_DELETE_ATTRIBUTES_BY_ID,
+    UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE,
+    UFS_STATEMENT_INSERT_CLONE_INTO_AREAS,
+    UFS_STATEMENT_INSERT_INTO_CLONE_MAPPINGS,
+    UFS_STATEMENT_MARK_MAPPING_REMOVED,
+    UFS_STATEMENT_DELETE_MAPPING_BY_IDS,
+    UFS_STATEMENT_QUERY_META,
+    UFS_STATEMENT_REPLACE_META,
+    UFS_STATEMENT_INSERT_INTO_BASE_STORAGE,
+    UFS_STATEMENT_MARK_STORAGE_BASE,
+    UFS_STATEMENT_MARK_SUBTREE_STALE,
+    UFS_STATEMENT_CLEAR_KEEP,
+    UFS_STATEMENT_INSERT_KEEP,
+    UFS_STATEMENT_DELETE_STALE_MAPPINGS,
+    UFS_STATEMENT_DELETE_STALE_ATTRIBUTES,
+    UFS_STATEMENT_DELETE_STALE_STORAGE,
+    UFS_STATEMENT_UNMARK_STALE,
+    UFS_STATEMENT_COUNT_MAPPINGS_IN_CHAIN,
+    UFS_STATEMENT_QUERY_MAPPINGS_IN_CHAIN,
+    UFS_STATEMENT_QUERY_MAPPINGS_OF_STORAGE,
+    UFS_STATEMENT_CLEAR_COLLAPSE_AREAS,
+    UFS_STATEMENT_INSERT_COLLAPSE_AREA,
+    UFS_STATEMENT_CLEAR_COLLAPSE,
+    UFS_STATEMENT_INSERT_COLLAPSE,
+    UFS_STATEMENT_DELETE_COLLAPSE_IN_AREA,
+    UFS_STATEMENT_INSERT_COLLAPSE_INTO_CLONES,
+    UFS_STATEMENT_INSERT_COLLAPSE_INTO_AREA,
+    UFS_STATEMENT_MARK_COLLAPSE_BASE,
+    UFS_STATEMENT_QUERY_CHILDREN_FILTERED,
+    UFS_STATEMENT_QUERY_STORAGE_RANGE,
+    UFS_STATEMENT_QUERY_MAPPINGS_OF_STORAGE_RANGE,
+    UFS_STATEMENT_QUERY_DIRECTORIES_IN_SUBTREE,
+    UFS_STATEMENT_QUERY_STALE_DIRECTORIES,
+    UFS_STATEMENT_QUERY_COLLAPSE_PARENTS,
+    UFS_STATEMENT_INSERT_WHITEOUT,
+    UFS_STATEMENT_INSERT_EXTENT_RANGE,
+    UFS_STATEMENT_QUERY_EXTENT_RANGE,
+    UFS_STATEMENT_COPY_EXTENTS,
+    UFS_STATEMENT_INSERT_INTO_CLONE_EXTENTS,
+    UFS_STATEMENT_DELETE_EXTENTS_BY_IDS,
+    UFS_STATEMENT_CLEAR_MERGE,
+    UFS_STATEMENT_QUERY_COLLAPSE_EXTENTS,
+    UFS_STATEMENT_INSERT_MERGE,
+    UFS_STATEMENT_DELETE_MERGE,
+    UFS_STATEMENT_INSERT_MERGE_INTO_AREA,
+    UFS_STATEMENT_QUERY_CLONE_OF_AREA,
+    UFS_STATEMENT_QUERY_MAPPING_OF_AREA,
+    UFS_STATEMENT_DELETE_MAPPINGS_OF_AREA,
+    UFS_STATEMENT_DELETE_AREA_BY_ID,
+    UFS_STATEMENT_QUERY_CHILD_OF_DIRECTORY,
     NUM_UFS_STATEMENTS,
 };
 
+typedef struct ufsSqliteFilterStruct {
+    ufsIdentifierType area;
+    ufsBloomType bloom;
+    uint64_t removals;              /* Keys that are stale in the filter.     */
+    uint64_t seen;                  /* Last view the area was seen in.        */
+    ufsIdentifierType source;       /* The area it was cloned from, or 0.     */
+    struct ufsSqliteFilterStruct *next;
+} ufsSqliteFilterType;
+
+/* The last view used for resolution, indexed by the areas it can see through */
+/* the clone chains of its own areas. A mapping row of storage then leads     */
+/* straight to the positions in the view that observe it.                     */
+typedef struct ufsSqliteViewEntryStruct {
+    ufsIdentifierType area;
+    uint32_t rank;                  /* Position in the view that sees area.   */
+    uint32_t depth;                 /* Distance of area along its chain.      */
+    int64_t next;                   /* Next entry of the same area, or -1.    */
+} ufsSqliteViewEntryType;
+
+typedef struct ufsSqliteViewIndexStruct {
+    ufsIdentifierType areas[ UFS_VIEW_MAX_SIZE ];
+    size_t size;                    /* 0 when nothing is cached.              */
+    ufsSqliteViewEntryType *entries;
+    size_t numEntries;
+    size_t maxEntries;
+    int64_t *slots;                 /* Open addressing, first entry of area.  */
+    uint64_t slotMask;
+} ufsSqliteViewIndexType;
+
+typedef struct ufsSqliteCandidateStruct {
+    uint32_t rank;
+    uint32_t depth;
+    int removed;
+} ufsSqliteCandidateType;
+
+/* The rows of one storage seen so far while resolving it.                    */
+typedef struct ufsSqliteResolveStruct {
+    size_t numCandidates;
+    int inBase;                     /* -1 until the storage is found.         */
+    int mapped;                     /* Live in some area, seen or not.        */
+} ufsSqliteResolveType;
+
+typedef struct ufsSqliteGenerationStruct {
+    ufsIdentifierType directory;
+    uint64_t generation;            /* 0 when the slot is empty.              */
+} ufsSqliteGenerationType;
+
+/* Only directories whose listing changed since ufs was created have a slot,  */
+/* every other directory is at floor.                                         */
+typedef struct ufsSqliteGenerationsStruct {
+    ufsSqliteGenerationType *slots; /* Open addressing, by directory.         */
+    uint64_t slotMask;
+    size_t size;
+    uint64_t last;                  /* Last generation handed out.            */
+    uint64_t floor;
+} ufsSqliteGenerationsType;
+
+typedef struct ufsSqliteBatchEntryStruct {
+    ufsIdentifierType storage;
+    size_t index;                   /* Position in the caller's arrays.       */
+} ufsSqliteBatchEntryType;
+
+/* An iterator that isn't told where its entries resolve.                     */
+typedef struct ufsSqliteDirIterStruct {
+    ufsDirIter iterator;
+    void *userData;
+} ufsSqliteDirIterType;
+
 typedef struct ufsSqliteStruct {
     sqlite3 *db;
     ufsIdentifierType rootId;
+    uint64_t attributesGeneration;
+    void *image;
+    size_t imageCapacity;
     sqlite3_stmt *statements[ NUM_UFS_STATEMENTS ];
-
+    ufsSqliteFilterType *filters[ UFS_SQLITE_FILTER_BUCKETS ];
+    uint64_t views;                 /* Views validated so far.                */
+    ufsSqliteViewIndexType viewIndex;
+    ufsSqliteCandidateType *candidates;
+    size_t maxCandidates;
+    ufsSqliteBatchEntryType *batch;
+    size_t maxBatch;
+    ufsChangeType *changes;         /* The feed, NULL until subscribed to.    */
+    uint64_t nextChange;            /* Sequence of the next change.           */
+    ufsSqliteGenerationsType generations;
+    struct ufsSqliteStruct *owner;  /* The instance a reader reads, or NULL.  */
+    uint64_t removedAreas;          /* Areas removed, or seen removed.        */
 } ufsSqliteStruct;
 
 static const char *UFS_SQL_TEXT[ NUM_UFS_STATEMENTS + 2 ] = {
 
-    /* Schema command:                                                        */
-    "CREATE TABLE IF NOT EXISTS ufsStorage(id INTEGER PRIMARY KEY,"
+    /* Schema command, sorters and temp tables must not spill into files:     */
+    "PRAGMA temp_store = MEMORY;"
+    "CREATE TABLE IF NOT EXISTS ufsStorage(id INTEGER PRIMARY KEY AUTOINCREMENT,"
                                           "name TEXT NOT NULL,"
                                           "parent INTEGER,"
-                                          "type INTEGER );"
+                                          "type INTEGER,"
+                                          "base INTEGER NOT NULL DEFAULT 0 );"
     "CREATE TABLE IF NOT EXISTS ufsAreas(id INTEGER PRIMARY KEY,"
-                                         "name TEXT NOT NULL );"
-    "CREATE TABLE IF NOT EXISTS ufsMappings(id INTEGER PRIMARY KEY,"
-                                           "areaId INTEGER,"
-                                           "storageId INTEGER,"
+                                         "name TEXT NOT NULL,"
+                                         "source INTEGER );"
+    "CREATE TABLE IF NOT EXISTS ufsMappings(areaId INTEGER NOT NULL,"
+                                           "storageId INTEGER NOT NULL,"
+                                           "removed INTEGER NOT NULL DEFAULT 0,"
+                                           "PRIMARY KEY (areaId, storageId),"
                                            "FOREIGN KEY (areaId) REFERENCES ufsAreas(id),"
-                                           "FOREIGN KEY (storageId) REFERENCES ufsStorage(id) );"
+                                           "FOREIGN KEY (storageId) REFERENCES ufsStorage(id) ) "
+                                           "WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS ufsExtents(areaId INTEGER NOT NULL,"
+                                          "storageId INTEGER NOT NULL,"
+                                          "extent INTEGER NOT NULL,"
+                                          "PRIMARY KEY (areaId, storageId, extent) ) "
+                                          "WITHOUT ROWID;"
+    "CREATE TABLE IF NOT EXISTS ufsAttributes(storageId INTEGER PRIMARY KEY,"
+                                             "mode INTEGER,"
+                                             "size INTEGER,"
+                                             "mtime INTEGER,"
+                                             "ctime INTEGER,"
+                                             "nlink INTEGER,"
+                                             "uid INTEGER,"
+                                             "gid INTEGER,"
+                                             "generation INTEGER,"
+                                             "FOREIGN KEY (storageId) REFERENCES ufsStorage(id) );"
+    "CREATE TABLE IF NOT EXISTS ufsMeta(key TEXT PRIMARY KEY,"
+                                       "value INTEGER );"
+    "CREATE INDEX IF NOT EXISTS ufsStorageByParent ON ufsStorage(parent, name);"
+    "CREATE INDEX IF NOT EXISTS ufsMappingsByStorage ON ufsMappings(storageId, removed);"
+    "CREATE INDEX IF NOT EXISTS ufsAreasBySource ON ufsAreas(source);"
+    "CREATE INDEX IF NOT EXISTS ufsStorageStale ON ufsStorage(id) where base = 2;"
+    "CREATE TRIGGER IF NOT EXISTS ufsDeleteExtents AFTER DELETE ON ufsMappings "
+        "BEGIN DELETE FROM ufsExtents where areaId = old.areaId and storageId = old.storageId; END;"
+    "CREATE TRIGGER IF NOT EXISTS ufsHideExtents AFTER UPDATE OF removed ON ufsMappings "
+        "WHEN new.removed != 0 "
+        "BEGIN DELETE FROM ufsExtents where areaId = old.areaId and storageId = old.storageId; END;"
+    "CREATE TEMP TABLE IF NOT EXISTS ufsKeep(id INTEGER PRIMARY KEY);"
+    "CREATE TEMP TABLE IF NOT EXISTS ufsCollapseAreas(id INTEGER PRIMARY KEY,"
+                                                     "position INTEGER NOT NULL );"
+    "CREATE TEMP TABLE IF NOT EXISTS ufsCollapse(storageId INTEGER PRIMARY KEY,"
+                                                "removed INTEGER NOT NULL );"
+    "CREATE TEMP TABLE IF NOT EXISTS ufsMerge(storageId INTEGER NOT NULL,"
+                                            "extent INTEGER NOT NULL,"
+                                            "PRIMARY KEY (storageId, extent) ) "
+                                            "WITHOUT ROWID;"
     ,
 
     /* Insert into the storage table:                                         */
     "INSERT INTO ufsStorage (name, parent, type) VALUES (?, ?, ?);",
 
     /* Query storage by name, parent, type:                                   */
-    "SELECT id from ufsStorage where name = ? and parent = ? and type = ?;",
+    "SELECT id, base from ufsStorage where name = ? and parent = ? and type = ?;",
 
     /* Query storage by id:                                                   */
-    "SELECT id from ufsStorage where id = ?;",
+    "SELECT id, type, parent, name from ufsStorage where id = ?;",
 
     /* Query storage by id, type:                                             */
-    "SELECT id from ufsStorage where id = ? and type = ?;",
+    "SELECT id, parent from ufsStorage where id = ? and type = ?;",
 
     /* Insert into the area table:                                            */
     "INSERT INTO ufsAreas (name) VALUES (?);",
@@ -69,19 +281,472 @@ static const char *UFS_SQL_TEXT[ NUM_UFS_STATEMENTS + 2 ] = {
     "SELECT id from ufsAreas where name = ?;",
 
     /* Query areas by id:                                                     */
-    "SELECT id from ufsAreas where id = ?;",
+    "SELECT id, source from ufsAreas where id = ?;",
+
+    /* Insert into mappings, or revive a mapping removed in a clone:          */
+    "INSERT INTO ufsMappings (areaId, storageId, removed) VALUES (?, ?, 0) "
+    "ON CONFLICT (areaId, storageId) DO UPDATE SET removed = 0;",
+
+    /* Query mappings by IDs, following the clone chain of the area:          */
+    "WITH RECURSIVE chain(id, depth) AS (SELECT ?1, 0 "
+        "UNION ALL SELECT a.source, c.depth + 1 FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL) "
+    "SELECT m.removed, c.id from chain c JOIN ufsMappings m "
+        "ON m.areaId = c.id and m.storageId = ?2 ORDER BY c.depth LIMIT 1;",
+
+    /* Query a mapping by IDs, for areas that aren't clones:                  */
+    "SELECT removed from ufsMappings where areaId = ? and storageId = ?;",
+
+    /* Transaction control:                                                   */
+    "BEGIN;",
+    "COMMIT;",
+    "ROLLBACK;",
+
+    /* Query whether any storage under a directory is explicitly mapped:      */
+    "WITH RECURSIVE subtree(id) AS (SELECT ? "
+        "UNION ALL SELECT s.id FROM ufsStorage s JOIN subtree t ON s.parent = t.id) "
+    "SELECT storageId from ufsMappings where storageId IN subtree and removed = 0 LIMIT 1;",
+
+    /* Delete all mappings of storage under a directory:                      */
+    "WITH RECURSIVE subtree(id) AS (SELECT ? "
+        "UNION ALL SELECT s.id FROM ufsStorage s JOIN subtree t ON s.parent = t.id) "
+    "DELETE FROM ufsMappings where storageId IN subtree;",
+
+    /* Delete a directory and all storage under it:                           */
+    "WITH RECURSIVE subtree(id) AS (SELECT ? "
+        "UNION ALL SELECT s.id FROM ufsStorage s JOIN subtree t ON s.parent = t.id) "
+    "DELETE FROM ufsStorage where id IN subtree;",
+
+    /* Query whether storage is an ancestor of (or is) a directory:           */
+    "WITH RECURSIVE ancestors(id) AS (SELECT ? "
+        "UNION ALL SELECT s.parent FROM ufsStorage s JOIN ancestors a ON s.id = a.id) "
+    "SELECT id from ancestors where id = ?;",
+
+    /* Update the parent and name of storage:                                 */
+    "UPDATE ufsStorage SET parent = ?, name = ? where id = ?;",
+
+    /* Insert or replace attributes:                                          */
+    "INSERT OR REPLACE INTO ufsAttributes (storageId, mode, size, mtime, ctime,"
+                                          "nlink, uid, gid, generation) "
+    "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);",
+
+    /* Query attributes by storage id:                                        */
+    "SELECT mode, size, mtime, ctime, nlink, uid, gid, generation "
+    "from ufsAttributes where storageId = ?;",
+
+    /* Delete attributes by storage id:                                       */
+    "DELETE FROM ufsAttributes where storageId = ?;",
+
+    /* Delete the attributes of all storage under a directory:                */
+    "WITH RECURSIVE subtree(id) AS (SELECT ? "
+        "UNION ALL SELECT s.id FROM ufsStorage s JOIN subtree t ON s.parent = t.id) "
+    "DELETE FROM ufsAttributes where storageId IN subtree;",
+
+    /* Insert a clone into the area table:                                    */
+    "INSERT INTO ufsAreas (name, source) VALUES (?, ?);",
+
+    /* Pin the current state of a mapping in the clones of an area:           */
+    "INSERT INTO ufsMappings (areaId, storageId, removed) "
+    "SELECT a.id, ?2, ?3 from ufsAreas a where a.source = ?1 and NOT EXISTS "
+        "(SELECT 1 from ufsMappings m where m.areaId = a.id and m.storageId = ?2);",
+
+    /* Mark a mapping as removed in a clone:                                  */
+    "INSERT INTO ufsMappings (areaId, storageId, removed) VALUES (?, ?, 1) "
+    "ON CONFLICT (areaId, storageId) DO UPDATE SET removed = 1;",
+
+    /* Delete a mapping by IDs:                                               */
+    "DELETE FROM ufsMappings where areaId = ? and storageId = ?;",
+
+    /* Query a meta value by key:                                             */
+    "SELECT value from ufsMeta where key = ?;",
+
+    /* Insert or replace a meta value:                                        */
+    "INSERT OR REPLACE INTO ufsMeta (key, value) VALUES (?, ?);",
+
+    /* Insert storage that exists in BASE:                                    */
+    "INSERT INTO ufsStorage (name, parent, type, base) VALUES (?, ?, ?, 1);",
+
+    /* Mark storage as existing in BASE:                                      */
+    "UPDATE ufsStorage SET base = 1 where id = ?;",
+
+    /* Mark the BASE storage under a directory as stale, except one:          */
+    "WITH RECURSIVE subtree(id) AS (SELECT ?1 "
+        "UNION ALL SELECT s.id FROM ufsStorage s JOIN subtree t ON s.parent = t.id) "
+    "UPDATE ufsStorage SET base = 2 where base = 1 and id IN subtree and id != ?2;",
+
+    /* Clear the stale storage that must be kept:                             */
+    "DELETE FROM ufsKeep;",
+
+    /* Find stale storage that is mapped or holds storage that isn't stale:   */
+    "INSERT INTO ufsKeep (id) "
+    "WITH RECURSIVE keep(id) AS ("
+        "SELECT m.storageId FROM ufsMappings m JOIN ufsStorage s ON s.id = m.storageId "
+            "where m.removed = 0 and s.base = 2 "
+        "UNION SELECT c.parent FROM ufsStorage c where c.base != 2 and c.parent IN "
+            "(SELECT id FROM ufsStorage where base = 2) "
+        "UNION SELECT p.id FROM keep k JOIN ufsStorage c ON c.id = k.id "
+            "JOIN ufsStorage p ON p.id = c.parent where p.base = 2) "
+    "SELECT id FROM keep;",
+
+    /* Delete the mappings of stale storage that isn't kept:                  */
+    "DELETE FROM ufsMappings where storageId IN "
+        "(SELECT id FROM ufsStorage where base = 2 and id NOT IN ufsKeep);",
+
+    /* Delete the attributes of stale storage that isn't kept:                */
+    "DELETE FROM ufsAttributes where storageId IN "
+        "(SELECT id FROM ufsStorage where base = 2 and id NOT IN ufsKeep);",
+
+    /* Delete stale storage that isn't kept:                                  */
+    "DELETE FROM ufsStorage where base = 2 and id NOT IN ufsKeep;",
+
+    /* Whatever stale storage is left is no longer in BASE:                   */
+    "UPDATE ufsStorage SET base = 0 where base = 2;",
+
+    /* Count the mappings of an area, including those of its clone chain:     */
+    "WITH RECURSIVE chain(id) AS (SELECT ? "
+        "UNION ALL SELECT a.source FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL) "
+    "SELECT count(*) from chain c JOIN ufsMappings m ON m.areaId = c.id;",
+
+    /* Query the mappings of an area, including those of its clone chain:     */
+    "WITH RECURSIVE chain(id) AS (SELECT ? "
+        "UNION ALL SELECT a.source FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL) "
+    "SELECT m.storageId from chain c JOIN ufsMappings m ON m.areaId = c.id;",
+
+    /* Query every mapping of storage, along with whether it's imported:      */
+    "SELECT s.base, m.areaId, m.removed from ufsStorage s "
+        "LEFT JOIN ufsMappings m ON m.storageId = s.id where s.id = ?;",
+
+    /* Clear the areas being collapsed:                                       */
+    "DELETE FROM ufsCollapseAreas;",
+
+    /* Add an area to be collapsed, at its position in the view:              */
+    "INSERT OR IGNORE INTO ufsCollapseAreas (id, position) VALUES (?, ?);",
+
+    /* Clear the storage being collapsed:                                     */
+    "DELETE FROM ufsCollapse;",
+
+    /* Collect the storage contained or whited out in any of the areas being  */
+    /* collapsed, the closest row along the clone chain of each area decides  */
+    /* what the area holds, and the first area in the view that holds a       */
+    /* mapping or a whiteout decides what's collected:                        */
+    "INSERT OR IGNORE INTO ufsCollapse (storageId, removed) "
+    "WITH RECURSIVE chain(root, position, id, depth) AS "
+        "(SELECT id, position, id, 0 FROM ufsCollapseAreas "
+        "UNION ALL SELECT c.root, c.position, a.source, c.depth + 1 FROM ufsAreas a "
+        "JOIN chain c ON a.id = c.id where a.source IS NOT NULL), "
+    "closest(storageId, position, removed, depth) AS "
+        "(SELECT m.storageId, c.position, m.removed, min(c.depth) "
+        "from chain c JOIN ufsMappings m ON m.areaId = c.id GROUP BY c.root, m.storageId), "
+    "first(storageId, removed, position) AS (SELECT storageId, removed, min(position) "
+        "from closest where removed != 1 GROUP BY storageId) "
+    "SELECT storageId, removed from first;",
+
+    /* Drop the collected storage an area already holds the same way:         */
+    "WITH RECURSIVE chain(id, depth) AS (SELECT ?, 0 "
+        "UNION ALL SELECT a.source, c.depth + 1 FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL), "
+    "closest(storageId, removed, depth) AS (SELECT m.storageId, m.removed, min(c.depth) "
+        "from chain c JOIN ufsMappings m ON m.areaId = c.id GROUP BY m.storageId) "
+    "DELETE FROM ufsCollapse where (storageId, removed) IN "
+        "(SELECT storageId, removed from closest);",
+
+    /* Clones of an area must keep what they saw of the collected storage,    */
+    /* nothing or a whiteout:                                                 */
+    "WITH RECURSIVE chain(id, depth) AS (SELECT ?1, 0 "
+        "UNION ALL SELECT a.source, c.depth + 1 FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL), "
+    "closest(storageId, removed, depth) AS (SELECT m.storageId, m.removed, min(c.depth) "
+        "from chain c JOIN ufsMappings m ON m.areaId = c.id "
+        "where m.storageId IN (SELECT storageId from ufsCollapse) GROUP BY m.storageId) "
+    "INSERT INTO ufsMappings (areaId, storageId, removed) "
+    "SELECT a.id, c.storageId, "
+        "coalesce((SELECT removed from closest where storageId = c.storageId), 1) "
+        "from ufsAreas a JOIN ufsCollapse c where a.source = ?1 "
+    "ON CONFLICT (areaId, storageId) DO NOTHING;",
+
+    /* Map or white out the collected storage in an area, replacing what the  */
+    /* area held of it:                                                       */
+    "INSERT INTO ufsMappings (areaId, storageId, removed) "
+    "SELECT ?, storageId, removed from ufsCollapse where true "
+    "ON CONFLICT (areaId, storageId) DO UPDATE SET removed = excluded.removed;",
+
+    /* Mark the collected storage as existing in BASE, or not if it was       */
+    /* whited out:                                                            */
+    "UPDATE ufsStorage SET base = (SELECT removed = 0 from ufsCollapse "
+        "where storageId = ufsStorage.id) "
+    "where id IN (SELECT storageId from ufsCollapse);",
+
+    /* Query the children of a directory within a range of names, of the      */
+    /* types in a mask, optionally matching a glob:                           */
+    "SELECT id from ufsStorage where parent = ?1 and name >= ?2 and name < ?3 "
+        "and ( ?4 >> type ) & 1 and ( ?5 IS NULL or name GLOB ?5 );",
+
+    /* Query a range of storage along with whether it's imported:             */
+    "SELECT id, base from ufsStorage where id BETWEEN ? and ? ORDER BY id;",
+
+    /* Query every mapping of a range of storage, in the order of the storage:*/
+    "SELECT storageId, areaId, removed from ufsMappings "
+        "where storageId BETWEEN ? and ? ORDER BY storageId;",
+
+    /* Query every directory in a subtree, including its root:                */
+    "WITH RECURSIVE subtree(id, type) AS (SELECT ?, 1 "
+        "UNION ALL SELECT s.id, s.type FROM ufsStorage s JOIN subtree t ON s.parent = t.id "
+        "where t.type = 1) "
+    "SELECT id from subtree where type = 1;",
+
+    /* Query the directories whose listing a sweep of stale storage changes:  */
+    "SELECT parent from ufsStorage where base = 2 "
+    "UNION SELECT id from ufsStorage where base = 2 and type = 1;",
+
+    /* Query the directories that hold the storage being collapsed:           */
+    "SELECT DISTINCT s.parent from ufsCollapse c "
+        "JOIN ufsStorage s ON s.id = c.storageId;",
+
+    /* Insert a whiteout, replacing the row of the area if there's one:       */
+    "INSERT INTO ufsMappings (areaId, storageId, removed) VALUES (?, ?, 2) "
+    "ON CONFLICT (areaId, storageId) DO UPDATE SET removed = 2;",
+
+    /* Insert the extents of a mapping from ?3 to ?4, both included:          */
+    "INSERT OR IGNORE INTO ufsExtents (areaId, storageId, extent) "
+    "WITH RECURSIVE range(extent) AS (SELECT ?3 "
+        "UNION ALL SELECT extent + 1 FROM range where extent < ?4) "
+    "SELECT ?1, ?2, extent from range;",
+
+    /* Query the extents of a mapping from ?3 to ?4, both included:           */
+    "SELECT extent from ufsExtents where areaId = ? and storageId = ? "
+        "and extent BETWEEN ? and ?;",
+
+    /* Copy the extents of storage from the area holding its row into one     */
+    /* that inherited it:                                                     */
+    "INSERT OR IGNORE INTO ufsExtents (areaId, storageId, extent) "
+    "SELECT ?1, ?2, extent from ufsExtents where areaId = ?3 and storageId = ?2;",
 
-    /* Insert into mappings:                                                  */
-    "INSERT INTO ufsMappings (areaId, storageId) VALUES (?, ?);",
+    /* Pin the extents a mapping has in the clones that inherit it, along     */
+    /* with the row that holds them:                                          */
+    "INSERT OR IGNORE INTO ufsExtents (areaId, storageId, extent) "
+    "SELECT a.id, ?2, e.extent from ufsAreas a JOIN ufsExtents e "
+        "ON e.areaId = ?3 and e.storageId = ?2 where a.source = ?1 and NOT EXISTS "
+        "(SELECT 1 from ufsMappings m where m.areaId = a.id and m.storageId = ?2);",
 
-    /* Query mappings by IDs:                                                 */
-    "SELECT id from ufsMappings where areaId = ? and storageId = ?;",
+    /* Delete the extents of a mapping, which then holds the whole storage:   */
+    "DELETE FROM ufsExtents where areaId = ? and storageId = ?;",
+
+    /* Clear the extents being merged:                                        */
+    "DELETE FROM ufsMerge;",
+
+    /* Query the storage held by extents along the clone chains of the areas  */
+    /* being collapsed, or of the last area:                                  */
+    "WITH RECURSIVE chain(id) AS "
+        "(SELECT id FROM (SELECT id FROM ufsCollapseAreas UNION SELECT ?) "
+        "UNION SELECT a.source FROM ufsAreas a JOIN chain c ON a.id = c.id "
+        "where a.source IS NOT NULL) "
+    "SELECT DISTINCT storageId from ufsExtents where extent = -1 and areaId IN chain;",
+
+    /* Add the extents of a mapping to those being merged:                    */
+    "INSERT OR IGNORE INTO ufsMerge (storageId, extent) "
+    "SELECT storageId, extent from ufsExtents where areaId = ?1 and storageId = ?2;",
+
+    /* Drop the extents being merged of storage:                              */
+    "DELETE FROM ufsMerge where storageId = ?;",
+
+    /* Give an area the merged extents of storage:                            */
+    "INSERT OR IGNORE INTO ufsExtents (areaId, storageId, extent) "
+    "SELECT ?1, storageId, extent from ufsMerge where storageId = ?2;",
+
+    /* Query whether an area has a clone:                                     */
+    "SELECT id from ufsAreas where source = ? LIMIT 1;",
+
+    /* Query whether an area maps any storage:                                */
+    "SELECT storageId from ufsMappings where areaId = ? and removed = 0 LIMIT 1;",
+
+    /* Delete every row of an area:                                           */
+    "DELETE FROM ufsMappings where areaId = ?;",
+
+    /* Delete an area by id:                                                  */
+    "DELETE FROM ufsAreas where id = ?;",
+
+    /* Query whether a directory contains any storage:                        */
+    "SELECT id from ufsStorage where parent = ? LIMIT 1;",
 
     NULL
 };
 
+static inline void *mapImage( size_t minimum, size_t *reserved );
+static inline ufsStatusType checkImageRoom( ufsSqliteStruct *ufsSqlite );
+static inline ufsStatusType openImageDb( void *image,
+                                         size_t size,
+                                         size_t capacity,
+                                         unsigned flags,
+                                         sqlite3 **db );
 static inline ufsSqliteStruct *prepareSqliteDb( sqlite3 *db );
+static inline int stepSqliteStatement( ufsSqliteStruct *ufsSqlite,
+                                       enum ufsSqliteStatementType statement );
+static inline ufsStatusType queryAttributes( ufsSqliteStruct *ufsSqlite,
+                                             ufsIdentifierType storage,
+                                             ufsAttributesType *attributes );
+static inline ufsStatusType queryStorage( ufsSqliteStruct *ufsSqlite,
+                                          ufsIdentifierType storage,
+                                          ufsStorageInfoType *info );
+static inline int pinCloneMappings( ufsSqliteStruct *ufsSqlite,
+                                    ufsIdentifierType area,
+                                    ufsIdentifierType storage,
+                                    int removed );
+static inline int queryMappingRow( ufsSqliteStruct *ufsSqlite,
+                                   ufsIdentifierType area,
+                                   ufsIdentifierType storage,
+                                   ufsIdentifierType *holder );
+static inline int isPartialMapping( ufsSqliteStruct *ufsSqlite,
+                                    ufsIdentifierType holder,
+                                    ufsIdentifierType storage );
+static inline int planExtentMerge( ufsSqliteStruct *ufsSqlite,
+                                   ufsViewSpanType view,
+                                   ufsIdentifierType **merges,
+                                   size_t *numMerges );
+static inline int applyExtentMerge( ufsSqliteStruct *ufsSqlite,
+                                    ufsIdentifierType last,
+                                    const ufsIdentifierType *merges,
+                                    size_t numMerges );
+static inline ufsIdentifierType importEntry( ufsSqliteStruct *ufsSqlite,
+                                             ufsIdentifierType parent,
+                                             const char *name,
+                                             int type,
+                                             int merge,
+                                             const ufsAttributesType *attributes,
+                                             int *merged );
+static inline ufsStatusType importChunk( ufsImportChunkType *chunk,
+                                         void *sinkData );
+static inline ufsStatusType sweepStaleBase( ufsSqliteStruct *ufsSqlite );
+static inline ufsStatusType removeStorage( ufsSqliteStruct *ufsSqlite,
+                                           ufsIdentifierType storage,
+                                           int type );
+static inline ufsSqliteFilterType *getAreaFilter( ufsSqliteStruct *ufsSqlite,
+                                                 ufsIdentifierType area );
+static inline void addToAreaFilter( ufsSqliteStruct *ufsSqlite,
+                                    ufsIdentifierType area,
+                                    ufsIdentifierType storage );
+static inline void removeFromAreaFilter( ufsSqliteStruct *ufsSqlite,
+                                         ufsIdentifierType area );
+static inline void dropAreaFilter( ufsSqliteStruct *ufsSqlite,
+                                   ufsIdentifierType area );
+static inline void followRemovedAreas( ufsSqliteStruct *ufsSqlite );
+static inline ufsViewSpanType viewSpanOf( ufsViewType view );
+static inline int isBadViewSpan( ufsViewSpanType view );
+static inline ufsStatusType validateView( ufsSqliteStruct *ufsSqlite,
+                                          ufsViewSpanType view );
+static inline ufsStatusType indexView( ufsSqliteStruct *ufsSqlite,
+                                       ufsViewSpanType view );
+static inline int64_t findViewEntry( const ufsSqliteViewIndexType *index,
+                                     ufsIdentifierType area );
+static inline ufsStatusType useView( ufsSqliteStruct *ufsSqlite,
+                                     ufsViewSpanType view );
+static inline ufsIdentifierType resolveInView( ufsSqliteStruct *ufsSqlite,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType storage );
+static inline ufsStatusType addResolveMapping( ufsSqliteStruct *ufsSqlite,
+                                               ufsSqliteResolveType *resolve,
+                                               ufsIdentifierType area,
+                                               int removed );
+static inline ufsIdentifierType pickResolved( ufsSqliteStruct *ufsSqlite,
+                                              ufsViewSpanType view,
+                                              const ufsSqliteResolveType *resolve );
+static inline ufsStatusType resolveMany( ufsSqliteStruct *ufsSqlite,
+                                         ufsViewSpanType view,
+                                         const ufsIdentifierType *storages,
+                                         size_t n,
+                                         ufsIdentifierType *areasOut,
+                                         ufsStatusType *statusOut );
+static inline ufsStatusType forgetArea( ufsIdentifierType storage,
+                                        ufsIdentifierType area,
+                                        uint64_t currEntry,
+                                        uint64_t numEntries,
+                                        void *userData );
+static inline int compareBatchEntries( const void *a, const void *b );
+static inline size_t filterPrefixLength( const ufsDirFilterType *filter );
+static inline void recordChange( ufsSqliteStruct *ufsSqlite,
+                                 uint32_t type,
+                                 ufsIdentifierType storage,
+                                 ufsIdentifierType parent,
+                                 ufsIdentifierType area,
+                                 ufsIdentifierType from );
+static inline ufsSqliteGenerationType *findGeneration(
+                                const ufsSqliteGenerationsType *generations,
+                                ufsIdentifierType directory );
+static inline void bumpGeneration( ufsSqliteStruct *ufsSqlite,
+                                   ufsIdentifierType directory );
+static inline int bumpGenerations( ufsSqliteStruct *ufsSqlite,
+                                   enum ufsSqliteStatementType statement,
+                                   ufsIdentifierType argument );
+static inline ufsStatusType writeImageFile( const char *path,
+                                            const unsigned char *data,
+                                            sqlite3_int64 size );
+
+
+ufsStatusType openImageDb( void *image,
+                           size_t size,
+                           size_t capacity,
+                           unsigned flags,
+                           sqlite3 **db )
+{
+    int res;
+
+    res = sqlite3_open( ":memory:", db );
+    if ( !*db )
+        return UFS_OUT_OF_MEMORY;
+
+    /* The database uses the memory in place, it's not copied or parsed.      */
+    if ( res == SQLITE_OK )
+        res = sqlite3_deserialize( *db, "main", image, size, capacity, flags );
+
+    if ( res != SQLITE_OK ) {
+        sqlite3_close( *db );
+        return UFS_UNKNOWN_ERROR;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+void *mapImage( size_t minimum, size_t *reserved )
+{
+    void *image;
+    size_t size;
+
+    /* Only pages that get written are ever backed by memory. Systems that    */
+    /* refuse to overcommit that much get the largest half that they grant.   */
+    for ( size = UFS_IMAGE_MAX_SIZE; ; size /= 2 ) {
+        if ( size < minimum )
+            size = minimum;
+        image = mmap( NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+        if ( image != MAP_FAILED ) {
+            *reserved = size;
+            return image;
+        }
+        if ( size == minimum )
+            return NULL;
+    }
+}
+
+ufsStatusType checkImageRoom( ufsSqliteStruct *ufsSqlite )
+{
+    sqlite3_int64 size;
+
+    /* Readers never write. The database can't grow past the reservation, so  */
+    /* calls are refused while they can still fail cleanly.                   */
+    if ( !ufsSqlite -> image )
+        return UFS_NO_ERROR;
+
+    sqlite3_serialize( ufsSqlite -> db, "main", &size,
+                       SQLITE_SERIALIZE_NOCOPY );
+    if ( size < 0 )
+        return UFS_UNKNOWN_ERROR;
 
+    if ( ufsSqlite -> imageCapacity - size < UFS_SQLITE_IMAGE_HEADROOM )
+        return UFS_OUT_OF_MEMORY;
+
+    return UFS_NO_ERROR;
+}
 
 struct ufsSqliteStruct *prepareSqliteDb( sqlite3 *db )
 {
@@ -95,6 +760,21 @@ struct ufsSqliteStruct *prepareSqliteDb( sqlite3 *db )
     }
 
     ufsSqlite -> db = db;
+    ufsSqlite -> attributesGeneration = 0;
+    ufsSqlite -> image = NULL;
+    ufsSqlite -> imageCapacity = 0;
+    memset( ufsSqlite -> filters, 0, sizeof( ufsSqlite -> filters ) );
+    ufsSqlite -> views = 0;
+    memset( &ufsSqlite -> viewIndex, 0, sizeof( ufsSqlite -> viewIndex ) );
+    ufsSqlite -> candidates = NULL;
+    ufsSqlite -> maxCandidates = 0;
+    ufsSqlite -> batch = NULL;
+    ufsSqlite -> maxBatch = 0;
+    ufsSqlite -> changes = NULL;
+    ufsSqlite -> nextChange = 0;
+    memset( &ufsSqlite -> generations, 0, sizeof( ufsSqlite -> generations ) );
+    ufsSqlite -> owner = NULL;
+    ufsSqlite -> removedAreas = 0;
     res = sqlite3_exec( db, UFS_SQL_TEXT[ 0 ], NULL, NULL, NULL );
     if ( res != SQLITE_OK ) {
         free( ufsSqlite );
@@ -115,150 +795,3554 @@ struct ufsSqliteStruct *prepareSqliteDb( sqlite3 *db )
         }
     }
 
+    /* Generations keep increasing across images.                             */
+    sqlite3_bind_text( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_META ],
+                       1, UFS_SQLITE_META_GENERATION, -1, SQLITE_STATIC );
+    res = sqlite3_step( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_META ] );
+    if ( res == SQLITE_ROW )
+        ufsSqlite -> attributesGeneration = sqlite3_column_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_META ], 0 );
+    sqlite3_reset( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_META ] );
+
     ufsErrno = UFS_NO_ERROR;
     return ufsSqlite;
 }
 
-ufsType ufsInit()
+int stepSqliteStatement( ufsSqliteStruct *ufsSqlite,
+                         enum ufsSqliteStatementType statement )
 {
-    ufsSqliteStruct *ret;
-    sqlite3 *db;
     int res;
 
-    res = sqlite3_open( ":memory:", &db );
-    if ( !db ) {
-        ufsErrno = UFS_OUT_OF_MEMORY;
-        return NULL;
-    }
+    /* Used for statements that take no arguments and yield no rows.          */
+    sqlite3_reset( ufsSqlite -> statements[ statement ] );
+    res = sqlite3_step( ufsSqlite -> statements[ statement ] );
+    sqlite3_reset( ufsSqlite -> statements[ statement ] );
+    return res;
+}
 
-    if ( res != SQLITE_OK ) {
-        sqlite3_close( db );
-        ufsErrno = UFS_UNKNOWN_ERROR;
-        return NULL;
-    }
+ufsStatusType queryAttributes( ufsSqliteStruct *ufsSqlite,
+                               ufsIdentifierType storage,
+                               ufsAttributesType *attributes )
+{
+    int res;
+    sqlite3_stmt *statement;
 
-    ret = prepareSqliteDb( db );
-    if ( !ret ) {
-        sqlite3_close( db );
-        return NULL;
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_ATTRIBUTES_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    res = sqlite3_step( statement );
+    if ( res == SQLITE_DONE )
+        return UFS_ATTRIBUTES_DO_NOT_EXIST;
+
+    if ( res != SQLITE_ROW )
+        return UFS_UNKNOWN_ERROR;
+
+    attributes -> mode = sqlite3_column_int64( statement, 0 );
+    attributes -> size = sqlite3_column_int64( statement, 1 );
+    attributes -> mtime = sqlite3_column_int64( statement, 2 );
+    attributes -> ctime = sqlite3_column_int64( statement, 3 );
+    attributes -> nlink = sqlite3_column_int64( statement, 4 );
+    attributes -> uid = sqlite3_column_int64( statement, 5 );
+    attributes -> gid = sqlite3_column_int64( statement, 6 );
+    attributes -> generation = sqlite3_column_int64( statement, 7 );
+    sqlite3_reset( statement );
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType queryStorage( ufsSqliteStruct *ufsSqlite,
+                            ufsIdentifierType storage,
+                            ufsStorageInfoType *info )
+{
+    const unsigned char *name;
+    sqlite3_stmt *statement;
+    int res;
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    res = sqlite3_step( statement );
+    if ( res != SQLITE_ROW ) {
+        sqlite3_reset( statement );
+        return res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
     }
-    ufsErrno = UFS_NO_ERROR;
-    return ret;
+
+    info -> type = sqlite3_column_int( statement, 1 );
+    info -> parent = sqlite3_column_int64( statement, 2 );
+    name = sqlite3_column_text( statement, 3 );
+    snprintf( info -> name, sizeof( info -> name ), "%s",
+              name ? ( const char * )name : "" );
+    sqlite3_reset( statement );
+    return UFS_NO_ERROR;
 }
 
-void ufsDestroy( ufsType ufs )
+int pinCloneMappings( ufsSqliteStruct *ufsSqlite,
+                      ufsIdentifierType area,
+                      ufsIdentifierType storage,
+                      int removed )
 {
-    int i;
-    ufsSqliteStruct *ufsSqlite;
-    if ( !ufs ) {
-        ufsErrno = UFS_NO_ERROR;
-        return;
+    ufsIdentifierType holder;
+    sqlite3_stmt *statement;
+    int res;
+
+    /* A mapping held by extents is pinned along with them.                   */
+    if ( !removed ) {
+        res = queryMappingRow( ufsSqlite, area, storage, &holder );
+        if ( res < 0 )
+            return SQLITE_ERROR;
+
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_CLONE_EXTENTS ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, area );
+        sqlite3_bind_int64( statement, 2, storage );
+        sqlite3_bind_int64( statement, 3, res ? area : holder );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            return res;
     }
 
-    ufsSqlite = ufs;
-    for (i = 0; i < NUM_UFS_STATEMENTS; i++)
-        sqlite3_finalize( ufsSqlite -> statements[ i ] );
-    sqlite3_close( ufsSqlite -> db );
-    free( ufsSqlite );
-    ufsErrno = UFS_NO_ERROR;
+    /* Clones that inherit the mapping from this area get their own copy of   */
+    /* its current state, so changing it here doesn't leak into them.         */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_CLONE_MAPPINGS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    sqlite3_bind_int( statement, 3, removed );
+    return sqlite3_step( statement );
 }
 
-ufsIdentifierType ufsAddDirectory( ufsType ufs,
-                                   ufsIdentifierType parent,
-                                   const char *name )
+int queryMappingRow( ufsSqliteStruct *ufsSqlite,
+                     ufsIdentifierType area,
+                     ufsIdentifierType storage,
+                     ufsIdentifierType *holder )
 {
-    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    int res, removed;
+
+    /* The row closest along the clone chain decides, 1 stands for no row.    */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    removed = res == SQLITE_ROW ? sqlite3_column_int( statement, 0 ) : 1;
+    *holder = res == SQLITE_ROW ? sqlite3_column_int64( statement, 1 ) : area;
+    sqlite3_reset( statement );
+    return res == SQLITE_ROW || res == SQLITE_DONE ? removed : -1;
+}
+
+int isPartialMapping( ufsSqliteStruct *ufsSqlite,
+                      ufsIdentifierType holder,
+                      ufsIdentifierType storage )
+{
+    sqlite3_stmt *statement;
     int res;
-    if ( !ufs || parent < 0 || !name ) {
-        ufsErrno = UFS_BAD_CALL;
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_EXTENT_RANGE ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, holder );
+    sqlite3_bind_int64( statement, 2, storage );
+    sqlite3_bind_int64( statement, 3, UFS_SQLITE_PARTIAL );
+    sqlite3_bind_int64( statement, 4, UFS_SQLITE_PARTIAL );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW && res != SQLITE_DONE )
         return -1;
-    }
 
-    ufsSqlite = ufs;
+    return res == SQLITE_ROW;
+}
 
-    /* Make sure parent is a directory if it's not ROOT.                      */
-    if ( parent > 0 ) {
-        sqlite3_reset(
-                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
-        sqlite3_clear_bindings(
-                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
-        sqlite3_bind_int(
-                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
-                1, parent );
-        sqlite3_bind_int(
-                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
-                2, UFS_STORAGE_TYPE_DIRECTORY );
-        res = sqlite3_step(
-                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
-        if ( res != SQLITE_ROW ) {
-            ufsErrno = UFS_PARENT_DOES_NOT_EXIST;
-            return -1;
+int planExtentMerge( ufsSqliteStruct *ufsSqlite,
+                     ufsViewSpanType view,
+                     ufsIdentifierType **merges,
+                     size_t *numMerges )
+{
+    ufsIdentifierType *storages, *grown, storage, holder;
+    size_t numStorages, maxStorages, i, j;
+    int res, removed, partial, seen, whole;
+    sqlite3_stmt *statement;
+
+    /* Only storage held by extents somewhere along the way can change, it's  */
+    /* collected first as walking it runs other statements.                   */
+    storages = NULL;
+    numStorages = 0;
+    maxStorages = 0;
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_COLLAPSE_EXTENTS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, view.areas[ view.count - 1 ] );
+    while ( ( res = sqlite3_step( statement ) ) == SQLITE_ROW ) {
+        if ( numStorages == maxStorages ) {
+            maxStorages = maxStorages ? maxStorages * 2 : 16;
+            grown = realloc( storages, maxStorages * sizeof( *storages ) );
+            if ( !grown ) {
+                res = SQLITE_NOMEM;
+                break;
+            }
+
+            storages = grown;
         }
-    }
 
-    /* Make sure it doesn't exist.                                            */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            3, UFS_STORAGE_TYPE_DIRECTORY );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    if ( res == SQLITE_ROW ) {
-        ufsErrno = UFS_ALREADY_EXISTS;
-        return -1;
+        storages[ numStorages++ ] = sqlite3_column_int64( statement, 0 );
     }
 
+    sqlite3_reset( statement );
+    if ( res == SQLITE_DONE )
+        res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_CLEAR_MERGE );
+
     if ( res != SQLITE_DONE ) {
-        ufsErrno = UFS_UNKNOWN_ERROR;
-        return -1;
+        free( storages );
+        return res;
     }
 
-    /* Finally, insert the directory into the db.                             */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            3, UFS_STORAGE_TYPE_DIRECTORY );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
-    if ( res != SQLITE_DONE ) {
-        ufsErrno = UFS_UNKNOWN_ERROR;
-        return -1;
+    /* The storage is read from the view like a view resolves it, down to     */
+    /* the first area that holds it whole. A whiteout reached before any area */
+    /* holds it keeps it out of the collapse.                                 */
+    *numMerges = 0;
+    for ( i = 0; i < numStorages; i++ ) {
+        storage = storages[ i ];
+        seen = 0;
+        whole = 0;
+        for ( j = 0; j < view.count; j++ ) {
+            removed = queryMappingRow( ufsSqlite, view.areas[ j ], storage,
+                                       &holder );
+            if ( removed < 0 )
+                goto fail;
+
+            if ( removed == 1 )
+                continue;
+
+            if ( removed == UFS_SQLITE_WHITEOUT ) {
+                whole = 1;
+                break;
+            }
+
+            partial = isPartialMapping( ufsSqlite, holder, storage );
+            if ( partial < 0 )
+                goto fail;
+
+            seen = 1;
+            whole = !partial;
+            if ( whole )
+                break;
+
+            statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_MERGE ];
+            sqlite3_reset( statement );
+            sqlite3_clear_bindings( statement );
+            sqlite3_bind_int64( statement, 1, holder );
+            sqlite3_bind_int64( statement, 2, storage );
+            res = sqlite3_step( statement );
+            sqlite3_reset( statement );
+            if ( res != SQLITE_DONE )
+                goto fail;
+        }
+
+        if ( !seen )
+            continue;
+
+        /* Nothing left in the merge of storage stands for holding it whole.  */
+        if ( whole ) {
+            statement = ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MERGE ];
+            sqlite3_reset( statement );
+            sqlite3_clear_bindings( statement );
+            sqlite3_bind_int64( statement, 1, storage );
+            res = sqlite3_step( statement );
+            sqlite3_reset( statement );
+            if ( res != SQLITE_DONE )
+                goto fail;
+        }
+
+        storages[ ( *numMerges )++ ] = storage;
     }
 
-    ufsErrno = UFS_NO_ERROR;
-    return sqlite3_last_insert_rowid( ufsSqlite -> db );
+    *merges = storages;
+    return SQLITE_DONE;
+
+fail:
+    free( storages );
+    return SQLITE_ERROR;
 }
 
-ufsIdentifierType ufsAddFile( ufsType ufs,
-                              ufsIdentifierType parent,     
-                              const char *name )
+int applyExtentMerge( ufsSqliteStruct *ufsSqlite,
+                      ufsIdentifierType last,
+                      const ufsIdentifierType *merges,
+                      size_t numMerges )
 {
-    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    size_t i;
     int res;
-    if ( !ufs || parent < 0 || !name ) {
-        ufsErrno = UFS_BAD_CALL;
+
+    for ( i = 0; i < numMerges; i++ ) {
+        res = pinCloneMappings( ufsSqlite, last, merges[ i ], 0 );
+        if ( res != SQLITE_DONE )
+            return res;
+
+        /* The area may have inherited the mapping, it gets its own.          */
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, last );
+        sqlite3_bind_int64( statement, 2, merges[ i ] );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            return res;
+
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_DELETE_EXTENTS_BY_IDS ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, last );
+        sqlite3_bind_int64( statement, 2, merges[ i ] );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            return res;
+
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_MERGE_INTO_AREA ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, last );
+        sqlite3_bind_int64( statement, 2, merges[ i ] );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            return res;
+    }
+
+    return SQLITE_DONE;
+}
+
+ufsIdentifierType importEntry( ufsSqliteStruct *ufsSqlite,
+                               ufsIdentifierType parent,
+                               const char *name,
+                               int type,
+                               int merge,
+                               const ufsAttributesType *attributes,
+                               int *merged )
+{
+    ufsIdentifierType id;
+    sqlite3_stmt *statement;
+    int res, base;
+
+    id = -1;
+    base = 0;
+    *merged = 0;
+
+    /* Only directories that existed before the import can already hold the   */
+    /* entry, everything under a new directory is new as well.                */
+    if ( merge ) {
+        statement =
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_text( statement, 1, name, -1, SQLITE_STATIC );
+        sqlite3_bind_int64( statement, 2, parent );
+        sqlite3_bind_int( statement, 3, type );
+        res = sqlite3_step( statement );
+        if ( res == SQLITE_ROW ) {
+            id = sqlite3_column_int64( statement, 0 );
+            base = sqlite3_column_int( statement, 1 );
+            *merged = 1;
+        } else if ( res != SQLITE_DONE ) {
+            return -1;
+        }
+        sqlite3_reset( statement );
+    }
+
+    if ( *merged ) {
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_MARK_STORAGE_BASE ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, id );
+    } else {
+        statement =
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_BASE_STORAGE ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_text( statement, 1, name, -1, SQLITE_STATIC );
+        sqlite3_bind_int64( statement, 2, parent );
+        sqlite3_bind_int( statement, 3, type );
+    }
+
+    if ( sqlite3_step( statement ) != SQLITE_DONE )
         return -1;
+
+    if ( !*merged ) {
+        id = sqlite3_last_insert_rowid( ufsSqlite -> db );
+        if ( type == UFS_STORAGE_TYPE_DIRECTORY )
+            bumpGeneration( ufsSqlite, id );
     }
 
-    ufsSqlite = ufs;
+    /* Storage that was already in BASE, or found again by a sync, doesn't    */
+    /* change what its parent lists.                                          */
+    if ( !base )
+        bumpGeneration( ufsSqlite, parent );
+
+    if ( !attributes )
+        return id;
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_ATTRIBUTES ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, id );
+    sqlite3_bind_int64( statement, 2, attributes -> mode );
+    sqlite3_bind_int64( statement, 3, attributes -> size );
+    sqlite3_bind_int64( statement, 4, attributes -> mtime );
+    sqlite3_bind_int64( statement, 5, attributes -> ctime );
+    sqlite3_bind_int64( statement, 6, attributes -> nlink );
+    sqlite3_bind_int64( statement, 7, attributes -> uid );
+    sqlite3_bind_int64( statement, 8, attributes -> gid );
+    sqlite3_bind_int64( statement, 9, ++ufsSqlite -> attributesGeneration );
+    if ( sqlite3_step( statement ) != SQLITE_DONE )
+        return -1;
+
+    return id;
+}
+
+ufsStatusType importChunk( ufsImportChunkType *chunk, void *sinkData )
+{
+    ufsImportEntryType *entry;
+    ufsStatusType status;
+    size_t i;
+
+    /* The whole import is a single transaction, room is checked as it goes.  */
+    status = checkImageRoom( sinkData );
+    if ( status != UFS_NO_ERROR )
+        return status;
+
+    for ( i = 0; i < chunk -> count; i++ ) {
+        entry = &chunk -> entries[ i ];
+        entry -> id = importEntry( sinkData,
+                                   chunk -> parent,
+                                   chunk -> names + entry -> nameOffset,
+                                   entry -> type,
+                                   chunk -> merge,
+                                   entry -> hasAttributes ?
+                                       &entry -> attributes : NULL,
+                                   &entry -> merged );
+        if ( entry -> id < 0 )
+            return UFS_UNKNOWN_ERROR;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType sweepStaleBase( ufsSqliteStruct *ufsSqlite )
+{
+    static const enum ufsSqliteStatementType sweep[] = {
+        UFS_STATEMENT_CLEAR_KEEP,
+        UFS_STATEMENT_INSERT_KEEP,
+        UFS_STATEMENT_DELETE_STALE_MAPPINGS,
+        UFS_STATEMENT_DELETE_STALE_ATTRIBUTES,
+        UFS_STATEMENT_DELETE_STALE_STORAGE,
+        UFS_STATEMENT_UNMARK_STALE,
+    };
+    size_t i;
+
+    if ( bumpGenerations( ufsSqlite, UFS_STATEMENT_QUERY_STALE_DIRECTORIES,
+                          -1 ) != SQLITE_DONE )
+        return UFS_UNKNOWN_ERROR;
+
+    /* Stale storage that is still mapped, or still holds storage, only       */
+    /* leaves BASE. The rest is removed.                                      */
+    for ( i = 0; i < sizeof( sweep ) / sizeof( *sweep ); i++ ) {
+        if ( stepSqliteStatement( ufsSqlite, sweep[ i ] ) != SQLITE_DONE )
+            return UFS_UNKNOWN_ERROR;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+/* Removes storage that holds nothing, its subtree is then the storage        */
+/* alone and the statements of ufsRemoveTree apply.                           */
+ufsStatusType removeStorage( ufsSqliteStruct *ufsSqlite,
+                             ufsIdentifierType storage,
+                             int type )
+{
+    static const enum ufsSqliteStatementType removals[] = {
+        UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE,
+        UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE,
+        UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE,
+    };
+    ufsIdentifierType parent;
+    sqlite3_stmt *statement;
+    ufsStatusType status;
+    size_t i;
+    int res;
+
+    status = checkImageRoom( ufsSqlite );
+    if ( status != UFS_NO_ERROR )
+        return status;
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE )
+        return UFS_UNKNOWN_ERROR;
+
+    /* Make sure the storage exists and is of the right type.                 */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    sqlite3_bind_int( statement, 2, type );
+    res = sqlite3_step( statement );
+    parent = sqlite3_column_int64( statement, 1 );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        status = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    if ( type == UFS_STORAGE_TYPE_DIRECTORY ) {
+        statement =
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_CHILD_OF_DIRECTORY ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, storage );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE ) {
+            status = res == SQLITE_ROW ? UFS_DIRECTORY_IS_NOT_EMPTY :
+                                         UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        status = res == SQLITE_ROW ? UFS_EXISTS_IN_EXPLICIT_MAPPING :
+                                     UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Whiteouts and rows hiding inherited mappings go with the storage.      */
+    for ( i = 0; i < sizeof( removals ) / sizeof( *removals ); i++ ) {
+        statement = ufsSqlite -> statements[ removals[ i ] ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, storage );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE ) {
+            status = UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        status = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_REMOVE_STORAGE,
+                  storage, parent, -1, -1 );
+    return UFS_NO_ERROR;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return status;
+}
+
+ufsSqliteFilterType *getAreaFilter( ufsSqliteStruct *ufsSqlite,
+                                    ufsIdentifierType area )
+{
+    ufsSqliteFilterType *filter, **bucket;
+    ufsIdentifierType source;
+    sqlite3_stmt *statement;
+    int64_t count;
+    int res;
+
+    followRemovedAreas( ufsSqlite );
+    bucket = &ufsSqlite -> filters[ area % UFS_SQLITE_FILTER_BUCKETS ];
+    for ( filter = *bucket; filter; filter = filter -> next ) {
+        if ( filter -> area == area )
+            return filter;
+    }
+
+    /* Only areas that exist get a filter.                                    */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    source = res == SQLITE_ROW ? sqlite3_column_int64( statement, 1 ) : 0;
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW )
+        return NULL;
+
+    /* A reader isn't told what the instance maps, it only keeps the source   */
+    /* of the area and never probes an empty bloom.                           */
+    if ( ufsSqlite -> owner ) {
+        filter = calloc( 1, sizeof( *filter ) );
+        if ( !filter )
+            return NULL;
+
+        goto insert;
+    }
+
+    /* Built on first use from everything the area can see through its clone  */
+    /* chain. Removed mappings are kept in, a filter may only err by saying   */
+    /* yes.                                                                   */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_COUNT_MAPPINGS_IN_CHAIN ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    if ( sqlite3_step( statement ) != SQLITE_ROW )
+        return NULL;
+
+    count = sqlite3_column_int64( statement, 0 );
+    sqlite3_reset( statement );
+    filter = malloc( sizeof( *filter ) );
+    if ( !filter )
+        return NULL;
+
+    if ( ufsBloomInit( &filter -> bloom, count ) ) {
+        free( filter );
+        return NULL;
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_CHAIN ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    while ( ( res = sqlite3_step( statement ) ) == SQLITE_ROW )
+        ufsBloomAdd( &filter -> bloom, sqlite3_column_int64( statement, 0 ) );
+
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsBloomDestroy( &filter -> bloom );
+        free( filter );
+        return NULL;
+    }
+
+insert:
+    filter -> area = area;
+    filter -> removals = 0;
+    filter -> seen = 0;
+    filter -> source = source;
+    filter -> next = *bucket;
+    *bucket = filter;
+    return filter;
+}
+
+void addToAreaFilter( ufsSqliteStruct *ufsSqlite,
+                      ufsIdentifierType area,
+                      ufsIdentifierType storage )
+{
+    ufsSqliteFilterType *filter;
+
+    for ( filter = ufsSqlite -> filters[ area % UFS_SQLITE_FILTER_BUCKETS ];
+          filter; filter = filter -> next ) {
+        if ( filter -> area != area )
+            continue;
+
+        /* Past twice its size a filter says yes too often, size it again.    */
+        if ( filter -> bloom.count >= 2 * filter -> bloom.capacity + 64 )
+            dropAreaFilter( ufsSqlite, area );
+        else
+            ufsBloomAdd( &filter -> bloom, storage );
+        return;
+    }
+}
+
+void removeFromAreaFilter( ufsSqliteStruct *ufsSqlite,
+                           ufsIdentifierType area )
+{
+    ufsSqliteFilterType *filter;
+
+    /* Keys can't be taken out, once half of them are stale start over.       */
+    for ( filter = ufsSqlite -> filters[ area % UFS_SQLITE_FILTER_BUCKETS ];
+          filter; filter = filter -> next ) {
+        if ( filter -> area != area )
+            continue;
+
+        if ( ++filter -> removals * 2 > filter -> bloom.count + 64 )
+            dropAreaFilter( ufsSqlite, area );
+        return;
+    }
+}
+
+void dropAreaFilter( ufsSqliteStruct *ufsSqlite, ufsIdentifierType area )
+{
+    ufsSqliteFilterType *filter, **link;
+
+    link = &ufsSqlite -> filters[ area % UFS_SQLITE_FILTER_BUCKETS ];
+    for ( ; *link; link = &( *link ) -> next ) {
+        if ( ( *link ) -> area != area )
+            continue;
+
+        filter = *link;
+        *link = filter -> next;
+        ufsBloomDestroy( &filter -> bloom );
+        free( filter );
+        return;
+    }
+}
+
+/* A reader forgets every area it knows once the instance removed one, its id */
+/* may belong to a new area by now.                                           */
+void followRemovedAreas( ufsSqliteStruct *ufsSqlite )
+{
+    int i;
+
+    if ( !ufsSqlite -> owner ||
+         ufsSqlite -> removedAreas == ufsSqlite -> owner -> removedAreas )
+        return;
+
+    for ( i = 0; i < UFS_SQLITE_FILTER_BUCKETS; i++ ) {
+        while ( ufsSqlite -> filters[ i ] )
+            dropAreaFilter( ufsSqlite, ufsSqlite -> filters[ i ] -> area );
+    }
+
+    ufsSqlite -> viewIndex.size = 0;
+    ufsSqlite -> removedAreas = ufsSqlite -> owner -> removedAreas;
+}
+
+ufsViewSpanType viewSpanOf( ufsViewType view )
+{
+    ufsViewSpanType span;
+
+    /* Only a fixed array has to be scanned for its length.                   */
+    span.areas = view;
+    for ( span.count = 0; span.count < UFS_VIEW_MAX_SIZE &&
+                          view[ span.count ] != UFS_VIEW_TERMINATOR;
+          span.count++ )
+        ;
+
+    return span;
+}
+
+int isBadViewSpan( ufsViewSpanType view )
+{
+    return view.count > UFS_VIEW_MAX_SIZE || ( !view.areas && view.count );
+}
+
+ufsStatusType validateView( ufsSqliteStruct *ufsSqlite,
+                            ufsViewSpanType view )
+{
+    ufsSqliteFilterType *filter;
+    sqlite3_stmt *statement;
+    size_t i;
+    int res;
+
+    for ( i = 0; i < view.count; i++ ) {
+        if ( view.areas[ i ] < 0 )
+            return UFS_INVALID_AREA_IN_VIEW;
+
+        if ( view.areas[ i ] == UFS_AREA_BASE_IDENTIFIER &&
+             i + 1 < view.count )
+            return UFS_BASE_IS_NOT_LAST_AREA;
+    }
+
+    /* Every area in the view gets its filter, which also proves it exists,   */
+    /* and is stamped with the view so a duplicate finds it stamped already.  */
+    ufsSqlite -> views++;
+    for ( i = 0; i < view.count; i++ ) {
+        if ( view.areas[ i ] == UFS_AREA_BASE_IDENTIFIER )
+            continue;
+
+        filter = getAreaFilter( ufsSqlite, view.areas[ i ] );
+        if ( filter && filter -> seen == ufsSqlite -> views )
+            return UFS_VIEW_CONTAINS_DUPLICATES;
+
+        if ( filter ) {
+            filter -> seen = ufsSqlite -> views;
+            continue;
+        }
+
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, view.areas[ i ] );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        return res == SQLITE_DONE ? UFS_INVALID_AREA_IN_VIEW :
+                                    UFS_UNKNOWN_ERROR;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType indexView( ufsSqliteStruct *ufsSqlite,
+                         ufsViewSpanType view )
+{
+    ufsSqliteViewIndexType *index;
+    ufsSqliteViewEntryType *entries;
+    ufsSqliteFilterType *filter;
+    ufsIdentifierType area;
+    uint64_t slot, numSlots;
+    int64_t *slots;
+    uint32_t depth;
+    size_t rank, i;
+
+    index = &ufsSqlite -> viewIndex;
+    index -> size = 0;
+    index -> numEntries = 0;
+    for ( rank = 0; rank < view.count; rank++ ) {
+        for ( area = view.areas[ rank ], depth = 0;
+              area != UFS_AREA_BASE_IDENTIFIER; depth++ ) {
+            if ( index -> numEntries == index -> maxEntries ) {
+                entries = realloc( index -> entries,
+                                   ( index -> maxEntries * 2 + 64 ) *
+                                   sizeof( *entries ) );
+                if ( !entries )
+                    return UFS_UNKNOWN_ERROR;
+
+                index -> entries = entries;
+                index -> maxEntries = index -> maxEntries * 2 + 64;
+            }
+
+            index -> entries[ index -> numEntries ].area = area;
+            index -> entries[ index -> numEntries ].rank = rank;
+            index -> entries[ index -> numEntries ].depth = depth;
+            index -> numEntries++;
+
+            filter = getAreaFilter( ufsSqlite, area );
+            if ( !filter )
+                return UFS_UNKNOWN_ERROR;
+
+            area = filter -> source;
+        }
+    }
+
+    /* At most half the slots are used, so probing stays short.               */
+    for ( numSlots = 16; numSlots < index -> numEntries * 2; numSlots *= 2 )
+        ;
+
+    if ( numSlots > index -> slotMask + 1 || !index -> slots ) {
+        slots = realloc( index -> slots, numSlots * sizeof( *slots ) );
+        if ( !slots )
+            return UFS_UNKNOWN_ERROR;
+
+        index -> slots = slots;
+        index -> slotMask = numSlots - 1;
+    }
+
+    memset( index -> slots, 0xff,
+            ( index -> slotMask + 1 ) * sizeof( *index -> slots ) );
+    for ( i = 0; i < index -> numEntries; i++ ) {
+        area = index -> entries[ i ].area;
+        slot = ( ( uint64_t )area * 0x9e3779b97f4a7c15ULL >> 32 ) &
+               index -> slotMask;
+        while ( index -> slots[ slot ] >= 0 &&
+                index -> entries[ index -> slots[ slot ] ].area != area )
+            slot = ( slot + 1 ) & index -> slotMask;
+
+        index -> entries[ i ].next = index -> slots[ slot ];
+        index -> slots[ slot ] = i;
+    }
+
+    memcpy( index -> areas, view.areas, view.count * sizeof( *view.areas ) );
+    index -> size = view.count;
+    return UFS_NO_ERROR;
+}
+
+int64_t findViewEntry( const ufsSqliteViewIndexType *index,
+                       ufsIdentifierType area )
+{
+    uint64_t slot;
+
+    if ( !index -> slots )
+        return -1;
+
+    slot = ( ( uint64_t )area * 0x9e3779b97f4a7c15ULL >> 32 ) &
+           index -> slotMask;
+    while ( index -> slots[ slot ] >= 0 &&
+            index -> entries[ index -> slots[ slot ] ].area != area )
+        slot = ( slot + 1 ) & index -> slotMask;
+
+    return index -> slots[ slot ];
+}
+
+ufsStatusType useView( ufsSqliteStruct *ufsSqlite, ufsViewSpanType view )
+{
+    ufsStatusType status;
+
+    followRemovedAreas( ufsSqlite );
+
+    /* Views are usually reused, only a new one is validated and indexed.     */
+    if ( view.count && view.count == ufsSqlite -> viewIndex.size &&
+         !memcmp( view.areas, ufsSqlite -> viewIndex.areas,
+                  view.count * sizeof( *view.areas ) ) )
+        return UFS_NO_ERROR;
+
+    status = validateView( ufsSqlite, view );
+    if ( status == UFS_NO_ERROR )
+        status = indexView( ufsSqlite, view );
+
+    if ( status != UFS_NO_ERROR )
+        ufsSqlite -> viewIndex.size = 0;
+
+    return status;
+}
+
+int compareBatchEntries( const void *a, const void *b )
+{
+    const ufsSqliteBatchEntryType *entryA, *entryB;
+
+    entryA = a;
+    entryB = b;
+    return ( entryA -> storage > entryB -> storage ) -
+           ( entryA -> storage < entryB -> storage );
+}
+
+size_t filterPrefixLength( const ufsDirFilterType *filter )
+{
+    size_t prefixLength, globLength;
+
+    /* Names matching the glob start with whatever comes before its first     */
+    /* wildcard, the longer of that and the prefix bounds the names.          */
+    prefixLength = filter -> prefix ? strlen( filter -> prefix ) : 0;
+    if ( !filter -> glob )
+        return prefixLength;
+
+    globLength = strcspn( filter -> glob, "*?[" );
+    if ( strncmp( filter -> glob, filter -> prefix ? filter -> prefix : "",
+                  prefixLength < globLength ? prefixLength : globLength ) )
+        return SIZE_MAX;
+
+    return prefixLength > globLength ? prefixLength : globLength;
+}
+
+ufsIdentifierType resolveInView( ufsSqliteStruct *ufsSqlite,
+                                 ufsViewSpanType view,
+                                 ufsIdentifierType storage )
+{
+    ufsSqliteResolveType resolve;
+    sqlite3_stmt *statement;
+    ufsStatusType status;
+    int res;
+
+    /* Every mapping row of the storage names the positions in the view that  */
+    /* observe it, the cost follows the mappings and not the view.            */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_OF_STORAGE ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    memset( &resolve, 0, sizeof( resolve ) );
+    resolve.inBase = -1;
+    status = UFS_NO_ERROR;
+    while ( status == UFS_NO_ERROR &&
+            ( res = sqlite3_step( statement ) ) == SQLITE_ROW ) {
+        resolve.inBase = sqlite3_column_int( statement, 0 );
+        if ( sqlite3_column_type( statement, 1 ) != SQLITE_NULL )
+            status = addResolveMapping( ufsSqlite, &resolve,
+                                        sqlite3_column_int64( statement, 1 ),
+                                        sqlite3_column_int( statement, 2 ) );
+    }
+
+    sqlite3_reset( statement );
+    if ( status != UFS_NO_ERROR || res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    return pickResolved( ufsSqlite, view, &resolve );
+}
+
+ufsStatusType addResolveMapping( ufsSqliteStruct *ufsSqlite,
+                                 ufsSqliteResolveType *resolve,
+                                 ufsIdentifierType area,
+                                 int removed )
+{
+    ufsSqliteCandidateType *candidate, *candidates;
+    int64_t entry;
+
+    resolve -> mapped |= !removed;
+    entry = findViewEntry( &ufsSqlite -> viewIndex, area );
+    for ( ; entry >= 0; entry = ufsSqlite -> viewIndex.entries[ entry ].next ) {
+        if ( resolve -> numCandidates == ufsSqlite -> maxCandidates ) {
+            candidates = realloc( ufsSqlite -> candidates,
+                                  ( ufsSqlite -> maxCandidates * 2 + 16 ) *
+                                  sizeof( *candidates ) );
+            if ( !candidates )
+                return UFS_UNKNOWN_ERROR;
+
+            ufsSqlite -> candidates = candidates;
+            ufsSqlite -> maxCandidates = ufsSqlite -> maxCandidates * 2 + 16;
+        }
+
+        candidate = &ufsSqlite -> candidates[ resolve -> numCandidates++ ];
+        candidate -> rank = ufsSqlite -> viewIndex.entries[ entry ].rank;
+        candidate -> depth = ufsSqlite -> viewIndex.entries[ entry ].depth;
+        candidate -> removed = removed;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+ufsIdentifierType pickResolved( ufsSqliteStruct *ufsSqlite,
+                                ufsViewSpanType view,
+                                const ufsSqliteResolveType *resolve )
+{
+    ufsSqliteCandidateType *candidates;
+    size_t numCandidates, i, j;
+    uint32_t best;
+    int whiteout;
+
+    if ( resolve -> inBase < 0 ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return -1;
+    }
+
+    /* An area observes the row closest to it along its chain, the first      */
+    /* area that observes a live one wins, unless one before it observes a    */
+    /* whiteout.                                                              */
+    best = UINT32_MAX;
+    whiteout = 0;
+    candidates = ufsSqlite -> candidates;
+    numCandidates = resolve -> numCandidates;
+    for ( i = 0; i < numCandidates; i++ ) {
+        if ( candidates[ i ].removed == 1 || candidates[ i ].rank >= best )
+            continue;
+
+        for ( j = 0; j < numCandidates; j++ ) {
+            if ( candidates[ j ].rank == candidates[ i ].rank &&
+                 candidates[ j ].depth < candidates[ i ].depth )
+                break;
+        }
+
+        if ( j == numCandidates ) {
+            best = candidates[ i ].rank;
+            whiteout = candidates[ i ].removed == UFS_SQLITE_WHITEOUT;
+        }
+    }
+
+    if ( whiteout ) {
+        ufsErrno = UFS_CANNOT_RESOLVE_STORAGE;
+        return -1;
+    }
+
+    if ( best != UINT32_MAX ) {
+        ufsErrno = UFS_NO_ERROR;
+        return view.areas[ best ];
+    }
+
+    /* BASE holds imported storage, and storage that isn't mapped anywhere.   */
+    if ( view.count > 0 &&
+         view.areas[ view.count - 1 ] == UFS_AREA_BASE_IDENTIFIER &&
+         ( resolve -> inBase || !resolve -> mapped ) ) {
+        ufsErrno = UFS_NO_ERROR;
+        return UFS_AREA_BASE_IDENTIFIER;
+    }
+
+    ufsErrno = UFS_CANNOT_RESOLVE_STORAGE;
+    return -1;
+}
+
+/* Resolves storage in a view that's in use, reading neighbouring storage in  */
+/* ranges.                                                                    */
+ufsStatusType resolveMany( ufsSqliteStruct *ufsSqlite,
+                           ufsViewSpanType view,
+                           const ufsIdentifierType *storages,
+                           size_t n,
+                           ufsIdentifierType *areasOut,
+                           ufsStatusType *statusOut )
+{
+    sqlite3_stmt *storageRange, *mappingRange;
+    ufsSqliteBatchEntryType *batch;
+    ufsSqliteResolveType resolve;
+    ufsIdentifierType storage, area;
+    ufsStatusType status;
+    int storageRes, mappingRes;
+    size_t i, j, k;
+
+    if ( n > ufsSqlite -> maxBatch ) {
+        batch = realloc( ufsSqlite -> batch, n * sizeof( *batch ) );
+        if ( !batch )
+            return UFS_OUT_OF_MEMORY;
+
+        ufsSqlite -> batch = batch;
+        ufsSqlite -> maxBatch = n;
+    }
+
+    /* Sorted, the batch is merged against ranges of the storage table, so    */
+    /* siblings that were added together are read in a single scan.           */
+    batch = ufsSqlite -> batch;
+    for ( i = 0; i < n; i++ ) {
+        batch[ i ].storage = storages[ i ];
+        batch[ i ].index = i;
+    }
+
+    qsort( batch, n, sizeof( *batch ), compareBatchEntries );
+    for ( i = 0; i < n && batch[ i ].storage <= 0; i++ ) {
+        areasOut[ batch[ i ].index ] = -1;
+        statusOut[ batch[ i ].index ] = UFS_BAD_CALL;
+    }
+
+    storageRange = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_RANGE ];
+    mappingRange = ufsSqlite -> statements[
+            UFS_STATEMENT_QUERY_MAPPINGS_OF_STORAGE_RANGE ];
+    status = UFS_NO_ERROR;
+    while ( i < n && status == UFS_NO_ERROR ) {
+
+        /* A range is only worth scanning while most of it is wanted, storage */
+        /* that is far from the rest is looked up on its own.                 */
+        for ( j = i + 1; j < n && ( uint64_t )( batch[ j ].storage -
+                                                batch[ i ].storage ) <
+                                  2 * ( j - i ) + 16; j++ )
+            ;
+
+        if ( j - i < UFS_SQLITE_BATCH_MIN_RANGE ) {
+            for ( ; i < j; i = k ) {
+                storage = batch[ i ].storage;
+                area = resolveInView( ufsSqlite, view, storage );
+                if ( area < 0 && ufsErrno == UFS_UNKNOWN_ERROR ) {
+                    status = ufsErrno;
+                    break;
+                }
+
+                for ( k = i; k < j && batch[ k ].storage == storage; k++ ) {
+                    areasOut[ batch[ k ].index ] = area;
+                    statusOut[ batch[ k ].index ] = ufsErrno;
+                }
+            }
+
+            continue;
+        }
+
+        /* The storage and its mappings are both read in the order of the     */
+        /* storage, and merged with the batch as they go.                     */
+        sqlite3_reset( storageRange );
+        sqlite3_clear_bindings( storageRange );
+        sqlite3_bind_int64( storageRange, 1, batch[ i ].storage );
+        sqlite3_bind_int64( storageRange, 2, batch[ j - 1 ].storage );
+        sqlite3_reset( mappingRange );
+        sqlite3_clear_bindings( mappingRange );
+        sqlite3_bind_int64( mappingRange, 1, batch[ i ].storage );
+        sqlite3_bind_int64( mappingRange, 2, batch[ j - 1 ].storage );
+        storageRes = sqlite3_step( storageRange );
+        mappingRes = sqlite3_step( mappingRange );
+        for ( ; i < j; i = k ) {
+            storage = batch[ i ].storage;
+            while ( storageRes == SQLITE_ROW &&
+                    sqlite3_column_int64( storageRange, 0 ) < storage )
+                storageRes = sqlite3_step( storageRange );
+
+            while ( mappingRes == SQLITE_ROW &&
+                    sqlite3_column_int64( mappingRange, 0 ) < storage )
+                mappingRes = sqlite3_step( mappingRange );
+
+            memset( &resolve, 0, sizeof( resolve ) );
+            resolve.inBase = -1;
+            if ( storageRes == SQLITE_ROW &&
+                 sqlite3_column_int64( storageRange, 0 ) == storage )
+                resolve.inBase = sqlite3_column_int( storageRange, 1 );
+
+            while ( mappingRes == SQLITE_ROW && status == UFS_NO_ERROR &&
+                    sqlite3_column_int64( mappingRange, 0 ) == storage ) {
+                status = addResolveMapping(
+                        ufsSqlite, &resolve,
+                        sqlite3_column_int64( mappingRange, 1 ),
+                        sqlite3_column_int( mappingRange, 2 ) );
+                mappingRes = sqlite3_step( mappingRange );
+            }
+
+            if ( ( storageRes != SQLITE_ROW && storageRes != SQLITE_DONE ) ||
+                 ( mappingRes != SQLITE_ROW && mappingRes != SQLITE_DONE ) )
+                status = UFS_UNKNOWN_ERROR;
+
+            if ( status != UFS_NO_ERROR )
+                break;
+
+            /* The same storage may be asked for more than once.              */
+            area = pickResolved( ufsSqlite, view, &resolve );
+            for ( k = i; k < j && batch[ k ].storage == storage; k++ ) {
+                areasOut[ batch[ k ].index ] = area;
+                statusOut[ batch[ k ].index ] = ufsErrno;
+            }
+        }
+
+        sqlite3_reset( storageRange );
+        sqlite3_reset( mappingRange );
+    }
+
+    return status;
+}
+
+ufsStatusType forgetArea( ufsIdentifierType storage,
+                          ufsIdentifierType area,
+                          uint64_t currEntry,
+                          uint64_t numEntries,
+                          void *userData )
+{
+    ufsSqliteDirIterType *dirIter;
+
+    ( void )area;
+    dirIter = userData;
+    return dirIter -> iterator( storage, currEntry, numEntries,
+                                dirIter -> userData );
+}
+
+void recordChange( ufsSqliteStruct *ufsSqlite,
+                   uint32_t type,
+                   ufsIdentifierType storage,
+                   ufsIdentifierType parent,
+                   ufsIdentifierType area,
+                   ufsIdentifierType from )
+{
+    ufsChangeType *change;
+    if ( !ufsSqlite -> changes )
+        return;
+
+    /* The oldest change is simply overwritten, consumers tell they lost it   */
+    /* by their cursor alone.                                                 */
+    change = &ufsSqlite -> changes[ ufsSqlite -> nextChange %
+                                    UFS_CHANGE_FEED_SIZE ];
+    change -> sequence = ufsSqlite -> nextChange++;
+    change -> type = type;
+    change -> storage = storage;
+    change -> parent = parent;
+    change -> area = area;
+    change -> from = from;
+}
+
+ufsSqliteGenerationType *findGeneration(
+                                const ufsSqliteGenerationsType *generations,
+                                ufsIdentifierType directory )
+{
+    uint64_t slot;
+
+    if ( !generations -> slots )
+        return NULL;
+
+    slot = ( ( uint64_t )directory * 0x9e3779b97f4a7c15ULL >> 32 ) &
+           generations -> slotMask;
+    while ( generations -> slots[ slot ].generation &&
+            generations -> slots[ slot ].directory != directory )
+        slot = ( slot + 1 ) & generations -> slotMask;
+
+    return &generations -> slots[ slot ];
+}
+
+void bumpGeneration( ufsSqliteStruct *ufsSqlite,
+                     ufsIdentifierType directory )
+{
+    ufsSqliteGenerationsType *generations, grown;
+    ufsSqliteGenerationType *slot;
+    uint64_t i;
+
+    /* At most half the slots are used, so probing stays short.               */
+    generations = &ufsSqlite -> generations;
+    if ( !generations -> slots ||
+         ( generations -> size + 1 ) * 2 > generations -> slotMask + 1 ) {
+        grown = *generations;
+        grown.slotMask = generations -> slots ?
+                         generations -> slotMask * 2 + 1 : 63;
+        grown.slots = calloc( grown.slotMask + 1, sizeof( *grown.slots ) );
+
+        /* Without memory every directory has to be considered changed.       */
+        if ( !grown.slots ) {
+            generations -> floor = ++generations -> last;
+            return;
+        }
+
+        for ( i = 0; generations -> slots &&
+                     i <= generations -> slotMask; i++ ) {
+            if ( generations -> slots[ i ].generation )
+                *findGeneration( &grown, generations -> slots[ i ].directory ) =
+                    generations -> slots[ i ];
+        }
+
+        free( generations -> slots );
+        *generations = grown;
+    }
+
+    slot = findGeneration( generations, directory );
+    if ( !slot -> generation ) {
+        slot -> directory = directory;
+        generations -> size++;
+    }
+
+    slot -> generation = ++generations -> last;
+}
+
+int bumpGenerations( ufsSqliteStruct *ufsSqlite,
+                     enum ufsSqliteStatementType statement,
+                     ufsIdentifierType argument )
+{
+    sqlite3_stmt *query;
+    int res;
+
+    query = ufsSqlite -> statements[ statement ];
+    sqlite3_reset( query );
+    sqlite3_clear_bindings( query );
+    if ( argument >= 0 )
+        sqlite3_bind_int64( query, 1, argument );
+
+    while ( ( res = sqlite3_step( query ) ) == SQLITE_ROW )
+        bumpGeneration( ufsSqlite, sqlite3_column_int64( query, 0 ) );
+
+    sqlite3_reset( query );
+    return res;
+}
+
+ufsStatusType writeImageFile( const char *path,
+                              const unsigned char *data,
+                              sqlite3_int64 size )
+{
+    char *tmpPath;
+    ssize_t written;
+    int fd;
+
+    tmpPath = malloc( strlen( path ) + sizeof( ".tmp" ) );
+    if ( !tmpPath )
+        return UFS_OUT_OF_MEMORY;
+
+    strcpy( tmpPath, path );
+    strcat( tmpPath, ".tmp" );
+    fd = open( tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 ) {
+        free( tmpPath );
+        return UFS_UNKNOWN_ERROR;
+    }
+
+    while ( size > 0 ) {
+        written = write( fd, data, size );
+        if ( written < 0 )
+            goto fail;
+
+        data += written;
+        size -= written;
+    }
+
+    /* The image must be on disk before it replaces the previous one.         */
+    if ( fsync( fd ) || close( fd ) ) {
+        fd = -1;
+        goto fail;
+    }
+
+    if ( rename( tmpPath, path ) ) {
+        fd = -1;
+        goto fail;
+    }
+
+    free( tmpPath );
+    return UFS_NO_ERROR;
+
+fail:
+    if ( fd >= 0 )
+        close( fd );
+    unlink( tmpPath );
+    free( tmpPath );
+    return UFS_UNKNOWN_ERROR;
+}
+
+ufsType ufsInit()
+{
+    ufsSqliteStruct *ret;
+    ufsStatusType status;
+    sqlite3 *db;
+    size_t capacity;
+    void *image;
+
+    /* Starts as an empty image, so readers can open the same memory.         */
+    image = mapImage( 2 * UFS_SQLITE_IMAGE_HEADROOM, &capacity );
+    if ( !image ) {
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    status = openImageDb( image, 0, capacity, 0, &db );
+    if ( status != UFS_NO_ERROR ) {
+        munmap( image, capacity );
+        ufsErrno = status;
+        return NULL;
+    }
+
+    ret = prepareSqliteDb( db );
+    if ( !ret ) {
+        sqlite3_close( db );
+        munmap( image, capacity );
+        return NULL;
+    }
+
+    ret -> image = image;
+    ret -> imageCapacity = capacity;
+    ufsErrno = UFS_NO_ERROR;
+    return ret;
+}
+
+ufsType ufsInitReader( ufsType ufs )
+{
+    ufsSqliteStruct *ufsSqlite, *ret;
+    ufsStatusType status;
+    sqlite3 *db;
+    if ( !ufs || ( ( ufsSqliteStruct * )ufs ) -> owner ) {
+        ufsErrno = UFS_BAD_CALL;
+        return NULL;
+    }
+
+    /* A connection of its own over the whole reservation. Its size is read   */
+    /* from the header of the database when a read starts, so it follows what */
+    /* the instance writes as long as they don't overlap.                     */
+    ufsSqlite = ufs;
+    status = openImageDb( ufsSqlite -> image, ufsSqlite -> imageCapacity,
+                          ufsSqlite -> imageCapacity,
+                          SQLITE_DESERIALIZE_READONLY, &db );
+    if ( status != UFS_NO_ERROR ) {
+        ufsErrno = status;
+        return NULL;
+    }
+
+    ret = prepareSqliteDb( db );
+    if ( !ret ) {
+        sqlite3_close( db );
+        return NULL;
+    }
+
+    ret -> owner = ufsSqlite;
+    ret -> removedAreas = ufsSqlite -> removedAreas;
+    ufsErrno = UFS_NO_ERROR;
+    return ret;
+}
+
+void ufsDestroy( ufsType ufs )
+{
+    int i;
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs ) {
+        ufsErrno = UFS_NO_ERROR;
+        return;
+    }
+
+    ufsSqlite = ufs;
+    for (i = 0; i < NUM_UFS_STATEMENTS; i++)
+        sqlite3_finalize( ufsSqlite -> statements[ i ] );
+    for (i = 0; i < UFS_SQLITE_FILTER_BUCKETS; i++) {
+        while ( ufsSqlite -> filters[ i ] )
+            dropAreaFilter( ufsSqlite, ufsSqlite -> filters[ i ] -> area );
+    }
+    free( ufsSqlite -> viewIndex.entries );
+    free( ufsSqlite -> viewIndex.slots );
+    free( ufsSqlite -> candidates );
+    free( ufsSqlite -> batch );
+    free( ufsSqlite -> changes );
+    free( ufsSqlite -> generations.slots );
+    sqlite3_close( ufsSqlite -> db );
+    if ( ufsSqlite -> image )
+        munmap( ufsSqlite -> image, ufsSqlite -> imageCapacity );
+    free( ufsSqlite );
+    ufsErrno = UFS_NO_ERROR;
+}
+
+ufsType ufsInitFromImage( const char *path )
+{
+    ufsSqliteStruct *ret;
+    sqlite3 *db;
+    struct stat st;
+    ufsStatusType status;
+    size_t capacity;
+    void *image;
+    int fd;
+    if ( !path ) {
+        ufsErrno = UFS_BAD_CALL;
+        return NULL;
+    }
+
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        ufsErrno = errno == ENOENT ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return NULL;
+    }
+
+    if ( fstat( fd, &st ) || st.st_size <= 0 ) {
+        close( fd );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return NULL;
+    }
+
+    /* Reserve room for the image and for growth, then map the file privately */
+    /* over the start of it. Pages are read from the file on first touch and  */
+    /* copied only once they're written.                                      */
+    image = mapImage( st.st_size + 2 * UFS_SQLITE_IMAGE_HEADROOM, &capacity );
+    if ( !image ) {
+        close( fd );
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    if ( mmap( image, st.st_size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ) {
+        munmap( image, capacity );
+        close( fd );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return NULL;
+    }
+    close( fd );
+
+    status = openImageDb( image, st.st_size, capacity, 0, &db );
+    if ( status != UFS_NO_ERROR ) {
+        munmap( image, capacity );
+        ufsErrno = status;
+        return NULL;
+    }
+
+    ret = prepareSqliteDb( db );
+    if ( !ret ) {
+        sqlite3_close( db );
+        munmap( image, capacity );
+        return NULL;
+    }
+
+    ret -> image = image;
+    ret -> imageCapacity = capacity;
+    ufsErrno = UFS_NO_ERROR;
+    return ret;
+}
+
+ufsStatusType ufsSaveImage( ufsType ufs,
+                            const char *path )
+{
+    ufsSqliteStruct *ufsSqlite;
+    unsigned char *data;
+    sqlite3_int64 size;
+    int res, copied;
+    if ( !ufs || !path ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    sqlite3_reset( ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_META ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_META ] );
+    sqlite3_bind_text( ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_META ],
+                       1, UFS_SQLITE_META_GENERATION, -1, SQLITE_STATIC );
+    sqlite3_bind_int64( ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_META ],
+                        2, ufsSqlite -> attributesGeneration );
+    res = sqlite3_step( ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_META ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* A loaded image is already one contiguous buffer and can be written     */
+    /* directly, otherwise sqlite assembles a copy.                           */
+    copied = 0;
+    data = sqlite3_serialize( ufsSqlite -> db, "main", &size,
+                              SQLITE_SERIALIZE_NOCOPY );
+    if ( !data ) {
+        data = sqlite3_serialize( ufsSqlite -> db, "main", &size, 0 );
+        copied = 1;
+    }
+
+    if ( !data ) {
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return ufsErrno;
+    }
+
+    ufsErrno = writeImageFile( path, data, size );
+    if ( copied )
+        sqlite3_free( data );
+
+    return ufsErrno;
+}
+
+ufsIdentifierType ufsAddDirectory( ufsType ufs,
+                                   ufsIdentifierType parent,
+                                   const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || parent < 0 || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
+
+    /* Make sure parent is a directory if it's not ROOT.                      */
+    if ( parent > 0 ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                1, parent );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                2, UFS_STORAGE_TYPE_DIRECTORY );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        if ( res != SQLITE_ROW ) {
+            ufsErrno = UFS_PARENT_DOES_NOT_EXIST;
+            return -1;
+        }
+    }
+
+    /* Make sure it doesn't exist.                                            */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            3, UFS_STORAGE_TYPE_DIRECTORY );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    if ( res == SQLITE_ROW ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return -1;
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    /* Finally, insert the directory into the db.                             */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            3, UFS_STORAGE_TYPE_DIRECTORY );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    id = sqlite3_last_insert_rowid( ufsSqlite -> db );
+    bumpGeneration( ufsSqlite, parent );
+    bumpGeneration( ufsSqlite, id );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_STORAGE, id, parent, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsIdentifierType ufsAddFile( ufsType ufs,
+                              ufsIdentifierType parent,     
+                              const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || parent < 0 || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
+
+    /* Make sure parent is a directory if it's not ROOT.                      */
+    if ( parent > 0 ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                1, parent );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                2, UFS_STORAGE_TYPE_DIRECTORY );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        if ( res != SQLITE_ROW ) {
+            ufsErrno = UFS_PARENT_DOES_NOT_EXIST;
+            return -1;
+        }
+    }
+
+    /* Make sure it doesn't exist.                                            */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            3, UFS_STORAGE_TYPE_FILE );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    if ( res == SQLITE_ROW ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return -1;
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    /* Finally, insert the file into the db.                                  */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
+            3, UFS_STORAGE_TYPE_FILE );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    id = sqlite3_last_insert_rowid( ufsSqlite -> db );
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_STORAGE, id, parent, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsIdentifierType ufsAddArea( ufsType ufs,
+                              const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    if (strncmp( name,
+                UFS_AREA_BASE_NAME,
+                sizeof( UFS_AREA_BASE_NAME ) /
+                sizeof( char )) == 0 ) {
+        ufsErrno = UFS_ILLEGAL_NAME;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
+
+    /* First verify that the area doesn't exist.                              */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_bind_text( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
+            1, name, -1, SQLITE_TRANSIENT );
+    res = sqlite3_step( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    if ( res == SQLITE_ROW ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return -1;
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    /* Finally, insert the area into the db.                                  */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ],
+            1, name, -1, SQLITE_TRANSIENT );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    id = sqlite3_last_insert_rowid( ufsSqlite -> db );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_AREA, -1, -1, id, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsStatusType ufsAddMapping( ufsType ufs,
+                             ufsIdentifierType area,
+                             ufsIdentifierType storage )
+{
+    int res, seen;
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType parent;
+    if ( !ufs || area <= 0 || storage < 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that area exists.                                         */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_bind_int( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ],
+            1, area );
+    res = sqlite3_step( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return ufsErrno;
+    }
+
+    /* Then verify that the storage exists.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_bind_int( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
+            1, storage );
+    res = sqlite3_step( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return ufsErrno;
+    }
+
+    parent = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ], 2 );
+
+    /* verify that the mapping doesn't exist.                                 */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    sqlite3_bind_int( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+            1, area );
+    sqlite3_bind_int( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+            2, storage );
+    res = sqlite3_step( 
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    if ( res == SQLITE_ROW && sqlite3_column_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+                0 ) == 0 ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return ufsErrno;
+    }
+
+    if ( res != SQLITE_DONE && res != SQLITE_ROW ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    seen = res == SQLITE_ROW ? sqlite3_column_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+                0 ) : 1;
+
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Clones of this area must keep not seeing the storage, or keep seeing   */
+    /* its whiteout.                                                          */
+    res = pinCloneMappings( ufsSqlite, area, storage, seen );
+    if ( res != SQLITE_DONE ) {
+        stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Finally, insert the area into the db.                                  */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ],
+            1, area );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ],
+            2, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
+    if ( res != SQLITE_DONE ) {
+        stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    addToAreaFilter( ufsSqlite, area, storage );
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_MAPPING, storage, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+	return ufsErrno;
+}
+
+ufsIdentifierType ufsGetDirectory( ufsType ufs,
+                                   ufsIdentifierType parent,
+                                   const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || parent < 0 || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Query the db and get the identifier.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            3, UFS_STORAGE_TYPE_DIRECTORY );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return -1;
+    }
+
+    /* Done with the row, a statement left stepping keeps its read open.      */
+    id = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ], 0 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsIdentifierType ufsGetFile( ufsType ufs,
+                              ufsIdentifierType parent,
+                              const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || parent < 0 || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Query the db and get the identifier.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            2, parent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            3, UFS_STORAGE_TYPE_FILE );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return -1;
+    }
+
+    id = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ], 0 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsIdentifierType ufsGetArea( ufsType ufs,
+                              const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    /* BASE is defined to have identifier 0.                                  */
+    if (strncmp( name, UFS_AREA_BASE_NAME, sizeof( UFS_AREA_BASE_NAME )) == 0) {
+        return UFS_AREA_BASE_IDENTIFIER;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Query the db and get the identifier.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
+            1, name, -1, SQLITE_TRANSIENT );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_DOES_NOT_EXIST;
+        return -1;
+    }
+
+    id = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ], 0 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsStatusType ufsGetStorage( ufsType ufs,
+                             ufsIdentifierType storage,
+                             ufsStorageInfoType *info )
+{
+    if ( !ufs || storage <= 0 || !info ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsErrno = queryStorage( ufs, storage, info );
+    return ufsErrno;
+}
+
+ufsStatusType ufsGetManyStorage( ufsType ufs,
+                                 const ufsIdentifierType *storages,
+                                 size_t count,
+                                 ufsStorageInfoType *infoOut,
+                                 ufsStatusType *statusOut )
+{
+    int res;
+    size_t i;
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || !storages || !infoOut || !statusOut ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Serve the whole batch from a single read transaction.                  */
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        if ( storages[ i ] <= 0 ) {
+            statusOut[ i ] = UFS_BAD_CALL;
+            continue;
+        }
+
+        statusOut[ i ] = queryStorage( ufsSqlite,
+                                       storages[ i ],
+                                       &infoOut[ i ] );
+        if ( statusOut[ i ] == UFS_UNKNOWN_ERROR ) {
+            stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+            ufsErrno = UFS_UNKNOWN_ERROR;
+            return ufsErrno;
+        }
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsProbeMapping( ufsType ufs,
+                               ufsIdentifierType area,
+                               ufsIdentifierType storage )
+{
+    int res, removed;
+    ufsSqliteStruct *ufsSqlite;
+    ufsSqliteFilterType *filter;
+    ufsStorageInfoType info;
+    sqlite3_stmt *statement;
+    ufsStatusType status;
+    if ( !ufs || area < 0 || storage < 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Most areas don't map most storage, rule it out without the mappings.   */
+    filter = getAreaFilter( ufsSqlite, area );
+    if ( filter && !ufsSqlite -> owner &&
+         !ufsBloomMayContain( &filter -> bloom, storage ) )
+        goto missing;
+
+    /* An area that isn't a clone answers with a single key lookup, there's   */
+    /* no chain to follow.                                                    */
+    statement = ufsSqlite -> statements[ filter && !filter -> source ?
+                                         UFS_STATEMENT_QUERY_MAPPING_BY_IDS :
+                                         UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    removed = res == SQLITE_ROW ? sqlite3_column_int( statement, 0 ) : 1;
+    sqlite3_reset( statement );
+
+    /* A mapping removed in a clone hides the one it inherited.               */
+    if ( removed )
+        goto missing;
+
+    ufsErrno = UFS_NO_ERROR;
+	return ufsErrno;
+
+missing:
+    /* Only a mapping between an area and storage that both exist is missing, */
+    /* an area exists when it has a filter.                                   */
+    status = queryStorage( ufsSqlite, storage, &info );
+    if ( status == UFS_NO_ERROR )
+        status = filter ? UFS_MAPPING_DOES_NOT_EXIST : UFS_DOES_NOT_EXIST;
+
+    ufsErrno = status;
+    return ufsErrno;
+}
+
+ufsStatusType ufsRemoveDirectory( ufsType ufs,
+                                  ufsIdentifierType directory )
+{
+    if ( !ufs || directory <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsErrno = removeStorage( ufs, directory, UFS_STORAGE_TYPE_DIRECTORY );
+    return ufsErrno;
+}
+
+ufsStatusType ufsRemoveFile( ufsType ufs,
+                             ufsIdentifierType file )
+{
+    if ( !ufs || file < 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    if ( file == UFS_STORAGE_ROOT_IDENTIFIER ) {
+        ufsErrno = UFS_ILLEGAL_NAME;
+        return ufsErrno;
+    }
+
+    ufsErrno = removeStorage( ufs, file, UFS_STORAGE_TYPE_FILE );
+    return ufsErrno;
+}
+
+ufsStatusType ufsRemoveArea( ufsType ufs,
+                             ufsIdentifierType area )
+{
+    int res;
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    if ( !ufs || area <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Make sure the area exists.                                             */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Clones see what they didn't change through the area, so it must out-   */
+    /* live them.                                                             */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_CLONE_OF_AREA ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = res == SQLITE_ROW ? UFS_AREA_HAS_CLONES : UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Mappings are a dependency, like for storage.                           */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPING_OF_AREA ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = res == SQLITE_ROW ? UFS_EXISTS_IN_EXPLICIT_MAPPING :
+                                       UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Only whiteouts and rows hiding inherited mappings are left, they go    */
+    /* along with the area.                                                   */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_OF_AREA ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_DELETE_AREA_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* A cached view that holds the area has to be validated again, readers   */
+    /* learn about it from the count.                                         */
+    dropAreaFilter( ufsSqlite, area );
+    ufsSqlite -> viewIndex.size = 0;
+    ufsSqlite -> removedAreas++;
+    recordChange( ufsSqlite, UFS_CHANGE_REMOVE_AREA, -1, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsStatusType ufsRemoveMapping( ufsType ufs,
+                                ufsIdentifierType area,
+                                ufsIdentifierType storage )
+{
+    int res;
+    ufsIdentifierType source, parent;
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || area <= 0 || storage < 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that area exists and see whether it's a clone.            */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ],
+            1, area );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    source = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ], 1 );
+
+    /* Then verify that the mapping exists.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+            1, area );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+            2, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    if ( res != SQLITE_ROW || sqlite3_column_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
+                0 ) != 0 ) {
+        ufsErrno = res == SQLITE_ROW || res == SQLITE_DONE ?
+                   UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Clones of this area must keep seeing the storage.                      */
+    res = pinCloneMappings( ufsSqlite, area, storage, 0 );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* A clone has to hide what it might inherit, other areas just forget.    */
+    if ( source ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_MAPPING_REMOVED ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_MAPPING_REMOVED ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_MAPPING_REMOVED ],
+                1, area );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_MAPPING_REMOVED ],
+                2, storage );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_MAPPING_REMOVED ] );
+    } else {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPING_BY_IDS ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPING_BY_IDS ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPING_BY_IDS ],
+                1, area );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPING_BY_IDS ],
+                2, storage );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPING_BY_IDS ] );
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* What the parent of the storage lists in views of area changes.         */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
+            1, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    parent = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ], 2 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    removeFromAreaFilter( ufsSqlite, area );
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_REMOVE_MAPPING, storage, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsStatusType ufsAddWhiteout( ufsType ufs,
+                              ufsIdentifierType area,
+                              ufsIdentifierType storage )
+{
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    ufsIdentifierType parent;
+    int res, seen;
+    if ( !ufs || area <= 0 || storage <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that the area and the storage exist.                      */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    res = sqlite3_step( statement );
+    parent = sqlite3_column_int64( statement, 2 );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Then find what the area sees of the storage now.                       */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    seen = res == SQLITE_ROW ? sqlite3_column_int( statement, 0 ) : 1;
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW && res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    if ( seen == UFS_SQLITE_WHITEOUT ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return ufsErrno;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Clones of this area must keep seeing what they saw.                    */
+    res = pinCloneMappings( ufsSqlite, area, storage, seen );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_WHITEOUT ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    if ( seen == 0 )
+        removeFromAreaFilter( ufsSqlite, area );
+
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_WHITEOUT, storage, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsStatusType ufsRemoveWhiteout( ufsType ufs,
+                                 ufsIdentifierType area,
+                                 ufsIdentifierType storage )
+{
+    ufsIdentifierType source, parent;
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    int res;
+    if ( !ufs || area <= 0 || storage <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    ufsErrno = ufsProbeWhiteout( ufs, area, storage );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    source = sqlite3_column_int64( statement, 1 );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    res = sqlite3_step( statement );
+    parent = sqlite3_column_int64( statement, 2 );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Clones of this area must keep the whiteout.                            */
+    res = pinCloneMappings( ufsSqlite, area, storage, UFS_SQLITE_WHITEOUT );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Like a removed mapping, a clone has to hide what it might inherit.     */
+    statement = ufsSqlite -> statements[ source ?
+                                         UFS_STATEMENT_MARK_MAPPING_REMOVED :
+                                         UFS_STATEMENT_DELETE_MAPPING_BY_IDS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_REMOVE_WHITEOUT,
+                  storage, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsStatusType ufsProbeWhiteout( ufsType ufs,
+                                ufsIdentifierType area,
+                                ufsIdentifierType storage )
+{
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    int res, removed;
+    if ( !ufs || area <= 0 || storage <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+
+    /* The closest row along the clone chain of the area decides.             */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    sqlite3_bind_int64( statement, 2, storage );
+    res = sqlite3_step( statement );
+    removed = res == SQLITE_ROW ? sqlite3_column_int( statement, 0 ) : 0;
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW && res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsErrno = removed == UFS_SQLITE_WHITEOUT ? UFS_NO_ERROR :
+                                               UFS_DOES_NOT_EXIST;
+    return ufsErrno;
+}
+
+ufsStatusType ufsAddExtents( ufsType ufs,
+                             ufsIdentifierType area,
+                             ufsIdentifierType storage,
+                             uint64_t first,
+                             uint64_t count )
+{
+    ufsIdentifierType holder;
+    ufsSqliteStruct *ufsSqlite;
+    ufsStorageInfoType info;
+    sqlite3_stmt *statement;
+    int res, removed, partial;
+    if ( !ufs || area <= 0 || storage < 0 || first > INT64_MAX ||
+         count > INT64_MAX - first ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that area and storage exist.                              */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, area );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsErrno = queryStorage( ufsSqlite, storage, &info );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* Then see whether the area holds it already, and how.                   */
+    removed = queryMappingRow( ufsSqlite, area, storage, &holder );
+    partial = removed ? 0 : isPartialMapping( ufsSqlite, holder, storage );
+    if ( removed < 0 || partial < 0 ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    if ( !removed && !partial ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return ufsErrno;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Clones of this area keep what they saw, extents included.              */
+    res = pinCloneMappings( ufsSqlite, area, storage, removed );
+    if ( res != SQLITE_DONE )
+        goto fail;
+
+    /* The area gets a row of its own unless it has one, a clone starts out   */
+    /* with the extents it inherited.                                         */
+    if ( removed || holder != area ) {
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, area );
+        sqlite3_bind_int64( statement, 2, storage );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            goto fail;
+
+        statement = ufsSqlite -> statements[ removed ?
+                                             UFS_STATEMENT_INSERT_EXTENT_RANGE :
+                                             UFS_STATEMENT_COPY_EXTENTS ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, area );
+        sqlite3_bind_int64( statement, 2, storage );
+        if ( removed ) {
+            sqlite3_bind_int64( statement, 3, UFS_SQLITE_PARTIAL );
+            sqlite3_bind_int64( statement, 4, UFS_SQLITE_PARTIAL );
+        } else {
+            sqlite3_bind_int64( statement, 3, holder );
+        }
+
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            goto fail;
+    }
+
+    if ( count ) {
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_EXTENT_RANGE ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, area );
+        sqlite3_bind_int64( statement, 2, storage );
+        sqlite3_bind_int64( statement, 3, first );
+        sqlite3_bind_int64( statement, 4, first + count - 1 );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE )
+            goto fail;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE )
+        goto fail;
+
+    if ( removed ) {
+        addToAreaFilter( ufsSqlite, area, storage );
+        bumpGeneration( ufsSqlite, info.parent );
+        recordChange( ufsSqlite, UFS_CHANGE_ADD_MAPPING, storage, -1, area,
+                      -1 );
+    }
+
+    recordChange( ufsSqlite, UFS_CHANGE_EXTENTS, storage, -1, area, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+fail:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    ufsErrno = UFS_UNKNOWN_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsGetExtents( ufsType ufs,
+                             ufsIdentifierType area,
+                             ufsIdentifierType storage,
+                             uint64_t first,
+                             uint64_t count,
+                             uint8_t *present )
+{
+    ufsIdentifierType holder;
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    int res, removed, partial;
+    if ( !ufs || area <= 0 || storage < 0 || ( count && !present ) ||
+         first > INT64_MAX || count > INT64_MAX - first ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    removed = queryMappingRow( ufsSqlite, area, storage, &holder );
+    partial = removed ? 0 : isPartialMapping( ufsSqlite, holder, storage );
+    if ( removed < 0 || partial < 0 ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    if ( removed ) {
+        ufsErrno = UFS_MAPPING_DOES_NOT_EXIST;
+        return ufsErrno;
+    }
+
+    if ( count )
+        memset( present, !partial, count );
+
+    if ( !partial || !count ) {
+        ufsErrno = UFS_NO_ERROR;
+        return ufsErrno;
+    }
+
+    /* Only the extents the area holds have rows, one range scan finds them.  */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_EXTENT_RANGE ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, holder );
+    sqlite3_bind_int64( statement, 2, storage );
+    sqlite3_bind_int64( statement, 3, first );
+    sqlite3_bind_int64( statement, 4, first + count - 1 );
+    while ( ( res = sqlite3_step( statement ) ) == SQLITE_ROW )
+        present[ sqlite3_column_int64( statement, 0 ) - first ] = 1;
+
+    sqlite3_reset( statement );
+    ufsErrno = res == SQLITE_DONE ? UFS_NO_ERROR : UFS_UNKNOWN_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsProbeExtents( ufsType ufs,
+                               ufsIdentifierType area,
+                               ufsIdentifierType storage )
+{
+    ufsIdentifierType holder;
+    ufsSqliteStruct *ufsSqlite;
+    int removed, partial;
+    if ( !ufs || area <= 0 || storage < 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    removed = queryMappingRow( ufsSqlite, area, storage, &holder );
+    partial = removed ? 0 : isPartialMapping( ufsSqlite, holder, storage );
+    if ( removed < 0 || partial < 0 ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsErrno = partial ? UFS_NO_ERROR : UFS_DOES_NOT_EXIST;
+    return ufsErrno;
+}
+
+ufsIdentifierType ufsCloneArea( ufsType ufs,
+                                ufsIdentifierType source,
+                                const char *name )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res;
+    if ( !ufs || source <= 0 || !name ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    if (strncmp( name,
+                UFS_AREA_BASE_NAME,
+                sizeof( UFS_AREA_BASE_NAME ) /
+                sizeof( char )) == 0 ) {
+        ufsErrno = UFS_ILLEGAL_NAME;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
+
+    /* First verify that the source exists.                                   */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ],
+            1, source );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    /* Then verify that the new area doesn't exist.                           */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
+            1, name, -1, SQLITE_TRANSIENT );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+    if ( res == SQLITE_ROW ) {
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return -1;
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    /* Finally, insert the clone, it shares every mapping with its source.    */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_CLONE_INTO_AREAS ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_CLONE_INTO_AREAS ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_CLONE_INTO_AREAS ],
+            1, name, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_CLONE_INTO_AREAS ],
+            2, source );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_CLONE_INTO_AREAS ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return -1;
+    }
+
+    id = sqlite3_last_insert_rowid( ufsSqlite -> db );
+    recordChange( ufsSqlite, UFS_CHANGE_ADD_AREA, -1, -1, id, source );
+    ufsErrno = UFS_NO_ERROR;
+    return id;
+}
+
+ufsStatusType ufsRemoveTree( ufsType ufs,
+                             ufsIdentifierType directory,
+                             uint64_t flags )
+{
+    int res;
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType parent;
+    if ( !ufs || directory <= 0 ||
+         ( flags & ~UFS_REMOVE_TREE_FLAG_MAPPINGS ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Make sure the directory exists.                                        */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+            1, directory );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+            2, UFS_STORAGE_TYPE_DIRECTORY );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+    parent = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ], 1 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    if ( !( flags & UFS_REMOVE_TREE_FLAG_MAPPINGS ) ) {
+        /* Without the flag mappings are a dependency, like in ufsRemove*.    */
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ],
+                1, directory );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ] );
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_IN_SUBTREE ] );
+        if ( res != SQLITE_DONE ) {
+            ufsErrno = res == SQLITE_ROW ? UFS_EXISTS_IN_EXPLICIT_MAPPING :
+                                           UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
+
+    /* Directories in the subtree change too, anyone still holding one of     */
+    /* them must not keep listing what it held.                               */
+    res = bumpGenerations( ufsSqlite, UFS_STATEMENT_QUERY_DIRECTORIES_IN_SUBTREE,
+                           directory );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Drop every mapping in the subtree in one pass. Without the flag, only  */
+    /* whiteouts and rows clones use to hide inherited mappings can be left.  */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE ],
+            1, directory );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE ] );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_MAPPINGS_IN_SUBTREE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Attribute records go away along with their storage.                    */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE ],
+            1, directory );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE ] );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_IN_SUBTREE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    /* Finally, delete the directory and everything under it.                 */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE ],
+            1, directory );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE ] );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_STORAGE_IN_SUBTREE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    bumpGeneration( ufsSqlite, parent );
+    recordChange( ufsSqlite, UFS_CHANGE_REMOVE_STORAGE,
+                  directory, parent, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsStatusType ufsMoveStorage( ufsType ufs,
+                              ufsIdentifierType storage,
+                              ufsIdentifierType newParent,
+                              const char *newName )
+{
+    int res, type;
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType oldParent;
+    if ( !ufs || storage <= 0 || newParent < 0 || !newName ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that the storage exists and get its type.                 */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
+            1, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    type = sqlite3_column_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ], 1 );
+    oldParent = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ], 2 );
+
+    /* Make sure the new parent is a directory if it's not ROOT.              */
+    if ( newParent > 0 ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                1, newParent );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                2, UFS_STORAGE_TYPE_DIRECTORY );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        if ( res != SQLITE_ROW ) {
+            ufsErrno = UFS_PARENT_DOES_NOT_EXIST;
+            return ufsErrno;
+        }
+    }
+
+    /* A directory can't be moved under itself.                               */
+    if ( type == UFS_STORAGE_TYPE_DIRECTORY && newParent > 0 ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ],
+                1, newParent );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ],
+                2, storage );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ] );
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_ANCESTOR ] );
+        if ( res != SQLITE_DONE ) {
+            ufsErrno = res == SQLITE_ROW ? UFS_BAD_CALL : UFS_UNKNOWN_ERROR;
+            return ufsErrno;
+        }
+    }
+
+    /* Make sure the new name isn't taken.                                    */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            1, newName, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            2, newParent );
+    sqlite3_bind_int(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+            3, type );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    if ( res == SQLITE_ROW ) {
+        /* Moving storage onto itself is a no-op.                             */
+        if ( sqlite3_column_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
+                0 ) == storage ) {
+            ufsErrno = UFS_NO_ERROR;
+            return ufsErrno;
+        }
+
+        ufsErrno = UFS_ALREADY_EXISTS;
+        return ufsErrno;
+    }
+
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Finally, re-link the storage, its identifier and mappings are kept.    */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ],
+            1, newParent );
+    sqlite3_bind_text(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ],
+            2, newName, -1, SQLITE_TRANSIENT );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ],
+            3, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_UPDATE_STORAGE_PARENT_NAME ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    bumpGeneration( ufsSqlite, oldParent );
+    bumpGeneration( ufsSqlite, newParent );
+    recordChange( ufsSqlite, UFS_CHANGE_MOVE_STORAGE,
+                  storage, newParent, -1, oldParent );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsSetAttributes( ufsType ufs,
+                                ufsIdentifierType storage,
+                                const ufsAttributesType *attributes )
+{
+    int res;
+    ufsSqliteStruct *ufsSqlite;
+    sqlite3_stmt *statement;
+    if ( !ufs || storage <= 0 || !attributes ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* First verify that the storage exists.                                  */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
+            1, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Then store the record under a fresh generation.                        */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_REPLACE_ATTRIBUTES ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, storage );
+    sqlite3_bind_int64( statement, 2, attributes -> mode );
+    sqlite3_bind_int64( statement, 3, attributes -> size );
+    sqlite3_bind_int64( statement, 4, attributes -> mtime );
+    sqlite3_bind_int64( statement, 5, attributes -> ctime );
+    sqlite3_bind_int64( statement, 6, attributes -> nlink );
+    sqlite3_bind_int64( statement, 7, attributes -> uid );
+    sqlite3_bind_int64( statement, 8, attributes -> gid );
+    sqlite3_bind_int64( statement, 9, ufsSqlite -> attributesGeneration + 1 );
+    res = sqlite3_step( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsSqlite -> attributesGeneration++;
+    recordChange( ufsSqlite, UFS_CHANGE_ATTRIBUTES, storage, -1, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsGetAttributes( ufsType ufs,
+                                ufsIdentifierType storage,
+                                ufsAttributesType *attributes )
+{
+    if ( !ufs || storage <= 0 || !attributes ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsErrno = queryAttributes( ufs, storage, attributes );
+    return ufsErrno;
+}
+
+ufsStatusType ufsGetManyAttributes( ufsType ufs,
+                                    const ufsIdentifierType *storages,
+                                    size_t count,
+                                    ufsAttributesType *attributesOut,
+                                    ufsStatusType *statusOut )
+{
+    int res;
+    size_t i;
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || !storages || !attributesOut || !statusOut ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+
+    /* Serve the whole batch from a single read transaction.                  */
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        if ( storages[ i ] <= 0 ) {
+            statusOut[ i ] = UFS_BAD_CALL;
+            continue;
+        }
+
+        statusOut[ i ] = queryAttributes( ufsSqlite,
+                                          storages[ i ],
+                                          &attributesOut[ i ] );
+        if ( statusOut[ i ] == UFS_UNKNOWN_ERROR ) {
+            stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+            ufsErrno = UFS_UNKNOWN_ERROR;
+            return ufsErrno;
+        }
+    }
+
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_ATTRIBUTES_BY_ID ] );
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsInvalidateAttributes( ufsType ufs,
+                                       ufsIdentifierType storage )
+{
+    int res;
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || storage <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_BY_ID ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_BY_ID ],
+            1, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_DELETE_ATTRIBUTES_BY_ID ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    if ( sqlite3_changes( ufsSqlite -> db ) == 0 ) {
+        ufsErrno = UFS_ATTRIBUTES_DO_NOT_EXIST;
+        return ufsErrno;
+    }
+
+    recordChange( ufsSqlite, UFS_CHANGE_ATTRIBUTES, storage, -1, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsImportBase( ufsType ufs,
+                             int rootFd,
+                             const ufsImportOptionsType *options )
+{
+    static const ufsImportOptionsType defaultOptions = { 0 };
+    ufsSqliteStruct *ufsSqlite;
+    uint32_t threads;
+    int res;
+    if ( !options )
+        options = &defaultOptions;
+
+    if ( !ufs || rootFd < 0 || options -> directory < 0 ||
+         ( options -> flags & ~( UFS_IMPORT_FLAG_ATTRIBUTES |
+                                 UFS_IMPORT_FLAG_SYNC ) ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    threads = options -> threads;
+    if ( threads == 0 ) {
+        res = sysconf( _SC_NPROCESSORS_ONLN );
+        threads = res > 0 ? res : 1;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Make sure the directory exists if it's not ROOT.                       */
+    if ( options -> directory > 0 ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                1, options -> directory );
+        sqlite3_bind_int(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
+                2, UFS_STORAGE_TYPE_DIRECTORY );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        if ( res != SQLITE_ROW ) {
+            ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST :
+                                            UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
+
+    /* When syncing, everything the walk doesn't find again leaves BASE.      */
+    if ( options -> flags & UFS_IMPORT_FLAG_SYNC ) {
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
+        sqlite3_clear_bindings(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ],
+                1, options -> directory );
+        sqlite3_bind_int64(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ],
+                2, options -> directory );
+        res = sqlite3_step(
+                ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
+        if ( res != SQLITE_DONE ) {
+            ufsErrno = UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
+
+    /* The walk reads the external fs in parallel, all inserts happen on this */
+    /* thread inside a single transaction.                                    */
+    ufsErrno = ufsImportWalk( rootFd, options, threads, importChunk, ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        goto rollback;
+
+    if ( options -> flags & UFS_IMPORT_FLAG_SYNC ) {
+        ufsErrno = sweepStaleBase( ufsSqlite );
+        if ( ufsErrno != UFS_NO_ERROR )
+            goto rollback;
+    }
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    recordChange( ufsSqlite, UFS_CHANGE_BASE,
+                  options -> directory, -1, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsIdentifierType ufsAddToBase( ufsType ufs,
+                                ufsIdentifierType parent,
+                                const char *name,
+                                int type,
+                                const ufsAttributesType *attributes )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType id;
+    int res, merged;
+    if ( !ufs || parent < 0 || !name ||
+         ( type != UFS_STORAGE_TYPE_FILE &&
+           type != UFS_STORAGE_TYPE_DIRECTORY ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
 
     /* Make sure parent is a directory if it's not ROOT.                      */
     if ( parent > 0 ) {
@@ -266,7 +4350,7 @@ ufsIdentifierType ufsAddFile( ufsType ufs,
                 ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
         sqlite3_clear_bindings(
                 ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
-        sqlite3_bind_int(
+        sqlite3_bind_int64(
                 ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ],
                 1, parent );
         sqlite3_bind_int(
@@ -274,415 +4358,630 @@ ufsIdentifierType ufsAddFile( ufsType ufs,
                 2, UFS_STORAGE_TYPE_DIRECTORY );
         res = sqlite3_step(
                 ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
+        sqlite3_reset(
+                ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ] );
         if ( res != SQLITE_ROW ) {
-            ufsErrno = UFS_PARENT_DOES_NOT_EXIST;
+            ufsErrno = res == SQLITE_DONE ? UFS_PARENT_DOES_NOT_EXIST :
+                                            UFS_UNKNOWN_ERROR;
             return -1;
         }
     }
 
-    /* Make sure it doesn't exist.                                            */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            3, UFS_STORAGE_TYPE_FILE );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    if ( res == SQLITE_ROW ) {
-        ufsErrno = UFS_ALREADY_EXISTS;
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
         return -1;
     }
 
-    if ( res != SQLITE_DONE ) {
+    id = importEntry( ufsSqlite, parent, name, type, 1, attributes, &merged );
+    if ( id < 0 ) {
+        stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
         ufsErrno = UFS_UNKNOWN_ERROR;
         return -1;
     }
 
-    /* Finally, insert the file into the db.                                  */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ],
-            3, UFS_STORAGE_TYPE_FILE );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_STORAGE ] );
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
     if ( res != SQLITE_DONE ) {
+        stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
         ufsErrno = UFS_UNKNOWN_ERROR;
         return -1;
     }
 
+    recordChange( ufsSqlite, UFS_CHANGE_BASE, id, parent, -1, -1 );
     ufsErrno = UFS_NO_ERROR;
-    return sqlite3_last_insert_rowid( ufsSqlite -> db );
+    return id;
 }
 
-ufsIdentifierType ufsAddArea( ufsType ufs,
-                              const char *name )
+ufsStatusType ufsRemoveFromBase( ufsType ufs,
+                                 ufsIdentifierType storage )
 {
     ufsSqliteStruct *ufsSqlite;
+    ufsIdentifierType parent;
     int res;
-    if ( !ufs || !name ) {
+    if ( !ufs || storage <= 0 ) {
         ufsErrno = UFS_BAD_CALL;
-        return -1;
-    }
-
-    if (strncmp( name,
-                UFS_AREA_BASE_NAME,
-                sizeof( UFS_AREA_BASE_NAME ) /
-                sizeof( char )) == 0 ) {
-        ufsErrno = UFS_ILLEGAL_NAME;
-        return -1;
+        return ufsErrno;
     }
 
     ufsSqlite = ufs;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
 
-    /* First verify that the area doesn't exist.                              */
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    /* Make sure the storage exists.                                          */
     sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
     sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
-    sqlite3_bind_text( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
-            1, name, -1, SQLITE_TRANSIENT );
-    res = sqlite3_step( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
-    if ( res == SQLITE_ROW ) {
-        ufsErrno = UFS_ALREADY_EXISTS;
-        return -1;
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
+            1, storage );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    parent = sqlite3_column_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ], 2 );
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
+    if ( res != SQLITE_ROW ) {
+        ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST : UFS_UNKNOWN_ERROR;
+        goto rollback;
     }
 
+    /* Everything in the subtree goes stale, including the storage itself.    */
+    sqlite3_reset(
+            ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
+    sqlite3_clear_bindings(
+            ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ],
+            1, storage );
+    sqlite3_bind_int64(
+            ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ],
+            2, -1 );
+    res = sqlite3_step(
+            ufsSqlite -> statements[ UFS_STATEMENT_MARK_SUBTREE_STALE ] );
     if ( res != SQLITE_DONE ) {
         ufsErrno = UFS_UNKNOWN_ERROR;
-        return -1;
+        goto rollback;
     }
 
-    /* Finally, insert the area into the db.                                  */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ],
-            1, name, -1, SQLITE_TRANSIENT );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_AREAS ] );
+    ufsErrno = sweepStaleBase( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
+        goto rollback;
+
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
     if ( res != SQLITE_DONE ) {
         ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    recordChange( ufsSqlite, UFS_CHANGE_BASE, storage, parent, -1, -1 );
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+
+rollback:
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
+}
+
+ufsIdentifierType ufsResolveStorageInView( ufsType ufs,
+                                           ufsViewType view,
+                                           ufsIdentifierType storage )
+{
+    if ( !view ) {
+        ufsErrno = UFS_BAD_CALL;
         return -1;
     }
 
-    ufsErrno = UFS_NO_ERROR;
-    return sqlite3_last_insert_rowid( ufsSqlite -> db );
+    return ufsResolveStorageInViewSpan( ufs, viewSpanOf( view ), storage );
+}
+
+ufsIdentifierType ufsResolveStorageInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType storage )
+{
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || isBadViewSpan( view ) || storage <= 0 ) {
+        ufsErrno = UFS_BAD_CALL;
+        return -1;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = useView( ufsSqlite, view );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return -1;
+
+    return resolveInView( ufsSqlite, view, storage );
+}
+
+ufsStatusType ufsResolveManyInView( ufsType ufs,
+                                    ufsViewType view,
+                                    const ufsIdentifierType *storages,
+                                    size_t n,
+                                    ufsIdentifierType *areasOut,
+                                    ufsStatusType *statusOut )
+{
+    if ( !view ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    return ufsResolveManyInViewSpan( ufs, viewSpanOf( view ), storages, n,
+                                     areasOut, statusOut );
+}
+
+ufsStatusType ufsResolveManyInViewSpan( ufsType ufs,
+                                        ufsViewSpanType view,
+                                        const ufsIdentifierType *storages,
+                                        size_t n,
+                                        ufsIdentifierType *areasOut,
+                                        ufsStatusType *statusOut )
+{
+    ufsSqliteStruct *ufsSqlite;
+    if ( !ufs || isBadViewSpan( view ) || ( n && ( !storages || !areasOut ||
+                                                   !statusOut ) ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    ufsErrno = useView( ufsSqlite, view );
+    if ( ufsErrno != UFS_NO_ERROR || !n )
+        return ufsErrno;
+
+    ufsErrno = resolveMany( ufsSqlite, view, storages, n, areasOut,
+                            statusOut );
+    return ufsErrno;
+}
+
+ufsStatusType ufsIterateDirInView( ufsType ufs,
+                                   ufsViewType view,
+                                   ufsIdentifierType directory,
+                                   ufsDirIter iterator,
+                                   void *userData )
+{
+    if ( !view ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    return ufsIterateDirInViewSpan( ufs, viewSpanOf( view ), directory,
+                                    iterator, userData );
+}
+
+ufsStatusType ufsIterateDirInViewSpan( ufsType ufs,
+                                       ufsViewSpanType view,
+                                       ufsIdentifierType directory,
+                                       ufsDirIter iterator,
+                                       void *userData )
+{
+    return ufsIterateFilteredDirInViewSpan( ufs, view, directory, NULL,
+                                            iterator, userData );
+}
+
+ufsStatusType ufsIterateFilteredDirInView( ufsType ufs,
+                                           ufsViewType view,
+                                           ufsIdentifierType directory,
+                                           const ufsDirFilterType *filter,
+                                           ufsDirIter iterator,
+                                           void *userData )
+{
+    if ( !view ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    return ufsIterateFilteredDirInViewSpan( ufs, viewSpanOf( view ),
+                                            directory, filter, iterator,
+                                            userData );
+}
+
+ufsStatusType ufsIterateFilteredDirInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType directory,
+                                               const ufsDirFilterType *filter,
+                                               ufsDirIter iterator,
+                                               void *userData )
+{
+    ufsSqliteDirIterType dirIter;
+    if ( !iterator ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    dirIter.iterator = iterator;
+    dirIter.userData = userData;
+    return ufsIterateResolvedDirInViewSpan( ufs, view, directory, filter,
+                                            forgetArea, &dirIter );
+}
+
+ufsStatusType ufsIterateResolvedDirInViewSpan( ufsType ufs,
+                                               ufsViewSpanType view,
+                                               ufsIdentifierType directory,
+                                               const ufsDirFilterType *filter,
+                                               ufsResolvedDirIter iterator,
+                                               void *userData )
+{
+    static const ufsDirFilterType all = { 0, NULL, NULL };
+    ufsIdentifierType *entries, *grown, *areas;
+    size_t numEntries, maxEntries, length, upperLength, i, j;
+    ufsSqliteStruct *ufsSqlite;
+    ufsStatusType status, *statuses;
+    sqlite3_stmt *statement;
+    const char *bound;
+    char *lower, *upper;
+    int res;
+    if ( !ufs || isBadViewSpan( view ) || directory < 0 || !iterator ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    filter = filter ? filter : &all;
+    if ( directory > 0 ) {
+        statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID_TYPE ];
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, directory );
+        sqlite3_bind_int( statement, 2, UFS_STORAGE_TYPE_DIRECTORY );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_ROW ) {
+            ufsErrno = res == SQLITE_DONE ? UFS_DOES_NOT_EXIST :
+                                            UFS_UNKNOWN_ERROR;
+            return ufsErrno;
+        }
+    }
+
+    ufsErrno = useView( ufsSqlite, view );
+    if ( ufsErrno != UFS_NO_ERROR )
+        return ufsErrno;
+
+    /* The prefix and the glob disagree, no name can match both.              */
+    length = filterPrefixLength( filter );
+    if ( length == SIZE_MAX )
+        return ufsErrno;
+
+    /* Names that start with the prefix are exactly those in [lower, upper),  */
+    /* upper is the prefix with its last byte that isn't 0xff incremented.    */
+    bound = filter -> prefix && strlen( filter -> prefix ) == length ?
+            filter -> prefix : filter -> glob;
+    lower = malloc( 2 * length + 2 );
+    if ( !lower ) {
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return ufsErrno;
+    }
+
+    upper = lower + length + 1;
+    memcpy( lower, length ? bound : "", length );
+    memcpy( upper, lower, length );
+    for ( upperLength = length;
+          upperLength && ( unsigned char )upper[ upperLength - 1 ] == 0xff;
+          upperLength-- )
+        ;
+
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_QUERY_CHILDREN_FILTERED ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, directory );
+    sqlite3_bind_text( statement, 2, lower, length, SQLITE_STATIC );
+    if ( upperLength ) {
+        upper[ upperLength - 1 ]++;
+        sqlite3_bind_text( statement, 3, upper, upperLength, SQLITE_STATIC );
+    } else {
+        /* Without an upper bound, every name sorts before a blob.            */
+        sqlite3_bind_zeroblob( statement, 3, 0 );
+    }
+
+    sqlite3_bind_int64( statement, 4, filter -> types ? filter -> types :
+                                      UFS_DIR_FILTER_TYPE_FILE |
+                                      UFS_DIR_FILTER_TYPE_DIRECTORY );
+    if ( filter -> glob )
+        sqlite3_bind_text( statement, 5, filter -> glob, -1, SQLITE_STATIC );
+
+    /* Entries are collected before the iterator is called, it needs their    */
+    /* count and may change ufs itself. They're resolved together once the    */
+    /* listing is over, and those the view doesn't see are left out.          */
+    entries = NULL;
+    numEntries = maxEntries = 0;
+    status = UFS_NO_ERROR;
+    while ( ( res = sqlite3_step( statement ) ) == SQLITE_ROW ) {
+        if ( numEntries == maxEntries ) {
+            grown = realloc( entries, ( maxEntries * 2 + 64 ) *
+                                      sizeof( *entries ) );
+            if ( !grown ) {
+                status = UFS_OUT_OF_MEMORY;
+                break;
+            }
+
+            entries = grown;
+            maxEntries = maxEntries * 2 + 64;
+        }
+
+        entries[ numEntries++ ] = sqlite3_column_int64( statement, 0 );
+    }
+
+    sqlite3_reset( statement );
+    free( lower );
+    if ( status == UFS_NO_ERROR && res != SQLITE_DONE )
+        status = UFS_UNKNOWN_ERROR;
+
+    areas = NULL;
+    statuses = NULL;
+    if ( status == UFS_NO_ERROR && numEntries ) {
+        areas = malloc( numEntries * sizeof( *areas ) );
+        statuses = malloc( numEntries * sizeof( *statuses ) );
+        status = areas && statuses ? resolveMany( ufsSqlite, view, entries,
+                                                  numEntries, areas,
+                                                  statuses ) :
+                                     UFS_OUT_OF_MEMORY;
+    }
+
+    for ( i = j = 0; status == UFS_NO_ERROR && i < numEntries; i++ ) {
+        if ( statuses[ i ] == UFS_CANNOT_RESOLVE_STORAGE )
+            continue;
+
+        status = statuses[ i ];
+        entries[ j ] = entries[ i ];
+        areas[ j++ ] = areas[ i ];
+    }
+
+    for ( i = 0; status == UFS_NO_ERROR && i < j; i++ )
+        status = iterator( entries[ i ], areas[ i ], i, j, userData );
+
+    free( entries );
+    free( areas );
+    free( statuses );
+    ufsErrno = status;
+    return ufsErrno;
+}
+
+ufsStatusType ufsGetDirectoryGeneration( ufsType ufs,
+                                         ufsIdentifierType directory,
+                                         uint64_t *generation )
+{
+    ufsSqliteStruct *ufsSqlite;
+    ufsSqliteGenerationType *slot;
+    if ( !ufs || directory < 0 || !generation ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsSqlite = ufs;
+    /* Only the instance bumps generations, readers answer with its own.      */
+    if ( ufsSqlite -> owner )
+        ufsSqlite = ufsSqlite -> owner;
+
+    slot = findGeneration( &ufsSqlite -> generations, directory );
+    *generation = ufsSqlite -> generations.floor;
+    if ( slot && slot -> generation > *generation )
+        *generation = slot -> generation;
+
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsCollapse( ufsType ufs,
+                           ufsViewType view )
+{
+    if ( !view ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    return ufsCollapseSpan( ufs, viewSpanOf( view ) );
 }
 
-ufsStatusType ufsAddMapping( ufsType ufs,
-                             ufsIdentifierType area,
-                             ufsIdentifierType storage )
+ufsStatusType ufsCollapseSpan( ufsType ufs,
+                               ufsViewSpanType view )
 {
-    int res;
+    ufsIdentifierType last, *merges;
     ufsSqliteStruct *ufsSqlite;
-    if ( !ufs || area <= 0 || storage < 0 ) {
+    sqlite3_stmt *statement;
+    size_t i, numMerges;
+    int res;
+    if ( !ufs || isBadViewSpan( view ) ) {
         ufsErrno = UFS_BAD_CALL;
         return ufsErrno;
     }
 
     ufsSqlite = ufs;
-
-    /* First verify that area exists.                                         */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
-    sqlite3_bind_int( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ],
-            1, area );
-    res = sqlite3_step( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_ID ] );
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
+    ufsErrno = checkImageRoom( ufsSqlite );
+    if ( ufsErrno != UFS_NO_ERROR )
         return ufsErrno;
-    }
 
-    /* Then verify that the storage exists.                                   */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
-    sqlite3_bind_int( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ],
-            1, storage );
-    res = sqlite3_step( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_ID ] );
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
+    ufsErrno = validateView( ufsSqlite, view );
+    if ( ufsErrno != UFS_NO_ERROR )
         return ufsErrno;
-    }
 
-    /* verify that the mapping doesn't exist.                                 */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-    sqlite3_bind_int( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
-            1, area );
-    sqlite3_bind_int( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
-            2, storage );
-    res = sqlite3_step( 
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-    if ( res == SQLITE_ROW ) {
-        ufsErrno = UFS_ALREADY_EXISTS;
+    if ( view.count < 2 )
         return ufsErrno;
-    }
 
+    last = view.areas[ view.count - 1 ];
+    merges = NULL;
+    numMerges = 0;
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_BEGIN_TRANSACTION );
     if ( res != SQLITE_DONE ) {
         ufsErrno = UFS_UNKNOWN_ERROR;
         return ufsErrno;
     }
 
-    /* Finally, insert the area into the db.                                  */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ],
-            1, area );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ],
-            2, storage );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_INSERT_INTO_MAPPINGS ] );
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_CLEAR_COLLAPSE_AREAS );
     if ( res != SQLITE_DONE ) {
         ufsErrno = UFS_UNKNOWN_ERROR;
-        return ufsErrno;
+        goto rollback;
     }
 
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_COLLAPSE_AREA ];
+    for ( i = 0; i + 1 < view.count; i++ ) {
+        sqlite3_reset( statement );
+        sqlite3_clear_bindings( statement );
+        sqlite3_bind_int64( statement, 1, view.areas[ i ] );
+        sqlite3_bind_int64( statement, 2, i );
+        res = sqlite3_step( statement );
+        sqlite3_reset( statement );
+        if ( res != SQLITE_DONE ) {
+            ufsErrno = UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
+    }
 
-    ufsErrno = UFS_NO_ERROR;
-	return ufsErrno;
-}
+    /* The whole collapse is a handful of set operations over the mappings,   */
+    /* each area's rows are contiguous in the table so they're range scans.   */
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_CLEAR_COLLAPSE );
+    if ( res == SQLITE_DONE )
+        res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_INSERT_COLLAPSE );
 
-ufsIdentifierType ufsGetDirectory( ufsType ufs,
-                                   ufsIdentifierType parent,
-                                   const char *name )
-{
-    int res;
-    ufsSqliteStruct *ufsSqlite;
-    if ( !ufs || parent < 0 || !name ) {
-        ufsErrno = UFS_BAD_CALL;
-        return -1;
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
     }
 
-    ufsSqlite = ufs;
+    if ( last == UFS_AREA_BASE_IDENTIFIER ) {
+        res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_MARK_COLLAPSE_BASE );
+        if ( res != SQLITE_DONE ) {
+            ufsErrno = UFS_UNKNOWN_ERROR;
+            goto rollback;
+        }
 
-    /* Query the db and get the identifier.                                   */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            3, UFS_STORAGE_TYPE_DIRECTORY );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+        goto commit;
+    }
 
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
-        return -1;
+    /* What the last area ends up holding of storage held by extents depends  */
+    /* on the mappings before they change.                                    */
+    res = planExtentMerge( ufsSqlite, view, &merges, &numMerges );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = res == SQLITE_NOMEM ? UFS_OUT_OF_MEMORY : UFS_UNKNOWN_ERROR;
+        goto rollback;
     }
 
-    ufsErrno = UFS_NO_ERROR;
-	return sqlite3_column_int( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-                               0 );;
-}
+    /* Storage the last area already contains is left alone, so its clones    */
+    /* are only pinned for storage they never saw through it.                 */
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_DELETE_COLLAPSE_IN_AREA ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, last );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
 
-ufsIdentifierType ufsGetFile( ufsType ufs,
-                              ufsIdentifierType parent,
-                              const char *name )
-{
-    int res;
-    ufsSqliteStruct *ufsSqlite;
-    if ( !ufs || parent < 0 || !name ) {
-        ufsErrno = UFS_BAD_CALL;
-        return -1;
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_COLLAPSE_INTO_CLONES ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, last );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
     }
 
-    ufsSqlite = ufs;
+    statement = ufsSqlite -> statements[ UFS_STATEMENT_INSERT_COLLAPSE_INTO_AREA ];
+    sqlite3_reset( statement );
+    sqlite3_clear_bindings( statement );
+    sqlite3_bind_int64( statement, 1, last );
+    res = sqlite3_step( statement );
+    sqlite3_reset( statement );
+    if ( res == SQLITE_DONE )
+        res = applyExtentMerge( ufsSqlite, last, merges, numMerges );
 
-    /* Query the db and get the identifier.                                   */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            1, name, -1, SQLITE_TRANSIENT );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            2, parent );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-            3, UFS_STORAGE_TYPE_FILE );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ] );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
 
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
-        return -1;
+commit:
+    res = bumpGenerations( ufsSqlite, UFS_STATEMENT_QUERY_COLLAPSE_PARENTS, -1 );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
     }
 
+    res = stepSqliteStatement( ufsSqlite, UFS_STATEMENT_COMMIT_TRANSACTION );
+    if ( res != SQLITE_DONE ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        goto rollback;
+    }
+
+    free( merges );
+
+    /* The filter of the last area is rebuilt on its next use.                */
+    dropAreaFilter( ufsSqlite, last );
+    recordChange( ufsSqlite, UFS_CHANGE_COLLAPSE, -1, -1, last, -1 );
     ufsErrno = UFS_NO_ERROR;
-	return sqlite3_column_int( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_STORAGE_BY_NAME_TYPE ],
-                               0 );
+    return ufsErrno;
+
+rollback:
+    free( merges );
+    stepSqliteStatement( ufsSqlite, UFS_STATEMENT_ROLLBACK_TRANSACTION );
+    return ufsErrno;
 }
 
-ufsIdentifierType ufsGetArea( ufsType ufs,
-                              const char *name )
+ufsStatusType ufsSubscribeChanges( ufsType ufs,
+                                   uint64_t *cursor )
 {
-    int res;
     ufsSqliteStruct *ufsSqlite;
-    if ( !ufs || !name ) {
+    if ( !ufs || !cursor ) {
         ufsErrno = UFS_BAD_CALL;
-        return -1;
-    }
-
-    /* BASE is defined to have identifier 0.                                  */
-    if (strncmp( name, UFS_AREA_BASE_NAME, sizeof( UFS_AREA_BASE_NAME )) == 0) {
-        return UFS_AREA_BASE_IDENTIFIER;
+        return ufsErrno;
     }
 
     ufsSqlite = ufs;
-
-    /* Query the db and get the identifier.                                   */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
-    sqlite3_bind_text(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
-            1, name, -1, SQLITE_TRANSIENT );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ] );
-
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
-        return -1;
+    if ( !ufsSqlite -> changes ) {
+        ufsSqlite -> changes = malloc( UFS_CHANGE_FEED_SIZE *
+                                       sizeof( *ufsSqlite -> changes ) );
+        if ( !ufsSqlite -> changes ) {
+            ufsErrno = UFS_OUT_OF_MEMORY;
+            return ufsErrno;
+        }
     }
 
+    *cursor = ufsSqlite -> nextChange;
     ufsErrno = UFS_NO_ERROR;
-	return sqlite3_column_int( ufsSqlite -> statements[ UFS_STATEMENT_QUERY_AREAS_BY_NAME ],
-                               0 );
+    return ufsErrno;
 }
 
-ufsStatusType ufsProbeMapping( ufsType ufs,
-                               ufsIdentifierType area,
-                               ufsIdentifierType storage )
+ufsStatusType ufsPollChanges( ufsType ufs,
+                              uint64_t *cursor,
+                              ufsChangeType *changes,
+                              size_t max,
+                              size_t *count )
 {
-    int res;
     ufsSqliteStruct *ufsSqlite;
-    if ( !ufs || area < 0 || storage < 0 ) {
+    uint64_t next;
+    size_t i;
+    if ( !ufs || !cursor || ( !changes && max ) || !count ) {
         ufsErrno = UFS_BAD_CALL;
         return ufsErrno;
     }
 
     ufsSqlite = ufs;
-
-    /* Query the db and get the identifier.                                   */
-    sqlite3_reset(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-    sqlite3_clear_bindings(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
-            1, area );
-    sqlite3_bind_int(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ],
-            2, storage );
-    res = sqlite3_step(
-            ufsSqlite -> statements[ UFS_STATEMENT_QUERY_MAPPINGS_BY_IDS ] );
-
-    if ( res != SQLITE_ROW ) {
-        ufsErrno = UFS_DOES_NOT_EXIST;
+    next = ufsSqlite -> nextChange;
+    *count = 0;
+    if ( !ufsSqlite -> changes || *cursor > next ) {
+        ufsErrno = UFS_BAD_CALL;
         return ufsErrno;
     }
 
-    ufsErrno = UFS_NO_ERROR;
-	return ufsErrno;
-}
-
-ufsStatusType ufsRemoveDirectory( ufsType ufs,
-                                  ufsIdentifierType directory )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
-
-ufsStatusType ufsRemoveFile( ufsType ufs,
-                             ufsIdentifierType file )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
-
-ufsStatusType ufsRemoveArea( ufsType ufs,
-                             ufsIdentifierType area )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
-
-ufsStatusType ufsRemoveMapping( ufsType ufs,
-                                ufsIdentifierType area,
-                                ufsIdentifierType storage )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
-
-ufsIdentifierType ufsResolveStorageInView( ufsType ufs,
-                                           ufsViewType view,
-                                           ufsIdentifierType storage )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
+    if ( next - *cursor > UFS_CHANGE_FEED_SIZE ) {
+        *cursor = next;
+        ufsErrno = UFS_CHANGES_OVERFLOWED;
+        return ufsErrno;
+    }
 
-ufsStatusType ufsIterateDirInView( ufsType ufs,
-                                   ufsViewType view,
-                                   ufsIdentifierType directory,
-                                   ufsDirIter iterator,
-                                   void *userData )
-{
-    ufsErrno = UFS_NO_ERROR;
-	return 0;
-}
+    for ( i = 0; i < max && *cursor < next; i++, ( *cursor )++ )
+        changes[ i ] = ufsSqlite -> changes[ *cursor % UFS_CHANGE_FEED_SIZE ];
 
-ufsStatusType ufsCollapse( ufsType ufs,
-                           ufsViewType view )
-{
+    *count = i;
     ufsErrno = UFS_NO_ERROR;
-	return 0;
+    return ufsErrno;
 }
@@ -0,0 +1,3266 @@
+/******************************************************************************\
+*  ufs_fuse.c                                                                  *
+*                                                                              *
+*  Serves a view of ufs as a filesystem, see ufs_fuse.h.                       *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+#define FUSE_USE_VERSION 35
+
+#include "ufs_fuse.h"
+#include <fuse_lowlevel.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#define UFS_FUSE_INODE( storage ) ( ( fuse_ino_t )( storage ) + FUSE_ROOT_ID )
+#define UFS_FUSE_STORAGE( inode ) \
+    ( ( ufsIdentifierType )( inode ) - FUSE_ROOT_ID )
+/* The kernel keeps entries and attributes until ufs tells it they changed.   */
+#define UFS_FUSE_TIMEOUT (86400.0)
+#define UFS_FUSE_NAME_SIZE (32)
+#define UFS_FUSE_COPY_SIZE (1024 * 1024)
+#define UFS_FUSE_INITIAL_ENTRIES (64)
+#define UFS_FUSE_INITIAL_INODES (1024)
+#define UFS_FUSE_CHANGES (256)
+#define UFS_FUSE_BATCH (64)
+/* The largest request libfuse takes, what the kernel sends is capped by it.  */
+#define UFS_FUSE_MAX_WRITE (1024 * 1024)
+/* Files larger than an extent are copied up an extent at a time.             */
+#define UFS_FUSE_EXTENT_SIZE (1024 * 1024)
+/* What an extent of the first area is while it's copied into it.             */
+#define UFS_FUSE_EXTENT_COPYING (2)
+/* Filesystem pairs whose copy strategy is remembered.                        */
+#define UFS_FUSE_PAIRS (16)
+#define UFS_FUSE_FILE( fi ) ( ( ufsFuseFileType * )( uintptr_t )( fi ) -> fh )
+
+/* What an open directory lists, taken when it's opened so offsets stay       */
+/* valid while it's read.                                                     */
+typedef struct ufsFuseEntryStruct {
+    ufsIdentifierType storage;
+    ufsIdentifierType area;         /* Where it resolved when it was listed.  */
+    uint32_t type;
+    char name[ UFS_STORAGE_NAME_MAX + 1 ];
+} ufsFuseEntryType;
+
+typedef struct ufsFuseDirStruct {
+    ufsIdentifierType directory;
+    ufsIdentifierType parent;
+    uint64_t generation;            /* Of the directory when it was listed.   */
+    ufsFuseEntryType *entries;
+    size_t numEntries;
+    size_t maxEntries;
+    struct ufsFuseDirStruct *prev;
+    struct ufsFuseDirStruct *next;
+} ufsFuseDirType;
+
+/* Storage the kernel holds an inode of, with the entry it was last seen      */
+/* under. Only those can be cached by the kernel, entries that aren't found   */
+/* are never cached, so nothing else is ever invalidated.                     */
+typedef struct ufsFuseInodeStruct {
+    ufsIdentifierType storage;
+    uint32_t type;
+    ufsIdentifierType parent;
+    uint64_t lookups;
+    char name[ UFS_STORAGE_NAME_MAX + 1 ];
+    struct ufsFuseInodeStruct *next;
+} ufsFuseInodeType;
+
+/* Content of storage in an area that holds it by extents, the rest is read   */
+/* from the layer below it, down to one that holds it whole.                  */
+typedef struct ufsFuseLayerStruct {
+    int fd;
+    dev_t device;                   /* The filesystem of the backing file.    */
+    uint64_t numExtents;            /* Extents that lie whole in the layer    */
+                                    /* below, the rest are always in this one.*/
+    uint8_t *present;               /* Which of them this one holds, or is    */
+                                    /* copying into itself.                   */
+    struct ufsFuseLayerStruct *lower;
+} ufsFuseLayerType;
+
+/* Storage held by extents, shared by its open files. Extents are only added  */
+/* with the lock held, and read without it.                                   */
+typedef struct ufsFusePartialStruct {
+    ufsIdentifierType storage;
+    ufsIdentifierType area;
+    ufsFuseLayerType *layers;
+    uint64_t marked;                /* Extents from numExtents up to this are */
+                                    /* known to ufs to be held.               */
+    uint32_t opens;                 /* Including a pending background copy.   */
+    struct ufsFusePartialStruct *next;
+    struct ufsFusePartialStruct *nextCopy;
+} ufsFusePartialType;
+
+/* The first copy strategy known to work from a filesystem to another.        */
+typedef struct ufsFusePairStruct {
+    dev_t source;
+    dev_t target;
+    int strategy;
+} ufsFusePairType;
+
+typedef struct ufsFuseFileStruct {
+    int fd;
+    int backing;                    /* The id the kernel reads and writes it  */
+                                    /* by when it's passed through, or 0.     */
+    ufsFusePartialType *partial;    /* NULL if the area holds it whole.       */
+} ufsFuseFileType;
+
+typedef struct ufsFuseInvalidationStruct {
+    fuse_ino_t inode;
+    fuse_ino_t parent;
+    int content;                    /* Whether cached content is dropped.     */
+    int drop;                       /* Whether the inode itself is dropped.   */
+    char name[ UFS_STORAGE_NAME_MAX + 1 ];
+} ufsFuseInvalidationType;
+
+typedef struct ufsFuseStruct {
+    ufsType ufs;
+    int baseFd;
+    int upperFd;
+    ufsIdentifierType *areas;
+    int *fds;                       /* Directory of each area in the view.    */
+    ufsViewSpanType view;
+    ufsIdentifierType top;          /* The area that receives writes.         */
+    struct fuse_session *session;
+    int mounted;
+    uint32_t threads;
+    uint32_t maxIdleThreads;
+    uint32_t flags;
+    int passthrough;                /* Whether the kernel agreed to it.       */
+    int writeback;                  /* Whether writes are cached, idem.       */
+    pthread_mutex_t lock;           /* Serializes requests that change ufs,   */
+                                    /* file content is served without it.     */
+    pthread_rwlock_t ufsLock;       /* Read through readers, written to       */
+                                    /* change ufs or the view.                */
+    pthread_mutex_t tableLock;      /* Guards inodes, dirs and readers.       */
+    ufsType *readers;               /* Idle readers of ufs.                   */
+    size_t numReaders;
+    size_t maxReaders;
+    ufsFuseDirType *dirs;           /* Open directories, the kernel may never */
+                                    /* release them if it's unmounted.        */
+    ufsFusePartialType *partials;   /* Open storage held by extents, idem.    */
+    ufsFusePartialType *copies;     /* Waiting to be copied in background.    */
+    pthread_t copier;
+    int copierStarted;
+    int stopping;
+    pthread_cond_t copyQueued;
+    pthread_cond_t extentCopied;    /* Waited on with the lock.               */
+    pthread_mutex_t pairsLock;      /* Guards pairs and the copy stats.       */
+    ufsFusePairType pairs[ UFS_FUSE_PAIRS ];
+    uint32_t numPairs;
+    ufsFuseInodeType **inodes;
+    size_t buckets;
+    size_t numInodes;
+    uint64_t cursor;                /* In the change feed of ufs.             */
+    ufsFuseInvalidationType *invalidations;
+    size_t numInvalidations;
+    size_t maxInvalidations;
+    ufsFuseStatsType stats;
+} ufsFuseStruct;
+
+static inline int toErrno( ufsStatusType status );
+static inline uint64_t nowNanoseconds( void );
+static inline int areaIndex( ufsFuseStruct *fuse, ufsIdentifierType area );
+static inline int areaFd( ufsFuseStruct *fuse, ufsIdentifierType area );
+static inline void backingName( ufsIdentifierType storage, char *name );
+static inline ufsType acquireReader( ufsFuseStruct *fuse );
+static inline void releaseReader( ufsFuseStruct *fuse, ufsType reader );
+static inline int basePath( ufsType ufs,
+                            ufsIdentifierType storage,
+                            char *path,
+                            size_t size );
+static inline int resolveStorage( ufsFuseStruct *fuse,
+                                  ufsType ufs,
+                                  ufsIdentifierType storage,
+                                  ufsIdentifierType *area );
+static inline int lookupChild( ufsFuseStruct *fuse,
+                               ufsType ufs,
+                               ufsIdentifierType parent,
+                               const char *name,
+                               ufsIdentifierType *storage,
+                               uint32_t *type,
+                               ufsIdentifierType *area );
+static inline void attributesToStat( const ufsAttributesType *attributes,
+                                     struct stat *st );
+static inline int statStorage( ufsFuseStruct *fuse,
+                               ufsType ufs,
+                               ufsIdentifierType storage,
+                               uint32_t type,
+                               ufsIdentifierType area,
+                               struct stat *st );
+static inline int fillStat( ufsFuseStruct *fuse,
+                            ufsType ufs,
+                            ufsIdentifierType storage,
+                            uint32_t type,
+                            ufsIdentifierType area,
+                            ufsStatusType status,
+                            const ufsAttributesType *attributes,
+                            int dirFd,
+                            const char *name,
+                            struct stat *st );
+static inline int openBacking( ufsFuseStruct *fuse,
+                               ufsIdentifierType storage,
+                               ufsIdentifierType area,
+                               int flags );
+static inline int setHandle( fuse_req_t req,
+                             ufsFuseStruct *fuse,
+                             int fd,
+                             ufsFusePartialType *partial,
+                             struct fuse_file_info *fi );
+static inline void releaseHandle( fuse_req_t req,
+                                  ufsFuseStruct *fuse,
+                                  ufsFuseFileType *file );
+static inline int backingFlags( ufsFuseStruct *fuse, int flags );
+static inline int loadLayers( ufsFuseStruct *fuse,
+                              ufsIdentifierType storage,
+                              ufsIdentifierType area,
+                              int flags,
+                              ufsFuseLayerType **layers );
+static inline void freeLayers( ufsFuseLayerType *layers );
+static inline ufsFuseLayerType *layerAt( ufsFuseLayerType *layers,
+                                         uint64_t extent );
+static inline size_t fillSegments( ufsFuseLayerType *layers,
+                                   off_t offset,
+                                   size_t size,
+                                   struct fuse_buf *segments );
+static inline int pairStrategy( ufsFuseStruct *fuse,
+                                dev_t source,
+                                dev_t target );
+static inline void setPairStrategy( ufsFuseStruct *fuse,
+                                    dev_t source,
+                                    dev_t target,
+                                    int strategy );
+static inline int copyWith( int strategy,
+                            int source,
+                            int target,
+                            off_t offset,
+                            size_t size );
+static inline int copySegment( ufsFuseStruct *fuse,
+                               ufsFuseLayerType *layer,
+                               int fd,
+                               dev_t device,
+                               off_t offset,
+                               size_t size,
+                               int lastStrategy );
+static inline int copyRange( ufsFuseStruct *fuse,
+                             ufsFuseLayerType *layers,
+                             int fd,
+                             dev_t device,
+                             off_t offset,
+                             size_t size );
+static inline int acquirePartial( ufsFuseStruct *fuse,
+                                  ufsIdentifierType storage,
+                                  ufsIdentifierType area,
+                                  ufsFusePartialType **partial );
+static inline void releasePartial( ufsFuseStruct *fuse,
+                                   ufsFusePartialType *partial );
+static inline int copyExtents( ufsFuseStruct *fuse,
+                               ufsFusePartialType *partial,
+                               uint64_t first,
+                               uint64_t last );
+static inline void queueCopy( ufsFuseStruct *fuse,
+                              ufsFusePartialType *partial );
+static void *copyInBackground( void *data );
+static inline void stopCopier( ufsFuseStruct *fuse );
+static inline int prepareWrite( ufsFuseStruct *fuse,
+                                ufsFusePartialType *partial,
+                                off_t offset,
+                                size_t size );
+static inline int truncatePartial( ufsFuseStruct *fuse,
+                                   ufsFusePartialType *partial,
+                                   off_t size );
+static inline int copyUp( ufsFuseStruct *fuse,
+                          ufsIdentifierType storage,
+                          ufsIdentifierType area,
+                          int empty );
+static inline int mapInTop( ufsFuseStruct *fuse, ufsIdentifierType storage );
+static inline int setAttributesInTop( ufsFuseStruct *fuse,
+                                      ufsIdentifierType storage,
+                                      const ufsAttributesType *attributes );
+static inline int addExtents( ufsFuseStruct *fuse,
+                              ufsIdentifierType area,
+                              ufsIdentifierType storage,
+                              uint64_t first,
+                              uint64_t count );
+static inline void replyEntry( fuse_req_t req,
+                               ufsFuseStruct *fuse,
+                               ufsType ufs,
+                               ufsIdentifierType parent,
+                               const char *name,
+                               ufsIdentifierType storage,
+                               uint32_t type,
+                               ufsIdentifierType area );
+static inline uint64_t mixKey( uint64_t key );
+static inline ufsFuseInodeType *findInode( ufsFuseStruct *fuse,
+                                           ufsIdentifierType storage );
+static inline int growInodes( ufsFuseStruct *fuse );
+static inline void rememberInode( ufsFuseStruct *fuse,
+                                  ufsIdentifierType parent,
+                                  const char *name,
+                                  ufsIdentifierType storage,
+                                  uint32_t type );
+static inline void forgetInode( ufsFuseStruct *fuse,
+                                ufsIdentifierType storage,
+                                uint64_t lookups );
+static inline int inView( ufsFuseStruct *fuse, ufsIdentifierType area );
+static inline int queueInvalidation( ufsFuseStruct *fuse,
+                                     const ufsFuseInodeType *inode,
+                                     int entry,
+                                     int content );
+static inline int queueAll( ufsFuseStruct *fuse );
+static inline int queueChange( ufsFuseStruct *fuse,
+                               const ufsChangeType *change );
+static inline int queueChanges( ufsFuseStruct *fuse );
+static inline void sendInvalidations( ufsFuseStruct *fuse,
+                                      ufsFuseInvalidationType *invalidations,
+                                      size_t count );
+static inline ufsStatusType openAreas( ufsFuseStruct *fuse,
+                                       ufsViewSpanType view,
+                                       ufsIdentifierType **areas,
+                                       int **fds );
+static inline void closeAreas( ufsFuseStruct *fuse,
+                               ufsIdentifierType *areas,
+                               int *fds,
+                               uint32_t count );
+static inline void freeDir( ufsFuseStruct *fuse, ufsFuseDirType *dir );
+static ufsStatusType collectEntry( ufsIdentifierType storage,
+                                   ufsIdentifierType area,
+                                   uint64_t currEntry,
+                                   uint64_t numEntries,
+                                   void *userData );
+static ufsStatusType rejectEntry( ufsIdentifierType storage,
+                                  uint64_t currEntry,
+                                  uint64_t numEntries,
+                                  void *userData );
+
+
+int toErrno( ufsStatusType status )
+{
+    switch ( status ) {
+        case UFS_NO_ERROR:
+            return 0;
+        case UFS_ALREADY_EXISTS:
+            return EEXIST;
+        case UFS_BAD_CALL:
+            return EINVAL;
+        case UFS_DOES_NOT_EXIST:
+        case UFS_CANNOT_RESOLVE_STORAGE:
+        case UFS_PARENT_DOES_NOT_EXIST:
+            return ENOENT;
+        case UFS_DIRECTORY_IS_NOT_EMPTY:
+            return ENOTEMPTY;
+        case UFS_OUT_OF_MEMORY:
+            return ENOMEM;
+        default:
+            return EIO;
+    }
+}
+
+uint64_t nowNanoseconds( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int areaIndex( ufsFuseStruct *fuse, ufsIdentifierType area )
+{
+    uint32_t i;
+
+    for ( i = 0; i < fuse -> view.count; i++ ) {
+        if ( fuse -> areas[ i ] == area )
+            return i;
+    }
+
+    return -1;
+}
+
+int areaFd( ufsFuseStruct *fuse, ufsIdentifierType area )
+{
+    int index;
+
+    index = areaIndex( fuse, area );
+    return index < 0 ? -1 : fuse -> fds[ index ];
+}
+
+void backingName( ufsIdentifierType storage, char *name )
+{
+    snprintf( name, UFS_FUSE_NAME_SIZE, "%lld", ( long long )storage );
+}
+
+/* Requests that only read ufs read it in parallel, through readers of their  */
+/* own, with the lock of ufs held for reading.                                */
+ufsType acquireReader( ufsFuseStruct *fuse )
+{
+    ufsType reader;
+
+    reader = NULL;
+    pthread_mutex_lock( &fuse -> tableLock );
+    if ( fuse -> numReaders )
+        reader = fuse -> readers[ --fuse -> numReaders ];
+    pthread_mutex_unlock( &fuse -> tableLock );
+    return reader ? reader : ufsInitReader( fuse -> ufs );
+}
+
+void releaseReader( ufsFuseStruct *fuse, ufsType reader )
+{
+    ufsType *readers;
+    size_t maxReaders;
+
+    pthread_mutex_lock( &fuse -> tableLock );
+    if ( fuse -> numReaders == fuse -> maxReaders ) {
+        maxReaders = fuse -> maxReaders * 2 + 4;
+        readers = realloc( fuse -> readers, maxReaders * sizeof( *readers ) );
+        if ( readers ) {
+            fuse -> readers = readers;
+            fuse -> maxReaders = maxReaders;
+        }
+    }
+
+    if ( fuse -> numReaders < fuse -> maxReaders ) {
+        fuse -> readers[ fuse -> numReaders++ ] = reader;
+        reader = NULL;
+    }
+    pthread_mutex_unlock( &fuse -> tableLock );
+    ufsDestroy( reader );
+}
+
+int basePath( ufsType ufs,
+              ufsIdentifierType storage,
+              char *path,
+              size_t size )
+{
+    ufsStorageInfoType info;
+    size_t position, length;
+
+    /* The path is built from the storage up to ROOT, right to left.          */
+    position = size - 1;
+    path[ position ] = '\0';
+    while ( storage != UFS_STORAGE_ROOT_IDENTIFIER ) {
+        if ( ufsGetStorage( ufs, storage, &info ) != UFS_NO_ERROR )
+            return -toErrno( ufsErrno );
+
+        length = strlen( info.name );
+        if ( position < length + 1 )
+            return -ENAMETOOLONG;
+
+        position -= length;
+        memcpy( path + position, info.name, length );
+        path[ --position ] = '/';
+        storage = info.parent;
+    }
+
+    if ( position == size - 1 ) {
+        strcpy( path, "." );
+        return 0;
+    }
+
+    memmove( path, path + position + 1, size - position - 1 );
+    return 0;
+}
+
+int resolveStorage( ufsFuseStruct *fuse,
+                    ufsType ufs,
+                    ufsIdentifierType storage,
+                    ufsIdentifierType *area )
+{
+    if ( storage == UFS_STORAGE_ROOT_IDENTIFIER ) {
+        *area = UFS_AREA_BASE_IDENTIFIER;
+        return 0;
+    }
+
+    *area = ufsResolveStorageInViewSpan( ufs, fuse -> view, storage );
+    return *area < 0 ? -toErrno( ufsErrno ) : 0;
+}
+
+int lookupChild( ufsFuseStruct *fuse,
+                 ufsType ufs,
+                 ufsIdentifierType parent,
+                 const char *name,
+                 ufsIdentifierType *storage,
+                 uint32_t *type,
+                 ufsIdentifierType *area )
+{
+    /* A file and a directory can share a name while only one of them is      */
+    /* seen in the view.                                                      */
+    *storage = ufsGetFile( ufs, parent, name );
+    if ( *storage > 0 && !resolveStorage( fuse, ufs, *storage, area ) ) {
+        *type = UFS_STORAGE_TYPE_FILE;
+        return 0;
+    }
+
+    *storage = ufsGetDirectory( ufs, parent, name );
+    if ( *storage > 0 && !resolveStorage( fuse, ufs, *storage, area ) ) {
+        *type = UFS_STORAGE_TYPE_DIRECTORY;
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+void attributesToStat( const ufsAttributesType *attributes, struct stat *st )
+{
+    st -> st_mode = attributes -> mode;
+    st -> st_size = attributes -> size;
+    st -> st_nlink = attributes -> nlink;
+    st -> st_uid = attributes -> uid;
+    st -> st_gid = attributes -> gid;
+    st -> st_mtim.tv_sec = attributes -> mtime / 1000000000LL;
+    st -> st_mtim.tv_nsec = attributes -> mtime % 1000000000LL;
+    st -> st_ctim.tv_sec = attributes -> ctime / 1000000000LL;
+    st -> st_ctim.tv_nsec = attributes -> ctime % 1000000000LL;
+    st -> st_atim = st -> st_mtim;
+    st -> st_blksize = 4096;
+    st -> st_blocks = ( attributes -> size + 511 ) / 512;
+}
+
+int statStorage( ufsFuseStruct *fuse,
+                 ufsType ufs,
+                 ufsIdentifierType storage,
+                 uint32_t type,
+                 ufsIdentifierType area,
+                 struct stat *st )
+{
+    ufsAttributesType attributes;
+    ufsStatusType status;
+
+    /* Files of an area are described by their backing file alone.            */
+    status = UFS_ATTRIBUTES_DO_NOT_EXIST;
+    if ( storage != UFS_STORAGE_ROOT_IDENTIFIER &&
+         ( type != UFS_STORAGE_TYPE_FILE ||
+           area == UFS_AREA_BASE_IDENTIFIER ) )
+        status = ufsGetAttributes( ufs, storage, &attributes );
+
+    return fillStat( fuse, ufs, storage, type, area, status, &attributes, -1,
+                     NULL, st );
+}
+
+/* Describes storage given its attribute record, or the status of querying    */
+/* it. Storage of BASE without a record is stated in the external fs, by its  */
+/* name in dirFd if there's one, or by its path otherwise.                    */
+int fillStat( ufsFuseStruct *fuse,
+              ufsType ufs,
+              ufsIdentifierType storage,
+              uint32_t type,
+              ufsIdentifierType area,
+              ufsStatusType status,
+              const ufsAttributesType *attributes,
+              int dirFd,
+              const char *name,
+              struct stat *st )
+{
+    char path[ PATH_MAX ];
+    int res;
+
+    memset( st, 0, sizeof( *st ) );
+    if ( storage == UFS_STORAGE_ROOT_IDENTIFIER ) {
+        res = fstat( fuse -> baseFd, st );
+    } else if ( type == UFS_STORAGE_TYPE_FILE &&
+                area != UFS_AREA_BASE_IDENTIFIER ) {
+        backingName( storage, path );
+        res = fstatat( areaFd( fuse, area ), path, st, 0 );
+    } else if ( status == UFS_NO_ERROR ) {
+        attributesToStat( attributes, st );
+        res = 0;
+    } else if ( status != UFS_ATTRIBUTES_DO_NOT_EXIST ) {
+        return -toErrno( status );
+    } else if ( area == UFS_AREA_BASE_IDENTIFIER && dirFd >= 0 ) {
+        res = fstatat( dirFd, name, st, AT_SYMLINK_NOFOLLOW );
+    } else if ( area == UFS_AREA_BASE_IDENTIFIER ) {
+        res = basePath( ufs, storage, path, sizeof( path ) );
+        if ( res )
+            return res;
+
+        res = fstatat( fuse -> baseFd, path, st, AT_SYMLINK_NOFOLLOW );
+    } else {
+        st -> st_mode = S_IFDIR | 0755;
+        st -> st_nlink = 2;
+        res = 0;
+    }
+
+    if ( res )
+        return -errno;
+
+    st -> st_ino = UFS_FUSE_INODE( storage );
+    return 0;
+}
+
+int openBacking( ufsFuseStruct *fuse,
+                 ufsIdentifierType storage,
+                 ufsIdentifierType area,
+                 int flags )
+{
+    char path[ PATH_MAX ];
+    int fd, res;
+
+    if ( area == UFS_AREA_BASE_IDENTIFIER ) {
+        res = basePath( fuse -> ufs, storage, path, sizeof( path ) );
+        if ( res )
+            return res;
+
+        fd = openat( fuse -> baseFd, path, flags | O_NOFOLLOW | O_CLOEXEC );
+    } else {
+        backingName( storage, path );
+        fd = openat( areaFd( fuse, area ), path, flags | O_CLOEXEC );
+    }
+
+    return fd < 0 ? -errno : fd;
+}
+
+/* Passing through fails without CAP_SYS_ADMIN, or for backing files stacked  */
+/* too deep, their content is then served by the daemon. So is content held   */
+/* by extents, which is spread over the layers.                               */
+int setHandle( fuse_req_t req,
+               ufsFuseStruct *fuse,
+               int fd,
+               ufsFusePartialType *partial,
+               struct fuse_file_info *fi )
+{
+    ufsFuseFileType *file;
+
+    file = calloc( 1, sizeof( *file ) );
+    if ( !file )
+        return -ENOMEM;
+
+    file -> fd = fd;
+    file -> partial = partial;
+    fi -> fh = ( uintptr_t )file;
+#ifdef FUSE_CAP_PASSTHROUGH
+    if ( fuse -> passthrough && !partial ) {
+        file -> backing = fuse_passthrough_open( req, fd );
+        if ( file -> backing > 0 ) {
+            fi -> backing_id = file -> backing;
+            fuse -> stats.passthroughs++;
+        } else {
+            file -> backing = 0;
+        }
+    }
+#else
+    ( void )req;
+    ( void )fuse;
+#endif
+
+    /* Writes go to the offsets they're given, so direct writes to a file     */
+    /* don't have to be serialized by the kernel.                             */
+#if FUSE_VERSION >= FUSE_MAKE_VERSION( 3, 12 )
+    fi -> parallel_direct_writes = !!( fi -> flags & O_DIRECT );
+#endif
+    return 0;
+}
+
+/* With the writeback cache the kernel reads pages around partial writes of   */
+/* files opened for writing only, and appends at the size it holds itself.    */
+int backingFlags( ufsFuseStruct *fuse, int flags )
+{
+    if ( !fuse -> writeback )
+        return flags;
+
+    if ( ( flags & O_ACCMODE ) == O_WRONLY )
+        flags = ( flags & ~O_ACCMODE ) | O_RDWR;
+
+    return flags & ~O_APPEND;
+}
+
+/* The lock must be held if the file is held by extents.                      */
+void releaseHandle( fuse_req_t req,
+                    ufsFuseStruct *fuse,
+                    ufsFuseFileType *file )
+{
+#ifdef FUSE_CAP_PASSTHROUGH
+    if ( file -> backing )
+        fuse_passthrough_close( req, file -> backing );
+#else
+    ( void )req;
+#endif
+    if ( file -> partial )
+        releasePartial( fuse, file -> partial );
+    close( file -> fd );
+    free( file );
+}
+
+int loadLayers( ufsFuseStruct *fuse,
+                ufsIdentifierType storage,
+                ufsIdentifierType area,
+                int flags,
+                ufsFuseLayerType **layers )
+{
+    ufsIdentifierType lower;
+    ufsFuseLayerType *layer;
+    ufsStatusType status;
+    ufsViewSpanType span;
+    struct stat st;
+    int index, res;
+
+    layer = calloc( 1, sizeof( *layer ) );
+    *layers = layer;
+    if ( !layer )
+        return -ENOMEM;
+
+    layer -> fd = openBacking( fuse, storage, area, flags );
+    if ( layer -> fd < 0 )
+        return layer -> fd;
+
+    if ( fstat( layer -> fd, &st ) )
+        return -errno;
+
+    layer -> device = st.st_dev;
+    index = areaIndex( fuse, area );
+    if ( area == UFS_AREA_BASE_IDENTIFIER || index < 0 )
+        return 0;
+
+    status = ufsProbeExtents( fuse -> ufs, area, storage );
+    if ( status == UFS_DOES_NOT_EXIST )
+        return 0;
+
+    if ( status != UFS_NO_ERROR )
+        return -toErrno( status );
+
+    /* The extents an area doesn't hold are in the next area of the view      */
+    /* that has the storage, which may hold it by extents as well.            */
+    span.areas = fuse -> areas + index + 1;
+    span.count = fuse -> view.count - index - 1;
+    lower = ufsResolveStorageInViewSpan( fuse -> ufs, span, storage );
+    if ( lower < 0 )
+        return -toErrno( ufsErrno );
+
+    res = loadLayers( fuse, storage, lower, O_RDONLY, &layer -> lower );
+    if ( res )
+        return res;
+
+    if ( fstat( layer -> lower -> fd, &st ) )
+        return -errno;
+
+    layer -> numExtents = st.st_size / UFS_FUSE_EXTENT_SIZE;
+    layer -> present = calloc( layer -> numExtents + 1,
+                               sizeof( *layer -> present ) );
+    if ( !layer -> present )
+        return -ENOMEM;
+
+    if ( !layer -> numExtents )
+        return 0;
+
+    return -toErrno( ufsGetExtents( fuse -> ufs, area, storage, 0,
+                                    layer -> numExtents, layer -> present ) );
+}
+
+void freeLayers( ufsFuseLayerType *layers )
+{
+    ufsFuseLayerType *lower;
+
+    for ( ; layers; layers = lower ) {
+        lower = layers -> lower;
+        if ( layers -> fd >= 0 )
+            close( layers -> fd );
+        free( layers -> present );
+        free( layers );
+    }
+}
+
+/* An extent is read from the layer below until it's whole in this one, the   */
+/* backing file is only part way filled while it's copied into it.            */
+ufsFuseLayerType *layerAt( ufsFuseLayerType *layers, uint64_t extent )
+{
+    while ( layers -> lower && extent < layers -> numExtents &&
+            __atomic_load_n( &layers -> present[ extent ],
+                             __ATOMIC_ACQUIRE ) != 1 )
+        layers = layers -> lower;
+
+    return layers;
+}
+
+/* Neighbouring extents of the same layer are read as one segment.            */
+size_t fillSegments( ufsFuseLayerType *layers,
+                     off_t offset,
+                     size_t size,
+                     struct fuse_buf *segments )
+{
+    ufsFuseLayerType *layer;
+    struct fuse_buf *last;
+    size_t count, length;
+
+    count = 0;
+    while ( size ) {
+        layer = layerAt( layers, offset / UFS_FUSE_EXTENT_SIZE );
+        length = UFS_FUSE_EXTENT_SIZE - offset % UFS_FUSE_EXTENT_SIZE;
+        if ( length > size )
+            length = size;
+
+        last = count ? &segments[ count - 1 ] : NULL;
+        if ( last && last -> fd == layer -> fd ) {
+            last -> size += length;
+        } else {
+            memset( &segments[ count ], 0, sizeof( segments[ count ] ) );
+            segments[ count ].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+            segments[ count ].fd = layer -> fd;
+            segments[ count ].pos = offset;
+            segments[ count++ ].size = length;
+        }
+
+        offset += length;
+        size -= length;
+    }
+
+    return count;
+}
+
+int pairStrategy( ufsFuseStruct *fuse, dev_t source, dev_t target )
+{
+    int strategy;
+    uint32_t i;
+
+    strategy = UFS_FUSE_COPY_CLONE;
+    pthread_mutex_lock( &fuse -> pairsLock );
+    for ( i = 0; i < fuse -> numPairs; i++ ) {
+        if ( fuse -> pairs[ i ].source == source &&
+             fuse -> pairs[ i ].target == target ) {
+            strategy = fuse -> pairs[ i ].strategy;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock( &fuse -> pairsLock );
+    return strategy;
+}
+
+/* Once the table is full, pairs that aren't in it try every strategy.        */
+void setPairStrategy( ufsFuseStruct *fuse,
+                      dev_t source,
+                      dev_t target,
+                      int strategy )
+{
+    uint32_t i;
+
+    pthread_mutex_lock( &fuse -> pairsLock );
+    for ( i = 0; i < fuse -> numPairs; i++ ) {
+        if ( fuse -> pairs[ i ].source == source &&
+             fuse -> pairs[ i ].target == target )
+            break;
+    }
+
+    if ( i < UFS_FUSE_PAIRS ) {
+        fuse -> pairs[ i ].source = source;
+        fuse -> pairs[ i ].target = target;
+        fuse -> pairs[ i ].strategy = strategy;
+        fuse -> numPairs += i == fuse -> numPairs;
+    }
+
+    pthread_mutex_unlock( &fuse -> pairsLock );
+}
+
+/* Copies a range to the same offset of target, up to the end of source if    */
+/* it ends before the range does.                                             */
+int copyWith( int strategy, int source, int target, off_t offset, size_t size )
+{
+    struct file_clone_range range;
+    loff_t in, out;
+    ssize_t moved, pending;
+    int pipes[ 2 ], res;
+    char *buffer;
+
+    in = offset;
+    out = offset;
+    res = 0;
+    switch ( strategy ) {
+        case UFS_FUSE_COPY_CLONE:
+            range.src_fd = source;
+            range.src_offset = offset;
+            range.src_length = size;
+            range.dest_offset = offset;
+            return ioctl( target, FICLONERANGE, &range ) ? -errno : 0;
+        case UFS_FUSE_COPY_RANGE:
+            while ( size ) {
+                moved = copy_file_range( source, &in, target, &out, size, 0 );
+                if ( moved <= 0 )
+                    return moved ? -errno : 0;
+
+                size -= moved;
+            }
+
+            return 0;
+        case UFS_FUSE_COPY_SPLICE:
+            if ( pipe2( pipes, O_CLOEXEC ) )
+                return -errno;
+
+            while ( !res && size ) {
+                moved = splice( source, &in, pipes[ 1 ], NULL, size,
+                                SPLICE_F_MOVE );
+                if ( moved <= 0 ) {
+                    res = moved ? -errno : 0;
+                    break;
+                }
+
+                size -= moved;
+                for ( pending = moved; !res && pending; pending -= moved ) {
+                    moved = splice( pipes[ 0 ], NULL, target, &out, pending,
+                                    SPLICE_F_MOVE );
+                    if ( moved <= 0 )
+                        res = moved ? -errno : -EIO;
+                }
+            }
+
+            close( pipes[ 0 ] );
+            close( pipes[ 1 ] );
+            return res;
+        default:
+            buffer = malloc( UFS_FUSE_COPY_SIZE );
+            if ( !buffer )
+                return -ENOMEM;
+
+            while ( size ) {
+                moved = pread( source, buffer, size < UFS_FUSE_COPY_SIZE ?
+                               size : UFS_FUSE_COPY_SIZE, in );
+                if ( moved <= 0 ) {
+                    res = moved ? -errno : 0;
+                    break;
+                }
+
+                if ( pwrite( target, buffer, moved, in ) != moved ) {
+                    res = errno ? -errno : -EIO;
+                    break;
+                }
+
+                in += moved;
+                size -= moved;
+            }
+
+            free( buffer );
+            return res;
+    }
+}
+
+/* Strategies are tried from the first one known to work for the pair, up to  */
+/* lastStrategy. One the filesystems don't support isn't tried for the pair   */
+/* again, while one that only rejects the range, as a clone of a range that   */
+/* isn't aligned to blocks does, is still tried for the next ones. Ranges     */
+/* that are a hole in the source are left as one.                             */
+int copySegment( ufsFuseStruct *fuse,
+                 ufsFuseLayerType *layer,
+                 int fd,
+                 dev_t device,
+                 off_t offset,
+                 size_t size,
+                 int lastStrategy )
+{
+    ufsFuseCopyStatsType *copies;
+    int strategy, first, res;
+    uint64_t start;
+    off_t data;
+
+    data = lseek( layer -> fd, offset, SEEK_DATA );
+    if ( ( data < 0 && errno == ENXIO ) ||
+         ( data >= 0 && ( size_t )( data - offset ) >= size ) )
+        return 0;
+
+    first = pairStrategy( fuse, layer -> device, device );
+    res = -EOPNOTSUPP;
+    for ( strategy = first; strategy <= lastStrategy; strategy++ ) {
+        start = nowNanoseconds();
+        res = copyWith( strategy, layer -> fd, fd, offset, size );
+        if ( !res ) {
+            pthread_mutex_lock( &fuse -> pairsLock );
+            copies = &fuse -> stats.copies[ strategy ];
+            copies -> copies++;
+            copies -> bytes += size;
+            copies -> nanoseconds += nowNanoseconds() - start;
+            pthread_mutex_unlock( &fuse -> pairsLock );
+            break;
+        }
+
+        if ( res != -EOPNOTSUPP && res != -EXDEV && res != -ENOTTY &&
+             res != -ENOSYS && res != -EINVAL && res != -EBADF )
+            break;
+
+        if ( res != -EINVAL && strategy == first &&
+             strategy < UFS_FUSE_COPY_READ_WRITE )
+            setPairStrategy( fuse, layer -> device, device, ++first );
+    }
+
+    return res;
+}
+
+/* Copies what the layers hold of a range to the same range of fd, content    */
+/* past the end of the layers is left as a hole. Neighbouring extents of the  */
+/* same layer are copied at once.                                             */
+int copyRange( ufsFuseStruct *fuse,
+               ufsFuseLayerType *layers,
+               int fd,
+               dev_t device,
+               off_t offset,
+               size_t size )
+{
+    ufsFuseLayerType *layer;
+    size_t length;
+    int res;
+
+    res = 0;
+    while ( !res && size ) {
+        layer = layerAt( layers, offset / UFS_FUSE_EXTENT_SIZE );
+        length = UFS_FUSE_EXTENT_SIZE - offset % UFS_FUSE_EXTENT_SIZE;
+        while ( length < size &&
+                layerAt( layers, ( offset + length ) /
+                                 UFS_FUSE_EXTENT_SIZE ) == layer )
+            length += UFS_FUSE_EXTENT_SIZE;
+        if ( length > size )
+            length = size;
+
+        res = copySegment( fuse, layer, fd, device, offset, length,
+                           UFS_FUSE_COPY_READ_WRITE );
+        offset += length;
+        size -= length;
+    }
+
+    return res;
+}
+
+int acquirePartial( ufsFuseStruct *fuse,
+                    ufsIdentifierType storage,
+                    ufsIdentifierType area,
+                    ufsFusePartialType **partial )
+{
+    ufsFusePartialType *curr;
+    ufsStatusType status;
+    int res;
+
+    *partial = NULL;
+    for ( curr = fuse -> partials; curr; curr = curr -> next ) {
+        if ( curr -> storage == storage && curr -> area == area ) {
+            curr -> opens++;
+            *partial = curr;
+            return 0;
+        }
+    }
+
+    if ( area == UFS_AREA_BASE_IDENTIFIER )
+        return 0;
+
+    status = ufsProbeExtents( fuse -> ufs, area, storage );
+    if ( status == UFS_DOES_NOT_EXIST )
+        return 0;
+
+    if ( status != UFS_NO_ERROR )
+        return -toErrno( status );
+
+    curr = calloc( 1, sizeof( *curr ) );
+    if ( !curr )
+        return -ENOMEM;
+
+    /* Extents are copied into the first area through the layer itself.       */
+    res = loadLayers( fuse, storage, area,
+                      area == fuse -> top ? O_RDWR : O_RDONLY,
+                      &curr -> layers );
+    if ( res ) {
+        freeLayers( curr -> layers );
+        free( curr );
+        return res;
+    }
+
+    curr -> storage = storage;
+    curr -> area = area;
+    curr -> marked = curr -> layers -> numExtents;
+    curr -> opens = 1;
+    curr -> next = fuse -> partials;
+    fuse -> partials = curr;
+    *partial = curr;
+    if ( area == fuse -> top &&
+         !( fuse -> flags & UFS_FUSE_FLAG_NO_BACKGROUND_COPY ) &&
+         memchr( curr -> layers -> present, 0,
+                 curr -> layers -> numExtents ) )
+        queueCopy( fuse, curr );
+
+    return 0;
+}
+
+void releasePartial( ufsFuseStruct *fuse, ufsFusePartialType *partial )
+{
+    ufsFusePartialType **curr;
+
+    if ( --partial -> opens )
+        return;
+
+    for ( curr = &fuse -> partials; *curr != partial;
+          curr = &( *curr ) -> next );
+    *curr = partial -> next;
+    freeLayers( partial -> layers );
+    free( partial );
+}
+
+/* Extents are added to ufs once they're copied, and only then read from the  */
+/* first area. Those past the layers below have nothing to copy, they're only */
+/* added. The lock must be held, it's let go while content is copied, and     */
+/* while waiting for an extent another thread copies.                         */
+int copyExtents( ufsFuseStruct *fuse,
+                 ufsFusePartialType *partial,
+                 uint64_t first,
+                 uint64_t last )
+{
+    ufsFuseLayerType *top;
+    uint64_t extent;
+    int res;
+
+    top = partial -> layers;
+    for ( extent = first; extent <= last && extent < top -> numExtents;
+          extent++ ) {
+        while ( top -> present[ extent ] == UFS_FUSE_EXTENT_COPYING )
+            pthread_cond_wait( &fuse -> extentCopied, &fuse -> lock );
+
+        if ( top -> present[ extent ] )
+            continue;
+
+        __atomic_store_n( &top -> present[ extent ], UFS_FUSE_EXTENT_COPYING,
+                          __ATOMIC_RELAXED );
+        pthread_mutex_unlock( &fuse -> lock );
+        res = copyRange( fuse, top -> lower, top -> fd, top -> device,
+                         extent * UFS_FUSE_EXTENT_SIZE, UFS_FUSE_EXTENT_SIZE );
+        pthread_mutex_lock( &fuse -> lock );
+        if ( !res )
+            res = addExtents( fuse, partial -> area, partial -> storage,
+                              extent, 1 );
+
+        __atomic_store_n( &top -> present[ extent ], !res, __ATOMIC_RELEASE );
+        pthread_cond_broadcast( &fuse -> extentCopied );
+        if ( res )
+            return res;
+
+        fuse -> stats.extents++;
+    }
+
+    if ( last < partial -> marked )
+        return 0;
+
+    res = addExtents( fuse, partial -> area, partial -> storage,
+                      partial -> marked, last + 1 - partial -> marked );
+    if ( !res )
+        __atomic_store_n( &partial -> marked, last + 1, __ATOMIC_RELEASE );
+
+    return res;
+}
+
+/* The rest of storage copied up by extents is copied by a single thread, in  */
+/* order, while writes copy what they need themselves and only wait for an    */
+/* extent the thread is copying. The lock must be held.                       */
+void queueCopy( ufsFuseStruct *fuse, ufsFusePartialType *partial )
+{
+    ufsFusePartialType **last;
+
+    if ( fuse -> stopping )
+        return;
+
+    if ( !fuse -> copierStarted ) {
+        if ( pthread_create( &fuse -> copier, NULL, copyInBackground, fuse ) )
+            return;
+
+        fuse -> copierStarted = 1;
+    }
+
+    for ( last = &fuse -> copies; *last; last = &( *last ) -> nextCopy );
+    *last = partial;
+    partial -> nextCopy = NULL;
+    partial -> opens++;
+    pthread_cond_signal( &fuse -> copyQueued );
+}
+
+void *copyInBackground( void *data )
+{
+    ufsFusePartialType *partial;
+    ufsFuseStruct *fuse;
+    uint64_t extent;
+
+    fuse = data;
+    pthread_mutex_lock( &fuse -> lock );
+    while ( !fuse -> stopping ) {
+        partial = fuse -> copies;
+        if ( !partial ) {
+            pthread_cond_wait( &fuse -> copyQueued, &fuse -> lock );
+            continue;
+        }
+
+        fuse -> copies = partial -> nextCopy;
+
+        /* Storage that's no longer open has no one waiting for it, what's    */
+        /* left is copied the next time it's opened.                          */
+        for ( extent = 0; !fuse -> stopping && partial -> opens > 1 &&
+                          extent < partial -> layers -> numExtents;
+              extent++ ) {
+            if ( copyExtents( fuse, partial, extent, extent ) )
+                break;
+        }
+
+        releasePartial( fuse, partial );
+    }
+
+    pthread_mutex_unlock( &fuse -> lock );
+    return NULL;
+}
+
+void stopCopier( ufsFuseStruct *fuse )
+{
+    ufsFusePartialType *partial;
+
+    pthread_mutex_lock( &fuse -> lock );
+    fuse -> stopping = 1;
+    pthread_cond_signal( &fuse -> copyQueued );
+    pthread_mutex_unlock( &fuse -> lock );
+    if ( fuse -> copierStarted )
+        pthread_join( fuse -> copier, NULL );
+
+    while ( ( partial = fuse -> copies ) ) {
+        fuse -> copies = partial -> nextCopy;
+        releasePartial( fuse, partial );
+    }
+}
+
+/* Writes only take the lock the first time they reach an extent, and wait    */
+/* for the extents they reach to be copied, not for the whole file.           */
+int prepareWrite( ufsFuseStruct *fuse,
+                  ufsFusePartialType *partial,
+                  off_t offset,
+                  size_t size )
+{
+    uint64_t first, last, extent;
+    ufsFuseLayerType *top;
+    int res;
+
+    if ( !size )
+        return 0;
+
+    top = partial -> layers;
+    first = offset / UFS_FUSE_EXTENT_SIZE;
+    last = ( offset + size - 1 ) / UFS_FUSE_EXTENT_SIZE;
+    for ( extent = first; extent <= last && extent < top -> numExtents;
+          extent++ ) {
+        if ( __atomic_load_n( &top -> present[ extent ],
+                              __ATOMIC_ACQUIRE ) != 1 )
+            break;
+    }
+
+    if ( ( extent > last || extent == top -> numExtents ) &&
+         last < __atomic_load_n( &partial -> marked, __ATOMIC_ACQUIRE ) )
+        return 0;
+
+    pthread_mutex_lock( &fuse -> lock );
+    res = copyExtents( fuse, partial, first, last );
+    pthread_mutex_unlock( &fuse -> lock );
+    return res;
+}
+
+/* Called before the backing file is truncated. The extent it ends in keeps   */
+/* what's before the end, and every extent past it is now held by the first   */
+/* area, so the layers below never show through what was cut or grown. The    */
+/* lock must be held.                                                         */
+int truncatePartial( ufsFuseStruct *fuse,
+                     ufsFusePartialType *partial,
+                     off_t size )
+{
+    ufsFuseLayerType *top;
+    uint64_t extent, end;
+    int res;
+
+    top = partial -> layers;
+    extent = ( size + UFS_FUSE_EXTENT_SIZE - 1 ) / UFS_FUSE_EXTENT_SIZE;
+    res = 0;
+    if ( extent && ( size % UFS_FUSE_EXTENT_SIZE ||
+                     extent > top -> numExtents ) )
+        res = copyExtents( fuse, partial, extent - 1, extent - 1 );
+
+    if ( res || extent >= top -> numExtents )
+        return res;
+
+    /* A copy under way would write past the new end.                         */
+    for ( end = extent; end < top -> numExtents; end++ ) {
+        while ( top -> present[ end ] == UFS_FUSE_EXTENT_COPYING )
+            pthread_cond_wait( &fuse -> extentCopied, &fuse -> lock );
+    }
+
+    res = addExtents( fuse, partial -> area, partial -> storage, extent,
+                      top -> numExtents - extent );
+    for ( end = top -> numExtents; !res && extent < end; extent++ )
+        __atomic_store_n( &top -> present[ extent ], 1, __ATOMIC_RELEASE );
+
+    return res;
+}
+
+int copyUp( ufsFuseStruct *fuse,
+            ufsIdentifierType storage,
+            ufsIdentifierType area,
+            int empty )
+{
+    char name[ UFS_FUSE_NAME_SIZE ], temporary[ UFS_FUSE_NAME_SIZE + 4 ];
+    ufsFuseLayerType *layers;
+    struct timespec times[ 2 ];
+    struct stat st, targetSt;
+    int target, res;
+    off_t tail;
+
+    target = -1;
+    res = loadLayers( fuse, storage, area, O_RDONLY, &layers );
+    if ( !res && fstat( layers -> fd, &st ) )
+        res = -errno;
+
+    if ( res )
+        goto out;
+
+    if ( empty )
+        st.st_size = 0;
+
+    backingName( storage, name );
+    snprintf( temporary, sizeof( temporary ), "%s.up", name );
+
+    /* The content is copied aside and renamed in, so a failed copy never     */
+    /* leaves a partial file behind in the area.                              */
+    target = openat( fuse -> fds[ 0 ], temporary,
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     st.st_mode & 07777 );
+    if ( target < 0 ) {
+        res = -errno;
+        goto out;
+    }
+
+    /* Files larger than an extent are copied as they're written, only the    */
+    /* extent they end in is copied now, so nothing past the end of the       */
+    /* layers below is ever read from them. Unless they can be cloned whole,  */
+    /* which shares their content instead of copying it.                      */
+    tail = st.st_size > UFS_FUSE_EXTENT_SIZE ?
+           st.st_size - st.st_size % UFS_FUSE_EXTENT_SIZE : 0;
+    if ( ftruncate( target, st.st_size ) || fstat( target, &targetSt ) )
+        res = -errno;
+    if ( !res && tail && !layers -> lower &&
+         !copySegment( fuse, layers, target, targetSt.st_dev, 0, st.st_size,
+                       UFS_FUSE_COPY_CLONE ) )
+        tail = 0;
+    else if ( !res )
+        res = copyRange( fuse, layers, target, targetSt.st_dev, tail,
+                         st.st_size - tail );
+
+    if ( !res ) {
+        ( void )fchown( target, st.st_uid, st.st_gid );
+        times[ 0 ] = st.st_atim;
+        times[ 1 ] = st.st_mtim;
+        ( void )futimens( target, times );
+        if ( renameat( fuse -> fds[ 0 ], temporary, fuse -> fds[ 0 ], name ) )
+            res = -errno;
+    }
+
+    if ( !res && tail )
+        res = addExtents( fuse, fuse -> top, storage,
+                          tail / UFS_FUSE_EXTENT_SIZE, st.st_size > tail );
+    else if ( !res )
+        res = mapInTop( fuse, storage );
+
+    if ( res )
+        unlinkat( fuse -> fds[ 0 ], temporary, 0 );
+
+out:
+    if ( target >= 0 )
+        close( target );
+    freeLayers( layers );
+    return res;
+}
+
+/* Changes to ufs hold the lock of ufs for writing, besides the lock, so no   */
+/* reader is reading what's changed.                                          */
+int mapInTop( ufsFuseStruct *fuse, ufsIdentifierType storage )
+{
+    ufsStatusType status;
+
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    status = ufsAddMapping( fuse -> ufs, fuse -> top, storage );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    if ( status == UFS_ALREADY_EXISTS )
+        return 0;
+
+    return -toErrno( status );
+}
+
+/* The record is added along with the mapping, a lookup never finds one       */
+/* without the other.                                                         */
+int setAttributesInTop( ufsFuseStruct *fuse,
+                        ufsIdentifierType storage,
+                        const ufsAttributesType *attributes )
+{
+    ufsStatusType status;
+
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    status = ufsAddMapping( fuse -> ufs, fuse -> top, storage );
+    if ( status == UFS_ALREADY_EXISTS )
+        status = UFS_NO_ERROR;
+    if ( status == UFS_NO_ERROR )
+        status = ufsSetAttributes( fuse -> ufs, storage, attributes );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    return -toErrno( status );
+}
+
+/* Storage that's since been mapped whole has nothing more to add.            */
+int addExtents( ufsFuseStruct *fuse,
+                ufsIdentifierType area,
+                ufsIdentifierType storage,
+                uint64_t first,
+                uint64_t count )
+{
+    ufsStatusType status;
+
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    status = ufsAddExtents( fuse -> ufs, area, storage, first, count );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    if ( status == UFS_ALREADY_EXISTS )
+        return 0;
+
+    return -toErrno( status );
+}
+
+void replyEntry( fuse_req_t req,
+                 ufsFuseStruct *fuse,
+                 ufsType ufs,
+                 ufsIdentifierType parent,
+                 const char *name,
+                 ufsIdentifierType storage,
+                 uint32_t type,
+                 ufsIdentifierType area )
+{
+    struct fuse_entry_param entry;
+    int res;
+
+    memset( &entry, 0, sizeof( entry ) );
+    res = statStorage( fuse, ufs, storage, type, area, &entry.attr );
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        return;
+    }
+
+    entry.ino = UFS_FUSE_INODE( storage );
+    entry.attr_timeout = UFS_FUSE_TIMEOUT;
+    entry.entry_timeout = UFS_FUSE_TIMEOUT;
+    if ( !fuse_reply_entry( req, &entry ) ) {
+        pthread_mutex_lock( &fuse -> tableLock );
+        rememberInode( fuse, parent, name, storage, type );
+        pthread_mutex_unlock( &fuse -> tableLock );
+    }
+}
+
+uint64_t mixKey( uint64_t key )
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+ufsFuseInodeType *findInode( ufsFuseStruct *fuse, ufsIdentifierType storage )
+{
+    ufsFuseInodeType *inode;
+
+    inode = fuse -> inodes[ mixKey( storage ) & ( fuse -> buckets - 1 ) ];
+    while ( inode && inode -> storage != storage )
+        inode = inode -> next;
+
+    return inode;
+}
+
+int growInodes( ufsFuseStruct *fuse )
+{
+    ufsFuseInodeType **inodes, *inode, *next;
+    size_t i, bucket;
+
+    inodes = calloc( fuse -> buckets * 2, sizeof( *inodes ) );
+    if ( !inodes )
+        return -1;
+
+    for ( i = 0; i < fuse -> buckets; i++ ) {
+        for ( inode = fuse -> inodes[ i ]; inode; inode = next ) {
+            next = inode -> next;
+            bucket = mixKey( inode -> storage ) & ( fuse -> buckets * 2 - 1 );
+            inode -> next = inodes[ bucket ];
+            inodes[ bucket ] = inode;
+        }
+    }
+
+    free( fuse -> inodes );
+    fuse -> inodes = inodes;
+    fuse -> buckets *= 2;
+    return 0;
+}
+
+void rememberInode( ufsFuseStruct *fuse,
+                    ufsIdentifierType parent,
+                    const char *name,
+                    ufsIdentifierType storage,
+                    uint32_t type )
+{
+    ufsFuseInodeType *inode, **bucket;
+
+    inode = findInode( fuse, storage );
+    if ( !inode ) {
+        /* Failing to grow only makes chains longer.                          */
+        if ( fuse -> numInodes >= fuse -> buckets )
+            ( void )growInodes( fuse );
+
+        inode = calloc( 1, sizeof( *inode ) );
+        if ( !inode )
+            return;
+
+        inode -> storage = storage;
+        inode -> type = type;
+        bucket = &fuse -> inodes[ mixKey( storage ) & ( fuse -> buckets - 1 ) ];
+        inode -> next = *bucket;
+        *bucket = inode;
+        fuse -> numInodes++;
+    }
+
+    inode -> parent = parent;
+    snprintf( inode -> name, sizeof( inode -> name ), "%s", name );
+    inode -> lookups++;
+}
+
+void forgetInode( ufsFuseStruct *fuse,
+                  ufsIdentifierType storage,
+                  uint64_t lookups )
+{
+    ufsFuseInodeType *inode, **link;
+
+    link = &fuse -> inodes[ mixKey( storage ) & ( fuse -> buckets - 1 ) ];
+    while ( *link && ( *link ) -> storage != storage )
+        link = &( *link ) -> next;
+
+    inode = *link;
+    if ( !inode )
+        return;
+
+    if ( inode -> lookups > lookups ) {
+        inode -> lookups -= lookups;
+        return;
+    }
+
+    *link = inode -> next;
+    fuse -> numInodes--;
+    free( inode );
+}
+
+int inView( ufsFuseStruct *fuse, ufsIdentifierType area )
+{
+    return areaFd( fuse, area ) >= 0;
+}
+
+int queueInvalidation( ufsFuseStruct *fuse,
+                       const ufsFuseInodeType *inode,
+                       int entry,
+                       int content )
+{
+    ufsFuseInvalidationType *invalidations, *invalidation;
+    size_t maxInvalidations;
+
+    if ( fuse -> numInvalidations == fuse -> maxInvalidations ) {
+        maxInvalidations = fuse -> maxInvalidations ?
+                           fuse -> maxInvalidations * 2 :
+                           UFS_FUSE_INITIAL_ENTRIES;
+        invalidations = realloc( fuse -> invalidations,
+                                 maxInvalidations * sizeof( *invalidations ) );
+        if ( !invalidations )
+            return -ENOMEM;
+
+        fuse -> invalidations = invalidations;
+        fuse -> maxInvalidations = maxInvalidations;
+    }
+
+    invalidation = &fuse -> invalidations[ fuse -> numInvalidations++ ];
+    invalidation -> inode = UFS_FUSE_INODE( inode -> storage );
+    invalidation -> parent = UFS_FUSE_INODE( inode -> parent );
+    invalidation -> content = content;
+    invalidation -> name[ 0 ] = '\0';
+
+    /* With the writeback cache the kernel trusts the size it holds of a file */
+    /* over what it's told, only a new inode picks up another one.            */
+    invalidation -> drop = fuse -> writeback && content &&
+                           inode -> type == UFS_STORAGE_TYPE_FILE;
+    if ( entry || invalidation -> drop )
+        memcpy( invalidation -> name, inode -> name, sizeof( inode -> name ) );
+
+    return 0;
+}
+
+int queueAll( ufsFuseStruct *fuse )
+{
+    ufsFuseInodeType *inode;
+    size_t i;
+    int res;
+
+    for ( i = 0; i < fuse -> buckets; i++ ) {
+        for ( inode = fuse -> inodes[ i ]; inode; inode = inode -> next ) {
+            res = queueInvalidation( fuse, inode, 1, 1 );
+            if ( res )
+                return res;
+        }
+    }
+
+    return 0;
+}
+
+/* Only storage the kernel holds is invalidated. Dropping the entry of a      */
+/* directory drops every entry below it, so changes to a whole subtree only   */
+/* need its top.                                                              */
+int queueChange( ufsFuseStruct *fuse, const ufsChangeType *change )
+{
+    ufsFuseInodeType *inode;
+
+    switch ( change -> type ) {
+        case UFS_CHANGE_ADD_STORAGE:
+        case UFS_CHANGE_ADD_AREA:
+            return 0;
+        case UFS_CHANGE_COLLAPSE:
+        case UFS_CHANGE_REMOVE_AREA:
+            return inView( fuse, change -> area ) ? queueAll( fuse ) : 0;
+        case UFS_CHANGE_BASE:
+            if ( change -> storage == UFS_STORAGE_ROOT_IDENTIFIER )
+                return queueAll( fuse );
+            break;
+        case UFS_CHANGE_ADD_MAPPING:
+        case UFS_CHANGE_REMOVE_MAPPING:
+        case UFS_CHANGE_ADD_WHITEOUT:
+        case UFS_CHANGE_REMOVE_WHITEOUT:
+        case UFS_CHANGE_EXTENTS:
+            if ( !inView( fuse, change -> area ) )
+                return 0;
+            break;
+        default:
+            break;
+    }
+
+    inode = findInode( fuse, change -> storage );
+    if ( !inode )
+        return 0;
+
+    /* A new attribute record keeps the entry, and a move keeps the content.  */
+    return queueInvalidation( fuse, inode,
+                              change -> type != UFS_CHANGE_ATTRIBUTES,
+                              change -> type != UFS_CHANGE_MOVE_STORAGE );
+}
+
+int queueChanges( ufsFuseStruct *fuse )
+{
+    ufsChangeType changes[ UFS_FUSE_CHANGES ];
+    ufsStatusType status;
+    size_t count, i;
+    int res;
+
+    do {
+        status = ufsPollChanges( fuse -> ufs, &fuse -> cursor, changes,
+                                 UFS_FUSE_CHANGES, &count );
+        if ( status == UFS_CHANGES_OVERFLOWED )
+            return queueAll( fuse );
+
+        if ( status != UFS_NO_ERROR )
+            return -toErrno( status );
+
+        for ( i = 0; i < count; i++ ) {
+            res = queueChange( fuse, &changes[ i ] );
+            if ( res )
+                return res;
+        }
+    } while ( count == UFS_FUSE_CHANGES );
+
+    return 0;
+}
+
+void sendInvalidations( ufsFuseStruct *fuse,
+                        ufsFuseInvalidationType *invalidations,
+                        size_t count )
+{
+    ufsFuseInvalidationType *invalidation;
+    size_t i;
+
+    /* Entries the kernel already dropped fail with ENOENT, which is fine.    */
+    for ( i = 0; fuse -> mounted && i < count; i++ ) {
+        invalidation = &invalidations[ i ];
+        /* A file that's dropped goes away once it's no longer open.          */
+        if ( invalidation -> drop )
+            fuse_lowlevel_notify_delete( fuse -> session,
+                                         invalidation -> parent,
+                                         invalidation -> inode,
+                                         invalidation -> name,
+                                         strlen( invalidation -> name ) );
+        else if ( invalidation -> name[ 0 ] )
+            fuse_lowlevel_notify_inval_entry( fuse -> session,
+                                              invalidation -> parent,
+                                              invalidation -> name,
+                                              strlen( invalidation -> name ) );
+
+        fuse_lowlevel_notify_inval_inode( fuse -> session,
+                                          invalidation -> inode,
+                                          invalidation -> content ? 0 : -1,
+                                          0 );
+    }
+}
+
+ufsStatusType openAreas( ufsFuseStruct *fuse,
+                         ufsViewSpanType view,
+                         ufsIdentifierType **areas,
+                         int **fds )
+{
+    char name[ UFS_FUSE_NAME_SIZE ];
+    uint32_t i;
+    int res;
+
+    *areas = malloc( view.count * sizeof( **areas ) );
+    *fds = malloc( view.count * sizeof( **fds ) );
+    if ( !*areas || !*fds ) {
+        free( *areas );
+        free( *fds );
+        *areas = NULL;
+        *fds = NULL;
+        return UFS_OUT_OF_MEMORY;
+    }
+
+    memcpy( *areas, view.areas, view.count * sizeof( **areas ) );
+    for ( i = 0; i < view.count; i++ )
+        ( *fds )[ i ] = -1;
+
+    for ( i = 0; i < view.count - 1; i++ ) {
+        backingName( view.areas[ i ], name );
+        res = mkdirat( fuse -> upperFd, name, 0755 );
+        if ( !res || errno == EEXIST )
+            ( *fds )[ i ] = openat( fuse -> upperFd, name,
+                                    O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+        if ( ( *fds )[ i ] < 0 ) {
+            closeAreas( fuse, *areas, *fds, view.count );
+            *areas = NULL;
+            *fds = NULL;
+            return UFS_UNKNOWN_ERROR;
+        }
+    }
+
+    ( *fds )[ view.count - 1 ] = fuse -> baseFd;
+    return UFS_NO_ERROR;
+}
+
+void closeAreas( ufsFuseStruct *fuse,
+                 ufsIdentifierType *areas,
+                 int *fds,
+                 uint32_t count )
+{
+    uint32_t i;
+
+    /* The last fd is BASE's, owned by the caller.                            */
+    ( void )fuse;
+    for ( i = 0; fds && i + 1 < count; i++ ) {
+        if ( fds[ i ] >= 0 )
+            close( fds[ i ] );
+    }
+
+    free( fds );
+    free( areas );
+}
+
+void freeDir( ufsFuseStruct *fuse, ufsFuseDirType *dir )
+{
+    if ( dir -> prev )
+        dir -> prev -> next = dir -> next;
+    else
+        fuse -> dirs = dir -> next;
+    if ( dir -> next )
+        dir -> next -> prev = dir -> prev;
+
+    free( dir -> entries );
+    free( dir );
+}
+
+ufsStatusType collectEntry( ufsIdentifierType storage,
+                            ufsIdentifierType area,
+                            uint64_t currEntry,
+                            uint64_t numEntries,
+                            void *userData )
+{
+    ufsFuseDirType *dir;
+    ufsFuseEntryType *entries;
+    size_t maxEntries;
+
+    ( void )currEntry;
+    dir = userData;
+    if ( dir -> numEntries == dir -> maxEntries ) {
+        maxEntries = dir -> maxEntries ? dir -> maxEntries * 2 :
+                                         UFS_FUSE_INITIAL_ENTRIES;
+        if ( maxEntries < numEntries )
+            maxEntries = numEntries;
+
+        entries = realloc( dir -> entries, maxEntries * sizeof( *entries ) );
+        if ( !entries )
+            return UFS_OUT_OF_MEMORY;
+
+        dir -> entries = entries;
+        dir -> maxEntries = maxEntries;
+    }
+
+    dir -> entries[ dir -> numEntries ].storage = storage;
+    dir -> entries[ dir -> numEntries++ ].area = area;
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType rejectEntry( ufsIdentifierType storage,
+                           uint64_t currEntry,
+                           uint64_t numEntries,
+                           void *userData )
+{
+    ( void )storage;
+    ( void )currEntry;
+    ( void )numEntries;
+    ( void )userData;
+    return UFS_DIRECTORY_IS_NOT_EMPTY;
+}
+
+static void ufsFuseConnect( void *userdata, struct fuse_conn_info *conn )
+{
+    ufsFuseStruct *fuse;
+
+    fuse = userdata;
+
+    /* Content moves between backing files and the kernel through pipes, it   */
+    /* never passes through a buffer of the daemon.                           */
+    if ( conn -> capable & FUSE_CAP_SPLICE_WRITE )
+        conn -> want |= FUSE_CAP_SPLICE_WRITE;
+    if ( conn -> capable & FUSE_CAP_SPLICE_MOVE )
+        conn -> want |= FUSE_CAP_SPLICE_MOVE;
+    if ( conn -> capable & FUSE_CAP_SPLICE_READ )
+        conn -> want |= FUSE_CAP_SPLICE_READ;
+
+    /* Listings always describe their entries, sparing a lookup of each one.  */
+    if ( conn -> capable & FUSE_CAP_READDIRPLUS )
+        conn -> want |= FUSE_CAP_READDIRPLUS;
+    conn -> want &= ~FUSE_CAP_READDIRPLUS_AUTO;
+
+    /* Reads and writes of open files can go straight to their backing file,  */
+    /* with a libfuse and a kernel that know how.                             */
+#ifdef FUSE_CAP_PASSTHROUGH
+    if ( !( fuse -> flags & UFS_FUSE_FLAG_NO_PASSTHROUGH ) &&
+         ( conn -> capable & FUSE_CAP_PASSTHROUGH ) ) {
+        conn -> want |= FUSE_CAP_PASSTHROUGH;
+        fuse -> passthrough = 1;
+    }
+#else
+    fuse -> passthrough = 0;
+#endif
+
+    /* Small writes are gathered in the page cache of the kernel and sent in  */
+    /* large requests, the kernel keeps the size and times of such files, and */
+    /* ufs invalidates them like any other once they're changed through it.   */
+    /* A file that's passed through is written by the kernel already.         */
+    conn -> max_write = UFS_FUSE_MAX_WRITE;
+    conn -> max_readahead = UFS_FUSE_MAX_WRITE;
+    fuse -> writeback = 0;
+    if ( !fuse -> passthrough &&
+         !( fuse -> flags & UFS_FUSE_FLAG_NO_WRITEBACK_CACHE ) &&
+         ( conn -> capable & FUSE_CAP_WRITEBACK_CACHE ) ) {
+        conn -> want |= FUSE_CAP_WRITEBACK_CACHE;
+        fuse -> writeback = 1;
+    }
+}
+
+static void ufsFuseLookup( fuse_req_t req,
+                           fuse_ino_t parent,
+                           const char *name )
+{
+    ufsIdentifierType storage, area;
+    ufsFuseStruct *fuse;
+    ufsType reader;
+    uint32_t type;
+    int res;
+
+    fuse = fuse_req_userdata( req );
+    __atomic_add_fetch( &fuse -> stats.lookups, 1, __ATOMIC_RELAXED );
+    if ( strlen( name ) > UFS_STORAGE_NAME_MAX ) {
+        fuse_reply_err( req, ENAMETOOLONG );
+        return;
+    }
+
+    pthread_rwlock_rdlock( &fuse -> ufsLock );
+    reader = acquireReader( fuse );
+    if ( !reader ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    res = lookupChild( fuse, reader, UFS_FUSE_STORAGE( parent ), name,
+                       &storage, &type, &area );
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    replyEntry( req, fuse, reader, UFS_FUSE_STORAGE( parent ), name, storage,
+                type, area );
+
+out:
+    if ( reader )
+        releaseReader( fuse, reader );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+}
+
+static void ufsFuseGetattr( fuse_req_t req,
+                            fuse_ino_t ino,
+                            struct fuse_file_info *fi )
+{
+    ufsIdentifierType storage, area;
+    ufsStorageInfoType info;
+    ufsFuseStruct *fuse;
+    ufsType reader;
+    struct stat st;
+    int res;
+
+    ( void )fi;
+    fuse = fuse_req_userdata( req );
+    __atomic_add_fetch( &fuse -> stats.getattrs, 1, __ATOMIC_RELAXED );
+    pthread_rwlock_rdlock( &fuse -> ufsLock );
+    reader = acquireReader( fuse );
+    storage = UFS_FUSE_STORAGE( ino );
+    info.type = UFS_STORAGE_TYPE_DIRECTORY;
+    if ( !reader || ( storage != UFS_STORAGE_ROOT_IDENTIFIER &&
+                      ufsGetStorage( reader, storage, &info ) !=
+                      UFS_NO_ERROR ) ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    res = resolveStorage( fuse, reader, storage, &area );
+    if ( !res )
+        res = statStorage( fuse, reader, storage, info.type, area, &st );
+
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    fuse_reply_attr( req, &st, UFS_FUSE_TIMEOUT );
+
+out:
+    if ( reader )
+        releaseReader( fuse, reader );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+}
+
+static void ufsFuseSetattr( fuse_req_t req,
+                            fuse_ino_t ino,
+                            struct stat *attr,
+                            int toSet,
+                            struct fuse_file_info *fi )
+{
+    ufsIdentifierType storage, area;
+    ufsAttributesType attributes;
+    struct timespec times[ 2 ];
+    ufsStorageInfoType info;
+    char name[ UFS_FUSE_NAME_SIZE ];
+    ufsFusePartialType *partial;
+    ufsFuseStruct *fuse;
+    struct stat st;
+    int res, fd;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    storage = UFS_FUSE_STORAGE( ino );
+    if ( storage == UFS_STORAGE_ROOT_IDENTIFIER ) {
+        fuse_reply_err( req, EPERM );
+        goto out;
+    }
+
+    if ( ufsGetStorage( fuse -> ufs, storage, &info ) != UFS_NO_ERROR ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    res = resolveStorage( fuse, fuse -> ufs, storage, &area );
+    if ( !res )
+        res = statStorage( fuse, fuse -> ufs, storage, info.type, area,
+                           &st );
+
+    /* Directories have no backing file, their record is all there is.        */
+    if ( !res && info.type == UFS_STORAGE_TYPE_DIRECTORY ) {
+        if ( toSet & FUSE_SET_ATTR_SIZE ) {
+            fuse_reply_err( req, EISDIR );
+            goto out;
+        }
+
+        if ( toSet & FUSE_SET_ATTR_MODE )
+            st.st_mode = ( st.st_mode & S_IFMT ) | ( attr -> st_mode & 07777 );
+        if ( toSet & FUSE_SET_ATTR_UID )
+            st.st_uid = attr -> st_uid;
+        if ( toSet & FUSE_SET_ATTR_GID )
+            st.st_gid = attr -> st_gid;
+        if ( toSet & FUSE_SET_ATTR_MTIME )
+            st.st_mtim = attr -> st_mtim;
+        if ( toSet & FUSE_SET_ATTR_MTIME_NOW )
+            clock_gettime( CLOCK_REALTIME, &st.st_mtim );
+        clock_gettime( CLOCK_REALTIME, &st.st_ctim );
+
+        attributes.mode = st.st_mode;
+        attributes.size = st.st_size;
+        attributes.mtime = st.st_mtim.tv_sec * 1000000000LL +
+                           st.st_mtim.tv_nsec;
+        attributes.ctime = st.st_ctim.tv_sec * 1000000000LL +
+                           st.st_ctim.tv_nsec;
+        attributes.nlink = st.st_nlink;
+        attributes.uid = st.st_uid;
+        attributes.gid = st.st_gid;
+        res = setAttributesInTop( fuse, storage, &attributes );
+        if ( !res )
+            res = statStorage( fuse, fuse -> ufs, storage, info.type,
+                               fuse -> top, &st );
+
+        if ( res )
+            fuse_reply_err( req, -res );
+        else
+            fuse_reply_attr( req, &st, UFS_FUSE_TIMEOUT );
+        goto out;
+    }
+
+    if ( !res && area != fuse -> top )
+        res = copyUp( fuse, storage, area, ( toSet & FUSE_SET_ATTR_SIZE ) &&
+                                           !attr -> st_size );
+
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    /* An open file of the area is changed through its fd, which may be the   */
+    /* only way to reach it once it's unlinked.                               */
+    partial = NULL;
+    if ( fi && area == fuse -> top ) {
+        fd = UFS_FUSE_FILE( fi ) -> fd;
+        partial = UFS_FUSE_FILE( fi ) -> partial;
+    } else {
+        fi = NULL;
+        if ( toSet & FUSE_SET_ATTR_SIZE )
+            res = acquirePartial( fuse, storage, fuse -> top, &partial );
+
+        backingName( storage, name );
+        fd = res ? -1 : openat( fuse -> fds[ 0 ], name, O_CLOEXEC |
+                                ( toSet & FUSE_SET_ATTR_SIZE ? O_WRONLY :
+                                                               O_RDONLY ) );
+        if ( fd < 0 ) {
+            if ( partial )
+                releasePartial( fuse, partial );
+            fuse_reply_err( req, res ? -res : errno );
+            goto out;
+        }
+    }
+
+    if ( ( toSet & FUSE_SET_ATTR_MODE ) && fchmod( fd, attr -> st_mode ) )
+        res = -errno;
+    if ( !res && ( toSet & ( FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID ) ) &&
+         fchown( fd, toSet & FUSE_SET_ATTR_UID ? attr -> st_uid :
+                                                 ( uid_t )-1,
+                 toSet & FUSE_SET_ATTR_GID ? attr -> st_gid :
+                                             ( gid_t )-1 ) )
+        res = -errno;
+    if ( !res && ( toSet & FUSE_SET_ATTR_SIZE ) && partial )
+        res = truncatePartial( fuse, partial, attr -> st_size );
+    if ( !res && ( toSet & FUSE_SET_ATTR_SIZE ) &&
+         ftruncate( fd, attr -> st_size ) )
+        res = -errno;
+    if ( !res && ( toSet & ( FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME ) ) ) {
+        times[ 0 ].tv_nsec = UTIME_OMIT;
+        times[ 1 ].tv_nsec = UTIME_OMIT;
+        if ( toSet & FUSE_SET_ATTR_ATIME_NOW )
+            times[ 0 ].tv_nsec = UTIME_NOW;
+        else if ( toSet & FUSE_SET_ATTR_ATIME )
+            times[ 0 ] = attr -> st_atim;
+        if ( toSet & FUSE_SET_ATTR_MTIME_NOW )
+            times[ 1 ].tv_nsec = UTIME_NOW;
+        else if ( toSet & FUSE_SET_ATTR_MTIME )
+            times[ 1 ] = attr -> st_mtim;
+        if ( futimens( fd, times ) )
+            res = -errno;
+    }
+
+    if ( !res ) {
+        res = fstat( fd, &st ) ? -errno : 0;
+        st.st_ino = ino;
+    }
+
+    if ( !fi ) {
+        if ( partial )
+            releasePartial( fuse, partial );
+        close( fd );
+    }
+
+    if ( res )
+        fuse_reply_err( req, -res );
+    else
+        fuse_reply_attr( req, &st, UFS_FUSE_TIMEOUT );
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+static void ufsFuseOpendir( fuse_req_t req,
+                            fuse_ino_t ino,
+                            struct fuse_file_info *fi )
+{
+    ufsIdentifierType directory, storages[ UFS_FUSE_BATCH ];
+    ufsStorageInfoType info, infos[ UFS_FUSE_BATCH ];
+    ufsStatusType status, statuses[ UFS_FUSE_BATCH ];
+    ufsFuseStruct *fuse;
+    ufsFuseDirType *dir;
+    ufsType reader;
+    size_t i, j, count;
+
+    fuse = fuse_req_userdata( req );
+    pthread_rwlock_rdlock( &fuse -> ufsLock );
+    reader = acquireReader( fuse );
+    if ( !reader ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    directory = UFS_FUSE_STORAGE( ino );
+    dir = calloc( 1, sizeof( *dir ) );
+    if ( !dir ) {
+        fuse_reply_err( req, ENOMEM );
+        goto out;
+    }
+
+    status = UFS_NO_ERROR;
+    dir -> directory = directory;
+    if ( directory != UFS_STORAGE_ROOT_IDENTIFIER ) {
+        status = ufsGetStorage( reader, directory, &info );
+        dir -> parent = info.parent;
+    }
+
+    if ( status == UFS_NO_ERROR )
+        status = ufsGetDirectoryGeneration( reader, directory,
+                                            &dir -> generation );
+    if ( status == UFS_NO_ERROR )
+        status = ufsIterateResolvedDirInViewSpan( reader, fuse -> view,
+                                                  directory, NULL,
+                                                  collectEntry, dir );
+
+    /* Names are only fetched once iteration is over, it must not be mixed    */
+    /* with other queries, a batch of entries at a time.                      */
+    for ( i = 0; status == UFS_NO_ERROR && i < dir -> numEntries;
+          i += count ) {
+        count = dir -> numEntries - i;
+        if ( count > UFS_FUSE_BATCH )
+            count = UFS_FUSE_BATCH;
+
+        for ( j = 0; j < count; j++ )
+            storages[ j ] = dir -> entries[ i + j ].storage;
+
+        status = ufsGetManyStorage( reader, storages, count, infos,
+                                    statuses );
+        for ( j = 0; status == UFS_NO_ERROR && j < count; j++ ) {
+            status = statuses[ j ];
+            dir -> entries[ i + j ].type = infos[ j ].type;
+            memcpy( dir -> entries[ i + j ].name, infos[ j ].name,
+                    sizeof( infos[ j ].name ) );
+        }
+    }
+
+    if ( status != UFS_NO_ERROR ) {
+        free( dir -> entries );
+        free( dir );
+        fuse_reply_err( req, toErrno( status ) );
+        goto out;
+    }
+
+    pthread_mutex_lock( &fuse -> tableLock );
+    dir -> next = fuse -> dirs;
+    if ( dir -> next )
+        dir -> next -> prev = dir;
+    fuse -> dirs = dir;
+    pthread_mutex_unlock( &fuse -> tableLock );
+    fi -> fh = ( uintptr_t )dir;
+    fuse_reply_open( req, fi );
+
+out:
+    if ( reader )
+        releaseReader( fuse, reader );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+}
+
+static void ufsFuseReaddir( fuse_req_t req,
+                            fuse_ino_t ino,
+                            size_t size,
+                            off_t offset,
+                            struct fuse_file_info *fi )
+{
+    ufsFuseDirType *dir;
+    size_t used, entrySize;
+    const char *name;
+    struct stat st;
+    char *buffer;
+    off_t i;
+
+    dir = ( ufsFuseDirType * )( uintptr_t )fi -> fh;
+    buffer = malloc( size );
+    if ( !buffer ) {
+        fuse_reply_err( req, ENOMEM );
+        return;
+    }
+
+    /* Offsets 0 and 1 are "." and "..", entry i follows at i + 2.            */
+    memset( &st, 0, sizeof( st ) );
+    used = 0;
+    for ( i = offset; i < ( off_t )dir -> numEntries + 2; i++ ) {
+        if ( i < 2 ) {
+            name = i == 0 ? "." : "..";
+            st.st_ino = i == 0 ? ino : UFS_FUSE_INODE( dir -> parent );
+            st.st_mode = S_IFDIR;
+        } else {
+            name = dir -> entries[ i - 2 ].name;
+            st.st_ino = UFS_FUSE_INODE( dir -> entries[ i - 2 ].storage );
+            st.st_mode = dir -> entries[ i - 2 ].type ==
+                         UFS_STORAGE_TYPE_DIRECTORY ? S_IFDIR : S_IFREG;
+        }
+
+        entrySize = fuse_add_direntry( req, buffer + used, size - used, name,
+                                       &st, i + 1 );
+        if ( entrySize > size - used )
+            break;
+
+        used += entrySize;
+    }
+
+    fuse_reply_buf( req, buffer, used );
+    free( buffer );
+}
+
+/* Same as readdir, with every entry described as lookup would. Entries keep  */
+/* the area they resolved to when the directory was listed, and are only      */
+/* resolved again once it changed. Attributes of the entries of a reply are   */
+/* fetched in one batch, BASE storage without attributes is stated by name in */
+/* its directory, which is only opened once. Entries that can't be described  */
+/* are listed by name, so the kernel looks them up on its own.                */
+static void ufsFuseReaddirplus( fuse_req_t req,
+                                fuse_ino_t ino,
+                                size_t size,
+                                off_t offset,
+                                struct fuse_file_info *fi )
+{
+    ufsIdentifierType storages[ UFS_FUSE_BATCH ], areas[ UFS_FUSE_BATCH ];
+    ufsStatusType resolved[ UFS_FUSE_BATCH ], found[ UFS_FUSE_BATCH ];
+    ufsAttributesType attributes[ UFS_FUSE_BATCH ];
+    char path[ PATH_MAX ], *buffer;
+    struct fuse_entry_param entry;
+    size_t used, entrySize, smallest, first, count, numListed, i, *listed;
+    ufsFuseEntryType *dirEntry;
+    ufsFuseStruct *fuse;
+    ufsFuseDirType *dir;
+    ufsStatusType status;
+    uint64_t generation;
+    int dirFd, res;
+    off_t position;
+    ufsType reader;
+
+    fuse = fuse_req_userdata( req );
+    dir = ( ufsFuseDirType * )( uintptr_t )fi -> fh;
+    pthread_rwlock_rdlock( &fuse -> ufsLock );
+    reader = acquireReader( fuse );
+
+    /* No more entries than the smallest ones fit can be listed.              */
+    smallest = fuse_add_direntry_plus( req, NULL, 0, "", NULL, 0 );
+    buffer = malloc( size );
+    listed = malloc( ( size / smallest + 1 ) * sizeof( *listed ) );
+    if ( !reader || !buffer || !listed ) {
+        fuse_reply_err( req, reader ? ENOMEM : toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    dirFd = dir -> directory == UFS_STORAGE_ROOT_IDENTIFIER ? fuse -> baseFd :
+                                                              -1;
+    if ( ufsGetDirectoryGeneration( reader, dir -> directory,
+                                    &generation ) != UFS_NO_ERROR )
+        generation = dir -> generation + 1;
+
+    used = 0;
+    first = 0;
+    count = 0;
+    numListed = 0;
+    for ( position = offset; position < ( off_t )dir -> numEntries + 2;
+          position++ ) {
+        memset( &entry, 0, sizeof( entry ) );
+        entry.attr_timeout = UFS_FUSE_TIMEOUT;
+        entry.entry_timeout = UFS_FUSE_TIMEOUT;
+
+        /* "." and ".." are never looked up through the listing.              */
+        if ( position < 2 ) {
+            entry.attr.st_ino = position == 0 ?
+                                ino : UFS_FUSE_INODE( dir -> parent );
+            entry.attr.st_mode = S_IFDIR;
+            entrySize = fuse_add_direntry_plus( req, buffer + used,
+                                                size - used,
+                                                position == 0 ? "." : "..",
+                                                &entry, position + 1 );
+            if ( entrySize > size - used )
+                break;
+
+            used += entrySize;
+            continue;
+        }
+
+        i = position - 2;
+        if ( i >= first + count ) {
+            first = i;
+            count = dir -> numEntries - first;
+            if ( count > UFS_FUSE_BATCH )
+                count = UFS_FUSE_BATCH;
+            if ( count > ( size - used ) / smallest + 1 )
+                count = ( size - used ) / smallest + 1;
+
+            for ( i = 0; i < count; i++ ) {
+                storages[ i ] = dir -> entries[ first + i ].storage;
+                areas[ i ] = dir -> entries[ first + i ].area;
+                resolved[ i ] = UFS_NO_ERROR;
+            }
+
+            /* A mapping of an entry added or removed since the listing also  */
+            /* changed the generation of its directory.                       */
+            status = UFS_NO_ERROR;
+            if ( generation != dir -> generation )
+                status = ufsResolveManyInViewSpan( reader, fuse -> view,
+                                                   storages, count, areas,
+                                                   resolved );
+            for ( i = 0; status != UFS_NO_ERROR && i < count; i++ )
+                resolved[ i ] = status;
+
+            status = ufsGetManyAttributes( reader, storages, count,
+                                           attributes, found );
+            for ( i = 0; status != UFS_NO_ERROR && i < count; i++ )
+                found[ i ] = status;
+
+            i = position - 2;
+        }
+
+        dirEntry = &dir -> entries[ i ];
+        res = -toErrno( resolved[ i - first ] );
+        if ( !res && dirFd < 0 &&
+             areas[ i - first ] == UFS_AREA_BASE_IDENTIFIER &&
+             found[ i - first ] == UFS_ATTRIBUTES_DO_NOT_EXIST &&
+             !basePath( reader, dir -> directory, path, sizeof( path ) ) )
+            dirFd = openat( fuse -> baseFd, path,
+                            O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if ( !res )
+            res = fillStat( fuse, reader, dirEntry -> storage,
+                            dirEntry -> type, areas[ i - first ],
+                            found[ i - first ], &attributes[ i - first ],
+                            dirFd, dirEntry -> name, &entry.attr );
+
+        if ( res ) {
+            memset( &entry.attr, 0, sizeof( entry.attr ) );
+            entry.attr.st_ino = UFS_FUSE_INODE( dirEntry -> storage );
+            entry.attr.st_mode = dirEntry -> type ==
+                                 UFS_STORAGE_TYPE_DIRECTORY ? S_IFDIR :
+                                                              S_IFREG;
+        } else {
+            entry.ino = UFS_FUSE_INODE( dirEntry -> storage );
+        }
+
+        entrySize = fuse_add_direntry_plus( req, buffer + used, size - used,
+                                            dirEntry -> name, &entry,
+                                            position + 1 );
+        if ( entrySize > size - used )
+            break;
+
+        used += entrySize;
+        if ( entry.ino )
+            listed[ numListed++ ] = i;
+    }
+
+    if ( dirFd >= 0 && dirFd != fuse -> baseFd )
+        close( dirFd );
+
+    /* The kernel holds every inode it was handed, as if looked up.           */
+    if ( !fuse_reply_buf( req, buffer, used ) ) {
+        pthread_mutex_lock( &fuse -> tableLock );
+        for ( i = 0; i < numListed; i++ )
+            rememberInode( fuse, dir -> directory,
+                           dir -> entries[ listed[ i ] ].name,
+                           dir -> entries[ listed[ i ] ].storage,
+                           dir -> entries[ listed[ i ] ].type );
+        pthread_mutex_unlock( &fuse -> tableLock );
+    }
+
+out:
+    free( listed );
+    free( buffer );
+    if ( reader )
+        releaseReader( fuse, reader );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+}
+
+static void ufsFuseReleasedir( fuse_req_t req,
+                               fuse_ino_t ino,
+                               struct fuse_file_info *fi )
+{
+    ufsFuseStruct *fuse;
+
+    ( void )ino;
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> tableLock );
+    freeDir( fuse, ( ufsFuseDirType * )( uintptr_t )fi -> fh );
+    pthread_mutex_unlock( &fuse -> tableLock );
+    fuse_reply_err( req, 0 );
+}
+
+static void ufsFuseOpen( fuse_req_t req,
+                         fuse_ino_t ino,
+                         struct fuse_file_info *fi )
+{
+    ufsIdentifierType storage, area;
+    ufsFusePartialType *partial;
+    ufsStorageInfoType info;
+    ufsFuseStruct *fuse;
+    int res, fd, flags;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    storage = UFS_FUSE_STORAGE( ino );
+    if ( storage == UFS_STORAGE_ROOT_IDENTIFIER ) {
+        fuse_reply_err( req, EISDIR );
+        goto out;
+    }
+
+    if ( ufsGetStorage( fuse -> ufs, storage, &info ) != UFS_NO_ERROR ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    if ( info.type == UFS_STORAGE_TYPE_DIRECTORY ) {
+        fuse_reply_err( req, EISDIR );
+        goto out;
+    }
+
+    res = resolveStorage( fuse, fuse -> ufs, storage, &area );
+    flags = backingFlags( fuse,
+                          fi -> flags & ~( O_CREAT | O_EXCL | O_NOCTTY ) );
+    if ( !res && area != fuse -> top &&
+         ( ( flags & O_ACCMODE ) != O_RDONLY || ( flags & O_TRUNC ) ) ) {
+        res = copyUp( fuse, storage, area, flags & O_TRUNC );
+        area = fuse -> top;
+    }
+
+    partial = NULL;
+    if ( !res )
+        res = acquirePartial( fuse, storage, area, &partial );
+
+    /* Storage held by extents is truncated through them, or the layers       */
+    /* below would show through.                                              */
+    fd = -1;
+    if ( !res ) {
+        fd = openBacking( fuse, storage, area,
+                          partial ? flags & ~O_TRUNC : flags );
+        res = fd < 0 ? fd : 0;
+    }
+
+    if ( !res && partial && ( flags & O_TRUNC ) ) {
+        res = truncatePartial( fuse, partial, 0 );
+        if ( !res && ftruncate( fd, 0 ) )
+            res = -errno;
+    }
+
+    if ( !res )
+        res = setHandle( req, fuse, fd, partial, fi );
+
+    if ( res ) {
+        if ( fd >= 0 )
+            close( fd );
+        if ( partial )
+            releasePartial( fuse, partial );
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    if ( fuse_reply_open( req, fi ) )
+        releaseHandle( req, fuse, UFS_FUSE_FILE( fi ) );
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+/* The reply points at the backing file, FUSE splices it into /dev/fuse.      */
+/* Content held by extents is assembled from the layers that hold them.       */
+static void ufsFuseRead( fuse_req_t req,
+                         fuse_ino_t ino,
+                         size_t size,
+                         off_t offset,
+                         struct fuse_file_info *fi )
+{
+    struct fuse_bufvec buffer = FUSE_BUFVEC_INIT( size ), *segments;
+    ufsFuseFileType *file;
+
+    ( void )ino;
+    file = UFS_FUSE_FILE( fi );
+    if ( !file -> partial ) {
+        buffer.buf[ 0 ].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+        buffer.buf[ 0 ].fd = file -> fd;
+        buffer.buf[ 0 ].pos = offset;
+        fuse_reply_data( req, &buffer, FUSE_BUF_SPLICE_MOVE );
+        return;
+    }
+
+    segments = malloc( sizeof( *segments ) + sizeof( struct fuse_buf ) *
+                       ( size / UFS_FUSE_EXTENT_SIZE + 2 ) );
+    if ( !segments ) {
+        fuse_reply_err( req, ENOMEM );
+        return;
+    }
+
+    segments -> count = fillSegments( file -> partial -> layers, offset, size,
+                                      segments -> buf );
+    segments -> idx = 0;
+    segments -> off = 0;
+    fuse_reply_data( req, segments, FUSE_BUF_SPLICE_MOVE );
+    free( segments );
+}
+
+/* Written data arrives in a pipe when the kernel splices requests, and goes  */
+/* from it to the backing file.                                               */
+static void ufsFuseWriteBuf( fuse_req_t req,
+                             fuse_ino_t ino,
+                             struct fuse_bufvec *in,
+                             off_t offset,
+                             struct fuse_file_info *fi )
+{
+    struct fuse_bufvec out = FUSE_BUFVEC_INIT( fuse_buf_size( in ) );
+    ufsFuseFileType *file;
+    ufsFuseStruct *fuse;
+    ssize_t written;
+
+    ( void )ino;
+    fuse = fuse_req_userdata( req );
+    file = UFS_FUSE_FILE( fi );
+    __atomic_fetch_add( &fuse -> stats.writes, 1, __ATOMIC_RELAXED );
+    written = file -> partial ? prepareWrite( fuse, file -> partial, offset,
+                                              out.buf[ 0 ].size ) : 0;
+    if ( written < 0 ) {
+        fuse_reply_err( req, -written );
+        return;
+    }
+
+    out.buf[ 0 ].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
+    out.buf[ 0 ].fd = file -> fd;
+    out.buf[ 0 ].pos = offset;
+    written = fuse_buf_copy( &out, in, 0 );
+    if ( written < 0 )
+        fuse_reply_err( req, -written );
+    else
+        fuse_reply_write( req, written );
+}
+
+static void ufsFuseFsync( fuse_req_t req,
+                          fuse_ino_t ino,
+                          int datasync,
+                          struct fuse_file_info *fi )
+{
+    int res;
+
+    ( void )ino;
+    res = datasync ? fdatasync( UFS_FUSE_FILE( fi ) -> fd ) :
+                     fsync( UFS_FUSE_FILE( fi ) -> fd );
+    fuse_reply_err( req, res ? errno : 0 );
+}
+
+static void ufsFuseRelease( fuse_req_t req,
+                            fuse_ino_t ino,
+                            struct fuse_file_info *fi )
+{
+    ufsFuseFileType *file;
+    ufsFuseStruct *fuse;
+
+    ( void )ino;
+    fuse = fuse_req_userdata( req );
+    file = UFS_FUSE_FILE( fi );
+    if ( !file -> partial ) {
+        releaseHandle( req, fuse, file );
+    } else {
+        pthread_mutex_lock( &fuse -> lock );
+        releaseHandle( req, fuse, file );
+        pthread_mutex_unlock( &fuse -> lock );
+    }
+
+    fuse_reply_err( req, 0 );
+}
+
+static void ufsFuseCreate( fuse_req_t req,
+                           fuse_ino_t parent,
+                           const char *name,
+                           mode_t mode,
+                           struct fuse_file_info *fi )
+{
+    ufsIdentifierType storage, area;
+    const struct fuse_ctx *context;
+    struct fuse_entry_param entry;
+    char backing[ UFS_FUSE_NAME_SIZE ];
+    ufsFuseStruct *fuse;
+    uint32_t type;
+    int res, fd;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    if ( strlen( name ) > UFS_STORAGE_NAME_MAX ) {
+        fuse_reply_err( req, ENAMETOOLONG );
+        goto out;
+    }
+
+    if ( !lookupChild( fuse, fuse -> ufs, UFS_FUSE_STORAGE( parent ), name,
+                       &storage, &type, &area ) ) {
+        fuse_reply_err( req, EEXIST );
+        goto out;
+    }
+
+    /* Storage hidden from the view, by a whiteout or by not being in any of  */
+    /* its areas, is taken over by the new file.                              */
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    storage = ufsAddFile( fuse -> ufs, UFS_FUSE_STORAGE( parent ), name );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    if ( storage < 0 && ufsErrno == UFS_ALREADY_EXISTS )
+        storage = ufsGetFile( fuse -> ufs, UFS_FUSE_STORAGE( parent ), name );
+
+    if ( storage < 0 ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    backingName( storage, backing );
+    fd = openat( fuse -> fds[ 0 ], backing,
+                 backingFlags( fuse, fi -> flags & ~( O_EXCL | O_NOCTTY ) ) |
+                 O_CREAT | O_TRUNC | O_CLOEXEC, mode );
+    if ( fd < 0 ) {
+        fuse_reply_err( req, errno );
+        goto out;
+    }
+
+    context = fuse_req_ctx( req );
+    ( void )fchown( fd, context -> uid, context -> gid );
+    res = mapInTop( fuse, storage );
+    memset( &entry, 0, sizeof( entry ) );
+    if ( !res )
+        res = fstat( fd, &entry.attr ) ? -errno : 0;
+
+    if ( res ) {
+        close( fd );
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    entry.ino = UFS_FUSE_INODE( storage );
+    entry.attr.st_ino = entry.ino;
+    entry.attr_timeout = UFS_FUSE_TIMEOUT;
+    entry.entry_timeout = UFS_FUSE_TIMEOUT;
+    res = setHandle( req, fuse, fd, NULL, fi );
+    if ( res ) {
+        close( fd );
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    if ( !fuse_reply_create( req, &entry, fi ) ) {
+        pthread_mutex_lock( &fuse -> tableLock );
+        rememberInode( fuse, UFS_FUSE_STORAGE( parent ), name, storage,
+                       UFS_STORAGE_TYPE_FILE );
+        pthread_mutex_unlock( &fuse -> tableLock );
+    } else {
+        releaseHandle( req, fuse, UFS_FUSE_FILE( fi ) );
+    }
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+static void ufsFuseMkdir( fuse_req_t req,
+                          fuse_ino_t parent,
+                          const char *name,
+                          mode_t mode )
+{
+    ufsIdentifierType storage, area;
+    const struct fuse_ctx *context;
+    ufsAttributesType attributes;
+    ufsFuseStruct *fuse;
+    struct timespec now;
+    uint32_t type;
+    int res;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    if ( strlen( name ) > UFS_STORAGE_NAME_MAX ) {
+        fuse_reply_err( req, ENAMETOOLONG );
+        goto out;
+    }
+
+    if ( !lookupChild( fuse, fuse -> ufs, UFS_FUSE_STORAGE( parent ), name,
+                       &storage, &type, &area ) ) {
+        fuse_reply_err( req, EEXIST );
+        goto out;
+    }
+
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    storage = ufsAddDirectory( fuse -> ufs, UFS_FUSE_STORAGE( parent ), name );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    if ( storage < 0 && ufsErrno == UFS_ALREADY_EXISTS )
+        storage = ufsGetDirectory( fuse -> ufs, UFS_FUSE_STORAGE( parent ),
+                                   name );
+
+    if ( storage < 0 ) {
+        fuse_reply_err( req, toErrno( ufsErrno ) );
+        goto out;
+    }
+
+    context = fuse_req_ctx( req );
+    clock_gettime( CLOCK_REALTIME, &now );
+    memset( &attributes, 0, sizeof( attributes ) );
+    attributes.mode = S_IFDIR | ( mode & 07777 );
+    attributes.mtime = now.tv_sec * 1000000000LL + now.tv_nsec;
+    attributes.ctime = attributes.mtime;
+    attributes.nlink = 2;
+    attributes.uid = context -> uid;
+    attributes.gid = context -> gid;
+    res = setAttributesInTop( fuse, storage, &attributes );
+
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    replyEntry( req, fuse, fuse -> ufs, UFS_FUSE_STORAGE( parent ), name,
+                storage, UFS_STORAGE_TYPE_DIRECTORY, fuse -> top );
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+static void ufsFuseUnlink( fuse_req_t req,
+                           fuse_ino_t parent,
+                           const char *name )
+{
+    ufsIdentifierType storage, area;
+    char backing[ UFS_FUSE_NAME_SIZE ];
+    ufsFuseStruct *fuse;
+    ufsStatusType status;
+    uint32_t type;
+    int res;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    res = lookupChild( fuse, fuse -> ufs, UFS_FUSE_STORAGE( parent ), name,
+                       &storage, &type, &area );
+    if ( !res && type != UFS_STORAGE_TYPE_FILE )
+        res = -EISDIR;
+
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    pthread_rwlock_wrlock( &fuse -> ufsLock );
+    status = ufsAddWhiteout( fuse -> ufs, fuse -> top, storage );
+    pthread_rwlock_unlock( &fuse -> ufsLock );
+    if ( status != UFS_NO_ERROR ) {
+        fuse_reply_err( req, toErrno( status ) );
+        goto out;
+    }
+
+    /* Files that are still open keep their backing file until they're        */
+    /* released.                                                              */
+    if ( area == fuse -> top ) {
+        backingName( storage, backing );
+        unlinkat( fuse -> fds[ 0 ], backing, 0 );
+    }
+
+    fuse_reply_err( req, 0 );
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+static void ufsFuseRmdir( fuse_req_t req,
+                          fuse_ino_t parent,
+                          const char *name )
+{
+    ufsIdentifierType storage, area;
+    ufsFuseStruct *fuse;
+    ufsStatusType status;
+    uint32_t type;
+    int res;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> lock );
+    res = lookupChild( fuse, fuse -> ufs, UFS_FUSE_STORAGE( parent ), name,
+                       &storage, &type, &area );
+    if ( !res && type != UFS_STORAGE_TYPE_DIRECTORY )
+        res = -ENOTDIR;
+
+    if ( res ) {
+        fuse_reply_err( req, -res );
+        goto out;
+    }
+
+    /* Only what the view sees counts, storage it doesn't see can stay.       */
+    status = ufsIterateDirInViewSpan( fuse -> ufs, fuse -> view, storage,
+                                      rejectEntry, NULL );
+    if ( status == UFS_NO_ERROR ) {
+        pthread_rwlock_wrlock( &fuse -> ufsLock );
+        status = ufsAddWhiteout( fuse -> ufs, fuse -> top, storage );
+        pthread_rwlock_unlock( &fuse -> ufsLock );
+    }
+
+    fuse_reply_err( req, toErrno( status ) );
+
+out:
+    pthread_mutex_unlock( &fuse -> lock );
+}
+
+static void ufsFuseForget( fuse_req_t req, fuse_ino_t ino, uint64_t lookups )
+{
+    ufsFuseStruct *fuse;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> tableLock );
+    forgetInode( fuse, UFS_FUSE_STORAGE( ino ), lookups );
+    pthread_mutex_unlock( &fuse -> tableLock );
+    fuse_reply_none( req );
+}
+
+static void ufsFuseForgetMulti( fuse_req_t req,
+                                size_t count,
+                                struct fuse_forget_data *forgets )
+{
+    ufsFuseStruct *fuse;
+    size_t i;
+
+    fuse = fuse_req_userdata( req );
+    pthread_mutex_lock( &fuse -> tableLock );
+    for ( i = 0; i < count; i++ )
+        forgetInode( fuse, UFS_FUSE_STORAGE( forgets[ i ].ino ),
+                     forgets[ i ].nlookup );
+    pthread_mutex_unlock( &fuse -> tableLock );
+    fuse_reply_none( req );
+}
+
+static void ufsFuseStatfs( fuse_req_t req, fuse_ino_t ino )
+{
+    ufsFuseStruct *fuse;
+    struct statvfs st;
+
+    ( void )ino;
+    fuse = fuse_req_userdata( req );
+    if ( fstatvfs( fuse -> upperFd, &st ) ) {
+        fuse_reply_err( req, errno );
+        return;
+    }
+
+    st.f_namemax = UFS_STORAGE_NAME_MAX;
+    fuse_reply_statfs( req, &st );
+}
+
+static const struct fuse_lowlevel_ops ufsFuseOperations = {
+    .init = ufsFuseConnect,
+    .lookup = ufsFuseLookup,
+    .forget = ufsFuseForget,
+    .forget_multi = ufsFuseForgetMulti,
+    .getattr = ufsFuseGetattr,
+    .setattr = ufsFuseSetattr,
+    .opendir = ufsFuseOpendir,
+    .readdir = ufsFuseReaddir,
+    .readdirplus = ufsFuseReaddirplus,
+    .releasedir = ufsFuseReleasedir,
+    .open = ufsFuseOpen,
+    .read = ufsFuseRead,
+    .write_buf = ufsFuseWriteBuf,
+    .fsync = ufsFuseFsync,
+    .release = ufsFuseRelease,
+    .create = ufsFuseCreate,
+    .mkdir = ufsFuseMkdir,
+    .unlink = ufsFuseUnlink,
+    .rmdir = ufsFuseRmdir,
+    .statfs = ufsFuseStatfs,
+};
+
+ufsFuseType ufsFuseInit( ufsType ufs,
+                         const ufsFuseOptionsType *options,
+                         int argc,
+                         char **argv )
+{
+    struct fuse_args args = FUSE_ARGS_INIT( 0, NULL );
+    pthread_rwlockattr_t attr;
+    ufsFuseStruct *fuse;
+    ufsStatusType status;
+    ufsType reader;
+    uint32_t count, i;
+    if ( !ufs || !options || options -> baseFd < 0 ||
+         options -> upperFd < 0 || options -> view.count < 2 ||
+         options -> view.count > UFS_VIEW_MAX_SIZE ||
+         !options -> view.areas || ( options -> flags & ~UFS_FUSE_FLAGS ) ||
+         argc < 0 || ( argc && !argv ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return NULL;
+    }
+
+    count = options -> view.count;
+    if ( options -> view.areas[ 0 ] == UFS_AREA_BASE_IDENTIFIER ||
+         options -> view.areas[ count - 1 ] != UFS_AREA_BASE_IDENTIFIER ) {
+        ufsErrno = UFS_BAD_CALL;
+        return NULL;
+    }
+
+    fuse = calloc( 1, sizeof( *fuse ) );
+    if ( !fuse ) {
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    fuse -> ufs = ufs;
+    fuse -> threads = options -> threads;
+    fuse -> maxIdleThreads = options -> maxIdleThreads;
+    fuse -> flags = options -> flags;
+    pthread_mutex_init( &fuse -> lock, NULL );
+    pthread_mutex_init( &fuse -> tableLock, NULL );
+    pthread_mutex_init( &fuse -> pairsLock, NULL );
+
+    /* Lookups keep coming while a change waits, they mustn't starve it.      */
+    pthread_rwlockattr_init( &attr );
+    pthread_rwlockattr_setkind_np(
+        &attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP );
+    pthread_rwlock_init( &fuse -> ufsLock, &attr );
+    pthread_rwlockattr_destroy( &attr );
+    pthread_cond_init( &fuse -> copyQueued, NULL );
+    pthread_cond_init( &fuse -> extentCopied, NULL );
+    fuse -> baseFd = options -> baseFd;
+    fuse -> upperFd = options -> upperFd;
+    fuse -> top = options -> view.areas[ 0 ];
+    status = openAreas( fuse, options -> view, &fuse -> areas, &fuse -> fds );
+    if ( status != UFS_NO_ERROR )
+        goto fail;
+
+    fuse -> view.areas = fuse -> areas;
+    fuse -> view.count = count;
+
+    /* Changes made to ufs from here on are what the kernel may have cached.  */
+    fuse -> buckets = UFS_FUSE_INITIAL_INODES;
+    fuse -> inodes = calloc( fuse -> buckets, sizeof( *fuse -> inodes ) );
+    status = UFS_OUT_OF_MEMORY;
+    if ( !fuse -> inodes )
+        goto fail;
+
+    status = ufsSubscribeChanges( ufs, &fuse -> cursor );
+    if ( status != UFS_NO_ERROR )
+        goto fail;
+
+    /* The first reader tells whether ufs can be read from other threads.     */
+    reader = ufsInitReader( ufs );
+    if ( !reader ) {
+        status = ufsErrno;
+        goto fail;
+    }
+
+    releaseReader( fuse, reader );
+
+    /* FUSE may rewrite its arguments, they're copied first.                  */
+    status = UFS_OUT_OF_MEMORY;
+    if ( fuse_opt_add_arg( &args, argc ? argv[ 0 ] : "ufs" ) )
+        goto fail;
+
+    for ( i = 1; i < ( uint32_t )argc; i++ ) {
+        if ( fuse_opt_add_arg( &args, argv[ i ] ) )
+            goto fail;
+    }
+
+    fuse -> session = fuse_session_new( &args, &ufsFuseOperations,
+                                        sizeof( ufsFuseOperations ), fuse );
+    fuse_opt_free_args( &args );
+    if ( !fuse -> session ) {
+        status = UFS_UNKNOWN_ERROR;
+        goto fail;
+    }
+
+    ufsErrno = UFS_NO_ERROR;
+    return fuse;
+
+fail:
+    fuse_opt_free_args( &args );
+    ufsFuseDestroy( fuse );
+    ufsErrno = status;
+    return NULL;
+}
+
+void ufsFuseDestroy( ufsFuseType fuse )
+{
+    ufsFuseInodeType *inode;
+    ufsFuseStruct *ufsFuse;
+    size_t i;
+
+    ufsFuse = fuse;
+    if ( !ufsFuse )
+        return;
+
+    if ( ufsFuse -> mounted ) {
+        fuse_remove_signal_handlers( ufsFuse -> session );
+        fuse_session_unmount( ufsFuse -> session );
+    }
+
+    if ( ufsFuse -> session )
+        fuse_session_destroy( ufsFuse -> session );
+
+    while ( ufsFuse -> dirs )
+        freeDir( ufsFuse, ufsFuse -> dirs );
+
+    stopCopier( ufsFuse );
+    while ( ufsFuse -> partials ) {
+        ufsFuse -> partials -> opens = 1;
+        releasePartial( ufsFuse, ufsFuse -> partials );
+    }
+
+    for ( i = 0; ufsFuse -> inodes && i < ufsFuse -> buckets; i++ ) {
+        while ( ( inode = ufsFuse -> inodes[ i ] ) ) {
+            ufsFuse -> inodes[ i ] = inode -> next;
+            free( inode );
+        }
+    }
+
+    closeAreas( ufsFuse, ufsFuse -> areas, ufsFuse -> fds,
+                ufsFuse -> view.count );
+    for ( i = 0; i < ufsFuse -> numReaders; i++ )
+        ufsDestroy( ufsFuse -> readers[ i ] );
+
+    free( ufsFuse -> readers );
+    free( ufsFuse -> inodes );
+    free( ufsFuse -> invalidations );
+    pthread_cond_destroy( &ufsFuse -> extentCopied );
+    pthread_cond_destroy( &ufsFuse -> copyQueued );
+    pthread_rwlock_destroy( &ufsFuse -> ufsLock );
+    pthread_mutex_destroy( &ufsFuse -> pairsLock );
+    pthread_mutex_destroy( &ufsFuse -> tableLock );
+    pthread_mutex_destroy( &ufsFuse -> lock );
+    free( ufsFuse );
+}
+
+ufsStatusType ufsFuseMount( ufsFuseType fuse, const char *mountpoint )
+{
+    ufsFuseStruct *ufsFuse;
+    if ( !fuse || !mountpoint || ( ( ufsFuseStruct * )fuse ) -> mounted ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsFuse = fuse;
+    if ( fuse_session_mount( ufsFuse -> session, mountpoint ) ) {
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    if ( fuse_set_signal_handlers( ufsFuse -> session ) ) {
+        fuse_session_unmount( ufsFuse -> session );
+        ufsErrno = UFS_UNKNOWN_ERROR;
+        return ufsErrno;
+    }
+
+    ufsFuse -> mounted = 1;
+    ufsErrno = UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsFuseLoop( ufsFuseType fuse )
+{
+    struct fuse_loop_config config;
+    ufsFuseStruct *ufsFuse;
+    long threads;
+    int res;
+    if ( !fuse || !( ( ufsFuseStruct * )fuse ) -> mounted ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsFuse = fuse;
+    threads = ufsFuse -> threads;
+    if ( !threads ) {
+        threads = sysconf( _SC_NPROCESSORS_ONLN );
+        if ( threads < 1 )
+            threads = 1;
+    }
+
+    if ( threads == 1 ) {
+        res = fuse_session_loop( ufsFuse -> session );
+    } else {
+        /* Every worker reads requests from an fd of its own, cloned from the */
+        /* session's, so they don't contend on a single queue.                */
+        config.clone_fd = 1;
+        config.max_idle_threads = ufsFuse -> maxIdleThreads ?
+                                  ufsFuse -> maxIdleThreads : threads;
+        res = fuse_session_loop_mt( ufsFuse -> session, &config );
+    }
+
+    ufsErrno = res < 0 ? UFS_UNKNOWN_ERROR : UFS_NO_ERROR;
+    return ufsErrno;
+}
+
+ufsStatusType ufsFuseUpdate( ufsFuseType fuse,
+                             ufsFuseUpdateFunction update,
+                             void *userData )
+{
+    ufsFuseInvalidationType *invalidations;
+    ufsFuseStruct *ufsFuse;
+    ufsStatusType status;
+    size_t count;
+    int res;
+    if ( !fuse || !update ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsFuse = fuse;
+    pthread_mutex_lock( &ufsFuse -> lock );
+    pthread_rwlock_wrlock( &ufsFuse -> ufsLock );
+    pthread_mutex_lock( &ufsFuse -> tableLock );
+
+    /* Changes made by requests were answered to the kernel already.          */
+    res = queueChanges( ufsFuse );
+    ufsFuse -> numInvalidations = 0;
+    status = res ? UFS_UNKNOWN_ERROR : update( ufsFuse -> ufs, userData );
+
+    /* update may have changed ufs before failing, its changes are followed   */
+    /* either way. If they can't be, everything the kernel holds is dropped.  */
+    res = queueChanges( ufsFuse );
+    if ( res && queueAll( ufsFuse ) )
+        ufsFuse -> numInvalidations = 0;
+
+    invalidations = ufsFuse -> invalidations;
+    count = ufsFuse -> numInvalidations;
+    ufsFuse -> stats.invalidations += count;
+    ufsFuse -> invalidations = NULL;
+    ufsFuse -> numInvalidations = 0;
+    ufsFuse -> maxInvalidations = 0;
+    pthread_mutex_unlock( &ufsFuse -> tableLock );
+    pthread_rwlock_unlock( &ufsFuse -> ufsLock );
+    pthread_mutex_unlock( &ufsFuse -> lock );
+
+    /* The kernel may hold locks of directories while it waits for requests   */
+    /* to be served, so it's only notified once ufs is free.                  */
+    sendInvalidations( ufsFuse, invalidations, count );
+    free( invalidations );
+    ufsErrno = status;
+    return ufsErrno;
+}
+
+ufsStatusType ufsFuseSetView( ufsFuseType fuse, ufsViewSpanType view )
+{
+    ufsIdentifierType *areas, *storages, *oldAreas, *newAreas;
+    ufsFuseInvalidationType *invalidations;
+    ufsFuseInodeType *inode, **inodes;
+    ufsStatusType status, *statuses;
+    ufsFuseStruct *ufsFuse;
+    size_t count, i, n;
+    int *fds;
+    if ( !fuse || view.count < 2 || view.count > UFS_VIEW_MAX_SIZE ||
+         !view.areas || view.areas[ 0 ] == UFS_AREA_BASE_IDENTIFIER ||
+         view.areas[ view.count - 1 ] != UFS_AREA_BASE_IDENTIFIER ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsFuse = fuse;
+    pthread_mutex_lock( &ufsFuse -> lock );
+    pthread_rwlock_wrlock( &ufsFuse -> ufsLock );
+    pthread_mutex_lock( &ufsFuse -> tableLock );
+    status = openAreas( ufsFuse, view, &areas, &fds );
+    if ( status != UFS_NO_ERROR ) {
+        pthread_mutex_unlock( &ufsFuse -> tableLock );
+        pthread_rwlock_unlock( &ufsFuse -> ufsLock );
+        pthread_mutex_unlock( &ufsFuse -> lock );
+        ufsErrno = status;
+        return ufsErrno;
+    }
+
+    /* Only storage the kernel holds that resolves differently in the new     */
+    /* view is invalidated, everything else it cached still holds.            */
+    n = ufsFuse -> numInodes;
+    storages = malloc( ( n ? n : 1 ) * sizeof( *storages ) );
+    oldAreas = malloc( ( n ? n : 1 ) * sizeof( *oldAreas ) );
+    newAreas = malloc( ( n ? n : 1 ) * sizeof( *newAreas ) );
+    inodes = malloc( ( n ? n : 1 ) * sizeof( *inodes ) );
+    statuses = malloc( ( n ? n : 1 ) * sizeof( *statuses ) );
+    status = UFS_OUT_OF_MEMORY;
+    if ( storages && oldAreas && newAreas && inodes && statuses ) {
+        n = 0;
+        for ( i = 0; i < ufsFuse -> buckets; i++ ) {
+            for ( inode = ufsFuse -> inodes[ i ]; inode;
+                  inode = inode -> next ) {
+                inodes[ n ] = inode;
+                storages[ n++ ] = inode -> storage;
+            }
+        }
+
+        status = ufsResolveManyInViewSpan( ufsFuse -> ufs, ufsFuse -> view,
+                                           storages, n, oldAreas, statuses );
+        if ( status == UFS_NO_ERROR )
+            status = ufsResolveManyInViewSpan( ufsFuse -> ufs, view, storages,
+                                               n, newAreas, statuses );
+    }
+
+    ufsFuse -> numInvalidations = 0;
+    for ( i = 0; status == UFS_NO_ERROR && i < n; i++ ) {
+        if ( oldAreas[ i ] != newAreas[ i ] &&
+             queueInvalidation( ufsFuse, inodes[ i ], 1, 1 ) )
+            status = UFS_OUT_OF_MEMORY;
+    }
+
+    if ( status == UFS_NO_ERROR ) {
+        closeAreas( ufsFuse, ufsFuse -> areas, ufsFuse -> fds,
+                    ufsFuse -> view.count );
+        ufsFuse -> areas = areas;
+        ufsFuse -> fds = fds;
+        ufsFuse -> view.areas = areas;
+        ufsFuse -> view.count = view.count;
+        ufsFuse -> top = areas[ 0 ];
+    } else {
+        closeAreas( ufsFuse, areas, fds, view.count );
+        ufsFuse -> numInvalidations = 0;
+    }
+
+    invalidations = ufsFuse -> invalidations;
+    count = ufsFuse -> numInvalidations;
+    ufsFuse -> stats.invalidations += count;
+    ufsFuse -> invalidations = NULL;
+    ufsFuse -> numInvalidations = 0;
+    ufsFuse -> maxInvalidations = 0;
+    pthread_mutex_unlock( &ufsFuse -> tableLock );
+    pthread_rwlock_unlock( &ufsFuse -> ufsLock );
+    pthread_mutex_unlock( &ufsFuse -> lock );
+
+    sendInvalidations( ufsFuse, invalidations, count );
+    free( invalidations );
+    free( storages );
+    free( oldAreas );
+    free( newAreas );
+    free( inodes );
+    free( statuses );
+    ufsErrno = status;
+    return ufsErrno;
+}
+
+void ufsFuseGetStats( ufsFuseType fuse, ufsFuseStatsType *stats )
+{
+    ufsFuseStruct *ufsFuse;
+
+    ufsFuse = fuse;
+    pthread_mutex_lock( &ufsFuse -> lock );
+    *stats = ufsFuse -> stats;
+    stats -> writes = __atomic_load_n( &ufsFuse -> stats.writes,
+                                       __ATOMIC_RELAXED );
+    stats -> lookups = __atomic_load_n( &ufsFuse -> stats.lookups,
+                                        __ATOMIC_RELAXED );
+    stats -> getattrs = __atomic_load_n( &ufsFuse -> stats.getattrs,
+                                         __ATOMIC_RELAXED );
+    pthread_mutex_unlock( &ufsFuse -> lock );
+    pthread_mutex_lock( &ufsFuse -> pairsLock );
+    memcpy( stats -> copies, ufsFuse -> stats.copies,
+            sizeof( stats -> copies ) );
+    pthread_mutex_unlock( &ufsFuse -> pairsLock );
+}
@@ -0,0 +1,270 @@
+/******************************************************************************\
+*  ufs_fuse.h                                                                  *
+*                                                                              *
+*  Serves a view of ufs as a filesystem, over the FUSE low-level API.          *
+*  The inode number of storage is its unique identifier plus one, so ROOT is   *
+*  the FUSE root inode, and the kernel hands ufs identifiers back on every     *
+*  request. Nothing is looked up by path except content of BASE, and only      *
+*  when it's opened.                                                           *
+*  Writes go to the first area of the view. Content of an area is kept in its  *
+*  own directory under an upper directory, one backing file per storage named  *
+*  after its identifier. Storage of lower areas and BASE is copied into the    *
+*  first area the first time it's opened for writing, removals leave a         *
+*  whiteout in it. Files larger than an extent of 1 MiB are copied an extent   *
+*  at a time, as they're written, and the area holds them by extents; reads    *
+*  of extents it doesn't hold go to the areas below. The rest of such a file   *
+*  is copied in background while it's open, writes only wait for the extents   *
+*  they reach.                                                                 *
+*  Content is cloned where the filesystems share it, and otherwise copied by   *
+*  the kernel with copy_file_range, or spliced through a pipe, the first that  *
+*  works for a pair of filesystems is used for it from then on.                *
+*  Where both the kernel and libfuse support it, reads and writes of an open   *
+*  file are passed through to its backing file by the kernel itself, and only  *
+*  reach the daemon otherwise. Files that aren't passed through have their     *
+*  writes cached by the kernel and sent in large requests.                     *
+*  The kernel caches entries and attributes for long, and the session follows  *
+*  the change feed of ufs to invalidate what it holds once it's changed        *
+*  through ufsFuseUpdate, or the view is switched with ufsFuseSetView.         *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#ifndef UFS_FUSE_H
+#define UFS_FUSE_H
+
+#include "ufs_core.h"
+
+typedef void *ufsFuseType;
+
+/* Content of open files is always served by the daemon.                      */
+#define UFS_FUSE_FLAG_NO_PASSTHROUGH (1U << 0)
+/* Writes reach the daemon as they're made, instead of being cached.          */
+#define UFS_FUSE_FLAG_NO_WRITEBACK_CACHE (1U << 1)
+/* Large files are only copied up by the extents that are written to.         */
+#define UFS_FUSE_FLAG_NO_BACKGROUND_COPY (1U << 2)
+#define UFS_FUSE_FLAGS \
+    (UFS_FUSE_FLAG_NO_PASSTHROUGH | UFS_FUSE_FLAG_NO_WRITEBACK_CACHE | \
+     UFS_FUSE_FLAG_NO_BACKGROUND_COPY)
+
+/* Ways content is copied up, in the order they're tried.                     */
+#define UFS_FUSE_COPY_CLONE (0)
+#define UFS_FUSE_COPY_RANGE (1)
+#define UFS_FUSE_COPY_SPLICE (2)
+#define UFS_FUSE_COPY_READ_WRITE (3)
+#define UFS_FUSE_COPIES (4)
+
+typedef ufsStatusType (*ufsFuseUpdateFunction)( ufsType ufs, void *userData );
+
+typedef struct ufsFuseOptionsStruct {
+    int baseFd;                     /* Directory of the external fs.          */
+    int upperFd;                    /* Where areas keep their content.        */
+    ufsViewSpanType view;           /* Must end with BASE, and have an area   */
+                                    /* before it.                             */
+    uint32_t threads;               /* Workers serving requests, 1 serves     */
+                                    /* them on the calling thread alone, 0    */
+                                    /* picks one per CPU.                     */
+    uint32_t maxIdleThreads;        /* Workers kept once idle, 0 for threads. */
+    uint32_t flags;                 /* UFS_FUSE_FLAG_* values.                */
+} ufsFuseOptionsType;
+
+typedef struct ufsFuseCopyStatsStruct {
+    uint64_t copies;                /* Ranges copied up this way, holes of    */
+                                    /* the source are left out.               */
+    uint64_t bytes;                 /* Their total size.                      */
+    uint64_t nanoseconds;           /* Time spent copying them.               */
+} ufsFuseCopyStatsType;
+
+typedef struct ufsFuseStatsStruct {
+    uint64_t lookups;               /* Entries the kernel didn't have cached. */
+    uint64_t getattrs;              /* Attributes it didn't have cached.      */
+    uint64_t invalidations;         /* Entries and inodes it was told to      */
+                                    /* drop.                                  */
+    uint64_t passthroughs;          /* Files opened with their content passed */
+                                    /* through to the backing file.           */
+    uint64_t writes;                /* Write requests that reached it.        */
+    uint64_t extents;               /* Extents of large files copied up as    */
+                                    /* they were written, or in background.   */
+    ufsFuseCopyStatsType copies[ UFS_FUSE_COPIES ];
+                                    /* By UFS_FUSE_COPY_* value.              */
+} ufsFuseStatsType;
+
+/******************************************************************************\
+* ufsFuseInit                                                                  *
+*                                                                              *
+*  Creates a FUSE session that serves the view, without mounting it.           *
+*  The directory of every area in the view is created under upperFd if it      *
+*  doesn't exist yet.                                                          *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments, including a reader.    *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including FUSE options  *
+*                       that aren't valid.                                     *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL. Only the session may use it until *
+*        it's destroyed, others change it through ufsFuseUpdate. The session   *
+*        reads it through readers of its own, see ufsInitReader.               *
+*  -options: The options of the session, must not be NULL. The fds must stay   *
+*            open as long as the session, the view is copied.                  *
+*  -argc: The number of FUSE arguments.                                        *
+*  -argv: FUSE arguments, argv[ 0 ] being the program name. Can be NULL if     *
+*         argc is 0.                                                           *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsFuseType: a new session, NULL on failure, check ufsErrno.               *
+*                                                                              *
+\******************************************************************************/
+ufsFuseType ufsFuseInit( ufsType ufs,
+                         const ufsFuseOptionsType *options,
+                         int argc,
+                         char **argv );
+
+/******************************************************************************\
+* ufsFuseDestroy                                                               *
+*                                                                              *
+*  Unmounts the session if it's mounted and destroys it. ufs itself is left as *
+*  is.                                                                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: The session, can be NULL, in which case this is a no-op.             *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsFuseDestroy( ufsFuseType fuse );
+
+/******************************************************************************\
+* ufsFuseMount                                                                 *
+*                                                                              *
+*  Mounts the session on a directory.                                          *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including not being     *
+*                       permitted to mount.                                    *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: The session, must not be NULL.                                       *
+*  -mountpoint: The directory to mount on, must not be NULL.                   *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsFuseMount( ufsFuseType fuse,
+                            const char *mountpoint );
+
+/******************************************************************************\
+* ufsFuseLoop                                                                  *
+*                                                                              *
+*  Serves requests until the session is unmounted, or a signal asks the        *
+*  process to stop.                                                            *
+*  Unless threads is 1, requests are served by a pool of workers that each     *
+*  read from a clone of the FUSE fd. Workers are started as requests arrive,   *
+*  the libfuse in use has no cap on how many are busy at once, threads and     *
+*  maxIdleThreads bound how many stay around once the load is gone.            *
+*  Lookups, attributes and listings read ufs in parallel, each worker through  *
+*  a reader of its own, while requests that change ufs are serialized and      *
+*  wait for them. Reads and writes of file content run in parallel.            *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: A mounted session, must not be NULL.                                 *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsFuseLoop( ufsFuseType fuse );
+
+/******************************************************************************\
+* ufsFuseUpdate                                                                *
+*                                                                              *
+*  Calls update with ufs while no request is being served, and then tells the  *
+*  kernel to drop what it cached of the storage that update changed. Only      *
+*  entries and inodes the kernel holds are invalidated, and only after update  *
+*  returned and requests can be served again. Can be called from any thread,   *
+*  including while ufsFuseLoop runs, but not from update itself.               *
+*  With the writeback cache, the kernel keeps the size of a file it holds      *
+*  whatever it's told, so changed files are dropped instead, once they're no   *
+*  longer open.                                                                *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*   -Any error returned by update.                                             *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: The session, must not be NULL.                                       *
+*  -update: Changes ufs, must not be NULL. It must not use the session.        *
+*  -userData: Passed to update.                                                *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsFuseUpdate( ufsFuseType fuse,
+                             ufsFuseUpdateFunction update,
+                             void *userData );
+
+/******************************************************************************\
+* ufsFuseSetView                                                               *
+*                                                                              *
+*  Switches the session to another view, with the same rules as the view of    *
+*  ufsFuseInit. Storage the kernel holds that resolves to another area in the  *
+*  new view is invalidated, along with its entry. Files that are open keep     *
+*  the content they were opened with.                                          *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: The session, must not be NULL.                                       *
+*  -view: The new view, it's copied.                                           *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsFuseSetView( ufsFuseType fuse, ufsViewSpanType view );
+
+/******************************************************************************\
+* ufsFuseGetStats                                                              *
+*                                                                              *
+*  Returns the counters of a session. Requests the kernel answers from its     *
+*  cache never reach the session, so comparing them with what the clients of   *
+*  the mount did gives how often the cache was hit.                            *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -fuse: The session, must not be NULL.                                       *
+*  -stats: Filled with the counters, must not be NULL.                         *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsFuseGetStats( ufsFuseType fuse, ufsFuseStatsType *stats );
+
+#endif /* UFS_FUSE_H */
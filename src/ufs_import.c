@@ -0,0 +1,543 @@
+/******************************************************************************\
+*  ufs_import.c                                                                *
+*                                                                              *
+*  Parallel walker of external trees, see ufs_import.h.                        *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "ufs_import.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define UFS_IMPORT_DENTS_SIZE (64 * 1024)
+
+struct ufsLinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+typedef struct ufsImportWorkStruct {
+    char *path;
+    ufsIdentifierType id;
+    int merge;
+} ufsImportWorkType;
+
+typedef struct ufsImportWorkerStruct {
+    struct ufsImportWalkStruct *walk;
+    pthread_t thread;
+    ufsImportWorkType **items;      /* Owner pops the tail, thieves the head. */
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} ufsImportWorkerType;
+
+typedef struct ufsImportWalkStruct {
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t resultsReady;
+    ufsImportWorkerType *workers;
+    uint32_t numWorkers;
+    uint32_t nextWorker;
+    uint64_t pending;               /* Queued directories and chunks.         */
+    uint32_t busy;                  /* Directories being read right now.      */
+    int stop;
+    ufsStatusType status;
+    ufsImportChunkType *results;
+    ufsImportChunkType *resultsTail;
+    int rootFd;
+    uint64_t flags;
+} ufsImportWalkType;
+
+static inline ufsImportWorkType *takeWork( ufsImportWalkType *walk,
+                                           ufsImportWorkerType *worker );
+static inline int pushWork( ufsImportWorkerType *worker,
+                            ufsImportWorkType *work );
+static inline void failWalk( ufsImportWalkType *walk, ufsStatusType status );
+static inline int submitChunk( ufsImportWalkType *walk,
+                               ufsImportChunkType *chunk );
+static inline ufsImportChunkType *newChunk( ufsImportWorkType *work );
+static inline ufsStatusType skipStatus( int error );
+static inline ufsStatusType readDirectory( ufsImportWalkType *walk,
+                                           ufsImportWorkType *work );
+static inline ufsStatusType queueDirectory( ufsImportWalkType *walk,
+                                            ufsImportChunkType *chunk,
+                                            ufsImportEntryType *entry,
+                                            const ufsImportOptionsType *options );
+static void *walkWorker( void *arg );
+
+
+ufsImportWorkType *takeWork( ufsImportWalkType *walk,
+                             ufsImportWorkerType *worker )
+{
+    ufsImportWorkerType *victim;
+    uint32_t i;
+
+    /* Newest work of our own first, it's the most likely to be cached.       */
+    if ( worker -> tail > worker -> head )
+        return worker -> items[ --worker -> tail ];
+
+    /* Otherwise steal the oldest work of someone else, it tends to be the    */
+    /* root of the largest untouched subtree.                                 */
+    for ( i = 0; i < walk -> numWorkers; i++ ) {
+        victim = &walk -> workers[ i ];
+        if ( victim -> tail > victim -> head )
+            return victim -> items[ victim -> head++ ];
+    }
+
+    return NULL;
+}
+
+int pushWork( ufsImportWorkerType *worker, ufsImportWorkType *work )
+{
+    ufsImportWorkType **items;
+    size_t capacity;
+
+    if ( worker -> head == worker -> tail )
+        worker -> head = worker -> tail = 0;
+
+    if ( worker -> tail == worker -> capacity ) {
+        if ( worker -> head > 0 ) {
+            memmove( worker -> items,
+                     worker -> items + worker -> head,
+                     ( worker -> tail - worker -> head ) * sizeof( *items ) );
+            worker -> tail -= worker -> head;
+            worker -> head = 0;
+        } else {
+            capacity = worker -> capacity ? worker -> capacity * 2 : 64;
+            items = realloc( worker -> items, capacity * sizeof( *items ) );
+            if ( !items )
+                return -1;
+
+            worker -> items = items;
+            worker -> capacity = capacity;
+        }
+    }
+
+    worker -> items[ worker -> tail++ ] = work;
+    return 0;
+}
+
+void failWalk( ufsImportWalkType *walk, ufsStatusType status )
+{
+    /* Called with the lock held, the first error wins.                       */
+    if ( walk -> status == UFS_NO_ERROR )
+        walk -> status = status;
+
+    walk -> stop = 1;
+    pthread_cond_broadcast( &walk -> workReady );
+    pthread_cond_signal( &walk -> resultsReady );
+}
+
+int submitChunk( ufsImportWalkType *walk, ufsImportChunkType *chunk )
+{
+    int stop;
+
+    pthread_mutex_lock( &walk -> lock );
+    stop = walk -> stop;
+    if ( !stop ) {
+        if ( walk -> resultsTail )
+            walk -> resultsTail -> next = chunk;
+        else
+            walk -> results = chunk;
+        walk -> resultsTail = chunk;
+        walk -> pending++;
+        pthread_cond_signal( &walk -> resultsReady );
+    }
+    pthread_mutex_unlock( &walk -> lock );
+
+    if ( stop ) {
+        free( chunk -> path );
+        free( chunk );
+    }
+
+    return stop;
+}
+
+ufsImportChunkType *newChunk( ufsImportWorkType *work )
+{
+    ufsImportChunkType *chunk;
+
+    chunk = malloc( sizeof( *chunk ) );
+    if ( !chunk )
+        return NULL;
+
+    chunk -> path = strdup( work -> path );
+    if ( !chunk -> path ) {
+        free( chunk );
+        return NULL;
+    }
+
+    chunk -> next = NULL;
+    chunk -> parent = work -> id;
+    chunk -> merge = work -> merge;
+    chunk -> count = 0;
+    chunk -> namesUsed = 0;
+    return chunk;
+}
+
+/* Entries that vanished, were replaced, or can't be read are skipped, only   */
+/* running out of memory or fds stops the walk.                               */
+ufsStatusType skipStatus( int error )
+{
+    switch ( error ) {
+        case ENOMEM:
+            return UFS_OUT_OF_MEMORY;
+        case EMFILE:
+        case ENFILE:
+            return UFS_UNKNOWN_ERROR;
+        default:
+            return UFS_NO_ERROR;
+    }
+}
+
+ufsStatusType readDirectory( ufsImportWalkType *walk,
+                             ufsImportWorkType *work )
+{
+    char dents[ UFS_IMPORT_DENTS_SIZE ];
+    struct ufsLinuxDirent64 *dent;
+    ufsImportChunkType *chunk;
+    ufsImportEntryType *entry;
+    ufsStatusType status;
+    struct statx stx;
+    long res, offset;
+    size_t nameLength;
+    int fd, needStat;
+
+    fd = openat( walk -> rootFd, work -> path,
+                 O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    /* A directory that vanished since it was listed, or that can't be read,  */
+    /* is imported without its entries.                                       */
+    if ( fd < 0 )
+        return skipStatus( errno );
+
+    chunk = newChunk( work );
+    if ( !chunk ) {
+        close( fd );
+        return UFS_OUT_OF_MEMORY;
+    }
+
+    while ( ( res = syscall( SYS_getdents64, fd,
+                             dents, sizeof( dents ) ) ) > 0 ) {
+        for ( offset = 0; offset < res; offset += dent -> d_reclen ) {
+            dent = ( struct ufsLinuxDirent64 * )( dents + offset );
+            if ( !strcmp( dent -> d_name, "." ) ||
+                 !strcmp( dent -> d_name, ".." ) )
+                continue;
+
+            nameLength = strlen( dent -> d_name ) + 1;
+            if ( chunk -> count == UFS_IMPORT_CHUNK_ENTRIES ||
+                 chunk -> namesUsed + nameLength > UFS_IMPORT_CHUNK_NAMES ) {
+                if ( submitChunk( walk, chunk ) ) {
+                    close( fd );
+                    return UFS_NO_ERROR;
+                }
+
+                chunk = newChunk( work );
+                if ( !chunk ) {
+                    close( fd );
+                    return UFS_OUT_OF_MEMORY;
+                }
+            }
+
+            entry = &chunk -> entries[ chunk -> count ];
+            entry -> type = dent -> d_type == DT_DIR ?
+                            UFS_STORAGE_TYPE_DIRECTORY : UFS_STORAGE_TYPE_FILE;
+            entry -> hasAttributes = 0;
+            entry -> merged = 0;
+            entry -> id = -1;
+
+            /* Some filesystems don't report types while listing.             */
+            needStat = ( walk -> flags & UFS_IMPORT_FLAG_ATTRIBUTES ) ||
+                       dent -> d_type == DT_UNKNOWN;
+            if ( needStat ) {
+                if ( statx( fd, dent -> d_name,
+                            AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                            STATX_BASIC_STATS, &stx ) ) {
+                    status = skipStatus( errno );
+                    if ( status == UFS_NO_ERROR )
+                        continue;
+
+                    free( chunk -> path );
+                    free( chunk );
+                    close( fd );
+                    return status;
+                }
+
+                entry -> type = S_ISDIR( stx.stx_mode ) ?
+                                UFS_STORAGE_TYPE_DIRECTORY :
+                                UFS_STORAGE_TYPE_FILE;
+            }
+
+            if ( walk -> flags & UFS_IMPORT_FLAG_ATTRIBUTES ) {
+                entry -> hasAttributes = 1;
+                entry -> attributes.mode = stx.stx_mode;
+                entry -> attributes.size = stx.stx_size;
+                entry -> attributes.mtime =
+                    stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+                entry -> attributes.ctime =
+                    stx.stx_ctime.tv_sec * 1000000000LL + stx.stx_ctime.tv_nsec;
+                entry -> attributes.nlink = stx.stx_nlink;
+                entry -> attributes.uid = stx.stx_uid;
+                entry -> attributes.gid = stx.stx_gid;
+                entry -> attributes.generation = 0;
+            }
+
+            entry -> nameOffset = chunk -> namesUsed;
+            memcpy( chunk -> names + chunk -> namesUsed,
+                    dent -> d_name, nameLength );
+            chunk -> namesUsed += nameLength;
+            chunk -> count++;
+        }
+    }
+
+    close( fd );
+    if ( res < 0 ) {
+        free( chunk -> path );
+        free( chunk );
+        return UFS_UNKNOWN_ERROR;
+    }
+
+    if ( chunk -> count == 0 ) {
+        free( chunk -> path );
+        free( chunk );
+        return UFS_NO_ERROR;
+    }
+
+    submitChunk( walk, chunk );
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType queueDirectory( ufsImportWalkType *walk,
+                              ufsImportChunkType *chunk,
+                              ufsImportEntryType *entry,
+                              const ufsImportOptionsType *options )
+{
+    ufsImportWorkType *work;
+    ufsStatusType status;
+    const char *name;
+    int res;
+
+    name = chunk -> names + entry -> nameOffset;
+    work = malloc( sizeof( *work ) );
+    if ( !work )
+        return UFS_OUT_OF_MEMORY;
+
+    work -> path = malloc( strlen( chunk -> path ) + strlen( name ) + 2 );
+    if ( !work -> path ) {
+        free( work );
+        return UFS_OUT_OF_MEMORY;
+    }
+
+    if ( !strcmp( chunk -> path, "." ) )
+        strcpy( work -> path, name );
+    else
+        sprintf( work -> path, "%s/%s", chunk -> path, name );
+    work -> id = entry -> id;
+    work -> merge = entry -> merged;
+
+    /* The directory is visited before anyone gets to list it.                */
+    if ( options -> visit ) {
+        status = options -> visit( work -> id, chunk -> parent, work -> path,
+                                   options -> userData );
+        if ( status != UFS_NO_ERROR ) {
+            free( work -> path );
+            free( work );
+            return status;
+        }
+    }
+
+    pthread_mutex_lock( &walk -> lock );
+    res = pushWork( &walk -> workers[ walk -> nextWorker ], work );
+    if ( !res ) {
+        walk -> pending++;
+        walk -> nextWorker = ( walk -> nextWorker + 1 ) % walk -> numWorkers;
+        pthread_cond_signal( &walk -> workReady );
+    }
+    pthread_mutex_unlock( &walk -> lock );
+
+    if ( res ) {
+        free( work -> path );
+        free( work );
+        return UFS_OUT_OF_MEMORY;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+void *walkWorker( void *arg )
+{
+    ufsImportWorkerType *worker;
+    ufsImportWalkType *walk;
+    ufsImportWorkType *work;
+    ufsStatusType status;
+
+    worker = arg;
+    walk = worker -> walk;
+    pthread_mutex_lock( &walk -> lock );
+    for ( ;; ) {
+        work = NULL;
+        while ( !walk -> stop && !( work = takeWork( walk, worker ) ) )
+            pthread_cond_wait( &walk -> workReady, &walk -> lock );
+
+        if ( !work )
+            break;
+
+        walk -> busy++;
+        pthread_mutex_unlock( &walk -> lock );
+
+        status = readDirectory( walk, work );
+        free( work -> path );
+        free( work );
+
+        pthread_mutex_lock( &walk -> lock );
+        walk -> busy--;
+        walk -> pending--;
+        if ( status != UFS_NO_ERROR )
+            failWalk( walk, status );
+        pthread_cond_signal( &walk -> resultsReady );
+    }
+    pthread_mutex_unlock( &walk -> lock );
+    return NULL;
+}
+
+ufsStatusType ufsImportWalk( int rootFd,
+                             const ufsImportOptionsType *options,
+                             uint32_t threads,
+                             ufsImportSink sink,
+                             void *sinkData )
+{
+    ufsImportWalkType walk = { 0 };
+    ufsImportChunkType *chunk;
+    ufsImportEntryType *entry;
+    ufsImportWorkType *work;
+    uint64_t directories, files;
+    ufsStatusType status;
+    uint32_t started;
+    size_t i;
+
+    walk.workers = calloc( threads, sizeof( *walk.workers ) );
+    if ( !walk.workers )
+        return UFS_OUT_OF_MEMORY;
+
+    pthread_mutex_init( &walk.lock, NULL );
+    pthread_cond_init( &walk.workReady, NULL );
+    pthread_cond_init( &walk.resultsReady, NULL );
+    walk.numWorkers = threads;
+    walk.status = UFS_NO_ERROR;
+    walk.rootFd = rootFd;
+    walk.flags = options -> flags;
+    directories = files = 0;
+
+    work = malloc( sizeof( *work ) );
+    if ( work )
+        work -> path = strdup( "." );
+
+    if ( !work || !work -> path || pushWork( &walk.workers[ 0 ], work ) ) {
+        if ( work )
+            free( work -> path );
+        free( work );
+        walk.status = UFS_OUT_OF_MEMORY;
+        walk.stop = 1;
+    } else {
+        work -> id = options -> directory;
+        work -> merge = 1;
+        walk.pending = 1;
+    }
+
+    for ( started = 0; started < threads && !walk.stop; started++ ) {
+        walk.workers[ started ].walk = &walk;
+        if ( pthread_create( &walk.workers[ started ].thread, NULL,
+                             walkWorker, &walk.workers[ started ] ) )
+            break;
+    }
+
+    /* Only hand work to the workers that actually started.                   */
+    pthread_mutex_lock( &walk.lock );
+    walk.numWorkers = started;
+    if ( started == 0 )
+        failWalk( &walk, UFS_UNKNOWN_ERROR );
+
+    for ( ;; ) {
+        /* Once stopped, only wait for the directories being read to finish.  */
+        while ( !walk.results &&
+                ( walk.stop ? walk.busy > 0 : walk.pending > 0 ) )
+            pthread_cond_wait( &walk.resultsReady, &walk.lock );
+
+        chunk = walk.results;
+        if ( !chunk )
+            break;
+
+        walk.results = chunk -> next;
+        if ( !walk.results )
+            walk.resultsTail = NULL;
+
+        if ( walk.stop ) {
+            walk.pending--;
+            free( chunk -> path );
+            free( chunk );
+            continue;
+        }
+        pthread_mutex_unlock( &walk.lock );
+
+        /* Queue the directories that were just added, spread over workers.   */
+        status = sink( chunk, sinkData );
+        for ( i = 0; i < chunk -> count && status == UFS_NO_ERROR; i++ ) {
+            entry = &chunk -> entries[ i ];
+            if ( entry -> type != UFS_STORAGE_TYPE_DIRECTORY ) {
+                files++;
+                continue;
+            }
+
+            directories++;
+            status = queueDirectory( &walk, chunk, entry, options );
+        }
+
+        free( chunk -> path );
+        free( chunk );
+        if ( options -> progress && status == UFS_NO_ERROR )
+            options -> progress( directories, files, options -> userData );
+
+        pthread_mutex_lock( &walk.lock );
+        walk.pending--;
+        if ( status != UFS_NO_ERROR )
+            failWalk( &walk, status );
+    }
+
+    walk.stop = 1;
+    pthread_cond_broadcast( &walk.workReady );
+    pthread_mutex_unlock( &walk.lock );
+
+    while ( started > 0 )
+        pthread_join( walk.workers[ --started ].thread, NULL );
+
+    /* Drop anything still queued after a failure.                            */
+    for ( i = 0; i < threads; i++ ) {
+        while ( walk.workers[ i ].tail > walk.workers[ i ].head ) {
+            work = walk.workers[ i ].items[ --walk.workers[ i ].tail ];
+            free( work -> path );
+            free( work );
+        }
+        free( walk.workers[ i ].items );
+    }
+
+    free( walk.workers );
+    pthread_cond_destroy( &walk.resultsReady );
+    pthread_cond_destroy( &walk.workReady );
+    pthread_mutex_destroy( &walk.lock );
+    return walk.status;
+}
@@ -0,0 +1,78 @@
+/******************************************************************************\
+*  ufs_import.h                                                                *
+*                                                                              *
+*  Parallel walker of external trees, used to import BASE into ufs.            *
+*  The walker only reads the external fs, entries are handed in chunks to a    *
+*  sink that adds them to ufs and assigns their identifiers.                   *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#ifndef UFS_IMPORT_H
+#define UFS_IMPORT_H
+
+#include "ufs_core.h"
+#include <stddef.h>
+
+#define UFS_IMPORT_CHUNK_ENTRIES (1024)
+#define UFS_IMPORT_CHUNK_NAMES (64 * 1024)
+
+typedef struct ufsImportEntryStruct {
+    uint32_t nameOffset;            /* Offset of the name in chunk names.     */
+    int type;
+    int hasAttributes;
+    int merged;                     /* Set by the sink if the entry existed.  */
+    ufsIdentifierType id;           /* Set by the sink.                       */
+    ufsAttributesType attributes;
+} ufsImportEntryType;
+
+typedef struct ufsImportChunkStruct {
+    struct ufsImportChunkStruct *next;
+    char *path;                     /* Directory path relative to the root.   */
+    ufsIdentifierType parent;
+    int merge;                      /* Entries may already exist in parent.   */
+    size_t count;
+    size_t namesUsed;
+    ufsImportEntryType entries[ UFS_IMPORT_CHUNK_ENTRIES ];
+    char names[ UFS_IMPORT_CHUNK_NAMES ];
+} ufsImportChunkType;
+
+typedef ufsStatusType (*ufsImportSink)( ufsImportChunkType *chunk,
+                                        void *sinkData );
+
+/******************************************************************************\
+* ufsImportWalk                                                                *
+*                                                                              *
+*  Walks the tree under rootFd with a pool of threads. Every directory is ow-  *
+*  ned by one thread at a time, idle threads steal queued directories from     *
+*  busy ones. Chunks of entries are passed to the sink on the calling thread,  *
+*  in no particular order other than a directory's chunk coming before the     *
+*  chunks of its entries. The callbacks in options are called on the calling   *
+*  thread as well.                                                             *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including I/O errors.   *
+*   -Any error returned by the sink or the visit callback, it stops the walk.  *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -rootFd: A directory fd of the tree to walk.                                *
+*  -options: The import options, must not be NULL.                             *
+*  -threads: The number of threads to walk with, must be greater than 0.       *
+*  -sink: Called for every chunk of entries, must not be NULL.                 *
+*  -sinkData: Passed to the sink, can be NULL.                                 *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of the walk.                                     *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsImportWalk( int rootFd,
+                             const ufsImportOptionsType *options,
+                             uint32_t threads,
+                             ufsImportSink sink,
+                             void *sinkData );
+
+#endif /* UFS_IMPORT_H */
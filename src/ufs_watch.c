@@ -0,0 +1,876 @@
+/******************************************************************************\
+*  ufs_watch.c                                                                 *
+*                                                                              *
+*  Keeps storage imported from BASE in sync with the external fs, see          *
+*  ufs_watch.h.                                                                *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#define _GNU_SOURCE
+
+#include "ufs_watch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define UFS_WATCH_BUFFER_SIZE (64 * 1024)
+#define UFS_WATCH_INITIAL_BUCKETS (1024)
+#define UFS_WATCH_NO_KEY (UINT64_MAX)
+
+enum ufsWatchEventKind {
+    UFS_WATCH_EVENT_CREATED,
+    UFS_WATCH_EVENT_REMOVED,
+    UFS_WATCH_EVENT_CHANGED,
+};
+
+typedef struct ufsWatchDirStruct {
+    ufsIdentifierType id;
+    uint64_t key;                   /* The wd, or a hash of the file handle.  */
+    char *path;                     /* Relative to the root fd.               */
+    int64_t mtime;                  /* Times when last seen, in nanoseconds.  */
+    int64_t ctime;
+    uint64_t epoch;                 /* Last ufsWatchProcess with events here. */
+    int wd;
+    struct file_handle *handle;
+    struct ufsWatchDirStruct *parent;
+    struct ufsWatchDirStruct *children;
+    struct ufsWatchDirStruct *prev;
+    struct ufsWatchDirStruct *next;
+    struct ufsWatchDirStruct *nextById;
+    struct ufsWatchDirStruct *nextByKey;
+} ufsWatchDirType;
+
+typedef struct ufsWatchStruct {
+    ufsType ufs;
+    int rootFd;
+    int fd;
+    uint64_t mask;
+    ufsImportOptionsType options;
+    const char *importPrefix;       /* Path of the directory being imported.  */
+    uint64_t epoch;                 /* Calls to ufsWatchProcess.              */
+    ufsWatchDirType *root;
+    ufsWatchDirType **byId;
+    ufsWatchDirType **byKey;
+    size_t buckets;
+    ufsWatchStatsType stats;
+} ufsWatchStruct;
+
+static inline uint64_t mixKey( uint64_t key );
+static inline uint64_t handleKey( const struct file_handle *handle );
+static inline ufsWatchDirType *findById( ufsWatchStruct *watch,
+                                         ufsIdentifierType id );
+static inline ufsWatchDirType *findByKey( ufsWatchStruct *watch,
+                                          uint64_t key,
+                                          const struct file_handle *handle );
+static inline void linkNode( ufsWatchStruct *watch, ufsWatchDirType *node );
+static inline void unlinkKey( ufsWatchStruct *watch, ufsWatchDirType *node );
+static inline void unlinkId( ufsWatchStruct *watch, ufsWatchDirType *node );
+static inline int growTables( ufsWatchStruct *watch );
+static inline char *joinPath( const char *path, const char *name );
+static inline void statToAttributes( const struct stat *st,
+                                     ufsAttributesType *attributes );
+static inline int addKernelWatch( ufsWatchStruct *watch,
+                                  ufsWatchDirType *node );
+static inline void removeKernelWatch( ufsWatchStruct *watch,
+                                      ufsWatchDirType *node );
+static inline ufsStatusType registerDirectory( ufsWatchStruct *watch,
+                                               ufsIdentifierType id,
+                                               ufsWatchDirType *parent,
+                                               const char *path );
+static inline void unregisterTree( ufsWatchStruct *watch,
+                                   ufsWatchDirType *node );
+static ufsStatusType watchVisit( ufsIdentifierType directory,
+                                 ufsIdentifierType parent,
+                                 const char *path,
+                                 void *userData );
+static void watchProgress( uint64_t directories,
+                           uint64_t files,
+                           void *userData );
+static inline ufsStatusType importInto( ufsWatchStruct *watch,
+                                        ufsWatchDirType *node );
+static inline ufsStatusType applyEvent( ufsWatchStruct *watch,
+                                        ufsWatchDirType *node,
+                                        const char *name,
+                                        enum ufsWatchEventKind kind,
+                                        int isDirectory );
+static ufsStatusType rescanChanged( ufsWatchStruct *watch,
+                                    ufsWatchDirType *node );
+static inline ufsStatusType processInotify( ufsWatchStruct *watch,
+                                            int *overflow );
+static inline ufsStatusType processFanotify( ufsWatchStruct *watch,
+                                             int *overflow );
+
+
+uint64_t mixKey( uint64_t key )
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+uint64_t handleKey( const struct file_handle *handle )
+{
+    uint64_t key;
+    unsigned int i;
+
+    /* FNV-1a over the type and the bytes of the handle.                      */
+    key = 0xcbf29ce484222325ULL ^ ( uint32_t )handle -> handle_type;
+    for ( i = 0; i < handle -> handle_bytes; i++ ) {
+        key ^= handle -> f_handle[ i ];
+        key *= 0x100000001b3ULL;
+    }
+
+    return key == UFS_WATCH_NO_KEY ? 0 : key;
+}
+
+ufsWatchDirType *findById( ufsWatchStruct *watch, ufsIdentifierType id )
+{
+    ufsWatchDirType *node;
+
+    node = watch -> byId[ mixKey( id ) & ( watch -> buckets - 1 ) ];
+    while ( node && node -> id != id )
+        node = node -> nextById;
+
+    return node;
+}
+
+ufsWatchDirType *findByKey( ufsWatchStruct *watch,
+                            uint64_t key,
+                            const struct file_handle *handle )
+{
+    ufsWatchDirType *node;
+
+    node = watch -> byKey[ mixKey( key ) & ( watch -> buckets - 1 ) ];
+    for ( ; node; node = node -> nextByKey ) {
+        if ( node -> key != key )
+            continue;
+
+        if ( !handle )
+            return node;
+
+        if ( node -> handle -> handle_type == handle -> handle_type &&
+             node -> handle -> handle_bytes == handle -> handle_bytes &&
+             !memcmp( node -> handle -> f_handle, handle -> f_handle,
+                      handle -> handle_bytes ) )
+            return node;
+    }
+
+    return NULL;
+}
+
+void linkNode( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    ufsWatchDirType **bucket;
+
+    bucket = &watch -> byId[ mixKey( node -> id ) & ( watch -> buckets - 1 ) ];
+    node -> nextById = *bucket;
+    *bucket = node;
+
+    if ( node -> key == UFS_WATCH_NO_KEY )
+        return;
+
+    bucket = &watch -> byKey[ mixKey( node -> key ) &
+                              ( watch -> buckets - 1 ) ];
+    node -> nextByKey = *bucket;
+    *bucket = node;
+}
+
+void unlinkKey( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    ufsWatchDirType **link;
+
+    if ( node -> key == UFS_WATCH_NO_KEY )
+        return;
+
+    link = &watch -> byKey[ mixKey( node -> key ) & ( watch -> buckets - 1 ) ];
+    while ( *link != node )
+        link = &( *link ) -> nextByKey;
+
+    *link = node -> nextByKey;
+    node -> key = UFS_WATCH_NO_KEY;
+}
+
+void unlinkId( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    ufsWatchDirType **link;
+
+    link = &watch -> byId[ mixKey( node -> id ) & ( watch -> buckets - 1 ) ];
+    while ( *link != node )
+        link = &( *link ) -> nextById;
+
+    *link = node -> nextById;
+}
+
+int growTables( ufsWatchStruct *watch )
+{
+    ufsWatchDirType **byId, **byKey, **oldById, *node, *next;
+    size_t i, oldBuckets;
+
+    byId = calloc( watch -> buckets * 2, sizeof( *byId ) );
+    byKey = calloc( watch -> buckets * 2, sizeof( *byKey ) );
+    if ( !byId || !byKey ) {
+        free( byId );
+        free( byKey );
+        return -1;
+    }
+
+    /* Every node is in byId, so it's enough to walk it to rehash them all.   */
+    oldById = watch -> byId;
+    oldBuckets = watch -> buckets;
+    free( watch -> byKey );
+    watch -> byId = byId;
+    watch -> byKey = byKey;
+    watch -> buckets *= 2;
+    for ( i = 0; i < oldBuckets; i++ ) {
+        for ( node = oldById[ i ]; node; node = next ) {
+            next = node -> nextById;
+            linkNode( watch, node );
+        }
+    }
+
+    free( oldById );
+    return 0;
+}
+
+char *joinPath( const char *path, const char *name )
+{
+    char *joined;
+
+    if ( !strcmp( path, "." ) )
+        return strdup( name );
+
+    if ( !strcmp( name, "." ) )
+        return strdup( path );
+
+    joined = malloc( strlen( path ) + strlen( name ) + 2 );
+    if ( joined )
+        sprintf( joined, "%s/%s", path, name );
+
+    return joined;
+}
+
+void statToAttributes( const struct stat *st, ufsAttributesType *attributes )
+{
+    attributes -> mode = st -> st_mode;
+    attributes -> size = st -> st_size;
+    attributes -> mtime = st -> st_mtim.tv_sec * 1000000000LL +
+                          st -> st_mtim.tv_nsec;
+    attributes -> ctime = st -> st_ctim.tv_sec * 1000000000LL +
+                          st -> st_ctim.tv_nsec;
+    attributes -> nlink = st -> st_nlink;
+    attributes -> uid = st -> st_uid;
+    attributes -> gid = st -> st_gid;
+    attributes -> generation = 0;
+}
+
+int addKernelWatch( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    char procPath[ PATH_MAX ];
+    int mountId;
+
+    if ( !watch -> stats.fanotify ) {
+        /* inotify only takes paths, reach the root fd through /proc.         */
+        snprintf( procPath, sizeof( procPath ), "/proc/self/fd/%d/%s",
+                  watch -> rootFd, node -> path );
+        node -> wd = inotify_add_watch( watch -> fd, procPath,
+                                        watch -> mask | IN_ONLYDIR |
+                                        IN_DONT_FOLLOW );
+        if ( node -> wd < 0 )
+            return -1;
+
+        node -> key = node -> wd;
+        return 0;
+    }
+
+    node -> handle = malloc( sizeof( *node -> handle ) + MAX_HANDLE_SZ );
+    if ( !node -> handle )
+        return -1;
+
+    node -> handle -> handle_bytes = MAX_HANDLE_SZ;
+    if ( name_to_handle_at( watch -> rootFd, node -> path,
+                            node -> handle, &mountId, 0 ) )
+        return -1;
+
+    if ( fanotify_mark( watch -> fd, FAN_MARK_ADD | FAN_MARK_ONLYDIR,
+                        watch -> mask, watch -> rootFd, node -> path ) )
+        return -1;
+
+    node -> key = handleKey( node -> handle );
+    return 0;
+}
+
+void removeKernelWatch( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    int fd;
+
+    if ( watch -> fd < 0 || node -> key == UFS_WATCH_NO_KEY )
+        return;
+
+    if ( !watch -> stats.fanotify ) {
+        inotify_rm_watch( watch -> fd, node -> wd );
+        return;
+    }
+
+    /* The path may name another directory by now, go through the handle.     */
+    fd = open_by_handle_at( watch -> rootFd, node -> handle, O_PATH );
+    if ( fd < 0 )
+        return;
+
+    fanotify_mark( watch -> fd, FAN_MARK_REMOVE | FAN_MARK_ONLYDIR,
+                   watch -> mask, fd, NULL );
+    close( fd );
+}
+
+ufsStatusType registerDirectory( ufsWatchStruct *watch,
+                                 ufsIdentifierType id,
+                                 ufsWatchDirType *parent,
+                                 const char *path )
+{
+    ufsWatchDirType *node, *old;
+    ufsStatusType status;
+    struct stat st;
+
+    node = findById( watch, id );
+    if ( node )
+        unregisterTree( watch, node );
+
+    if ( fstatat( watch -> rootFd, path, &st, AT_SYMLINK_NOFOLLOW ) )
+        return errno == ENOENT ? UFS_NO_ERROR : UFS_UNKNOWN_ERROR;
+
+    node = calloc( 1, sizeof( *node ) );
+    if ( !node )
+        return UFS_OUT_OF_MEMORY;
+
+    node -> id = id;
+    node -> key = UFS_WATCH_NO_KEY;
+    node -> wd = -1;
+    node -> mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    node -> ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+    node -> path = strdup( path );
+    status = UFS_NO_ERROR;
+    if ( !node -> path )
+        status = UFS_OUT_OF_MEMORY;
+    else if ( addKernelWatch( watch, node ) )
+        /* A directory that's gone by now has nothing to watch.               */
+        status = errno == ENOENT ? UFS_NO_ERROR : UFS_UNKNOWN_ERROR;
+
+    if ( node -> key == UFS_WATCH_NO_KEY ) {
+        free( node -> handle );
+        free( node -> path );
+        free( node );
+        return status;
+    }
+
+    /* The same directory under an older name loses its key to this one.      */
+    old = findByKey( watch, node -> key, node -> handle );
+    if ( old )
+        unlinkKey( watch, old );
+
+    if ( watch -> stats.directories >= watch -> buckets &&
+         growTables( watch ) ) {
+        removeKernelWatch( watch, node );
+        free( node -> handle );
+        free( node -> path );
+        free( node );
+        return UFS_OUT_OF_MEMORY;
+    }
+
+    linkNode( watch, node );
+    node -> parent = parent;
+    if ( parent ) {
+        node -> next = parent -> children;
+        if ( parent -> children )
+            parent -> children -> prev = node;
+        parent -> children = node;
+    }
+
+    watch -> stats.directories++;
+    return UFS_NO_ERROR;
+}
+
+void unregisterTree( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    while ( node -> children )
+        unregisterTree( watch, node -> children );
+
+    if ( node -> prev )
+        node -> prev -> next = node -> next;
+    else if ( node -> parent )
+        node -> parent -> children = node -> next;
+
+    if ( node -> next )
+        node -> next -> prev = node -> prev;
+
+    if ( watch -> root == node )
+        watch -> root = NULL;
+
+    removeKernelWatch( watch, node );
+    unlinkKey( watch, node );
+    unlinkId( watch, node );
+    watch -> stats.directories--;
+    free( node -> handle );
+    free( node -> path );
+    free( node );
+}
+
+ufsStatusType watchVisit( ufsIdentifierType directory,
+                          ufsIdentifierType parent,
+                          const char *path,
+                          void *userData )
+{
+    ufsWatchStruct *watch;
+    ufsWatchDirType *parentNode;
+    ufsStatusType status;
+    char *fullPath;
+
+    watch = userData;
+    parentNode = findById( watch, parent );
+    if ( !parentNode )
+        return UFS_NO_ERROR;
+
+    fullPath = joinPath( watch -> importPrefix, path );
+    if ( !fullPath )
+        return UFS_OUT_OF_MEMORY;
+
+    status = registerDirectory( watch, directory, parentNode, fullPath );
+    free( fullPath );
+    return status;
+}
+
+void watchProgress( uint64_t directories, uint64_t files, void *userData )
+{
+    ufsWatchStruct *watch;
+
+    watch = userData;
+    watch -> options.progress( directories, files, watch -> options.userData );
+}
+
+ufsStatusType importInto( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    ufsImportOptionsType options;
+    ufsStatusType status;
+    int fd;
+
+    fd = openat( watch -> rootFd, node -> path,
+                 O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC );
+    if ( fd < 0 )
+        return errno == ENOENT ? UFS_NO_ERROR : UFS_UNKNOWN_ERROR;
+
+    options = watch -> options;
+    options.directory = node -> id;
+    options.flags |= UFS_IMPORT_FLAG_SYNC;
+    options.progress = watch -> options.progress ? watchProgress : NULL;
+    options.visit = watchVisit;
+    options.userData = watch;
+    watch -> importPrefix = node -> path;
+    status = ufsImportBase( watch -> ufs, fd, &options );
+    watch -> importPrefix = NULL;
+    close( fd );
+    return status;
+}
+
+ufsStatusType applyEvent( ufsWatchStruct *watch,
+                          ufsWatchDirType *node,
+                          const char *name,
+                          enum ufsWatchEventKind kind,
+                          int isDirectory )
+{
+    ufsAttributesType attributes, *attributesPtr;
+    ufsWatchDirType *child;
+    ufsIdentifierType id;
+    ufsStatusType status;
+    struct stat st;
+    char *path;
+    int type;
+
+    path = joinPath( node -> path, name );
+    if ( !path )
+        return UFS_OUT_OF_MEMORY;
+
+    status = UFS_NO_ERROR;
+    attributesPtr = watch -> options.flags & UFS_IMPORT_FLAG_ATTRIBUTES ?
+                    &attributes : NULL;
+    switch ( kind ) {
+    case UFS_WATCH_EVENT_REMOVED:
+        id = isDirectory ? ufsGetDirectory( watch -> ufs, node -> id, name ) :
+                           ufsGetFile( watch -> ufs, node -> id, name );
+        if ( id < 0 )
+            break;
+
+        child = isDirectory ? findById( watch, id ) : NULL;
+        if ( child )
+            unregisterTree( watch, child );
+
+        status = ufsRemoveFromBase( watch -> ufs, id );
+        break;
+
+    case UFS_WATCH_EVENT_CREATED:
+        /* Gone again already, the removal is on its way.                     */
+        if ( fstatat( watch -> rootFd, path, &st, AT_SYMLINK_NOFOLLOW ) )
+            break;
+
+        if ( attributesPtr )
+            statToAttributes( &st, attributesPtr );
+
+        type = S_ISDIR( st.st_mode ) ? UFS_STORAGE_TYPE_DIRECTORY :
+                                       UFS_STORAGE_TYPE_FILE;
+        id = ufsAddToBase( watch -> ufs, node -> id, name, type,
+                           attributesPtr );
+        if ( id < 0 ) {
+            status = ufsErrno;
+            break;
+        }
+
+        if ( type != UFS_STORAGE_TYPE_DIRECTORY )
+            break;
+
+        /* A directory may arrive with contents, through a rename.            */
+        status = registerDirectory( watch, id, node, path );
+        child = findById( watch, id );
+        if ( status == UFS_NO_ERROR && child )
+            status = importInto( watch, child );
+        break;
+
+    case UFS_WATCH_EVENT_CHANGED:
+        if ( !attributesPtr ||
+             fstatat( watch -> rootFd, path, &st, AT_SYMLINK_NOFOLLOW ) )
+            break;
+
+        id = S_ISDIR( st.st_mode ) ?
+             ufsGetDirectory( watch -> ufs, node -> id, name ) :
+             ufsGetFile( watch -> ufs, node -> id, name );
+        if ( id <= 0 )
+            break;
+
+        statToAttributes( &st, attributesPtr );
+        status = ufsSetAttributes( watch -> ufs, id, attributesPtr );
+        break;
+    }
+
+    free( path );
+    if ( status != UFS_NO_ERROR || kind == UFS_WATCH_EVENT_CHANGED )
+        return status;
+
+    /* The directory itself changed, remember its times so an overflow        */
+    /* doesn't import it again for a change that was already applied.         */
+    if ( !fstatat( watch -> rootFd, node -> path, &st, AT_SYMLINK_NOFOLLOW ) ) {
+        node -> mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        node -> ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+        if ( attributesPtr && node -> id > 0 ) {
+            statToAttributes( &st, attributesPtr );
+            status = ufsSetAttributes( watch -> ufs, node -> id,
+                                       attributesPtr );
+        }
+    }
+
+    node -> epoch = watch -> epoch;
+    watch -> stats.events++;
+    return status;
+}
+
+ufsStatusType rescanChanged( ufsWatchStruct *watch, ufsWatchDirType *node )
+{
+    ufsWatchDirType *child, *next;
+    ufsStatusType status;
+    int64_t mtime, ctime;
+    struct stat st;
+
+    /* Events of this call were applied before the overflow was seen, and     */
+    /* the times remembered then may already hide the events that were lost.  */
+    /* A directory that's gone changed its parent, which was handled first.   */
+    if ( fstatat( watch -> rootFd, node -> path, &st, AT_SYMLINK_NOFOLLOW ) )
+        return UFS_NO_ERROR;
+
+    mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    ctime = st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+    if ( mtime != node -> mtime || ctime != node -> ctime ||
+         node -> epoch == watch -> epoch ) {
+        node -> mtime = mtime;
+        node -> ctime = ctime;
+        while ( node -> children )
+            unregisterTree( watch, node -> children );
+
+        watch -> stats.rescans++;
+        return importInto( watch, node );
+    }
+
+    for ( child = node -> children; child; child = next ) {
+        next = child -> next;
+        status = rescanChanged( watch, child );
+        if ( status != UFS_NO_ERROR )
+            return status;
+    }
+
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType processInotify( ufsWatchStruct *watch, int *overflow )
+{
+    char buffer[ UFS_WATCH_BUFFER_SIZE ]
+        __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+    const struct inotify_event *event;
+    enum ufsWatchEventKind kind;
+    ufsWatchDirType *node;
+    ufsStatusType status;
+    ssize_t length;
+    char *offset;
+
+    while ( ( length = read( watch -> fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+        for ( offset = buffer; offset < buffer + length;
+              offset += sizeof( *event ) + event -> len ) {
+            event = ( const struct inotify_event * )offset;
+            if ( event -> mask & IN_Q_OVERFLOW ) {
+                *overflow = 1;
+                continue;
+            }
+
+            node = findByKey( watch, event -> wd, NULL );
+            if ( !node )
+                continue;
+
+            /* The kernel dropped the watch, the directory itself is handled  */
+            /* by the event of its parent.                                    */
+            if ( event -> mask & IN_IGNORED ) {
+                unlinkKey( watch, node );
+                continue;
+            }
+
+            if ( !event -> len )
+                continue;
+
+            if ( event -> mask & ( IN_CREATE | IN_MOVED_TO ) )
+                kind = UFS_WATCH_EVENT_CREATED;
+            else if ( event -> mask & ( IN_DELETE | IN_MOVED_FROM ) )
+                kind = UFS_WATCH_EVENT_REMOVED;
+            else
+                kind = UFS_WATCH_EVENT_CHANGED;
+
+            status = applyEvent( watch, node, event -> name, kind,
+                                 !!( event -> mask & IN_ISDIR ) );
+            if ( status != UFS_NO_ERROR )
+                return status;
+        }
+    }
+
+    if ( length < 0 && errno != EAGAIN )
+        return UFS_UNKNOWN_ERROR;
+
+    return UFS_NO_ERROR;
+}
+
+ufsStatusType processFanotify( ufsWatchStruct *watch, int *overflow )
+{
+    char buffer[ UFS_WATCH_BUFFER_SIZE ]
+        __attribute__(( aligned( __alignof__(
+            struct fanotify_event_metadata ) ) ));
+    const struct fanotify_event_metadata *metadata;
+    const struct fanotify_event_info_header *info;
+    const struct fanotify_event_info_fid *fid;
+    const struct file_handle *handle;
+    enum ufsWatchEventKind kind;
+    ufsWatchDirType *node;
+    ufsStatusType status;
+    const char *name;
+    ssize_t length;
+    uint32_t offset;
+
+    while ( ( length = read( watch -> fd, buffer, sizeof( buffer ) ) ) > 0 ) {
+        metadata = ( const struct fanotify_event_metadata * )buffer;
+        for ( ; FAN_EVENT_OK( metadata, length );
+              metadata = FAN_EVENT_NEXT( metadata, length ) ) {
+            if ( metadata -> vers != FANOTIFY_METADATA_VERSION )
+                return UFS_UNKNOWN_ERROR;
+
+            if ( metadata -> mask & FAN_Q_OVERFLOW ) {
+                *overflow = 1;
+                continue;
+            }
+
+            if ( metadata -> mask & ( FAN_CREATE | FAN_MOVED_TO ) )
+                kind = UFS_WATCH_EVENT_CREATED;
+            else if ( metadata -> mask & ( FAN_DELETE | FAN_MOVED_FROM ) )
+                kind = UFS_WATCH_EVENT_REMOVED;
+            else
+                kind = UFS_WATCH_EVENT_CHANGED;
+
+            /* Only the directory and name record is of interest.             */
+            for ( offset = metadata -> metadata_len;
+                  offset < metadata -> event_len;
+                  offset += info -> len ) {
+                info = ( const struct fanotify_event_info_header * )
+                       ( ( const char * )metadata + offset );
+                if ( !info -> len )
+                    break;
+
+                if ( info -> info_type != FAN_EVENT_INFO_TYPE_DFID_NAME )
+                    continue;
+
+                fid = ( const struct fanotify_event_info_fid * )info;
+                handle = ( const struct file_handle * )fid -> handle;
+                name = ( const char * )handle -> f_handle +
+                       handle -> handle_bytes;
+                node = findByKey( watch, handleKey( handle ), handle );
+                if ( !node || !strcmp( name, "." ) )
+                    continue;
+
+                status = applyEvent( watch, node, name, kind,
+                                     !!( metadata -> mask & FAN_ONDIR ) );
+                if ( status != UFS_NO_ERROR )
+                    return status;
+            }
+        }
+    }
+
+    if ( length < 0 && errno != EAGAIN )
+        return UFS_UNKNOWN_ERROR;
+
+    return UFS_NO_ERROR;
+}
+
+ufsWatchType ufsWatchInit( ufsType ufs,
+                           int rootFd,
+                           const ufsImportOptionsType *options,
+                           uint64_t flags )
+{
+    ufsWatchStruct *watch;
+    ufsStatusType status;
+    if ( !ufs || rootFd < 0 || ( options && options -> visit ) ||
+         ( flags & ~UFS_WATCH_FLAG_INOTIFY ) ) {
+        ufsErrno = UFS_BAD_CALL;
+        return NULL;
+    }
+
+    watch = calloc( 1, sizeof( *watch ) );
+    if ( !watch ) {
+        ufsErrno = UFS_OUT_OF_MEMORY;
+        return NULL;
+    }
+
+    watch -> ufs = ufs;
+    watch -> rootFd = rootFd;
+    watch -> fd = -1;
+    if ( options )
+        watch -> options = *options;
+
+    watch -> buckets = UFS_WATCH_INITIAL_BUCKETS;
+    watch -> byId = calloc( watch -> buckets, sizeof( *watch -> byId ) );
+    watch -> byKey = calloc( watch -> buckets, sizeof( *watch -> byKey ) );
+    if ( !watch -> byId || !watch -> byKey ) {
+        status = UFS_OUT_OF_MEMORY;
+        goto fail;
+    }
+
+    /* fanotify needs privileges, fall back to inotify without them.          */
+    if ( !( flags & UFS_WATCH_FLAG_INOTIFY ) )
+        watch -> fd = fanotify_init( FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                                     FAN_NONBLOCK | FAN_CLOEXEC,
+                                     O_RDONLY | O_LARGEFILE );
+
+    if ( watch -> fd >= 0 ) {
+        watch -> stats.fanotify = 1;
+        watch -> mask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM |
+                        FAN_MOVED_TO | FAN_ONDIR;
+        if ( watch -> options.flags & UFS_IMPORT_FLAG_ATTRIBUTES )
+            watch -> mask |= FAN_ATTRIB | FAN_CLOSE_WRITE | FAN_EVENT_ON_CHILD;
+    } else {
+        watch -> fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        watch -> mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                        IN_EXCL_UNLINK;
+        if ( watch -> options.flags & UFS_IMPORT_FLAG_ATTRIBUTES )
+            watch -> mask |= IN_ATTRIB | IN_CLOSE_WRITE;
+    }
+
+    if ( watch -> fd < 0 ) {
+        status = UFS_UNKNOWN_ERROR;
+        goto fail;
+    }
+
+    status = registerDirectory( watch, watch -> options.directory, NULL, "." );
+    watch -> root = findById( watch, watch -> options.directory );
+    if ( status == UFS_NO_ERROR && !watch -> root )
+        status = UFS_UNKNOWN_ERROR;
+
+    if ( status == UFS_NO_ERROR )
+        status = importInto( watch, watch -> root );
+
+    if ( status != UFS_NO_ERROR )
+        goto fail;
+
+    ufsErrno = UFS_NO_ERROR;
+    return watch;
+
+fail:
+    ufsWatchDestroy( watch );
+    ufsErrno = status;
+    return NULL;
+}
+
+void ufsWatchDestroy( ufsWatchType watch )
+{
+    ufsWatchStruct *ufsWatch;
+
+    ufsWatch = watch;
+    if ( !ufsWatch )
+        return;
+
+    /* Closing the fd drops every kernel watch at once.                       */
+    if ( ufsWatch -> fd >= 0 )
+        close( ufsWatch -> fd );
+    ufsWatch -> fd = -1;
+
+    if ( ufsWatch -> root )
+        unregisterTree( ufsWatch, ufsWatch -> root );
+
+    free( ufsWatch -> byId );
+    free( ufsWatch -> byKey );
+    free( ufsWatch );
+}
+
+int ufsWatchGetFd( ufsWatchType watch )
+{
+    return ( ( ufsWatchStruct * )watch ) -> fd;
+}
+
+ufsStatusType ufsWatchProcess( ufsWatchType watch )
+{
+    ufsWatchStruct *ufsWatch;
+    int overflow;
+    if ( !watch ) {
+        ufsErrno = UFS_BAD_CALL;
+        return ufsErrno;
+    }
+
+    ufsWatch = watch;
+    ufsWatch -> epoch++;
+    overflow = 0;
+    if ( ufsWatch -> stats.fanotify )
+        ufsErrno = processFanotify( ufsWatch, &overflow );
+    else
+        ufsErrno = processInotify( ufsWatch, &overflow );
+
+    if ( ufsErrno != UFS_NO_ERROR || !overflow )
+        return ufsErrno;
+
+    /* Events were lost, look for the directories that changed since they     */
+    /* were last seen and import just those again.                            */
+    ufsWatch -> stats.overflows++;
+    if ( ufsWatch -> root )
+        ufsErrno = rescanChanged( ufsWatch, ufsWatch -> root );
+
+    return ufsErrno;
+}
+
+void ufsWatchGetStats( ufsWatchType watch, ufsWatchStatsType *stats )
+{
+    *stats = ( ( ufsWatchStruct * )watch ) -> stats;
+}
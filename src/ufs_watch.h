@@ -0,0 +1,139 @@
+/******************************************************************************\
+*  ufs_watch.h                                                                 *
+*                                                                              *
+*  Keeps storage imported from BASE in sync with the external fs.              *
+*  A watch imports a tree of the external fs into ufs and then follows its     *
+*  changes, with fanotify where it's available and inotify otherwise.          *
+*  Changes are applied one entry at a time, if the kernel drops events only    *
+*  the directories that changed since they were last seen are imported again.  *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+#ifndef UFS_WATCH_H
+#define UFS_WATCH_H
+
+#include "ufs_core.h"
+
+#define UFS_WATCH_FLAG_INOTIFY (1ULL << 0)
+
+typedef void *ufsWatchType;
+
+typedef struct ufsWatchStatsStruct {
+    uint64_t events;                /* Events applied to ufs.                 */
+    uint64_t overflows;             /* Times the kernel dropped events.       */
+    uint64_t rescans;               /* Directories imported again after that. */
+    uint64_t directories;           /* Directories being watched.             */
+    int fanotify;                   /* Whether fanotify is used.              */
+} ufsWatchStatsType;
+
+/******************************************************************************\
+* ufsWatchInit                                                                 *
+*                                                                              *
+*  Imports the tree under rootFd into ufs like ufsImportBase with UFS_IMPORT_  *
+*  FLAG_SYNC, and starts watching it. Every directory is watched before it's   *
+*  listed, so no change made while importing is missed.                        *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_OUT_OF_MEMORY: The system is out of memory.                           *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above, including running out   *
+*                       of kernel watches.                                     *
+*   -Any error of ufsImportBase.                                               *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -ufs: The ufs instance, must not be NULL. It must not be used by anyone     *
+*        else while ufsWatchProcess runs.                                      *
+*  -rootFd: A directory fd of the tree, must stay open as long as the watch.   *
+*  -options: The import options, can be NULL. visit must be NULL, the watch    *
+*            uses it.                                                          *
+*  -flags: UFS_WATCH_FLAG_INOTIFY to use inotify even if fanotify works.       *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsWatchType: a new watch, NULL on failure, check ufsErrno.                *
+*                                                                              *
+\******************************************************************************/
+ufsWatchType ufsWatchInit( ufsType ufs,
+                           int rootFd,
+                           const ufsImportOptionsType *options,
+                           uint64_t flags );
+
+/******************************************************************************\
+* ufsWatchDestroy                                                              *
+*                                                                              *
+*  Stops watching and destroys the watch. ufs itself is left as is.            *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -watch: The watch, can be NULL, in which case this is a no-op.              *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsWatchDestroy( ufsWatchType watch );
+
+/******************************************************************************\
+* ufsWatchGetFd                                                                *
+*                                                                              *
+*  Returns an fd that becomes readable when there are changes to process, to   *
+*  be used with poll/epoll.                                                    *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -watch: The watch, must not be NULL.                                        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -int: The fd, owned by the watch.                                           *
+*                                                                              *
+\******************************************************************************/
+int ufsWatchGetFd( ufsWatchType watch );
+
+/******************************************************************************\
+* ufsWatchProcess                                                              *
+*                                                                              *
+*  Applies all the changes that are pending, without blocking.                 *
+*  Entries that were created are added to BASE, entries that were removed      *
+*  leave it, renames are handled as a removal and a creation. If the kernel    *
+*  dropped events, every directory whose times changed, or that had events in  *
+*  this call, is imported again.                                               *
+*                                                                              *
+*  Possible errors:                                                            *
+*   -UFS_BAD_CALL: The function received bad arguments.                        *
+*   -UFS_UNKNOWN_ERROR: Any error not specified above.                         *
+*   -Any error of ufsImportBase.                                               *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -watch: The watch, must not be NULL.                                        *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -ufsStatusType: The status of this call, ufsErrno is also set.              *
+*                                                                              *
+\******************************************************************************/
+ufsStatusType ufsWatchProcess( ufsWatchType watch );
+
+/******************************************************************************\
+* ufsWatchGetStats                                                             *
+*                                                                              *
+*  Returns the counters of a watch.                                            *
+*                                                                              *
+* Parameters                                                                   *
+*                                                                              *
+*  -watch: The watch, must not be NULL.                                        *
+*  -stats: Filled with the counters, must not be NULL.                         *
+*                                                                              *
+* Return                                                                       *
+*                                                                              *
+*  -void.                                                                      *
+*                                                                              *
+\******************************************************************************/
+void ufsWatchGetStats( ufsWatchType watch, ufsWatchStatsType *stats );
+
+#endif /* UFS_WATCH_H */
@@ -20,6 +20,10 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include "ufs_core.h"
 #include "utils.h"
 
@@ -36,6 +40,11 @@
 #define TEST_AREA_NAME TEST_AREA_NAME_0
 #define TEST_AREA_NAME_0 ("testArea0")
 #define TEST_AREA_NAME_1 ("testArea1")
+#define TEST_AREA_NAME_2 ("testArea2")
+#define TEST_AREA_NAME_3 ("testArea3")
+
+#define TEST_IMAGE_PATH ("testImage.ufs")
+#define TEST_IMPORT_TEMPLATE ("/tmp/ufsTestImportXXXXXX")
 
 static void test_ufs_init( void **state )
 {
@@ -676,11 +685,20 @@ static void test_ufs_probe_mapping_file_does_not_exist( void **state )
 static void test_ufs_probe_mapping_mapping_does_not_exist( void **state )
 {
     struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, dirId;
     ufsStatusType status;
 
     ufsStruct = *state;
 
-    status = ufsProbeMapping( ufsStruct -> ufs, 1, 1 );
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId, dirId );
     ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
 }
 /* ########################################################################## */
@@ -1120,6 +1138,95 @@ static void test_ufs_remove_area_remove_then_get( void **state )
     ASSERT_UFS_ERROR( areaId, UFS_DOES_NOT_EXIST );
 
 }
+
+static void test_ufs_remove_area_has_clones( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    areaId1 = ufsCloneArea( ufsStruct -> ufs, areaId0, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    status = ufsRemoveArea( ufsStruct -> ufs, areaId0 );
+    ASSERT_UFS_STATUS( status, UFS_AREA_HAS_CLONES );
+
+    /* Once the clone is gone its source can go too.                          */
+    status = ufsRemoveArea( ufsStruct -> ufs, areaId1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveArea( ufsStruct -> ufs, areaId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+
+static void test_ufs_remove_area_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, fileId, id;
+    ufsStatusType status;
+    ufsViewType view;
+    ufsType reader;
+
+    ufsStruct = *state;
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    areaId1 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                         TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId1, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    reader = ufsInitReader( ufsStruct -> ufs );
+    assert_non_null( reader );
+
+    view[ 0 ] = areaId1;
+    view[ 1 ] = areaId0;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    id = ufsResolveStorageInView( reader, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    /* The area goes away with its whiteout, views that held it are no longer */
+    /* valid.                                                                 */
+    status = ufsRemoveArea( ufsStruct -> ufs, areaId1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_INVALID_AREA_IN_VIEW );
+
+    id = ufsResolveStorageInView( reader, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_INVALID_AREA_IN_VIEW );
+
+    /* A clone added later may get the id of the removed area, readers must   */
+    /* not take it for the area they knew.                                    */
+    areaId1 = ufsCloneArea( ufsStruct -> ufs, areaId0, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    view[ 0 ] = areaId1;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, areaId1 );
+
+    id = ufsResolveStorageInView( reader, view, fileId );
+    assert_int_equal( id, areaId1 );
+    ufsDestroy( reader );
+}
 /* ########################################################################## */
 
 /* ufsRemoveMapping                                                           */
@@ -1297,109 +1404,3935 @@ static void test_ufs_remove_mapping_remove_then_probe( void **state )
 }
 /* ########################################################################## */
 
-static const struct CMUnitTest ufs_test_suite[] = {
+/* ufsRemoveTree                                                              */
+static void test_ufs_remove_tree_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStatusType status;
 
-    cmocka_unit_test( test_ufs_init ),
+    ufsStruct = *state;
 
-    /* ufsAddDirectory tests.                                                 */
-    cmocka_unit_test_setup_teardown( test_ufs_add_directory_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_directory, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_directory_duplicate, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_directory_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    status = ufsRemoveTree( NULL, 1, 0 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
 
-    /* ufsAddFile tests.                                                      */
-    cmocka_unit_test_setup_teardown( test_ufs_add_file_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_file, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_file_duplicate, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_file_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_file_same_name_different_directory, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    status = ufsRemoveTree( ufsStruct -> ufs, 0, 0 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
 
-    /* ufsAddArea tests.                                                      */
-    cmocka_unit_test_setup_teardown( test_ufs_add_area_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_area, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_area_duplicate, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_area_illegal_name, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    status = ufsRemoveTree( ufsStruct -> ufs, -1, 0 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
 
-    /* ufsAddMapping tests.                                                   */
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_file, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_directory, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_duplicate, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_file_does_not_exist, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    status = ufsRemoveTree( ufsStruct -> ufs, 1, ~0ULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
 
-    /* ufsGetDirectory tests.                                                 */
-    cmocka_unit_test_setup_teardown( test_ufs_get_directory_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_directory, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_directory_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_directory_does_not_exist, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+static void test_ufs_remove_tree( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId0, dirId1, fileId0, fileId1;
+    ufsStatusType status;
 
-    /* ufsGetFile tests.                                                      */
-    cmocka_unit_test_setup_teardown( test_ufs_get_file_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_file, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_file_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_file_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_file_exists_in_different_directory, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    ufsStruct = *state;
 
-    /* ufsGetArea tests.                                                      */
-    cmocka_unit_test_setup_teardown( test_ufs_get_area_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_area, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_get_area_does_not_exist, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
 
-    /* ufsProbeMapping                                                        */
-    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_area_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_file_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_mapping_does_not_exist, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
 
-    /* ufsRemoveDirectory                                                     */
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_contains_file, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_exists_in_mapping, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_double_remove, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_remove_then_add, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_remove_then_get, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    fileId0 = ufsAddFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId0 );
 
-    /* ufsRemoveFile                                                          */
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_exists_in_mapping, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_double_remove, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_remove_then_add, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_file_remove_then_get, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    fileId1 = ufsAddFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( fileId1 );
 
-    /* ufsRemoveArea                                                          */
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_exists_in_mapping, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_double_remove, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_remove_then_add, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_area_remove_then_get, ufsGetInstance, ufsCleanup ),
-    /* ====================================================================== */
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId0, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
 
-    /* ufsRemoveMapping                                                       */
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_bad_args, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_does_not_exist, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_no_side_effects, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_double_remove, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_remove_then_add, ufsGetInstance, ufsCleanup ),
-    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_remove_then_probe, ufsGetInstance, ufsCleanup ),
+static void test_ufs_remove_tree_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsRemoveTree( ufsStruct -> ufs, 1, 0 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    /* Files aren't trees.                                                    */
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, fileId, 0 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_remove_tree_exists_in_mapping( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, dirId0, dirId1, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId0, 0 );
+    ASSERT_UFS_STATUS( status, UFS_EXISTS_IN_EXPLICIT_MAPPING );
+
+    /* Nothing should have been removed.                                      */
+    dirId1 = ufsGetDirectory( ufsStruct -> ufs, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    fileId = ufsGetFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+}
+
+static void test_ufs_remove_tree_with_mappings( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveTree( ufsStruct -> ufs,
+                            dirId,
+                            UFS_REMOVE_TREE_FLAG_MAPPINGS );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_remove_tree_double_remove( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId, 0 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_remove_tree_remove_then_get( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId0, dirId1;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId0, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId0 = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_ERROR( dirId0, UFS_DOES_NOT_EXIST );
+
+    /* Siblings are left untouched.                                           */
+    dirId0 = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+    assert_int_equal( dirId0, dirId1 );
+}
+
+static void test_ufs_remove_tree_ids_not_reused( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId0, dirId1;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId0, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* The largest identifier was removed, the next one must still be new.    */
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+    assert_true( dirId1 > dirId0 );
+}
+/* ########################################################################## */
+
+/* ufsMoveStorage                                                             */
+static void test_ufs_move_storage_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsMoveStorage( NULL, 1, UFS_STORAGE_ROOT_IDENTIFIER, TEST_FILE_NAME );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsMoveStorage( ufsStruct -> ufs,
+            0,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, 1, -1, TEST_FILE_NAME );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsMoveStorage( ufsStruct -> ufs,
+            1,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_move_storage( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, dirId0, dirId1, fileId, id;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId, dirId1, TEST_FILE_NAME_1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* The identifier and the mapping are kept.                               */
+    id = ufsGetFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+    assert_int_equal( id, fileId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_move_storage_directory( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId0, dirId1, fileId, id;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId0 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, dirId0, dirId1, TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetDirectory( ufsStruct -> ufs, dirId1, TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+    assert_int_equal( id, dirId0 );
+
+    /* Contents move along with the directory.                                */
+    id = ufsGetFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( id );
+    assert_int_equal( id, fileId );
+
+    /* A directory can't be moved under itself.                               */
+    status = ufsMoveStorage( ufsStruct -> ufs, dirId1, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, dirId1, dirId1, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_move_storage_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsMoveStorage( ufsStruct -> ufs,
+            1,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_move_storage_parent_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId, fileId + 1, TEST_FILE_NAME );
+    ASSERT_UFS_STATUS( status, UFS_PARENT_DOES_NOT_EXIST );
+
+    /* Files can't act as parents.                                            */
+    status = ufsMoveStorage( ufsStruct -> ufs, dirId, fileId, TEST_DIRECTORY_NAME );
+    ASSERT_UFS_STATUS( status, UFS_PARENT_DOES_NOT_EXIST );
+}
+
+static void test_ufs_move_storage_already_exists( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId0, fileId1;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId0 = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId0 );
+
+    fileId1 = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( fileId1 );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId0, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    /* Moving storage onto itself is allowed.                                 */
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId0, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+/* ########################################################################## */
+
+/* ufs attribute tests                                                        */
+static void test_ufs_set_attributes_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsSetAttributes( NULL, 1, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, 0, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, 1, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetAttributes( NULL, 1, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, -1, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, 1, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsInvalidateAttributes( ufsStruct -> ufs, 0 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_set_attributes( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes0 = { 0 }, attributes1 = { 0 };
+    ufsIdentifierType dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes1 );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+
+    attributes0.mode = 0100644;
+    attributes0.size = 1ULL << 40;
+    attributes0.mtime = 1700000000123456789LL;
+    attributes0.ctime = 1700000000987654321LL;
+    attributes0.nlink = 1;
+    attributes0.uid = 1000;
+    attributes0.gid = 100;
+
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    assert_int_equal( attributes1.mode, attributes0.mode );
+    assert_int_equal( attributes1.size, attributes0.size );
+    assert_int_equal( attributes1.mtime, attributes0.mtime );
+    assert_int_equal( attributes1.ctime, attributes0.ctime );
+    assert_int_equal( attributes1.nlink, attributes0.nlink );
+    assert_int_equal( attributes1.uid, attributes0.uid );
+    assert_int_equal( attributes1.gid, attributes0.gid );
+    assert_true( attributes1.generation > 0 );
+}
+
+static void test_ufs_set_attributes_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsSetAttributes( ufsStruct -> ufs, 1, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_set_attributes_generation( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsIdentifierType dirId, fileId;
+    ufsStatusType status;
+    uint64_t generation;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, dirId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, dirId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    generation = attributes.generation;
+
+    /* Any later record, on any storage, gets a greater generation.           */
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( attributes.generation > generation );
+    generation = attributes.generation;
+
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( attributes.generation > generation );
+}
+
+static void test_ufs_get_many_attributes( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 }, attributesOut[ 4 ];
+    ufsIdentifierType storages[ 4 ];
+    ufsStatusType status, statusOut[ 4 ];
+
+    ufsStruct = *state;
+
+    storages[ 0 ] = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( storages[ 0 ] );
+
+    storages[ 1 ] = ufsAddFile( ufsStruct -> ufs, storages[ 0 ], TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( storages[ 1 ] );
+
+    storages[ 2 ] = ufsAddFile( ufsStruct -> ufs, storages[ 0 ], TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( storages[ 2 ] );
+
+    storages[ 3 ] = storages[ 2 ] + 1;
+
+    attributes.size = 10;
+    status = ufsSetAttributes( ufsStruct -> ufs, storages[ 0 ], &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    attributes.size = 20;
+    status = ufsSetAttributes( ufsStruct -> ufs, storages[ 2 ], &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetManyAttributes( NULL, storages, 4, attributesOut, statusOut );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetManyAttributes( ufsStruct -> ufs,
+            storages,
+            4,
+            attributesOut,
+            statusOut );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    assert_int_equal( statusOut[ 0 ], UFS_NO_ERROR );
+    assert_int_equal( attributesOut[ 0 ].size, 10 );
+    assert_int_equal( statusOut[ 1 ], UFS_ATTRIBUTES_DO_NOT_EXIST );
+    assert_int_equal( statusOut[ 2 ], UFS_NO_ERROR );
+    assert_int_equal( attributesOut[ 2 ].size, 20 );
+    assert_int_equal( statusOut[ 3 ], UFS_ATTRIBUTES_DO_NOT_EXIST );
+}
+
+static void test_ufs_invalidate_attributes( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsIdentifierType dirId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsInvalidateAttributes( ufsStruct -> ufs, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+
+    status = ufsInvalidateAttributes( ufsStruct -> ufs, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+
+    /* Records are removed along with their storage.                          */
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, dirId, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+}
+/* ########################################################################## */
+
+/* ufsCloneArea                                                               */
+static void test_ufs_clone_area_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType id;
+
+    ufsStruct = *state;
+
+    id = ufsCloneArea( NULL, 1, TEST_AREA_NAME );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsCloneArea( ufsStruct -> ufs, UFS_AREA_BASE_IDENTIFIER, TEST_AREA_NAME );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsCloneArea( ufsStruct -> ufs, 1, NULL );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+}
+
+static void test_ufs_clone_area( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, dirId, fileId, id;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    areaId1 = ufsCloneArea( ufsStruct -> ufs, areaId0, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+    assert_int_not_equal( areaId0, areaId1 );
+
+    id = ufsGetArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+    assert_int_equal( id, areaId1 );
+
+    /* The clone sees the mappings of its source.                             */
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, dirId );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+}
+
+static void test_ufs_clone_area_diverge( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, dirId, fileId0, fileId1;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId0 = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId0 );
+
+    fileId1 = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( fileId1 );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    areaId1 = ufsCloneArea( ufsStruct -> ufs, areaId0, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    /* Changes to the clone don't reach the source.                           */
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId1, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileId1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileId0 );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId0, fileId1 );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    /* Changes to the source don't reach the clone.                           */
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, dirId );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+
+static void test_ufs_clone_area_of_clone( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, areaId2, dirId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    areaId1 = ufsCloneArea( ufsStruct -> ufs, areaId0, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    areaId2 = ufsCloneArea( ufsStruct -> ufs, areaId1, "testArea2" );
+    ASSERT_UFS_NO_ERROR( areaId2 );
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId1, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId2, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, dirId );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+}
+
+static void test_ufs_clone_area_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType id;
+
+    ufsStruct = *state;
+
+    id = ufsCloneArea( ufsStruct -> ufs, 1, TEST_AREA_NAME );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_clone_area_duplicate( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, id;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    id = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME );
+    ASSERT_UFS_ERROR( id, UFS_ALREADY_EXISTS );
+
+    id = ufsCloneArea( ufsStruct -> ufs, areaId, UFS_AREA_BASE_NAME );
+    ASSERT_UFS_ERROR( id, UFS_ILLEGAL_NAME );
+}
+/* ########################################################################## */
+
+/* ufsSaveImage / ufsInitFromImage                                            */
+static void test_ufs_image_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStatusType status;
+    ufsType ufs;
+
+    ufsStruct = *state;
+
+    status = ufsSaveImage( NULL, TEST_IMAGE_PATH );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsSaveImage( ufsStruct -> ufs, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    ufs = ufsInitFromImage( NULL );
+    assert_null( ufs );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+}
+
+static void test_ufs_image_does_not_exist( void **state )
+{
+    ufsType ufs;
+
+    (void)state;
+
+    unlink( TEST_IMAGE_PATH );
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_null( ufs );
+    assert_int_equal( ufsErrno, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_image_not_an_image( void **state )
+{
+    FILE *file;
+    ufsType ufs;
+
+    (void)state;
+
+    file = fopen( TEST_IMAGE_PATH, "w" );
+    assert_non_null( file );
+    fputs( "this is not a ufs image", file );
+    fclose( file );
+
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_null( ufs );
+    assert_int_equal( ufsErrno, UFS_UNKNOWN_ERROR );
+    unlink( TEST_IMAGE_PATH );
+}
+
+static void test_ufs_image_round_trip( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsIdentifierType dirId, fileId, areaId, id;
+    ufsStatusType status;
+    uint64_t generation;
+    ufsType ufs;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    attributes.size = 4096;
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    generation = attributes.generation;
+
+    status = ufsSaveImage( ufsStruct -> ufs, TEST_IMAGE_PATH );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_non_null( ufs );
+    assert_int_equal( ufsErrno, UFS_NO_ERROR );
+
+    id = ufsGetDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME );
+    assert_int_equal( id, dirId );
+
+    id = ufsGetFile( ufs, dirId, TEST_FILE_NAME );
+    assert_int_equal( id, fileId );
+
+    id = ufsGetArea( ufs, TEST_AREA_NAME );
+    assert_int_equal( id, areaId );
+
+    status = ufsProbeMapping( ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 4096 );
+    assert_int_equal( attributes.generation, generation );
+
+    /* Generations handed out after loading stay ahead of the saved ones.     */
+    status = ufsSetAttributes( ufs, dirId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufs, dirId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( attributes.generation > generation );
+
+    ufsDestroy( ufs );
+    unlink( TEST_IMAGE_PATH );
+}
+
+static void test_ufs_image_copy_on_write( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId, id;
+    ufsStatusType status;
+    ufsType ufs;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    status = ufsSaveImage( ufsStruct -> ufs, TEST_IMAGE_PATH );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_non_null( ufs );
+
+    fileId = ufsAddFile( ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+    ufsDestroy( ufs );
+
+    /* Changes made after loading don't reach the image file.                 */
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_non_null( ufs );
+
+    id = ufsGetFile( ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    /* Until they're saved.                                                   */
+    fileId = ufsAddFile( ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsSaveImage( ufs, TEST_IMAGE_PATH );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    ufsDestroy( ufs );
+
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_non_null( ufs );
+
+    id = ufsGetFile( ufs, dirId, TEST_FILE_NAME );
+    assert_int_equal( id, fileId );
+
+    ufsDestroy( ufs );
+    unlink( TEST_IMAGE_PATH );
+}
+static void test_ufs_image_out_of_room( void **state )
+{
+    char name[ UFS_STORAGE_NAME_MAX + 1 ];
+    ufsIdentifierType firstId, id;
+    struct rlimit limit, reduced;
+    unsigned long pages;
+    size_t i;
+    FILE *statm;
+    ufsType ufs;
+
+    /* Leave little address space, so the image can only reserve a little.    */
+    statm = fopen( "/proc/self/statm", "r" );
+    assert_non_null( statm );
+    assert_int_equal( fscanf( statm, "%lu", &pages ), 1 );
+    fclose( statm );
+
+    assert_int_equal( getrlimit( RLIMIT_AS, &limit ), 0 );
+    reduced = limit;
+    reduced.rlim_cur = pages * sysconf( _SC_PAGESIZE ) + ( 128ULL << 20 );
+    assert_int_equal( setrlimit( RLIMIT_AS, &reduced ), 0 );
+    ufs = ufsInit();
+    assert_int_equal( setrlimit( RLIMIT_AS, &limit ), 0 );
+    assert_non_null( ufs );
+
+    firstId = -1;
+    for ( i = 0; i < 1000000; i++ ) {
+        snprintf( name, sizeof( name ), "%0*zu", UFS_STORAGE_NAME_MAX, i );
+        id = ufsAddFile( ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+        if ( id < 0 )
+            break;
+        if ( firstId < 0 )
+            firstId = id;
+    }
+
+    /* Refused cleanly before the image ran out, what was there is intact.    */
+    ASSERT_UFS_ERROR( id, UFS_OUT_OF_MEMORY );
+    assert_true( i > 0 );
+
+    snprintf( name, sizeof( name ), "%0*zu", UFS_STORAGE_NAME_MAX,
+              ( size_t )0 );
+    id = ufsGetFile( ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+    assert_int_equal( id, firstId );
+
+    id = ufsAddDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME );
+    ASSERT_UFS_ERROR( id, UFS_OUT_OF_MEMORY );
+
+    ufsDestroy( ufs );
+}
+/* ########################################################################## */
+
+/* ufsInitReader                                                              */
+static void test_ufs_reader_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsType reader, ufs;
+
+    ufsStruct = *state;
+
+    ufs = ufsInitReader( NULL );
+    assert_null( ufs );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    reader = ufsInitReader( ufsStruct -> ufs );
+    assert_non_null( reader );
+
+    /* Readers are made from the instance itself.                             */
+    ufs = ufsInitReader( reader );
+    assert_null( ufs );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+    ufsDestroy( reader );
+}
+
+static void test_ufs_reader_follows_instance( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId, areaId, id;
+    ufsAttributesType attributes = { 0 };
+    uint64_t generation, readGeneration;
+    ufsStatusType status;
+    ufsViewType view;
+    char name[ 32 ];
+    ufsType reader;
+    int i;
+
+    ufsStruct = *state;
+
+    reader = ufsInitReader( ufsStruct -> ufs );
+    assert_non_null( reader );
+    assert_int_equal( ufsErrno, UFS_NO_ERROR );
+
+    /* Everything done after the reader was made shows through it.            */
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    attributes.size = 4096;
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetDirectory( reader, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME );
+    assert_int_equal( id, dirId );
+
+    id = ufsGetFile( reader, dirId, TEST_FILE_NAME );
+    assert_int_equal( id, fileId );
+
+    status = ufsProbeMapping( reader, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( reader, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 4096 );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( reader, view, fileId );
+    assert_int_equal( id, areaId );
+
+    status = ufsGetDirectoryGeneration( ufsStruct -> ufs, dirId, &generation );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetDirectoryGeneration( reader, dirId, &readGeneration );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( readGeneration, generation );
+
+    /* Including what grows the database past what the reader last read, and  */
+    /* what it then no longer sees.                                           */
+    for ( i = 0; i < 4096; i++ ) {
+        snprintf( name, sizeof( name ), "%s%d", TEST_FILE_NAME, i );
+        id = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER, name );
+        ASSERT_UFS_NO_ERROR( id );
+    }
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    snprintf( name, sizeof( name ), "%s%d", TEST_FILE_NAME, i - 1 );
+    assert_int_equal( ufsGetFile( reader, UFS_STORAGE_ROOT_IDENTIFIER, name ),
+                      id );
+
+    status = ufsProbeMapping( reader, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    id = ufsResolveStorageInView( reader, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+    ufsDestroy( reader );
+
+    /* The instance is untouched by its readers.                              */
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME );
+    assert_int_equal( id, fileId );
+}
+
+static void test_ufs_reader_of_image( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId, id;
+    ufsStatusType status;
+    ufsType ufs, reader;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    status = ufsSaveImage( ufsStruct -> ufs, TEST_IMAGE_PATH );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    ufs = ufsInitFromImage( TEST_IMAGE_PATH );
+    assert_non_null( ufs );
+
+    reader = ufsInitReader( ufs );
+    assert_non_null( reader );
+
+    id = ufsGetDirectory( reader, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME );
+    assert_int_equal( id, dirId );
+
+    fileId = ufsAddFile( ufs, dirId, TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    id = ufsGetFile( reader, dirId, TEST_FILE_NAME );
+    assert_int_equal( id, fileId );
+
+    ufsDestroy( reader );
+    ufsDestroy( ufs );
+    unlink( TEST_IMAGE_PATH );
+}
+/* ########################################################################## */
+
+/* ufsImportBase                                                              */
+
+/* Builds the tree:                                                           */
+/*   testDirectory0/testFile0  (4 bytes)                                      */
+/*   testDirectory0/testDirectory1/testFile1                                  */
+/*   testFile0                                                                */
+static int createImportTree( char *root )
+{
+    char path[ 256 ];
+    int fd;
+
+    strcpy( root, TEST_IMPORT_TEMPLATE );
+    assert_non_null( mkdtemp( root ) );
+
+    snprintf( path, sizeof( path ), "%s/%s", root, TEST_DIRECTORY_NAME_0 );
+    assert_int_equal( mkdir( path, 0755 ), 0 );
+
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_DIRECTORY_NAME_1 );
+    assert_int_equal( mkdir( path, 0755 ), 0 );
+
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_FILE_NAME_0 );
+    fd = open( path, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    assert_int_equal( write( fd, "ufs!", 4 ), 4 );
+    close( fd );
+
+    snprintf( path, sizeof( path ), "%s/%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_DIRECTORY_NAME_1, TEST_FILE_NAME_1 );
+    fd = open( path, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    close( fd );
+
+    snprintf( path, sizeof( path ), "%s/%s", root, TEST_FILE_NAME_0 );
+    fd = open( path, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    close( fd );
+
+    fd = open( root, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    return fd;
+}
+
+static void removeImportTree( char *root, int fd )
+{
+    char path[ 256 ];
+
+    close( fd );
+    snprintf( path, sizeof( path ), "%s/%s", root, TEST_FILE_NAME_0 );
+    unlink( path );
+    snprintf( path, sizeof( path ), "%s/%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_DIRECTORY_NAME_1, TEST_FILE_NAME_1 );
+    unlink( path );
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_FILE_NAME_0 );
+    unlink( path );
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_DIRECTORY_NAME_1 );
+    rmdir( path );
+    snprintf( path, sizeof( path ), "%s/%s", root, TEST_DIRECTORY_NAME_0 );
+    rmdir( path );
+    rmdir( root );
+}
+
+static void importProgress( uint64_t directories,
+                            uint64_t files,
+                            void *userData )
+{
+    uint64_t *counts;
+
+    counts = userData;
+    counts[ 0 ] = directories;
+    counts[ 1 ] = files;
+}
+
+static void test_ufs_import_base_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsImportBase( NULL, 0, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsImportBase( ufsStruct -> ufs, -1, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    options.directory = -1;
+    status = ufsImportBase( ufsStruct -> ufs, 0, &options );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    options.directory = UFS_STORAGE_ROOT_IDENTIFIER;
+    options.flags = ~UFS_IMPORT_FLAG_ATTRIBUTES;
+    status = ufsImportBase( ufsStruct -> ufs, 0, &options );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_import_base_does_not_exist( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsIdentifierType fileId;
+    ufsStatusType status;
+    char root[ 64 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    options.directory = fileId + 1;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    /* Files can't hold an imported tree.                                     */
+    options.directory = fileId;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    removeImportTree( root, fd );
+}
+
+static void test_ufs_import_base( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsIdentifierType dirId0, dirId1, id;
+    ufsAttributesType attributes;
+    ufsStatusType status;
+    char root[ 64 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    options.threads = 4;
+    options.flags = UFS_IMPORT_FLAG_ATTRIBUTES;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId0 = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsGetDirectory( ufsStruct -> ufs, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, id, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 4 );
+    assert_true( S_ISREG( attributes.mode ) );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, dirId1, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( S_ISDIR( attributes.mode ) );
+
+    removeImportTree( root, fd );
+}
+
+static void test_ufs_import_base_merge( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, areaId, id;
+    ufsAttributesType attributes;
+    ufsStatusType status;
+    char root[ 64 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Existing storage is reused, and its mappings are left alone.           */
+    status = ufsImportBase( ufsStruct -> ufs, fd, NULL );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    assert_int_equal( id, dirId );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Without the flag no attributes are stored.                             */
+    status = ufsGetAttributes( ufsStruct -> ufs, id, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+
+    /* Importing again changes nothing.                                       */
+    status = ufsImportBase( ufsStruct -> ufs, fd, NULL );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_ALREADY_EXISTS );
+
+    removeImportTree( root, fd );
+}
+
+static void test_ufs_import_base_into_directory( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsIdentifierType dirId, id;
+    ufsStatusType status;
+    uint64_t counts[ 2 ] = { 0 };
+    char root[ 64 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    dirId = ufsAddDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    options.directory = dirId;
+    options.threads = 1;
+    options.progress = importProgress;
+    options.userData = counts;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    assert_int_equal( counts[ 0 ], 2 );
+    assert_int_equal( counts[ 1 ], 3 );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    removeImportTree( root, fd );
+}
+static void test_ufs_import_base_sync( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsIdentifierType dirId, areaId, fileId, id;
+    ufsStatusType status;
+    char root[ 64 ], path[ 256 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    status = ufsImportBase( ufsStruct -> ufs, fd, NULL );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    fileId = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    snprintf( path, sizeof( path ), "%s/%s", root, TEST_FILE_NAME_0 );
+    assert_int_equal( unlink( path ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_FILE_NAME_0 );
+    assert_int_equal( unlink( path ), 0 );
+
+    /* Without the flag nothing leaves BASE.                                  */
+    status = ufsImportBase( ufsStruct -> ufs, fd, NULL );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    options.flags = UFS_IMPORT_FLAG_SYNC;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    /* Mapped storage stays.                                                  */
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    assert_int_equal( id, fileId );
+
+    id = ufsGetDirectory( ufsStruct -> ufs, dirId, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    removeImportTree( root, fd );
+}
+
+/* Replaces testDirectory1 with a file before it's listed.                    */
+static ufsStatusType replaceDirectory( ufsIdentifierType directory,
+                                       ufsIdentifierType parent,
+                                       const char *path,
+                                       void *userData )
+{
+    char full[ 256 ];
+    int fd;
+
+    ( void )directory;
+    ( void )parent;
+    if ( strcmp( path + strlen( path ) - strlen( TEST_DIRECTORY_NAME_1 ),
+                 TEST_DIRECTORY_NAME_1 ) )
+        return UFS_NO_ERROR;
+
+    snprintf( full, sizeof( full ), "%s/%s/%s", ( char * )userData, path,
+              TEST_FILE_NAME_1 );
+    assert_int_equal( unlink( full ), 0 );
+    snprintf( full, sizeof( full ), "%s/%s", ( char * )userData, path );
+    assert_int_equal( rmdir( full ), 0 );
+    fd = open( full, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    close( fd );
+    return UFS_NO_ERROR;
+}
+
+static void test_ufs_import_base_unreadable( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsIdentifierType dirId0, dirId1, id;
+    ufsStatusType status;
+    char root[ 64 ], path[ 256 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createImportTree( root );
+
+    /* The directory can't be opened as one once it's listed, the rest of     */
+    /* the tree is still imported.                                            */
+    options.visit = replaceDirectory;
+    options.userData = root;
+    status = ufsImportBase( ufsStruct -> ufs, fd, &options );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId0 = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId0 );
+
+    dirId1 = ufsGetDirectory( ufsStruct -> ufs, dirId0, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId1 );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId1, TEST_FILE_NAME_1 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId0, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    snprintf( path, sizeof( path ), "%s/%s/%s", root,
+              TEST_DIRECTORY_NAME_0, TEST_DIRECTORY_NAME_1 );
+    unlink( path );
+    removeImportTree( root, fd );
+}
+
+static void test_ufs_add_to_base_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType id;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    id = ufsAddToBase( NULL, UFS_STORAGE_ROOT_IDENTIFIER, TEST_FILE_NAME,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER, NULL,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsAddToBase( ufsStruct -> ufs, -1, TEST_FILE_NAME,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                       TEST_FILE_NAME, 2, NULL );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsAddToBase( ufsStruct -> ufs, 1, TEST_FILE_NAME,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_ERROR( id, UFS_PARENT_DOES_NOT_EXIST );
+
+    status = ufsRemoveFromBase( NULL, 1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsRemoveFromBase( ufsStruct -> ufs, 0 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsRemoveFromBase( ufsStruct -> ufs, 1 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_add_to_base( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, fileId, ownId, id;
+    ufsAttributesType attributes = { 0 };
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME, UFS_STORAGE_TYPE_DIRECTORY,
+                          NULL );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    attributes.size = 4;
+    fileId = ufsAddToBase( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0,
+                           UFS_STORAGE_TYPE_FILE, &attributes );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    /* Adding it again reuses it.                                             */
+    id = ufsAddToBase( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    assert_int_equal( id, fileId );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 4 );
+
+    /* Storage that isn't in BASE keeps the directory in ufs.                 */
+    ownId = ufsAddFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( ownId );
+
+    status = ufsRemoveFromBase( ufsStruct -> ufs, dirId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME );
+    assert_int_equal( id, dirId );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS( status, UFS_ATTRIBUTES_DO_NOT_EXIST );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    assert_int_equal( id, ownId );
+}
+/* ########################################################################## */
+
+/* ufsResolveStorageInView                                                    */
+static void test_ufs_resolve_storage_in_view_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsViewType view = { UFS_AREA_BASE_IDENTIFIER, UFS_VIEW_TERMINATOR };
+    ufsIdentifierType id;
+
+    ufsStruct = *state;
+
+    id = ufsResolveStorageInView( NULL, view, 1 );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, NULL, 1 );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, 0 );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+}
+
+static void test_ufs_resolve_storage_in_view_invalid_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsViewType view;
+    ufsIdentifierType areaId, fileId, id;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_BASE_IS_NOT_LAST_AREA );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_VIEW_CONTAINS_DUPLICATES );
+
+    view[ 1 ] = areaId + 1;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_INVALID_AREA_IN_VIEW );
+
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId + 1 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    /* An empty view contains nothing.                                        */
+    view[ 0 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+}
+
+static void test_ufs_resolve_storage_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, fileId0, fileId1, id;
+    ufsViewType view;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId0 = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId0 );
+
+    fileId1 = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( fileId1 );
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    areaId1 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    view[ 0 ] = areaId0;
+    view[ 1 ] = areaId1;
+    view[ 2 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+
+    /* Storage that isn't explicitly mapped lives in BASE.                    */
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId0 );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+    assert_int_equal( ufsErrno, UFS_NO_ERROR );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId0 );
+    assert_int_equal( id, areaId1 );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId0 );
+    assert_int_equal( id, areaId0 );
+
+    /* Mapped storage is no longer in BASE.                                   */
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId0 );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId1 );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId0, fileId0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = areaId0;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId0 );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+}
+
+static void test_ufs_resolve_storage_in_view_many_mappings( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, cloneId, fileIds[ 512 ], id;
+    ufsViewType view;
+    ufsStatusType status;
+    char name[ 32 ];
+    int i;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    for ( i = 0; i < 512; i++ ) {
+        snprintf( name, sizeof( name ), "%d", i );
+        fileIds[ i ] = ufsAddFile( ufsStruct -> ufs,
+                UFS_STORAGE_ROOT_IDENTIFIER,
+                name );
+        ASSERT_UFS_NO_ERROR( fileIds[ i ] );
+    }
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+
+    /* Mappings added and removed after the area was first looked at are      */
+    /* observed, however many there are.                                      */
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileIds[ 0 ] );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    for ( i = 0; i < 512; i++ ) {
+        status = ufsAddMapping( ufsStruct -> ufs, areaId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+
+        id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileIds[ i ] );
+        assert_int_equal( id, areaId );
+    }
+
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    for ( i = 0; i < 512; i += 2 ) {
+        status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+
+    for ( i = 0; i < 512; i++ ) {
+        status = ufsProbeMapping( ufsStruct -> ufs, areaId, fileIds[ i ] );
+        assert_int_equal( status, i % 2 ? UFS_NO_ERROR : UFS_MAPPING_DOES_NOT_EXIST );
+
+        status = ufsProbeMapping( ufsStruct -> ufs, cloneId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+}
+static void test_ufs_resolve_storage_in_view_clones( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, cloneId, fileId, id;
+    ufsViewType view;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    /* The clone sees what it inherited.                                      */
+    view[ 0 ] = cloneId;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, cloneId );
+
+    /* The same view observes later changes.                                  */
+    status = ufsRemoveMapping( ufsStruct -> ufs, cloneId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, areaId );
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+
+    status = ufsAddMapping( ufsStruct -> ufs, cloneId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, cloneId );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+}
+
+static void test_ufs_resolve_storage_in_view_span( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areas[ 3 ], fileId, id;
+    ufsViewSpanType span;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areas[ 0 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areas[ 0 ] );
+
+    areas[ 1 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areas[ 1 ] );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areas[ 1 ], fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    span.areas = NULL;
+    span.count = 1;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    span.areas = areas;
+    span.count = UFS_VIEW_MAX_SIZE + 1;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_BAD_CALL );
+
+    /* Spans need no terminator, only count areas are looked at.              */
+    areas[ 2 ] = areas[ 0 ];
+    span.count = 2;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    assert_int_equal( id, areas[ 1 ] );
+
+    span.count = 1;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    span.count = 3;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_VIEW_CONTAINS_DUPLICATES );
+
+    areas[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_INVALID_AREA_IN_VIEW );
+
+    areas[ 2 ] = UFS_AREA_BASE_IDENTIFIER;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    assert_int_equal( id, areas[ 1 ] );
+
+    span.count = 0;
+    id = ufsResolveStorageInViewSpan( ufsStruct -> ufs, span, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+}
+
+static void test_ufs_resolve_many_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, cloneId, fileIds[ 512 ], storages[ 520 ];
+    ufsIdentifierType areas[ 520 ], id;
+    ufsStatusType statuses[ 520 ], status;
+    ufsViewType view;
+    char name[ 32 ];
+    int i;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    for ( i = 0; i < 512; i++ ) {
+        snprintf( name, sizeof( name ), "%d", i );
+        fileIds[ i ] = ufsAddFile( ufsStruct -> ufs,
+                UFS_STORAGE_ROOT_IDENTIFIER,
+                name );
+        ASSERT_UFS_NO_ERROR( fileIds[ i ] );
+
+        if ( i % 3 == 0 ) {
+            status = ufsAddMapping( ufsStruct -> ufs, areaId, fileIds[ i ] );
+            ASSERT_UFS_STATUS_NO_ERROR( status );
+        }
+    }
+
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    for ( i = 0; i < 512; i += 9 ) {
+        status = ufsRemoveMapping( ufsStruct -> ufs, cloneId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+
+    view[ 0 ] = cloneId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+
+    status = ufsResolveManyInView( NULL, view, storages, 1, areas, statuses );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsResolveManyInView( ufsStruct -> ufs, view, NULL, 1,
+                                   areas, statuses );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsResolveManyInView( ufsStruct -> ufs, view, NULL, 0,
+                                   NULL, NULL );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Out of order, with duplicates, gaps and storage that doesn't exist.    */
+    for ( i = 0; i < 512; i++ )
+        storages[ i ] = fileIds[ ( i * 7 ) % 512 ];
+    storages[ 512 ] = fileIds[ 5 ];
+    storages[ 513 ] = 0;
+    storages[ 514 ] = fileIds[ 511 ] + 1;
+    storages[ 515 ] = fileIds[ 511 ] + 100000;
+    storages[ 516 ] = fileIds[ 0 ];
+    storages[ 517 ] = -3;
+    storages[ 518 ] = fileIds[ 3 ];
+    storages[ 519 ] = fileIds[ 511 ];
+    status = ufsResolveManyInView( ufsStruct -> ufs, view, storages, 520,
+                                   areas, statuses );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    for ( i = 0; i < 520; i++ ) {
+        if ( storages[ i ] <= 0 ) {
+            assert_int_equal( statuses[ i ], UFS_BAD_CALL );
+            assert_int_equal( areas[ i ], -1 );
+            continue;
+        }
+
+        id = ufsResolveStorageInView( ufsStruct -> ufs, view, storages[ i ] );
+        assert_int_equal( areas[ i ], id );
+        assert_int_equal( statuses[ i ], ufsErrno );
+    }
+
+    assert_int_equal( statuses[ 514 ], UFS_DOES_NOT_EXIST );
+    assert_int_equal( statuses[ 516 ], UFS_CANNOT_RESOLVE_STORAGE );
+    assert_int_equal( areas[ 518 ], cloneId );
+    assert_int_equal( areas[ 512 ], UFS_AREA_BASE_IDENTIFIER );
+}
+/* ########################################################################## */
+
+/* ufsCollapse                                                                */
+static void test_ufs_collapse_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsViewType view = { UFS_AREA_BASE_IDENTIFIER, UFS_VIEW_TERMINATOR };
+    ufsIdentifierType areaId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsCollapse( NULL, view );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsCollapse( ufsStruct -> ufs, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS( status, UFS_BASE_IS_NOT_LAST_AREA );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = areaId;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS( status, UFS_VIEW_CONTAINS_DUPLICATES );
+
+    view[ 1 ] = areaId + 1;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS( status, UFS_INVALID_AREA_IN_VIEW );
+}
+
+static void test_ufs_collapse( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId0, areaId1, areaId2, cloneId, fileIds[ 4 ];
+    ufsViewType view;
+    ufsStatusType status;
+    char name[ 32 ];
+    int i;
+
+    ufsStruct = *state;
+
+    for ( i = 0; i < 4; i++ ) {
+        snprintf( name, sizeof( name ), "%d", i );
+        fileIds[ i ] = ufsAddFile( ufsStruct -> ufs,
+                UFS_STORAGE_ROOT_IDENTIFIER,
+                name );
+        ASSERT_UFS_NO_ERROR( fileIds[ i ] );
+    }
+
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    areaId1 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    areaId2 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_2 );
+    ASSERT_UFS_NO_ERROR( areaId2 );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileIds[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId1, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId2, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* A clone of the last area must not see what's collapsed into it.        */
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId2, TEST_AREA_NAME_3 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId2, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    view[ 0 ] = areaId0;
+    view[ 1 ] = areaId1;
+    view[ 2 ] = areaId2;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    for ( i = 0; i < 3; i++ ) {
+        status = ufsProbeMapping( ufsStruct -> ufs, areaId2, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId2, fileIds[ 3 ] );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, cloneId, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, cloneId, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* The collapsed areas are left as they were.                             */
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId0, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Removed mappings of a clone aren't collapsed, even if its source has   */
+    /* them.                                                                  */
+    status = ufsRemoveMapping( ufsStruct -> ufs, cloneId, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId1, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = cloneId;
+    view[ 1 ] = areaId1;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId1, fileIds[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+
+static void test_ufs_collapse_into_base( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, fileId, id;
+    ufsViewType view;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+}
+
+static void test_ufs_collapse_span( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areas[ 2 ], fileId;
+    ufsViewSpanType span;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areas[ 0 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areas[ 0 ] );
+
+    areas[ 1 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areas[ 1 ] );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areas[ 0 ], fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    span.areas = NULL;
+    span.count = 2;
+    status = ufsCollapseSpan( ufsStruct -> ufs, span );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    span.areas = areas;
+    status = ufsCollapseSpan( ufsStruct -> ufs, span );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areas[ 1 ], fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+/* ########################################################################## */
+
+/* ufsIterateDirInView                                                        */
+#define TEST_ITERATE_MAX_ENTRIES (16)
+
+struct testIterateStateStruct {
+    ufsIdentifierType entries[ TEST_ITERATE_MAX_ENTRIES ];
+    ufsIdentifierType areas[ TEST_ITERATE_MAX_ENTRIES ];
+    uint64_t numEntries;
+    uint64_t total;
+    uint64_t stopAt;                /* Stop after this many entries, 0 never. */
+};
+
+static ufsStatusType collectEntries( ufsIdentifierType storage,
+                                     uint64_t currEntry,
+                                     uint64_t numEntries,
+                                     void *userData )
+{
+    struct testIterateStateStruct *iterate;
+
+    iterate = userData;
+    assert_int_equal( currEntry, iterate -> numEntries );
+    assert_true( iterate -> numEntries < TEST_ITERATE_MAX_ENTRIES );
+    iterate -> total = numEntries;
+    iterate -> entries[ iterate -> numEntries++ ] = storage;
+    return iterate -> numEntries == iterate -> stopAt ? UFS_UNKNOWN_ERROR :
+                                                        UFS_NO_ERROR;
+}
+
+static ufsStatusType collectResolvedEntries( ufsIdentifierType storage,
+                                             ufsIdentifierType area,
+                                             uint64_t currEntry,
+                                             uint64_t numEntries,
+                                             void *userData )
+{
+    struct testIterateStateStruct *iterate;
+    ufsStatusType status;
+
+    iterate = userData;
+    status = collectEntries( storage, currEntry, numEntries, userData );
+    iterate -> areas[ iterate -> numEntries - 1 ] = area;
+    return status;
+}
+
+/* Creates a0, a1, a2 (a directory) and b0 in a new directory.                */
+static ufsIdentifierType createIterateTree( ufsType ufs,
+                                            ufsIdentifierType *ids )
+{
+    ufsIdentifierType dirId;
+
+    dirId = ufsAddDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                             TEST_DIRECTORY_NAME );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    ids[ 0 ] = ufsAddFile( ufs, dirId, "a0" );
+    ASSERT_UFS_NO_ERROR( ids[ 0 ] );
+
+    ids[ 1 ] = ufsAddFile( ufs, dirId, "a1" );
+    ASSERT_UFS_NO_ERROR( ids[ 1 ] );
+
+    ids[ 2 ] = ufsAddDirectory( ufs, dirId, "a2" );
+    ASSERT_UFS_NO_ERROR( ids[ 2 ] );
+
+    ids[ 3 ] = ufsAddFile( ufs, dirId, "b0" );
+    ASSERT_UFS_NO_ERROR( ids[ 3 ] );
+    return dirId;
+}
+
+static void test_ufs_iterate_dir_in_view_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testIterateStateStruct iterate = { 0 };
+    ufsViewType view = { UFS_AREA_BASE_IDENTIFIER, UFS_VIEW_TERMINATOR };
+    ufsIdentifierType fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    status = ufsIterateDirInView( NULL, view, UFS_STORAGE_ROOT_IDENTIFIER,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsIterateDirInView( ufsStruct -> ufs, NULL,
+                                  UFS_STORAGE_ROOT_IDENTIFIER,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, -1,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsIterateDirInView( ufsStruct -> ufs, view,
+                                  UFS_STORAGE_ROOT_IDENTIFIER,
+                                  NULL, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    fileId = ufsAddFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, fileId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, fileId + 1,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+    assert_int_equal( iterate.numEntries, 0 );
+}
+
+static void test_ufs_iterate_dir_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testIterateStateStruct iterate;
+    ufsIdentifierType areaId0, areaId1, dirId, ids[ 4 ];
+    ufsViewType view;
+    ufsStatusType status;
+    int i;
+
+    ufsStruct = *state;
+
+    dirId = createIterateTree( ufsStruct -> ufs, ids );
+    areaId0 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId0 );
+
+    areaId1 = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( areaId1 );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId0, ids[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* An area only has what's mapped in it.                                  */
+    view[ 0 ] = areaId0;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, dirId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 1 );
+    assert_int_equal( iterate.total, 1 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 1 ] );
+
+    view[ 0 ] = areaId1;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, dirId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 0 );
+
+    /* The union with BASE has everything, in the order of the names.         */
+    view[ 0 ] = areaId0;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, dirId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 4 );
+    assert_int_equal( iterate.total, 4 );
+    for ( i = 0; i < 4; i++ )
+        assert_int_equal( iterate.entries[ i ], ids[ i ] );
+
+    /* BASE alone doesn't have storage that is mapped elsewhere.              */
+    view[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 1 ] = UFS_VIEW_TERMINATOR;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, dirId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 3 );
+
+    /* An iterator error stops the iteration.                                 */
+    view[ 0 ] = areaId0;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    memset( &iterate, 0, sizeof( iterate ) );
+    iterate.stopAt = 2;
+    status = ufsIterateDirInView( ufsStruct -> ufs, view, dirId,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_UNKNOWN_ERROR );
+    assert_int_equal( iterate.numEntries, 2 );
+}
+
+static void test_ufs_iterate_filtered_dir_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testIterateStateStruct iterate;
+    ufsIdentifierType areas[ 1 ], dirId, ids[ 4 ];
+    ufsDirFilterType filter;
+    ufsViewSpanType span;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    dirId = createIterateTree( ufsStruct -> ufs, ids );
+    areas[ 0 ] = UFS_AREA_BASE_IDENTIFIER;
+    span.areas = areas;
+    span.count = 1;
+
+    memset( &filter, 0, sizeof( filter ) );
+    filter.types = UFS_DIR_FILTER_TYPE_DIRECTORY;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 1 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 2 ] );
+
+    /* Filtered out entries don't count towards the total.                    */
+    filter.types = UFS_DIR_FILTER_TYPE_FILE;
+    filter.prefix = "a";
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 2 );
+    assert_int_equal( iterate.total, 2 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 0 ] );
+    assert_int_equal( iterate.entries[ 1 ], ids[ 1 ] );
+
+    filter.types = 0;
+    filter.prefix = NULL;
+    filter.glob = "*0";
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 2 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 0 ] );
+    assert_int_equal( iterate.entries[ 1 ], ids[ 3 ] );
+
+    filter.prefix = "a";
+    filter.glob = "a[^1]";
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 2 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 0 ] );
+    assert_int_equal( iterate.entries[ 1 ], ids[ 2 ] );
+
+    /* A prefix that the glob can't start with matches nothing.               */
+    filter.prefix = "b";
+    filter.glob = "a*";
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 0 );
+
+    filter.prefix = "a0";
+    filter.glob = NULL;
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 1 );
+    assert_int_equal( iterate.entries[ 0 ], ids[ 0 ] );
+
+    filter.prefix = "c";
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateFilteredDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              &filter, collectEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 0 );
+}
+
+static void test_ufs_iterate_resolved_dir_in_view( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testIterateStateStruct iterate;
+    ufsIdentifierType areas[ 2 ], dirId, ids[ 4 ];
+    ufsViewSpanType span;
+    ufsStatusType status;
+    int i;
+
+    ufsStruct = *state;
+
+    dirId = createIterateTree( ufsStruct -> ufs, ids );
+    areas[ 0 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areas[ 0 ] );
+    areas[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    span.areas = areas;
+    span.count = 2;
+
+    status = ufsIterateResolvedDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              NULL, NULL, &iterate );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areas[ 0 ], ids[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areas[ 0 ], ids[ 3 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Every entry comes with the area it resolves to, those hidden by a      */
+    /* whiteout aren't counted.                                               */
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateResolvedDirInViewSpan( ufsStruct -> ufs, span, dirId,
+                                              NULL, collectResolvedEntries,
+                                              &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 3 );
+    assert_int_equal( iterate.total, 3 );
+    for ( i = 0; i < 3; i++ ) {
+        assert_int_equal( iterate.entries[ i ], ids[ i ] );
+        assert_int_equal( iterate.areas[ i ],
+                          i == 1 ? areas[ 0 ] : UFS_AREA_BASE_IDENTIFIER );
+    }
+}
+/* ########################################################################## */
+
+/* ufsPollChanges                                                             */
+static void test_ufs_poll_changes_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsChangeType changes[ 4 ];
+    ufsStatusType status;
+    uint64_t cursor;
+    size_t count;
+
+    ufsStruct = *state;
+
+    status = ufsSubscribeChanges( NULL, &cursor );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsSubscribeChanges( ufsStruct -> ufs, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    /* Nothing was subscribed to yet.                                         */
+    cursor = 0;
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsSubscribeChanges( ufsStruct -> ufs, &cursor );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( NULL, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsPollChanges( ufsStruct -> ufs, NULL, changes, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, NULL, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    cursor++;
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_poll_changes( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, fileId, areaId, cloneId;
+    ufsAttributesType attributes = { 0 };
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    ufsChangeType changes[ 16 ];
+    ufsStatusType status;
+    uint64_t cursor, other;
+    size_t count;
+
+    ufsStruct = *state;
+
+    /* Changes made before subscribing are not recorded.                      */
+    directoryId = ufsAddDirectory( ufsStruct -> ufs,
+                                   UFS_STORAGE_ROOT_IDENTIFIER,
+                                   TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( directoryId );
+
+    status = ufsSubscribeChanges( ufsStruct -> ufs, &cursor );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 16, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 0 );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, directoryId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Calls that fail change nothing.                                        */
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId,
+                             UFS_STORAGE_ROOT_IDENTIFIER, TEST_FILE_NAME_1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = cloneId;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveTree( ufsStruct -> ufs, directoryId, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* A second consumer starts from here.                                    */
+    status = ufsSubscribeChanges( ufsStruct -> ufs, &other );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 4 );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes + 4, 12,
+                             &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 5 );
+    assert_int_equal( cursor, other );
+
+    assert_int_equal( changes[ 0 ].type, UFS_CHANGE_ADD_STORAGE );
+    assert_int_equal( changes[ 0 ].storage, fileId );
+    assert_int_equal( changes[ 0 ].parent, directoryId );
+
+    assert_int_equal( changes[ 1 ].type, UFS_CHANGE_ADD_AREA );
+    assert_int_equal( changes[ 1 ].area, areaId );
+    assert_int_equal( changes[ 1 ].from, -1 );
+
+    assert_int_equal( changes[ 2 ].type, UFS_CHANGE_ADD_AREA );
+    assert_int_equal( changes[ 2 ].area, cloneId );
+    assert_int_equal( changes[ 2 ].from, areaId );
+
+    assert_int_equal( changes[ 3 ].type, UFS_CHANGE_ADD_MAPPING );
+    assert_int_equal( changes[ 3 ].area, areaId );
+    assert_int_equal( changes[ 3 ].storage, fileId );
+
+    assert_int_equal( changes[ 4 ].type, UFS_CHANGE_ATTRIBUTES );
+    assert_int_equal( changes[ 4 ].storage, fileId );
+
+    assert_int_equal( changes[ 5 ].type, UFS_CHANGE_MOVE_STORAGE );
+    assert_int_equal( changes[ 5 ].storage, fileId );
+    assert_int_equal( changes[ 5 ].parent, UFS_STORAGE_ROOT_IDENTIFIER );
+    assert_int_equal( changes[ 5 ].from, directoryId );
+
+    assert_int_equal( changes[ 6 ].type, UFS_CHANGE_REMOVE_MAPPING );
+    assert_int_equal( changes[ 6 ].area, areaId );
+    assert_int_equal( changes[ 6 ].storage, fileId );
+
+    assert_int_equal( changes[ 7 ].type, UFS_CHANGE_COLLAPSE );
+    assert_int_equal( changes[ 7 ].area, areaId );
+
+    assert_int_equal( changes[ 8 ].type, UFS_CHANGE_REMOVE_STORAGE );
+    assert_int_equal( changes[ 8 ].storage, directoryId );
+    assert_int_equal( changes[ 8 ].parent, UFS_STORAGE_ROOT_IDENTIFIER );
+
+    assert_int_equal( changes[ 8 ].sequence, changes[ 0 ].sequence + 8 );
+}
+
+static void test_ufs_poll_changes_removals( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, fileId, areaId;
+    ufsChangeType changes[ 4 ];
+    ufsStatusType status;
+    uint64_t cursor;
+    size_t count;
+
+    ufsStruct = *state;
+
+    directoryId = ufsAddDirectory( ufsStruct -> ufs,
+                                   UFS_STORAGE_ROOT_IDENTIFIER,
+                                   TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( directoryId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, directoryId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    status = ufsSubscribeChanges( ufsStruct -> ufs, &cursor );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Calls that fail change nothing.                                        */
+    status = ufsRemoveDirectory( ufsStruct -> ufs, directoryId );
+    ASSERT_UFS_STATUS( status, UFS_DIRECTORY_IS_NOT_EMPTY );
+
+    status = ufsRemoveFile( ufsStruct -> ufs, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveDirectory( ufsStruct -> ufs, directoryId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveArea( ufsStruct -> ufs, areaId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 3 );
+
+    assert_int_equal( changes[ 0 ].type, UFS_CHANGE_REMOVE_STORAGE );
+    assert_int_equal( changes[ 0 ].storage, fileId );
+    assert_int_equal( changes[ 0 ].parent, directoryId );
+
+    assert_int_equal( changes[ 1 ].type, UFS_CHANGE_REMOVE_STORAGE );
+    assert_int_equal( changes[ 1 ].storage, directoryId );
+    assert_int_equal( changes[ 1 ].parent, UFS_STORAGE_ROOT_IDENTIFIER );
+
+    assert_int_equal( changes[ 2 ].type, UFS_CHANGE_REMOVE_AREA );
+    assert_int_equal( changes[ 2 ].area, areaId );
+}
+
+static void test_ufs_poll_changes_overflow( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes = { 0 };
+    ufsChangeType changes[ 4 ];
+    ufsIdentifierType fileId;
+    ufsStatusType status;
+    uint64_t cursor, lagging;
+    size_t count, i;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                         TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsSubscribeChanges( ufsStruct -> ufs, &lagging );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Exactly a full ring is still delivered.                                */
+    for ( i = 0; i < UFS_CHANGE_FEED_SIZE; i++ ) {
+        status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+
+    cursor = lagging;
+    status = ufsPollChanges( ufsStruct -> ufs, &cursor, changes, 4, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 4 );
+    assert_int_equal( changes[ 0 ].sequence, lagging );
+
+    status = ufsSetAttributes( ufsStruct -> ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &lagging, changes, 4, &count );
+    ASSERT_UFS_STATUS( status, UFS_CHANGES_OVERFLOWED );
+    assert_int_equal( count, 0 );
+
+    /* The cursor was moved past the loss, the consumer can carry on.         */
+    status = ufsPollChanges( ufsStruct -> ufs, &lagging, changes, 4, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 0 );
+
+    status = ufsInvalidateAttributes( ufsStruct -> ufs, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsPollChanges( ufsStruct -> ufs, &lagging, changes, 4, &count );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( count, 1 );
+    assert_int_equal( changes[ 0 ].type, UFS_CHANGE_ATTRIBUTES );
+    assert_int_equal( changes[ 0 ].storage, fileId );
+}
+
+/* ########################################################################## */
+
+/* ufsGetDirectoryGeneration                                                  */
+static void test_ufs_get_directory_generation_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStatusType status;
+    uint64_t generation;
+
+    ufsStruct = *state;
+
+    status = ufsGetDirectoryGeneration( NULL, UFS_STORAGE_ROOT_IDENTIFIER,
+                                        &generation );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetDirectoryGeneration( ufsStruct -> ufs, -1, &generation );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetDirectoryGeneration( ufsStruct -> ufs,
+                                        UFS_STORAGE_ROOT_IDENTIFIER, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+/* Returns the generation of a directory, which must succeed.                 */
+static uint64_t getGeneration( ufsType ufs, ufsIdentifierType directory )
+{
+    ufsStatusType status;
+    uint64_t generation;
+
+    status = ufsGetDirectoryGeneration( ufs, directory, &generation );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    return generation;
+}
+
+static void test_ufs_get_directory_generation( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, otherId, fileId, areaId;
+    ufsAttributesType attributes = { 0 };
+    uint64_t root, directory, other;
+    ufsStatusType status;
+    ufsType ufs;
+
+    ufsStruct = *state;
+    ufs = ufsStruct -> ufs;
+
+    root = getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER );
+    directoryId = ufsAddDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                   TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( directoryId );
+    assert_true( getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER ) > root );
+
+    otherId = ufsAddDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                               TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( otherId );
+
+    directory = getGeneration( ufs, directoryId );
+    other = getGeneration( ufs, otherId );
+    fileId = ufsAddFile( ufs, directoryId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+    assert_int_equal( getGeneration( ufs, otherId ), other );
+
+    /* Mappings of children change what a directory lists, attributes don't.  */
+    areaId = ufsAddArea( ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    directory = getGeneration( ufs, directoryId );
+    status = ufsAddMapping( ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+
+    directory = getGeneration( ufs, directoryId );
+    status = ufsSetAttributes( ufs, fileId, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( getGeneration( ufs, directoryId ), directory );
+
+    status = ufsRemoveMapping( ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+
+    /* Moving changes both directories.                                       */
+    directory = getGeneration( ufs, directoryId );
+    other = getGeneration( ufs, otherId );
+    status = ufsMoveStorage( ufs, fileId, otherId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+    assert_true( getGeneration( ufs, otherId ) > other );
+
+    /* Removing a tree changes its parent and every directory in it.          */
+    status = ufsMoveStorage( ufs, otherId, directoryId, TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    root = getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER );
+    directory = getGeneration( ufs, directoryId );
+    other = getGeneration( ufs, otherId );
+    status = ufsRemoveTree( ufs, directoryId, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER ) > root );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+    assert_true( getGeneration( ufs, otherId ) > other );
+}
+
+static void test_ufs_get_directory_generation_remove( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, fileId;
+    uint64_t root, directory;
+    ufsStatusType status;
+    ufsType ufs;
+
+    ufsStruct = *state;
+    ufs = ufsStruct -> ufs;
+
+    directoryId = ufsAddDirectory( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                   TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( directoryId );
+
+    fileId = ufsAddFile( ufs, directoryId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    /* A removal that fails leaves every listing as it was.                   */
+    root = getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER );
+    directory = getGeneration( ufs, directoryId );
+    status = ufsRemoveDirectory( ufs, directoryId );
+    ASSERT_UFS_STATUS( status, UFS_DIRECTORY_IS_NOT_EMPTY );
+    assert_int_equal( getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER ), root );
+    assert_int_equal( getGeneration( ufs, directoryId ), directory );
+
+    /* Removing a child changes what its parent lists.                        */
+    status = ufsRemoveFile( ufs, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+    assert_int_equal( getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER ), root );
+
+    status = ufsRemoveDirectory( ufs, directoryId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, UFS_STORAGE_ROOT_IDENTIFIER ) > root );
+}
+
+static void test_ufs_get_directory_generation_base( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, fileId, id;
+    uint64_t directory;
+    ufsStatusType status;
+    ufsType ufs;
+
+    ufsStruct = *state;
+    ufs = ufsStruct -> ufs;
+
+    directoryId = ufsAddToBase( ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                TEST_DIRECTORY_NAME, UFS_STORAGE_TYPE_DIRECTORY,
+                                NULL );
+    ASSERT_UFS_NO_ERROR( directoryId );
+
+    directory = getGeneration( ufs, directoryId );
+    fileId = ufsAddToBase( ufs, directoryId, TEST_FILE_NAME_0,
+                           UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+
+    /* Adding what's already in BASE changes nothing.                         */
+    directory = getGeneration( ufs, directoryId );
+    id = ufsAddToBase( ufs, directoryId, TEST_FILE_NAME_0,
+                       UFS_STORAGE_TYPE_FILE, NULL );
+    assert_int_equal( id, fileId );
+    assert_int_equal( getGeneration( ufs, directoryId ), directory );
+
+    status = ufsRemoveFromBase( ufs, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_true( getGeneration( ufs, directoryId ) > directory );
+}
+
+/* ########################################################################## */
+
+/* ufsAddWhiteout                                                             */
+static void test_ufs_add_whiteout_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                         TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddWhiteout( NULL, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, UFS_AREA_BASE_IDENTIFIER,
+                             fileId );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId,
+                             UFS_STORAGE_ROOT_IDENTIFIER );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId + 1, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId + 1 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsRemoveWhiteout( NULL, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsRemoveWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsProbeWhiteout( NULL, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_add_whiteout( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, upperId, fileId, otherId, id;
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    struct testIterateStateStruct iterate;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    upperId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( upperId );
+
+    fileId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                           TEST_FILE_NAME_0, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    otherId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                            TEST_FILE_NAME_1, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( otherId );
+
+    /* Deleting BASE storage in an area is a single whiteout.                 */
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    status = ufsProbeWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeWhiteout( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    memset( &iterate, 0, sizeof( iterate ) );
+    status = ufsIterateDirInView( ufsStruct -> ufs, view,
+                                  UFS_STORAGE_ROOT_IDENTIFIER,
+                                  collectEntries, &iterate );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( iterate.numEntries, 1 );
+    assert_int_equal( iterate.entries[ 0 ], otherId );
+
+    /* An area before the whiteout that maps the storage still sees it.       */
+    status = ufsAddMapping( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = upperId;
+    view[ 1 ] = areaId;
+    view[ 2 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, upperId );
+
+    /* A whiteout replaces a mapping, and a mapping replaces a whiteout.      */
+    status = ufsAddWhiteout( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    status = ufsAddMapping( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeWhiteout( ufsStruct -> ufs, upperId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, upperId );
+
+    /* Removing the whiteout brings BASE back.                                */
+    status = ufsRemoveWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsRemoveWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+}
+
+static void test_ufs_add_whiteout_clones( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, cloneId, fileId, id;
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    fileId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                           TEST_FILE_NAME_0, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* A clone inherits the whiteout, and keeps it once the source drops it.  */
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    view[ 0 ] = cloneId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    status = ufsRemoveWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+
+    status = ufsRemoveWhiteout( ufsStruct -> ufs, cloneId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+
+    /* The source deleting it again doesn't reach the clone.                  */
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, UFS_AREA_BASE_IDENTIFIER );
+}
+
+static void test_ufs_add_whiteout_collapse( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType upperId, middleId, lastId, fileIds[ 4 ], id;
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    ufsStatusType status;
+    char name[ 32 ];
+    int i;
+
+    ufsStruct = *state;
+
+    upperId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( upperId );
+
+    middleId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( middleId );
+
+    lastId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_2 );
+    ASSERT_UFS_NO_ERROR( lastId );
+
+    for ( i = 0; i < 4; i++ ) {
+        snprintf( name, sizeof( name ), "%s%d", TEST_FILE_NAME, i );
+        fileIds[ i ] = ufsAddToBase( ufsStruct -> ufs,
+                                     UFS_STORAGE_ROOT_IDENTIFIER, name,
+                                     UFS_STORAGE_TYPE_FILE, NULL );
+        ASSERT_UFS_NO_ERROR( fileIds[ i ] );
+    }
+
+    /* Deleted above a mapping, deleted above a mapping of the last area,     */
+    /* mapped above a whiteout, and mapped above a whiteout of the last area. */
+    status = ufsAddWhiteout( ufsStruct -> ufs, upperId, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddMapping( ufsStruct -> ufs, middleId, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, upperId, fileIds[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddMapping( ufsStruct -> ufs, lastId, fileIds[ 1 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, upperId, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddWhiteout( ufsStruct -> ufs, middleId, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddMapping( ufsStruct -> ufs, upperId, fileIds[ 3 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddWhiteout( ufsStruct -> ufs, lastId, fileIds[ 3 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = upperId;
+    view[ 1 ] = middleId;
+    view[ 2 ] = lastId;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* The last area shows what the view showed, over BASE as well.           */
+    for ( i = 0; i < 2; i++ ) {
+        status = ufsProbeWhiteout( ufsStruct -> ufs, lastId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+
+        status = ufsProbeMapping( ufsStruct -> ufs, lastId, fileIds[ i ] );
+        ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+    }
+
+    for ( i = 2; i < 4; i++ ) {
+        status = ufsProbeMapping( ufsStruct -> ufs, lastId, fileIds[ i ] );
+        ASSERT_UFS_STATUS_NO_ERROR( status );
+    }
+
+    view[ 0 ] = lastId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    for ( i = 0; i < 4; i++ ) {
+        id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileIds[ i ] );
+        if ( i < 2 )
+            ASSERT_UFS_ERROR( id, UFS_CANNOT_RESOLVE_STORAGE );
+        else
+            assert_int_equal( id, lastId );
+    }
+
+    /* The areas that were collapsed keep their own whiteouts.                */
+    status = ufsProbeWhiteout( ufsStruct -> ufs, upperId, fileIds[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeWhiteout( ufsStruct -> ufs, middleId, fileIds[ 2 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+}
+
+/* ########################################################################## */
+
+/* ufsAddExtents                                                              */
+#define TEST_EXTENTS (8)
+
+static void test_ufs_add_extents_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, fileId;
+    uint8_t present[ TEST_EXTENTS ];
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    fileId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                         TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddExtents( NULL, areaId, fileId, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddExtents( ufsStruct -> ufs, UFS_AREA_BASE_IDENTIFIER,
+                            fileId, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, -1, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, INT64_MAX, 2 );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId + 1, fileId, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId + 1, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsGetExtents( NULL, areaId, fileId, 0, 1, present );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 0, 1, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 0, 1, present );
+    ASSERT_UFS_STATUS( status, UFS_MAPPING_DOES_NOT_EXIST );
+
+    status = ufsProbeExtents( NULL, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_add_extents( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, fileId, otherId, id;
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    uint8_t present[ TEST_EXTENTS ];
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    fileId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                           TEST_FILE_NAME_0, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    otherId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                            TEST_FILE_NAME_1, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( otherId );
+
+    /* Storage mapped without extents is contained, but holds none of them.   */
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 0, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = areaId;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    view[ 2 ] = UFS_VIEW_TERMINATOR;
+    id = ufsResolveStorageInView( ufsStruct -> ufs, view, fileId );
+    assert_int_equal( id, areaId );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 0,
+                            TEST_EXTENTS, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( memchr( present, 1, TEST_EXTENTS ), NULL );
+
+    /* Extents add up, and ranges can overlap.                                */
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 2, 2 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 3, 3 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 1, 6, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\0\1\1\1\1\0", 6 );
+
+    /* Storage held whole holds every extent, and takes no more.              */
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, otherId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, otherId, 0, 1 );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, areaId, otherId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, otherId, 0,
+                            TEST_EXTENTS, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( memchr( present, 0, TEST_EXTENTS ), NULL );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_ALREADY_EXISTS );
+
+    /* Extents go away with their mapping, a new mapping starts over.         */
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 0, 0 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 0,
+                            TEST_EXTENTS, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( memchr( present, 1, TEST_EXTENTS ), NULL );
+
+    /* And so do they with a whiteout that replaces it.                       */
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 0, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddWhiteout( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsAddMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_add_extents_clones( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType areaId, cloneId, fileId;
+    uint8_t present[ TEST_EXTENTS ];
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    areaId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( areaId );
+
+    fileId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                           TEST_FILE_NAME_0, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 0, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* A clone inherits the extents, and the two diverge from then on.        */
+    cloneId = ufsCloneArea( ufsStruct -> ufs, areaId, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( cloneId );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, cloneId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddExtents( ufsStruct -> ufs, areaId, fileId, 1, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsAddExtents( ufsStruct -> ufs, cloneId, fileId, 2, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetExtents( ufsStruct -> ufs, areaId, fileId, 0, 4, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\1\1\0\0", 4 );
+
+    status = ufsGetExtents( ufsStruct -> ufs, cloneId, fileId, 0, 4,
+                            present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\1\0\1\0", 4 );
+
+    /* The source dropping its mapping leaves the clone with its own.         */
+    status = ufsRemoveMapping( ufsStruct -> ufs, areaId, fileId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetExtents( ufsStruct -> ufs, cloneId, fileId, 0, 4,
+                            present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\1\0\1\0", 4 );
+}
+
+static void test_ufs_collapse_extents( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType upperId, middleId, lastId, fileId, otherId, wholeId;
+    ufsViewType view = { UFS_VIEW_TERMINATOR };
+    uint8_t present[ TEST_EXTENTS ];
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    upperId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( upperId );
+    middleId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( middleId );
+    lastId = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_2 );
+    ASSERT_UFS_NO_ERROR( lastId );
+
+    fileId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                           TEST_FILE_NAME_0, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( fileId );
+    otherId = ufsAddToBase( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                            TEST_FILE_NAME_1, UFS_STORAGE_TYPE_FILE, NULL );
+    ASSERT_UFS_NO_ERROR( otherId );
+    wholeId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                          TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( wholeId );
+
+    /* fileId falls through every area, so the last one holds the union.      */
+    status = ufsAddExtents( ufsStruct -> ufs, upperId, fileId, 0, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddExtents( ufsStruct -> ufs, middleId, fileId, 2, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddExtents( ufsStruct -> ufs, lastId, fileId, 4, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* otherId is held whole in the middle, which hides what's below it.      */
+    status = ufsAddExtents( ufsStruct -> ufs, upperId, otherId, 1, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddMapping( ufsStruct -> ufs, middleId, otherId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddExtents( ufsStruct -> ufs, lastId, otherId, 3, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* wholeId is held by extents only in the last area, below a whole one.   */
+    status = ufsAddMapping( ufsStruct -> ufs, upperId, wholeId );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsAddExtents( ufsStruct -> ufs, lastId, wholeId, 0, 1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    view[ 0 ] = upperId;
+    view[ 1 ] = middleId;
+    view[ 2 ] = lastId;
+    view[ 3 ] = UFS_VIEW_TERMINATOR;
+    status = ufsCollapse( ufsStruct -> ufs, view );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetExtents( ufsStruct -> ufs, lastId, fileId, 0, 6, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\1\0\1\0\1\0", 6 );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, lastId, otherId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    status = ufsProbeExtents( ufsStruct -> ufs, lastId, wholeId );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+
+    /* The collapsed areas are left as they are.                              */
+    status = ufsGetExtents( ufsStruct -> ufs, upperId, fileId, 0, 2,
+                            present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_memory_equal( present, "\1\0", 2 );
+}
+
+/* ########################################################################## */
+
+/* ufsGetStorage                                                              */
+static void test_ufs_get_storage_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStorageInfoType info;
+    ufsIdentifierType fileId;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    fileId = ufsAddFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                         TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsGetStorage( NULL, fileId, &info );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetStorage( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                            &info );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetStorage( ufsStruct -> ufs, fileId, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetStorage( ufsStruct -> ufs, fileId + 1, &info );
+    ASSERT_UFS_STATUS( status, UFS_DOES_NOT_EXIST );
+}
+
+static void test_ufs_get_storage( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType directoryId, fileId;
+    ufsStorageInfoType info;
+    ufsStatusType status;
+
+    ufsStruct = *state;
+
+    directoryId = ufsAddDirectory( ufsStruct -> ufs,
+                                   UFS_STORAGE_ROOT_IDENTIFIER,
+                                   TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( directoryId );
+    fileId = ufsAddFile( ufsStruct -> ufs, directoryId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( fileId );
+
+    status = ufsGetStorage( ufsStruct -> ufs, directoryId, &info );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( info.parent, UFS_STORAGE_ROOT_IDENTIFIER );
+    assert_int_equal( info.type, UFS_STORAGE_TYPE_DIRECTORY );
+    assert_string_equal( info.name, TEST_DIRECTORY_NAME_0 );
+
+    status = ufsGetStorage( ufsStruct -> ufs, fileId, &info );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( info.parent, directoryId );
+    assert_int_equal( info.type, UFS_STORAGE_TYPE_FILE );
+    assert_string_equal( info.name, TEST_FILE_NAME_0 );
+
+    /* Moving storage is seen right away.                                     */
+    status = ufsMoveStorage( ufsStruct -> ufs, fileId,
+                             UFS_STORAGE_ROOT_IDENTIFIER, TEST_FILE_NAME_1 );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetStorage( ufsStruct -> ufs, fileId, &info );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( info.parent, UFS_STORAGE_ROOT_IDENTIFIER );
+    assert_string_equal( info.name, TEST_FILE_NAME_1 );
+}
+
+static void test_ufs_get_many_storage_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsStorageInfoType info[ 1 ];
+    ufsIdentifierType storages[ 1 ];
+    ufsStatusType status, statusOut[ 1 ];
+
+    ufsStruct = *state;
+    storages[ 0 ] = UFS_STORAGE_ROOT_IDENTIFIER;
+
+    status = ufsGetManyStorage( NULL, storages, 1, info, statusOut );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetManyStorage( ufsStruct -> ufs, NULL, 1, info, statusOut );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetManyStorage( ufsStruct -> ufs, storages, 1, NULL,
+                                statusOut );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+
+    status = ufsGetManyStorage( ufsStruct -> ufs, storages, 1, info, NULL );
+    ASSERT_UFS_STATUS( status, UFS_BAD_CALL );
+}
+
+static void test_ufs_get_many_storage( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType storages[ 4 ];
+    ufsStatusType status, statusOut[ 4 ];
+    ufsStorageInfoType info[ 4 ];
+
+    ufsStruct = *state;
+
+    storages[ 0 ] = ufsAddDirectory( ufsStruct -> ufs,
+                                     UFS_STORAGE_ROOT_IDENTIFIER,
+                                     TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( storages[ 0 ] );
+    storages[ 1 ] = ufsAddFile( ufsStruct -> ufs, storages[ 0 ],
+                                TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( storages[ 1 ] );
+    storages[ 2 ] = storages[ 1 ] + 1;
+    storages[ 3 ] = UFS_STORAGE_ROOT_IDENTIFIER;
+
+    /* A missing or bad storage only fails its own entry.                     */
+    status = ufsGetManyStorage( ufsStruct -> ufs, storages, 4, info,
+                                statusOut );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( statusOut[ 0 ], UFS_NO_ERROR );
+    assert_int_equal( info[ 0 ].parent, UFS_STORAGE_ROOT_IDENTIFIER );
+    assert_int_equal( info[ 0 ].type, UFS_STORAGE_TYPE_DIRECTORY );
+    assert_string_equal( info[ 0 ].name, TEST_DIRECTORY_NAME_0 );
+    assert_int_equal( statusOut[ 1 ], UFS_NO_ERROR );
+    assert_int_equal( info[ 1 ].parent, storages[ 0 ] );
+    assert_int_equal( info[ 1 ].type, UFS_STORAGE_TYPE_FILE );
+    assert_string_equal( info[ 1 ].name, TEST_FILE_NAME_0 );
+    assert_int_equal( statusOut[ 2 ], UFS_DOES_NOT_EXIST );
+    assert_int_equal( statusOut[ 3 ], UFS_BAD_CALL );
+
+    /* Queries made after a batch are not affected by it.                     */
+    status = ufsGetStorage( ufsStruct -> ufs, storages[ 1 ], &info[ 0 ] );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_string_equal( info[ 0 ].name, TEST_FILE_NAME_0 );
+}
+
+/* ########################################################################## */
+
+static const struct CMUnitTest ufs_test_suite[] = {
+
+    cmocka_unit_test( test_ufs_init ),
+
+    /* ufsAddDirectory tests.                                                 */
+    cmocka_unit_test_setup_teardown( test_ufs_add_directory_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_directory_duplicate, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_directory_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsAddFile tests.                                                      */
+    cmocka_unit_test_setup_teardown( test_ufs_add_file_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_file, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_file_duplicate, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_file_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_file_same_name_different_directory, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsAddArea tests.                                                      */
+    cmocka_unit_test_setup_teardown( test_ufs_add_area_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_area, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_area_duplicate, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_area_illegal_name, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsAddMapping tests.                                                   */
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_file, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_duplicate, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_area_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_mapping_file_does_not_exist, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsGetDirectory tests.                                                 */
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_does_not_exist, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsGetFile tests.                                                      */
+    cmocka_unit_test_setup_teardown( test_ufs_get_file_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_file, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_file_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_file_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_file_exists_in_different_directory, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsGetArea tests.                                                      */
+    cmocka_unit_test_setup_teardown( test_ufs_get_area_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_area, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_area_does_not_exist, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsProbeMapping                                                        */
+    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_area_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_file_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_probe_mapping_mapping_does_not_exist, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsRemoveDirectory                                                     */
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_contains_file, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_exists_in_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_double_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_remove_then_add, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_directory_remove_then_get, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsRemoveFile                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_exists_in_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_double_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_remove_then_add, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_file_remove_then_get, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsRemoveArea                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_exists_in_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_double_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_remove_then_add, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_remove_then_get, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_has_clones, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_area_in_view, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsRemoveMapping                                                       */
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_no_side_effects, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_double_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_remove_then_add, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_mapping_remove_then_probe, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsRemoveTree                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_exists_in_mapping, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_with_mappings, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_double_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_remove_then_get, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_remove_tree_ids_not_reused, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsMoveStorage                                                         */
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage_parent_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_move_storage_already_exists, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufs attribute tests                                                    */
+    cmocka_unit_test_setup_teardown( test_ufs_set_attributes_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_set_attributes, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_set_attributes_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_set_attributes_generation, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_many_attributes, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_invalidate_attributes, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsCloneArea                                                           */
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area_diverge, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area_of_clone, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_clone_area_duplicate, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsSaveImage / ufsInitFromImage                                        */
+    cmocka_unit_test_setup_teardown( test_ufs_image_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test( test_ufs_image_does_not_exist ),
+    cmocka_unit_test( test_ufs_image_not_an_image ),
+    cmocka_unit_test_setup_teardown( test_ufs_image_round_trip, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_image_copy_on_write, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test( test_ufs_image_out_of_room ),
+    cmocka_unit_test_setup_teardown( test_ufs_reader_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_reader_follows_instance, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_reader_of_image, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsImportBase                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_does_not_exist, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_merge, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_into_directory, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_sync, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_import_base_unreadable, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_to_base_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_to_base, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsResolveStorageInView                                                */
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view_invalid_view, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view_many_mappings, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view_clones, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_storage_in_view_span, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_resolve_many_in_view, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsCollapse                                                            */
+    cmocka_unit_test_setup_teardown( test_ufs_collapse_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_collapse, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_collapse_into_base, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_collapse_span, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsIterateDirInView                                                    */
+    cmocka_unit_test_setup_teardown( test_ufs_iterate_dir_in_view_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_iterate_dir_in_view, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_iterate_filtered_dir_in_view, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_iterate_resolved_dir_in_view, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsPollChanges                                                         */
+    cmocka_unit_test_setup_teardown( test_ufs_poll_changes_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_poll_changes, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_poll_changes_removals, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_poll_changes_overflow, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsGetDirectoryGeneration                                              */
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_generation_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_generation, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_generation_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_directory_generation_base, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsAddWhiteout                                                         */
+    cmocka_unit_test_setup_teardown( test_ufs_add_whiteout_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_whiteout, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_whiteout_clones, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_whiteout_collapse, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsAddExtents                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_add_extents_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_extents, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_add_extents_clones, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_collapse_extents, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+
+    /* ufsGetStorage                                                          */
+    cmocka_unit_test_setup_teardown( test_ufs_get_storage_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_storage, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_many_storage_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_get_many_storage, ufsGetInstance, ufsCleanup ),
     /* ====================================================================== */
 };
 
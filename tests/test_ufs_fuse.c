@@ -0,0 +1,1089 @@
+/******************************************************************************\
+*  test_ufs_fuse.c                                                             *
+*                                                                              *
+*  Test suite for serving a view over FUSE.                                    *
+*  Every test mounts a view of a fresh tree and goes through the kernel, tests *
+*  are skipped if mounting is not permitted.                                   *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+
+#define UFS_TESTING
+
+#ifndef UFS_TEST_DISABLE
+
+#define _GNU_SOURCE
+
+#include <memory.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include "ufs_core.h"
+#include "ufs_fuse.h"
+#include "utils.h"
+
+#include <cmocka.h>
+
+#define TEST_AREA_NAME_0 ("testArea0")
+#define TEST_AREA_NAME_1 ("testArea1")
+#define TEST_DIRECTORY_NAME_0 ("testDirectory0")
+#define TEST_DIRECTORY_NAME_1 ("testDirectory1")
+#define TEST_FILE_NAME_0 ("testFile0")
+#define TEST_FILE_NAME_1 ("testFile1")
+#define TEST_CONTENTS_0 ("contents0")
+#define TEST_CONTENTS_1 ("contents1")
+#define TEST_CONTENTS_2 ("longerContents2")
+#define TEST_FUSE_TEMPLATE ("/tmp/ufsTestFuseXXXXXX")
+#define TEST_FUSE_CLIENTS (8)
+#define TEST_FUSE_FILES (16)
+#define TEST_FUSE_WRITES (256)
+#define TEST_FUSE_EXTENT (1024 * 1024)
+#define TEST_FUSE_EXTENTS (9)
+#define TEST_FUSE_COPIED_EXTENTS (32)
+#define TEST_FUSE_TAIL (4096)
+
+struct testMountStruct {
+    char root[ 64 ];
+    char mountpoint[ 128 ];
+    int baseFd;
+    int upperFd;
+    ufsIdentifierType area;
+    ufsIdentifierType view[ 2 ];
+    uint32_t flags;
+    ufsFuseType fuse;
+    pthread_t thread;
+};
+
+static int removeEntry( const char *path,
+                        const struct stat *st,
+                        int type,
+                        struct FTW *ftw )
+{
+    (void) st;
+    (void) type;
+    (void) ftw;
+
+    return remove( path );
+}
+
+static void createFile( int fd, const char *path, const char *contents )
+{
+    int fileFd;
+
+    fileFd = openat( fd, path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    assert_true( fileFd >= 0 );
+    if ( contents )
+        assert_int_equal( write( fileFd, contents, strlen( contents ) ),
+                          strlen( contents ) );
+    close( fileFd );
+}
+
+static void assertContents( int fd, const char *path, const char *contents )
+{
+    char buffer[ 64 ] = { 0 };
+    int fileFd;
+
+    fileFd = openat( fd, path, O_RDONLY );
+    assert_true( fileFd >= 0 );
+    assert_int_equal( read( fileFd, buffer, sizeof( buffer ) - 1 ),
+                      strlen( contents ) );
+    assert_string_equal( buffer, contents );
+    close( fileFd );
+}
+
+static int countEntries( const char *path )
+{
+    struct dirent *entry;
+    DIR *dir;
+    int count;
+
+    dir = opendir( path );
+    assert_non_null( dir );
+    count = 0;
+    while ( ( entry = readdir( dir ) ) ) {
+        if ( strcmp( entry -> d_name, "." ) && strcmp( entry -> d_name, ".." ) )
+            count++;
+    }
+
+    closedir( dir );
+    return count;
+}
+
+/* Clients don't use cmocka from their threads, they count what went wrong.   */
+struct testClientStruct {
+    pthread_t thread;
+    const char *mountpoint;
+    int index;
+    int failures;
+};
+
+static int readAll( const char *path, char *buffer, size_t size )
+{
+    ssize_t readBytes;
+    int fd;
+
+    fd = open( path, O_RDONLY );
+    if ( fd < 0 )
+        return -1;
+
+    readBytes = read( fd, buffer, size - 1 );
+    close( fd );
+    if ( readBytes < 0 )
+        return -1;
+
+    buffer[ readBytes ] = '\0';
+    return 0;
+}
+
+/* Every client creates a file of its own and reads all of BASE, so lookups,  */
+/* creations and reads of all clients are interleaved.                        */
+static void *runClient( void *data )
+{
+    struct testClientStruct *client;
+    char path[ 256 ], buffer[ 64 ];
+    struct stat st;
+    int i, round, fd;
+
+    client = data;
+    snprintf( path, sizeof( path ), "%s/client%d", client -> mountpoint,
+              client -> index );
+    fd = open( path, O_WRONLY | O_CREAT | O_EXCL, 0644 );
+    if ( fd < 0 || write( fd, TEST_CONTENTS_1, strlen( TEST_CONTENTS_1 ) ) !=
+                   ( ssize_t )strlen( TEST_CONTENTS_1 ) )
+        client -> failures++;
+    if ( fd >= 0 )
+        close( fd );
+
+    for ( round = 0; round < 8; round++ ) {
+        for ( i = 0; i < TEST_FUSE_FILES; i++ ) {
+            snprintf( path, sizeof( path ), "%s/file%d", client -> mountpoint,
+                      i );
+            if ( stat( path, &st ) || st.st_size != strlen( TEST_CONTENTS_0 ) ||
+                 readAll( path, buffer, sizeof( buffer ) ) ||
+                 strcmp( buffer, TEST_CONTENTS_0 ) )
+                client -> failures++;
+        }
+    }
+
+    snprintf( path, sizeof( path ), "%s/client%d", client -> mountpoint,
+              client -> index );
+    if ( readAll( path, buffer, sizeof( buffer ) ) ||
+         strcmp( buffer, TEST_CONTENTS_1 ) )
+        client -> failures++;
+
+    return NULL;
+}
+
+/* What an update changes, and the storage it changes.                        */
+struct testUpdateStruct {
+    ufsIdentifierType area;
+    ufsIdentifierType storage;
+    uint64_t size;
+    uint8_t present[ TEST_FUSE_EXTENTS ];
+};
+
+static ufsStatusType setSize( ufsType ufs, void *userData )
+{
+    ufsAttributesType attributes;
+    struct testUpdateStruct *update;
+    ufsStatusType status;
+
+    update = userData;
+    status = ufsGetAttributes( ufs, update -> storage, &attributes );
+    if ( status != UFS_NO_ERROR )
+        return status;
+
+    attributes.size = update -> size;
+    return ufsSetAttributes( ufs, update -> storage, &attributes );
+}
+
+static ufsStatusType getExtents( ufsType ufs, void *userData )
+{
+    struct testUpdateStruct *update;
+
+    update = userData;
+    return ufsGetExtents( ufs, update -> area, update -> storage, 0,
+                          TEST_FUSE_EXTENTS, update -> present );
+}
+
+static ufsStatusType hideStorage( ufsType ufs, void *userData )
+{
+    struct testUpdateStruct *update;
+
+    update = userData;
+    return ufsAddWhiteout( ufs, update -> area, update -> storage );
+}
+
+static void *serve( void *data )
+{
+    ufsFuseLoop( data );
+    return NULL;
+}
+
+/* Creates base, upper and the mountpoint under a fresh root. base is filled  */
+/* before it's imported, by the caller.                                       */
+static void createTree( struct testMountStruct *mount )
+{
+    char path[ 128 ];
+
+    mount -> flags = 0;
+    strcpy( mount -> root, TEST_FUSE_TEMPLATE );
+    assert_non_null( mkdtemp( mount -> root ) );
+
+    snprintf( path, sizeof( path ), "%s/base", mount -> root );
+    assert_int_equal( mkdir( path, 0755 ), 0 );
+    mount -> baseFd = open( path, O_RDONLY | O_DIRECTORY );
+    assert_true( mount -> baseFd >= 0 );
+
+    snprintf( path, sizeof( path ), "%s/upper", mount -> root );
+    assert_int_equal( mkdir( path, 0755 ), 0 );
+    mount -> upperFd = open( path, O_RDONLY | O_DIRECTORY );
+    assert_true( mount -> upperFd >= 0 );
+
+    snprintf( mount -> mountpoint, sizeof( mount -> mountpoint ), "%s/mnt",
+              mount -> root );
+    assert_int_equal( mkdir( mount -> mountpoint, 0755 ), 0 );
+}
+
+static void removeTree( struct testMountStruct *mount )
+{
+    close( mount -> baseFd );
+    close( mount -> upperFd );
+    nftw( mount -> root, removeEntry, 16, FTW_DEPTH | FTW_PHYS );
+}
+
+static void startMount( ufsType ufs, struct testMountStruct *mount )
+{
+    ufsImportOptionsType importOptions = { 0 };
+    ufsFuseOptionsType options = { 0 };
+    char *argv[] = { "test_ufs_fuse" };
+    ufsStatusType status;
+
+    importOptions.flags = UFS_IMPORT_FLAG_ATTRIBUTES;
+    status = ufsImportBase( ufs, mount -> baseFd, &importOptions );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    mount -> area = ufsAddArea( ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( mount -> area );
+    mount -> view[ 0 ] = mount -> area;
+    mount -> view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+
+    options.baseFd = mount -> baseFd;
+    options.upperFd = mount -> upperFd;
+    options.view.areas = mount -> view;
+    options.view.count = 2;
+    options.flags = mount -> flags;
+    mount -> fuse = ufsFuseInit( ufs, &options, 1, argv );
+    assert_non_null( mount -> fuse );
+
+    if ( ufsFuseMount( mount -> fuse, mount -> mountpoint ) != UFS_NO_ERROR ) {
+        ufsFuseDestroy( mount -> fuse );
+        removeTree( mount );
+        skip();
+    }
+
+    assert_int_equal( pthread_create( &mount -> thread, NULL, serve,
+                                      mount -> fuse ), 0 );
+}
+
+static void stopMount( struct testMountStruct *mount )
+{
+    /* The loop returns once the kernel drops the connection.                 */
+    assert_int_equal( umount2( mount -> mountpoint, 0 ), 0 );
+    pthread_join( mount -> thread, NULL );
+    ufsFuseDestroy( mount -> fuse );
+    removeTree( mount );
+}
+
+static void test_ufs_fuse_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsFuseOptionsType options = { 0 };
+    ufsIdentifierType view[ 2 ];
+    ufsFuseType fuse;
+
+    ufsStruct = *state;
+
+    view[ 0 ] = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_0 );
+    ASSERT_UFS_NO_ERROR( view[ 0 ] );
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    options.view.areas = view;
+    options.view.count = 2;
+
+    fuse = ufsFuseInit( NULL, &options, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    fuse = ufsFuseInit( ufsStruct -> ufs, NULL, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    fuse = ufsFuseInit( ufsStruct -> ufs, &options, 1, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    /* Writes need an area, and the view must end with BASE.                  */
+    options.view.areas = view + 1;
+    options.view.count = 1;
+    fuse = ufsFuseInit( ufsStruct -> ufs, &options, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    options.view.areas = view;
+    options.view.count = 1;
+    fuse = ufsFuseInit( ufsStruct -> ufs, &options, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    options.baseFd = -1;
+    options.view.count = 2;
+    fuse = ufsFuseInit( ufsStruct -> ufs, &options, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    options.baseFd = 0;
+    options.flags = ~UFS_FUSE_FLAGS;
+    fuse = ufsFuseInit( ufsStruct -> ufs, &options, 0, NULL );
+    assert_null( fuse );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    assert_int_equal( ufsFuseMount( NULL, "/" ), UFS_BAD_CALL );
+    assert_int_equal( ufsFuseLoop( NULL ), UFS_BAD_CALL );
+    ufsFuseDestroy( NULL );
+}
+
+static void test_ufs_fuse_read( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsIdentifierType id;
+    char path[ 256 ];
+    struct stat st;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    assert_int_equal( mkdirat( mount.baseFd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_0,
+              TEST_FILE_NAME_1 );
+    createFile( mount.baseFd, path, TEST_CONTENTS_1 );
+    startMount( ufsStruct -> ufs, &mount );
+
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    assertContents( fd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    assertContents( fd, path, TEST_CONTENTS_1 );
+
+    /* Inode numbers are the identifiers of storage.                          */
+    id = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                     TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), 0 );
+    assert_int_equal( st.st_ino, id + 1 );
+    assert_int_equal( st.st_size, strlen( TEST_CONTENTS_0 ) );
+    assert_true( S_ISREG( st.st_mode ) );
+
+    assert_int_equal( fstatat( fd, TEST_DIRECTORY_NAME_0, &st, 0 ), 0 );
+    assert_true( S_ISDIR( st.st_mode ) );
+
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_1, &st, 0 ), -1 );
+    assert_int_equal( errno, ENOENT );
+
+    assert_int_equal( countEntries( mount.mountpoint ), 2 );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_write( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsIdentifierType id, dirId;
+    ufsStatusType status;
+    char path[ 256 ];
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    startMount( ufsStruct -> ufs, &mount );
+
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+
+    /* Writing to BASE storage copies it into the area first.                 */
+    createFile( fd, TEST_FILE_NAME_0, TEST_CONTENTS_1 );
+    assertContents( fd, TEST_FILE_NAME_0, TEST_CONTENTS_1 );
+    assertContents( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+
+    id = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                     TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+    status = ufsProbeMapping( ufsStruct -> ufs, mount.area, id );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* New storage only exists in the area.                                   */
+    assert_int_equal( mkdirat( fd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_0,
+              TEST_FILE_NAME_1 );
+    createFile( fd, path, TEST_CONTENTS_0 );
+    assertContents( fd, path, TEST_CONTENTS_0 );
+    assert_int_equal( countEntries( mount.mountpoint ), 2 );
+    assert_int_equal( faccessat( mount.baseFd, TEST_DIRECTORY_NAME_0, F_OK,
+                                 0 ), -1 );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                             TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId );
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+    status = ufsProbeMapping( ufsStruct -> ufs, mount.area, id );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_remove( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsIdentifierType id;
+    ufsStatusType status;
+    char path[ 256 ];
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    assert_int_equal( mkdirat( mount.baseFd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_0,
+              TEST_FILE_NAME_1 );
+    createFile( mount.baseFd, path, TEST_CONTENTS_1 );
+    startMount( ufsStruct -> ufs, &mount );
+
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+
+    /* Removing BASE storage leaves a whiteout, BASE itself is untouched.     */
+    assert_int_equal( unlinkat( fd, TEST_FILE_NAME_0, 0 ), 0 );
+    assert_int_equal( faccessat( fd, TEST_FILE_NAME_0, F_OK, 0 ), -1 );
+    assert_int_equal( errno, ENOENT );
+    assertContents( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+
+    id = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                     TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+    status = ufsProbeWhiteout( ufsStruct -> ufs, mount.area, id );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Created again, it's new content in the area.                           */
+    createFile( fd, TEST_FILE_NAME_0, TEST_CONTENTS_1 );
+    assertContents( fd, TEST_FILE_NAME_0, TEST_CONTENTS_1 );
+
+    assert_int_equal( unlinkat( fd, TEST_DIRECTORY_NAME_0, AT_REMOVEDIR ), -1 );
+    assert_int_equal( errno, ENOTEMPTY );
+    assert_int_equal( unlinkat( fd, path, 0 ), 0 );
+    assert_int_equal( unlinkat( fd, TEST_DIRECTORY_NAME_0, AT_REMOVEDIR ), 0 );
+    assert_int_equal( countEntries( mount.mountpoint ), 1 );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_parallel( void **state )
+{
+    struct testClientStruct clients[ TEST_FUSE_CLIENTS ];
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    char name[ 64 ];
+    int i;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    for ( i = 0; i < TEST_FUSE_FILES; i++ ) {
+        snprintf( name, sizeof( name ), "file%d", i );
+        createFile( mount.baseFd, name, TEST_CONTENTS_0 );
+    }
+    startMount( ufsStruct -> ufs, &mount );
+
+    for ( i = 0; i < TEST_FUSE_CLIENTS; i++ ) {
+        clients[ i ].mountpoint = mount.mountpoint;
+        clients[ i ].index = i;
+        clients[ i ].failures = 0;
+        assert_int_equal( pthread_create( &clients[ i ].thread, NULL,
+                                          runClient, &clients[ i ] ), 0 );
+    }
+
+    for ( i = 0; i < TEST_FUSE_CLIENTS; i++ ) {
+        pthread_join( clients[ i ].thread, NULL );
+        assert_int_equal( clients[ i ].failures, 0 );
+    }
+
+    assert_int_equal( countEntries( mount.mountpoint ),
+                      TEST_FUSE_FILES + TEST_FUSE_CLIENTS );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_invalidate( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testUpdateStruct update;
+    struct testMountStruct mount;
+    ufsIdentifierType view[ 2 ];
+    ufsViewSpanType span;
+    ufsStatusType status;
+    struct stat st;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    createFile( mount.baseFd, TEST_FILE_NAME_1, TEST_CONTENTS_1 );
+    startMount( ufsStruct -> ufs, &mount );
+
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), 0 );
+    assert_int_equal( st.st_size, strlen( TEST_CONTENTS_0 ) );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_1, &st, 0 ), 0 );
+
+    /* Attributes are cached for long, a change through ufs drops them.       */
+    update.storage = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                 TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( update.storage );
+    update.size = 1234;
+    status = ufsFuseUpdate( mount.fuse, setSize, &update );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), 0 );
+    assert_int_equal( st.st_size, 1234 );
+
+    /* So are entries.                                                        */
+    update.area = mount.area;
+    status = ufsFuseUpdate( mount.fuse, hideStorage, &update );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), -1 );
+    assert_int_equal( errno, ENOENT );
+
+    /* Writes through the mount are seen right away.                          */
+    createFile( fd, TEST_FILE_NAME_0, TEST_CONTENTS_2 );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), 0 );
+    assert_int_equal( st.st_size, strlen( TEST_CONTENTS_2 ) );
+
+    /* Hiding storage in an area that isn't in the view changes nothing,      */
+    /* until the view is switched to it.                                      */
+    update.area = ufsAddArea( ufsStruct -> ufs, TEST_AREA_NAME_1 );
+    ASSERT_UFS_NO_ERROR( update.area );
+    update.storage = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                 TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( update.storage );
+    status = ufsFuseUpdate( mount.fuse, hideStorage, &update );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_1, &st, 0 ), 0 );
+
+    view[ 0 ] = update.area;
+    view[ 1 ] = UFS_AREA_BASE_IDENTIFIER;
+    span.areas = view;
+    span.count = 2;
+    status = ufsFuseSetView( mount.fuse, span );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_1, &st, 0 ), -1 );
+    assert_int_equal( errno, ENOENT );
+    /* The file written in the first area is BASE's again, as is its record.  */
+    assert_int_equal( fstatat( fd, TEST_FILE_NAME_0, &st, 0 ), 0 );
+    assert_int_equal( st.st_size, 1234 );
+
+    span.count = 1;
+    assert_int_equal( ufsFuseSetView( mount.fuse, span ), UFS_BAD_CALL );
+    assert_int_equal( ufsFuseUpdate( mount.fuse, NULL, NULL ), UFS_BAD_CALL );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_readdirplus( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsFuseStatsType before, after;
+    struct dirent *entry;
+    char name[ 64 ];
+    struct stat st;
+    DIR *dir;
+    int i, count;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    for ( i = 0; i < TEST_FUSE_FILES; i++ ) {
+        snprintf( name, sizeof( name ), "file%d", i );
+        createFile( mount.baseFd, name, i % 2 ? TEST_CONTENTS_2 :
+                                                TEST_CONTENTS_0 );
+    }
+    assert_int_equal( mkdirat( mount.baseFd, TEST_DIRECTORY_NAME_0, 0755 ),
+                      0 );
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* Listing describes every entry, stating them reaches no handler.        */
+    dir = opendir( mount.mountpoint );
+    assert_non_null( dir );
+    while ( readdir( dir ) );
+    ufsFuseGetStats( mount.fuse, &before );
+
+    rewinddir( dir );
+    count = 0;
+    while ( ( entry = readdir( dir ) ) ) {
+        if ( !strcmp( entry -> d_name, "." ) ||
+             !strcmp( entry -> d_name, ".." ) )
+            continue;
+
+        assert_int_equal( fstatat( dirfd( dir ), entry -> d_name, &st,
+                                   AT_SYMLINK_NOFOLLOW ), 0 );
+        if ( !strcmp( entry -> d_name, TEST_DIRECTORY_NAME_0 ) ) {
+            assert_true( S_ISDIR( st.st_mode ) );
+        } else {
+            assert_int_equal( sscanf( entry -> d_name, "file%d", &i ), 1 );
+            assert_true( S_ISREG( st.st_mode ) );
+            assert_int_equal( st.st_size, strlen( i % 2 ? TEST_CONTENTS_2 :
+                                                          TEST_CONTENTS_0 ) );
+        }
+        count++;
+    }
+
+    ufsFuseGetStats( mount.fuse, &after );
+    assert_int_equal( count, TEST_FUSE_FILES + 1 );
+    assert_int_equal( after.lookups, before.lookups );
+    assert_int_equal( after.getattrs, before.getattrs );
+
+    closedir( dir );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_no_passthrough( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsFuseStatsType stats;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    mount.flags = UFS_FUSE_FLAG_NO_PASSTHROUGH;
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* Content of BASE and of the area is served by the daemon alone.         */
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    assertContents( fd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    createFile( fd, TEST_FILE_NAME_1, TEST_CONTENTS_1 );
+    assertContents( fd, TEST_FILE_NAME_1, TEST_CONTENTS_1 );
+
+    ufsFuseGetStats( mount.fuse, &stats );
+    assert_int_equal( stats.passthroughs, 0 );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_writeback( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    ufsFuseStatsType before, after;
+    char path[ 160 ], buffer[ 64 ];
+    struct stat st;
+    int fd, i;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    createFile( mount.baseFd, TEST_FILE_NAME_0, TEST_CONTENTS_0 );
+    startMount( ufsStruct -> ufs, &mount );
+    ufsFuseGetStats( mount.fuse, &before );
+
+    /* Small writes reach the daemon in a few large requests.                 */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_1 );
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    assert_true( fd >= 0 );
+    for ( i = 0; i < TEST_FUSE_WRITES; i++ )
+        assert_int_equal( write( fd, TEST_CONTENTS_1,
+                                 strlen( TEST_CONTENTS_1 ) ),
+                          strlen( TEST_CONTENTS_1 ) );
+    assert_int_equal( fstat( fd, &st ), 0 );
+    assert_int_equal( st.st_size,
+                      TEST_FUSE_WRITES * strlen( TEST_CONTENTS_1 ) );
+    close( fd );
+
+    ufsFuseGetStats( mount.fuse, &after );
+    assert_true( after.writes - before.writes < TEST_FUSE_WRITES );
+    assert_int_equal( stat( path, &st ), 0 );
+    assert_int_equal( st.st_size,
+                      TEST_FUSE_WRITES * strlen( TEST_CONTENTS_1 ) );
+
+    /* Appends to a file of BASE land after what it had, written only.        */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_WRONLY | O_APPEND );
+    assert_true( fd >= 0 );
+    assert_int_equal( write( fd, TEST_CONTENTS_1, strlen( TEST_CONTENTS_1 ) ),
+                      strlen( TEST_CONTENTS_1 ) );
+    close( fd );
+
+    snprintf( buffer, sizeof( buffer ), "%s%s", TEST_CONTENTS_0,
+              TEST_CONTENTS_1 );
+    fd = open( mount.mountpoint, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    assertContents( fd, TEST_FILE_NAME_0, buffer );
+
+    close( fd );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_extents( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    uint8_t present[ TEST_FUSE_EXTENTS ];
+    char path[ 160 ], *expected, *buffer;
+    struct testMountStruct mount;
+    ufsFuseStatsType stats;
+    ufsIdentifierType id;
+    ufsStatusType status;
+    struct stat st;
+    size_t size, i;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+
+    /* A file of BASE that ends part way in its last extent.                  */
+    size = ( TEST_FUSE_EXTENTS - 1 ) * TEST_FUSE_EXTENT + 4321;
+    expected = malloc( size );
+    buffer = malloc( size );
+    assert_non_null( expected );
+    assert_non_null( buffer );
+    for ( i = 0; i < size; i++ )
+        expected[ i ] = ( char )( i * 7 + i / TEST_FUSE_EXTENT );
+
+    fd = openat( mount.baseFd, TEST_FILE_NAME_0, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    assert_int_equal( pwrite( fd, expected, size, 0 ), size );
+    close( fd );
+    mount.flags = UFS_FUSE_FLAG_NO_BACKGROUND_COPY;
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* Writing copies up the extent written to, and the one the file ends in. */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_RDWR );
+    assert_true( fd >= 0 );
+    memset( expected + 3 * TEST_FUSE_EXTENT + 100, 'Z', 16 );
+    assert_int_equal( pwrite( fd, expected + 3 * TEST_FUSE_EXTENT + 100, 16,
+                              3 * TEST_FUSE_EXTENT + 100 ), 16 );
+    assert_int_equal( fsync( fd ), 0 );
+
+    id = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                     TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+    status = ufsProbeExtents( ufsStruct -> ufs, mount.area, id );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    status = ufsGetExtents( ufsStruct -> ufs, mount.area, id, 0,
+                            TEST_FUSE_EXTENTS, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    for ( i = 0; i < TEST_FUSE_EXTENTS; i++ )
+        assert_int_equal( present[ i ], i == 3 || i == TEST_FUSE_EXTENTS - 1 );
+
+    ufsFuseGetStats( mount.fuse, &stats );
+    assert_int_equal( stats.extents, 1 );
+
+    /* The backing file only takes the space of what was copied.              */
+    snprintf( path, sizeof( path ), "%lld/%lld", ( long long )mount.area,
+              ( long long )id );
+    assert_int_equal( fstatat( mount.upperFd, path, &st, 0 ), 0 );
+    assert_int_equal( st.st_size, size );
+    assert_true( st.st_blocks * 512 < 4 * TEST_FUSE_EXTENT );
+
+    /* Reads are assembled from the area and BASE.                            */
+    assert_int_equal( pread( fd, buffer, size, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+
+    /* What's cut stays cut once the file grows again.                        */
+    assert_int_equal( ftruncate( fd, 2 * TEST_FUSE_EXTENT + 10 ), 0 );
+    assert_int_equal( ftruncate( fd, size ), 0 );
+    memset( expected + 2 * TEST_FUSE_EXTENT + 10, 0,
+            size - 2 * TEST_FUSE_EXTENT - 10 );
+    assert_int_equal( pread( fd, buffer, size, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+    close( fd );
+
+    status = ufsGetExtents( ufsStruct -> ufs, mount.area, id, 0,
+                            TEST_FUSE_EXTENTS, present );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    for ( i = 0; i < TEST_FUSE_EXTENTS; i++ )
+        assert_int_equal( present[ i ], i >= 2 );
+
+    /* As read by a new open of it.                                           */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_RDONLY );
+    assert_true( fd >= 0 );
+    assert_int_equal( pread( fd, buffer, size, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+
+    close( fd );
+    free( expected );
+    free( buffer );
+    stopMount( &mount );
+}
+
+/* Without passthrough and the page cache every read and write is a request,  */
+/* spliced between /dev/fuse and the layers of a file held by extents.        */
+static void test_ufs_fuse_splice_extents( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    char path[ 160 ], *expected, *buffer;
+    ufsFuseStatsType before, after;
+    struct testMountStruct mount;
+    size_t size, i;
+    off_t offset;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    size = 3 * TEST_FUSE_EXTENT + 1000;
+    expected = malloc( size );
+    buffer = malloc( size + TEST_FUSE_EXTENT );
+    assert_non_null( expected );
+    assert_non_null( buffer );
+    for ( i = 0; i < size; i++ )
+        expected[ i ] = ( char )( i * 5 + i / TEST_FUSE_EXTENT + 3 );
+
+    fd = openat( mount.baseFd, TEST_FILE_NAME_0, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    assert_int_equal( pwrite( fd, expected, size, 0 ), size );
+    close( fd );
+    mount.flags = UFS_FUSE_FLAG_NO_PASSTHROUGH |
+                  UFS_FUSE_FLAG_NO_WRITEBACK_CACHE |
+                  UFS_FUSE_FLAG_NO_BACKGROUND_COPY;
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* A write across the end of the first extent lands in both.              */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_RDWR );
+    assert_true( fd >= 0 );
+    ufsFuseGetStats( mount.fuse, &before );
+    offset = TEST_FUSE_EXTENT - 4096;
+    memset( expected + offset, 'S', 8192 );
+    assert_int_equal( pwrite( fd, expected + offset, 8192, offset ), 8192 );
+    ufsFuseGetStats( mount.fuse, &after );
+    assert_true( after.writes > before.writes );
+    assert_int_equal( after.extents - before.extents, 2 );
+
+    /* A read across the end of the second extent is spliced from the area    */
+    /* and from BASE.                                                         */
+    assert_int_equal( posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ), 0 );
+    offset = 2 * TEST_FUSE_EXTENT - 4096;
+    assert_int_equal( pread( fd, buffer, 8192, offset ), 8192 );
+    assert_memory_equal( buffer, expected + offset, 8192 );
+
+    /* One across the end of the third one reaches the end of the file and    */
+    /* returns short.                                                         */
+    assert_int_equal( posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ), 0 );
+    offset = 3 * TEST_FUSE_EXTENT - 4096;
+    assert_int_equal( pread( fd, buffer, TEST_FUSE_EXTENT, offset ),
+                      size - offset );
+    assert_memory_equal( buffer, expected + offset, size - offset );
+
+    /* As does one of the whole file, from a new open of it.                  */
+    close( fd );
+    fd = open( path, O_RDONLY );
+    assert_true( fd >= 0 );
+    assert_int_equal( posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED ), 0 );
+    assert_int_equal( pread( fd, buffer, size + TEST_FUSE_EXTENT, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+
+    close( fd );
+    free( expected );
+    free( buffer );
+    stopMount( &mount );
+}
+
+static void test_ufs_fuse_background_copy( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testUpdateStruct update;
+    struct testMountStruct mount;
+    char path[ 160 ], *expected, *buffer;
+    ufsFuseStatsType stats;
+    ufsStatusType status;
+    uint64_t copies;
+    size_t size, i;
+    int fd;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    size = ( TEST_FUSE_EXTENTS - 1 ) * TEST_FUSE_EXTENT + 4321;
+    expected = malloc( size );
+    buffer = malloc( size );
+    assert_non_null( expected );
+    assert_non_null( buffer );
+    for ( i = 0; i < size; i++ )
+        expected[ i ] = ( char )( i * 7 + i / TEST_FUSE_EXTENT );
+
+    fd = openat( mount.baseFd, TEST_FILE_NAME_0, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    assert_int_equal( pwrite( fd, expected, size, 0 ), size );
+    close( fd );
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* The write returns before the rest of the file is copied, which goes on */
+    /* while it's open.                                                       */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_RDWR );
+    assert_true( fd >= 0 );
+    memset( expected + 5 * TEST_FUSE_EXTENT, 'Z', 16 );
+    assert_int_equal( pwrite( fd, expected + 5 * TEST_FUSE_EXTENT, 16,
+                              5 * TEST_FUSE_EXTENT ), 16 );
+    for ( i = 0; i < 1000; i++ ) {
+        ufsFuseGetStats( mount.fuse, &stats );
+        if ( stats.extents == TEST_FUSE_EXTENTS - 1 )
+            break;
+
+        usleep( 10000 );
+    }
+
+    assert_int_equal( stats.extents, TEST_FUSE_EXTENTS - 1 );
+    assert_int_equal( pread( fd, buffer, size, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+    close( fd );
+
+    update.area = mount.area;
+    update.storage = ufsGetFile( ufsStruct -> ufs, UFS_STORAGE_ROOT_IDENTIFIER,
+                                 TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( update.storage );
+    status = ufsFuseUpdate( mount.fuse, getExtents, &update );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    for ( i = 0; i < TEST_FUSE_EXTENTS; i++ )
+        assert_int_equal( update.present[ i ], 1 );
+
+    /* Every copy was made one way or another, and timed.                     */
+    copies = 0;
+    for ( i = 0; i < UFS_FUSE_COPIES; i++ ) {
+        copies += stats.copies[ i ].copies;
+        if ( stats.copies[ i ].copies )
+            assert_true( stats.copies[ i ].bytes > 0 );
+    }
+
+    assert_true( copies >= TEST_FUSE_EXTENTS );
+
+    free( expected );
+    free( buffer );
+    stopMount( &mount );
+}
+
+/* Extents being copied into the first area are read from BASE, not from the  */
+/* part of the backing file that's already written.                           */
+static void test_ufs_fuse_read_while_copied( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    struct testMountStruct mount;
+    char path[ 160 ], *expected, *buffer;
+    ufsFuseStatsType stats;
+    size_t size, tail, i;
+    int fd, reader;
+    off_t offset;
+
+    ufsStruct = *state;
+    createTree( &mount );
+    size = TEST_FUSE_COPIED_EXTENTS * TEST_FUSE_EXTENT;
+    expected = malloc( size );
+    buffer = malloc( size );
+    assert_non_null( expected );
+    assert_non_null( buffer );
+    for ( i = 0; i < size; i++ )
+        expected[ i ] = ( char )( i * 13 + i / TEST_FUSE_EXTENT + 1 );
+
+    fd = openat( mount.baseFd, TEST_FILE_NAME_0, O_WRONLY | O_CREAT, 0644 );
+    assert_true( fd >= 0 );
+    assert_int_equal( pwrite( fd, expected, size, 0 ), size );
+    close( fd );
+    startMount( ufsStruct -> ufs, &mount );
+
+    /* Opening it for writing starts the copy, which goes an extent at a time */
+    /* from the first one. The other open reads the end of the extent being   */
+    /* copied over and over, past the page cache, until the copy is done.     */
+    snprintf( path, sizeof( path ), "%s/%s", mount.mountpoint,
+              TEST_FILE_NAME_0 );
+    fd = open( path, O_RDWR );
+    assert_true( fd >= 0 );
+    reader = open( path, O_RDONLY );
+    assert_true( reader >= 0 );
+    tail = TEST_FUSE_EXTENT - TEST_FUSE_TAIL;
+    do {
+        ufsFuseGetStats( mount.fuse, &stats );
+        offset = stats.extents % TEST_FUSE_COPIED_EXTENTS * TEST_FUSE_EXTENT +
+                 tail;
+        assert_int_equal( posix_fadvise( reader, offset, TEST_FUSE_TAIL,
+                                         POSIX_FADV_DONTNEED ), 0 );
+        assert_int_equal( pread( reader, buffer, TEST_FUSE_TAIL, offset ),
+                          TEST_FUSE_TAIL );
+        assert_memory_equal( buffer, expected + offset, TEST_FUSE_TAIL );
+    } while ( stats.extents < TEST_FUSE_COPIED_EXTENTS );
+
+    assert_int_equal( posix_fadvise( reader, 0, 0, POSIX_FADV_DONTNEED ), 0 );
+    assert_int_equal( pread( reader, buffer, size, 0 ), size );
+    assert_memory_equal( buffer, expected, size );
+    close( reader );
+    close( fd );
+    free( expected );
+    free( buffer );
+    stopMount( &mount );
+}
+
+/* ########################################################################## */
+
+static const struct CMUnitTest ufs_test_suite[] = {
+
+    /* ufsFuse tests.                                                         */
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_read, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_write, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_remove, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_parallel, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_invalidate, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_readdirplus, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_no_passthrough, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_writeback, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_extents, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_splice_extents, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_background_copy, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_fuse_read_while_copied, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+};
+
+int main( void ) {
+    return cmocka_run_group_tests( ufs_test_suite, NULL, NULL );
+}
+
+#else
+
+int main( void ) {
+    return 0;
+}
+
+#endif /* UFS_TEST_DISABLE */
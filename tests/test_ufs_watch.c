@@ -0,0 +1,414 @@
+/******************************************************************************\
+*  test_ufs_watch.c                                                            *
+*                                                                              *
+*  Test suite for keeping BASE in sync with a watch.                           *
+*  Every test runs once with fanotify, skipped if it's not permitted, and once *
+*  with inotify.                                                               *
+*                                                                              *
+*              Written by A.N.                                  18-10-2026     *
+*                                                                              *
+\******************************************************************************/
+
+
+#define UFS_TESTING
+
+#ifndef UFS_TEST_DISABLE
+
+#define _GNU_SOURCE
+
+#include <memory.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "ufs_core.h"
+#include "ufs_watch.h"
+#include "utils.h"
+
+#include <cmocka.h>
+
+#define TEST_DIRECTORY_NAME_0 ("testDirectory0")
+#define TEST_DIRECTORY_NAME_1 ("testDirectory1")
+#define TEST_FILE_NAME_0 ("testFile0")
+#define TEST_FILE_NAME_1 ("testFile1")
+#define TEST_WATCH_TEMPLATE ("/tmp/ufsTestWatchXXXXXX")
+
+/* More creations than the kernel queues by default.                          */
+#define TEST_OVERFLOW_FILES (20000)
+
+static int removeEntry( const char *path,
+                        const struct stat *st,
+                        int type,
+                        struct FTW *ftw )
+{
+    (void) st;
+    (void) type;
+    (void) ftw;
+
+    return remove( path );
+}
+
+static int createWatchTree( char *root )
+{
+    int fd;
+
+    strcpy( root, TEST_WATCH_TEMPLATE );
+    assert_non_null( mkdtemp( root ) );
+
+    fd = open( root, O_RDONLY | O_DIRECTORY );
+    assert_true( fd >= 0 );
+    return fd;
+}
+
+static void removeWatchTree( char *root, int fd )
+{
+    close( fd );
+    nftw( root, removeEntry, 16, FTW_DEPTH | FTW_PHYS );
+}
+
+static void createFile( int fd, const char *path, const char *contents )
+{
+    int fileFd;
+
+    fileFd = openat( fd, path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    assert_true( fileFd >= 0 );
+    if ( contents )
+        assert_int_equal( write( fileFd, contents, strlen( contents ) ),
+                          strlen( contents ) );
+    close( fileFd );
+}
+
+static ufsWatchType startWatch( ufsType ufs,
+                                int fd,
+                                uint64_t importFlags,
+                                uint64_t flags )
+{
+    ufsImportOptionsType options = { 0 };
+    ufsWatchStatsType stats;
+    ufsWatchType watch;
+
+    options.flags = importFlags;
+    watch = ufsWatchInit( ufs, fd, &options, flags );
+    assert_non_null( watch );
+    assert_int_equal( ufsErrno, UFS_NO_ERROR );
+
+    ufsWatchGetStats( watch, &stats );
+    if ( !( flags & UFS_WATCH_FLAG_INOTIFY ) && !stats.fanotify ) {
+        ufsWatchDestroy( watch );
+        skip();
+    }
+
+    return watch;
+}
+
+static void test_ufs_watch_bad_args( void **state )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsImportOptionsType options = { 0 };
+    ufsWatchType watch;
+
+    ufsStruct = *state;
+
+    watch = ufsWatchInit( NULL, 0, NULL, 0 );
+    assert_null( watch );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    watch = ufsWatchInit( ufsStruct -> ufs, -1, NULL, 0 );
+    assert_null( watch );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    watch = ufsWatchInit( ufsStruct -> ufs, 0, NULL, ~UFS_WATCH_FLAG_INOTIFY );
+    assert_null( watch );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    options.visit = ( ufsImportVisit )1;
+    watch = ufsWatchInit( ufsStruct -> ufs, 0, &options, 0 );
+    assert_null( watch );
+    assert_int_equal( ufsErrno, UFS_BAD_CALL );
+
+    assert_int_equal( ufsWatchProcess( NULL ), UFS_BAD_CALL );
+    ufsWatchDestroy( NULL );
+}
+
+static void watchCreate( void **state, uint64_t flags )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, id;
+    ufsWatchType watch;
+    ufsStatusType status;
+    char root[ 64 ], outside[ 64 ], path[ 256 ];
+    int fd, outsideFd;
+
+    ufsStruct = *state;
+    fd = createWatchTree( root );
+    watch = startWatch( ufsStruct -> ufs, fd, 0, flags );
+
+    assert_int_equal( mkdirat( fd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    createFile( fd, TEST_FILE_NAME_0, NULL );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    /* The new directory is watched as well.                                  */
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_0,
+              TEST_FILE_NAME_0 );
+    createFile( fd, path, NULL );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    /* A directory that's moved in comes with its contents.                   */
+    outsideFd = createWatchTree( outside );
+    assert_int_equal( mkdirat( outsideFd, TEST_DIRECTORY_NAME_1, 0755 ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_1,
+              TEST_FILE_NAME_1 );
+    createFile( outsideFd, path, NULL );
+    assert_int_equal( renameat( outsideFd, TEST_DIRECTORY_NAME_1,
+                                fd, TEST_DIRECTORY_NAME_1 ), 0 );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_1 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    ufsWatchDestroy( watch );
+    removeWatchTree( outside, outsideFd );
+    removeWatchTree( root, fd );
+}
+
+static void watchRemoveRename( void **state, uint64_t flags )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, id;
+    ufsWatchType watch;
+    ufsStatusType status;
+    char root[ 64 ], path[ 256 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createWatchTree( root );
+    assert_int_equal( mkdirat( fd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_0,
+              TEST_FILE_NAME_0 );
+    createFile( fd, path, NULL );
+    createFile( fd, TEST_FILE_NAME_0, NULL );
+    watch = startWatch( ufsStruct -> ufs, fd, 0, flags );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    assert_int_equal( unlinkat( fd, TEST_FILE_NAME_0, 0 ), 0 );
+    assert_int_equal( renameat( fd, TEST_DIRECTORY_NAME_0,
+                                fd, TEST_DIRECTORY_NAME_1 ), 0 );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    id = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_1 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    /* The renamed directory is still followed.                               */
+    snprintf( path, sizeof( path ), "%s/%s", TEST_DIRECTORY_NAME_1,
+              TEST_FILE_NAME_0 );
+    assert_int_equal( unlinkat( fd, path, 0 ), 0 );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    id = ufsGetFile( ufsStruct -> ufs, dirId, TEST_FILE_NAME_0 );
+    ASSERT_UFS_ERROR( id, UFS_DOES_NOT_EXIST );
+
+    ufsWatchDestroy( watch );
+    removeWatchTree( root, fd );
+}
+
+static void watchAttributes( void **state, uint64_t flags )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsAttributesType attributes;
+    ufsIdentifierType id;
+    ufsWatchType watch;
+    ufsStatusType status;
+    char root[ 64 ];
+    int fd;
+
+    ufsStruct = *state;
+    fd = createWatchTree( root );
+    createFile( fd, TEST_FILE_NAME_0, NULL );
+    watch = startWatch( ufsStruct -> ufs, fd,
+                        UFS_IMPORT_FLAG_ATTRIBUTES, flags );
+
+    id = ufsGetFile( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_FILE_NAME_0 );
+    ASSERT_UFS_NO_ERROR( id );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, id, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 0 );
+
+    createFile( fd, TEST_FILE_NAME_0, "ufs!" );
+    assert_int_equal( fchmodat( fd, TEST_FILE_NAME_0, 0600, 0 ), 0 );
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    status = ufsGetAttributes( ufsStruct -> ufs, id, &attributes );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+    assert_int_equal( attributes.size, 4 );
+    assert_int_equal( attributes.mode & 0777, 0600 );
+
+    ufsWatchDestroy( watch );
+    removeWatchTree( root, fd );
+}
+
+static void watchOverflow( void **state, uint64_t flags )
+{
+    struct ufsTestUfsStateStruct *ufsStruct;
+    ufsIdentifierType dirId, id;
+    ufsWatchStatsType stats;
+    ufsWatchType watch;
+    ufsStatusType status;
+    char root[ 64 ], path[ 256 ];
+    int fd, i;
+
+    ufsStruct = *state;
+    fd = createWatchTree( root );
+    assert_int_equal( mkdirat( fd, TEST_DIRECTORY_NAME_0, 0755 ), 0 );
+    assert_int_equal( mkdirat( fd, TEST_DIRECTORY_NAME_1, 0755 ), 0 );
+    watch = startWatch( ufsStruct -> ufs, fd, 0, flags );
+
+    for ( i = 0; i < TEST_OVERFLOW_FILES; i++ ) {
+        snprintf( path, sizeof( path ), "%s/%d", TEST_DIRECTORY_NAME_0, i );
+        createFile( fd, path, NULL );
+    }
+
+    status = ufsWatchProcess( watch );
+    ASSERT_UFS_STATUS_NO_ERROR( status );
+
+    /* Only the directory that changed is imported again.                     */
+    ufsWatchGetStats( watch, &stats );
+    assert_true( stats.overflows >= 1 );
+    assert_int_equal( stats.rescans, stats.overflows );
+
+    dirId = ufsGetDirectory( ufsStruct -> ufs,
+            UFS_STORAGE_ROOT_IDENTIFIER,
+            TEST_DIRECTORY_NAME_0 );
+    ASSERT_UFS_NO_ERROR( dirId );
+
+    for ( i = 0; i < TEST_OVERFLOW_FILES; i += TEST_OVERFLOW_FILES / 10 ) {
+        snprintf( path, sizeof( path ), "%d", i );
+        id = ufsGetFile( ufsStruct -> ufs, dirId, path );
+        ASSERT_UFS_NO_ERROR( id );
+    }
+
+    snprintf( path, sizeof( path ), "%d", TEST_OVERFLOW_FILES - 1 );
+    id = ufsGetFile( ufsStruct -> ufs, dirId, path );
+    ASSERT_UFS_NO_ERROR( id );
+
+    ufsWatchDestroy( watch );
+    removeWatchTree( root, fd );
+}
+
+static void test_ufs_watch_create_fanotify( void **state )
+{
+    watchCreate( state, 0 );
+}
+
+static void test_ufs_watch_create_inotify( void **state )
+{
+    watchCreate( state, UFS_WATCH_FLAG_INOTIFY );
+}
+
+static void test_ufs_watch_remove_rename_fanotify( void **state )
+{
+    watchRemoveRename( state, 0 );
+}
+
+static void test_ufs_watch_remove_rename_inotify( void **state )
+{
+    watchRemoveRename( state, UFS_WATCH_FLAG_INOTIFY );
+}
+
+static void test_ufs_watch_attributes_fanotify( void **state )
+{
+    watchAttributes( state, 0 );
+}
+
+static void test_ufs_watch_attributes_inotify( void **state )
+{
+    watchAttributes( state, UFS_WATCH_FLAG_INOTIFY );
+}
+
+static void test_ufs_watch_overflow_fanotify( void **state )
+{
+    watchOverflow( state, 0 );
+}
+
+static void test_ufs_watch_overflow_inotify( void **state )
+{
+    watchOverflow( state, UFS_WATCH_FLAG_INOTIFY );
+}
+/* ########################################################################## */
+
+static const struct CMUnitTest ufs_test_suite[] = {
+
+    /* ufsWatch tests.                                                        */
+    cmocka_unit_test_setup_teardown( test_ufs_watch_bad_args, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_create_fanotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_create_inotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_remove_rename_fanotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_remove_rename_inotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_attributes_fanotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_attributes_inotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_overflow_fanotify, ufsGetInstance, ufsCleanup ),
+    cmocka_unit_test_setup_teardown( test_ufs_watch_overflow_inotify, ufsGetInstance, ufsCleanup ),
+    /* ====================================================================== */
+};
+
+int main( void ) {
+    return cmocka_run_group_tests( ufs_test_suite, NULL, NULL );
+}
+
+#else
+
+int main( void ) {
+    return 0;
+}
+
+#endif /* UFS_TEST_DISABLE */